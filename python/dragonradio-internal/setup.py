@@ -66,6 +66,7 @@ ext_modules = [
          os.path.join(SRC, 'Math.cc'),
          os.path.join(SRC, 'dsp/FIRDesign.cc'),
          os.path.join(SRC, 'dsp/FFTW.cc'),
+         os.path.join(SRC, 'dsp/FilterCache.cc'),
          os.path.join(SRC, 'dsp/TableNCO.cc'),
          os.path.join(SRC, 'liquid/Filter.cc'),
          os.path.join(SRC, 'liquid/Modem.cc'),
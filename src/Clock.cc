@@ -5,6 +5,8 @@
 #include <string.h>
 #include <time.h>
 
+#include <stdexcept>
+
 #ifdef RANDOM_CLOCK_BIAS
 #include <random>
 #endif
@@ -15,13 +17,13 @@ uhd::usrp::multi_usrp::sptr Clock::usrp_;
 
 uhd::time_spec_t Clock::t0_(0.0);
 
-double WallClock::skew_(1.0);
+SeqLock<WallClock::Params> WallClock::params_(WallClock::Params{uhd::time_spec_t(0.0), 1.0});
 
-uhd::time_spec_t WallClock::offset_(0.0);
+std::mutex WallClock::params_mutex_;
 
-void Clock::setUSRP(uhd::usrp::multi_usrp::sptr usrp)
+/** @brief Get the current system time */
+static uhd::time_spec_t getSystemTime(void)
 {
-    // Set offset relative to system NTP time
     struct timespec t;
     int    err;
 
@@ -30,7 +32,16 @@ void Clock::setUSRP(uhd::usrp::multi_usrp::sptr usrp)
         exit(EXIT_FAILURE);
     }
 
-    uhd::time_spec_t now(t.tv_sec, ((double)t.tv_nsec)/1e9);
+    return uhd::time_spec_t(t.tv_sec, ((double)t.tv_nsec)/1e9);
+}
+
+void Clock::setUSRP(uhd::usrp::multi_usrp::sptr usrp)
+{
+    if (VirtualTime::enabled())
+        throw std::runtime_error("Cannot attach a USRP while virtual time is enabled");
+
+    // Set offset relative to system NTP time
+    uhd::time_spec_t now = getSystemTime();
 
     usrp_ = usrp;
     t0_ = now;
@@ -53,3 +64,20 @@ void Clock::releaseUSRP(void)
 {
     usrp_.reset();
 }
+
+void Clock::enableVirtualTime(void)
+{
+    // The device would be handed virtual timestamps for RX and TX, so refuse
+    // rather than schedule bursts at times the USRP has never heard of.
+    if (usrp_)
+        throw std::runtime_error("Cannot enable virtual time while a USRP is attached");
+
+    t0_ = getSystemTime();
+
+    VirtualTime::enable(t0_);
+}
+
+void Clock::disableVirtualTime(void)
+{
+    VirtualTime::disable();
+}
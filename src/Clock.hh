@@ -6,9 +6,13 @@
 
 #include <chrono>
 #include <memory>
+#include <mutex>
 
 #include <uhd/usrp/multi_usrp.hpp>
 
+#include "SeqLock.hh"
+#include "VirtualTime.hh"
+
 template <class T>
 struct time_point_t {
     uhd::time_spec_t t;
@@ -94,11 +98,26 @@ public:
     /** @brief Set the USRP used for clock operations.
      * @param usrp The USRP.
      */
+    /** Throws std::runtime_error if virtual time is enabled.
+     */
     static void setUSRP(uhd::usrp::multi_usrp::sptr usrp);
 
     /** @brief Release the USRP used for clock operations. */
     static void releaseUSRP(void);
 
+    /** @brief Use virtual time instead of the USRP's time. */
+    /** Virtual time starts at the current system time, paused. This is meant
+     * for simulation without a USRP, and throws std::runtime_error if a USRP
+     * is attached: the MAC would otherwise schedule RX and TX on the device
+     * using virtual timestamps. There is no simulated device, so under virtual
+     * time only code that does not touch the radio, such as the timer queue
+     * and the controller's timers, can run.
+     */
+    static void enableVirtualTime(void);
+
+    /** @brief Go back to using the USRP's time. */
+    static void disableVirtualTime(void);
+
 protected:
     /** @brief The USRP used for clock operations. */
     static uhd::usrp::multi_usrp::sptr usrp_;
@@ -109,6 +128,9 @@ protected:
     /** @brief Get the current UHD time. */
     static uhd::time_spec_t getTimeNow() noexcept
     {
+        if (VirtualTime::enabled())
+            return VirtualTime::now();
+
         while (true) {
             try {
                 return usrp_->get_time_now();
@@ -171,53 +193,90 @@ public:
     /** @brief Get time offset. */
     MonoClock::time_point getTimeOffset(void)
     {
-        return MonoClock::time_point { offset_ };
+        return MonoClock::time_point { params_.load().offset };
     }
 
     /** @brief Set time offset. */
     void setTimeOffset(const MonoClock::time_point &offset)
     {
-        offset_ = offset.t;
+        std::lock_guard<std::mutex> lock(params_mutex_);
+        Params                      params = params_.load();
+
+        params.offset = offset.t;
+        params_.store(params);
     }
 
     /** @brief Get skew. */
     double getSkew(void)
     {
-        return skew_;
+        return params_.load().skew;
     }
 
     /** @brief set skew. */
     void setSkew(double skew)
     {
-        skew_ = skew;
+        std::lock_guard<std::mutex> lock(params_mutex_);
+        Params                      params = params_.load();
+
+        params.skew = skew;
+        params_.store(params);
+    }
+
+    /** @brief Set time offset and skew together.
+     * @param offset The time offset
+     * @param skew The skew
+     */
+    /** Readers see either the old offset and skew or the new offset and
+     * skew, never a mix of the two.
+     */
+    void setTimeOffsetAndSkew(const MonoClock::time_point &offset, double skew)
+    {
+        std::lock_guard<std::mutex> lock(params_mutex_);
+
+        params_.store(Params{offset.t, skew});
     }
 
     /** @brief Get the current wall-clock time. */
     static time_point now() noexcept
     {
         uhd::time_spec_t now = getTimeNow();
+        Params           params = params_.load();
 
-        return time_point { t0_ + offset_ + skew_*(now - t0_).get_real_secs() };
+        return time_point { t0_ + params.offset + params.skew*(now - t0_).get_real_secs() };
     }
 
     /** @brief Return the monotonic time corresponding to wall-clock time. */
     static MonoClock::time_point to_mono_time(const time_point &t) noexcept
     {
-        return MonoClock::time_point { t0_ + (t.t - t0_ - offset_).get_real_secs() / skew_ };
+        Params params = params_.load();
+
+        return MonoClock::time_point { t0_ + (t.t - t0_ - params.offset).get_real_secs() / params.skew };
     }
 
     /** @brief Return the wall-clock time corresponding to monotonic time. */
     static time_point to_wall_time(const MonoClock::time_point &t) noexcept
     {
-        return time_point { t0_ + offset_ + skew_*(t.t - t0_).get_real_secs() };
+        Params params = params_.load();
+
+        return time_point { t0_ + params.offset + params.skew*(t.t - t0_).get_real_secs() };
     }
 
 private:
-    /** @brief The offset between the USRP's clock and wall-clock time. */
-    static uhd::time_spec_t offset_;
+    /** @brief Parameters mapping the USRP's clock to wall-clock time */
+    struct Params {
+        /** @brief The offset between the USRP's clock and wall-clock time. */
+        uhd::time_spec_t offset;
+
+        /** @brief Clock skew. */
+        double skew;
+    };
+
+    /** @brief Current clock parameters */
+    /** Readers never take a lock, so the clock can be read on any path. */
+    static SeqLock<Params> params_;
 
-    /** @brief Clock skew. */
-    static double skew_;
+    /** @brief Mutex serializing writers of params_ */
+    static std::mutex params_mutex_;
 };
 
 #endif /* CLOCK_H_ */
@@ -5,9 +5,12 @@
 #define IQBUFFER_H_
 
 #include <atomic>
+#include <chrono>
 #include <complex>
+#include <condition_variable>
 #include <deque>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
 #include <vector>
@@ -138,21 +141,73 @@ public:
      */
     size_t oversample;
 
+    /** @brief Publish the number of samples received so far.
+     * @param n Number of samples received so far.
+     */
+    void publishSamples(size_t n)
+    {
+        nsamples.store(n, std::memory_order_release);
+        wakeWaiters();
+    }
+
+    /** @brief Mark the buffer as complete. */
+    void markComplete(void)
+    {
+        complete.store(true, std::memory_order_release);
+        wakeWaiters();
+    }
+
     /** @brief Wait for the buffer to start filling. */
     void waitToStartFilling(void)
     {
-        for (int spin_count = 0;; ++spin_count) {
-            if (nsamples.load(std::memory_order_relaxed) != 0 ||
-                complete.load(std::memory_order_relaxed))
-                break;
-
-            if (spin_count < 16)
-                _mm_pause();
-            else {
-                std::this_thread::yield();
-                spin_count = 0;
-            }
+        bool complete_;
+
+        waitForSamples(0, complete_);
+    }
+
+    /** @brief Wait for more than n samples to be received.
+     * @param n Number of samples already consumed.
+     * @param complete_ Set to true if the buffer is complete.
+     * @return The number of samples received so far. This may only be less
+     * than or equal to n if the buffer is complete.
+     */
+    /** Samples arrive in bursts, one USRP packet at a time, so we first spin
+     * briefly in case the next packet is about to land, and then block until
+     * the producer publishes more samples or marks the buffer complete.
+     */
+    size_t waitForSamples(size_t n, bool &complete_)
+    {
+        constexpr unsigned kSpinCount = 64;
+
+        for (unsigned count = 0; count < kSpinCount; ++count) {
+            complete_ = complete.load(std::memory_order_acquire);
+
+            size_t avail = nsamples.load(std::memory_order_acquire);
+
+            if (avail > n || complete_)
+                return avail;
+
+            _mm_pause();
         }
+
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        size_t                       avail;
+
+        // Announce ourselves before re-checking so that a producer that
+        // publishes after our check is guaranteed to see us and notify.
+        nwaiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        wait_cond_.wait(lock, [&]() {
+            complete_ = complete.load(std::memory_order_acquire);
+            avail = nsamples.load(std::memory_order_acquire);
+
+            return avail > n || complete_;
+        });
+
+        nwaiters_.fetch_sub(1, std::memory_order_relaxed);
+
+        return avail;
     }
 
     /** @brief Zero all data in the buffer */
@@ -193,6 +248,152 @@ public:
 
         avg_power /= n;
     }
+
+private:
+    /** @brief Mutex protecting waits for samples */
+    std::mutex wait_mutex_;
+
+    /** @brief Condition variable signaled when samples are published */
+    std::condition_variable wait_cond_;
+
+    /** @brief Number of threads blocked waiting for samples */
+    std::atomic<unsigned> nwaiters_ = 0;
+
+    /** @brief Wake threads blocked in waitForSamples */
+    void wakeWaiters(void)
+    {
+        // Pairs with the fence in waitForSamples: either we see the waiter,
+        // or the waiter sees the value we just stored.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (nwaiters_.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+
+            wait_cond_.notify_all();
+        }
+    }
+};
+
+/** @brief A contiguous span of samples within an IQ buffer */
+struct IQSpan {
+    IQSpan(const std::shared_ptr<IQBuf> &buf_, size_t off_, size_t len_)
+      : buf(buf_)
+      , off(off_)
+      , len(len_)
+    {
+    }
+
+    /** @brief The IQ buffer holding the samples */
+    std::shared_ptr<IQBuf> buf;
+
+    /** @brief Offset of first sample in span */
+    size_t off;
+
+    /** @brief Number of samples in span */
+    size_t len;
+
+    /** @brief Pointer to first sample in span */
+    const std::complex<float> *data(void) const
+    {
+        return buf->data() + off;
+    }
+
+    /** @brief Number of samples in span */
+    size_t size(void) const
+    {
+        return len;
+    }
+
+#if !defined(NOUHD)
+    /** @brief Timestamp of the first sample in the span */
+    std::optional<MonoClock::time_point> timestamp(void) const
+    {
+        if (buf->timestamp)
+            return *buf->timestamp + off/buf->fs;
+        else
+            return std::nullopt;
+    }
+#endif /* !defined(NOUHD) */
+};
+
+/** @brief A segmented view of IQ samples held in multiple IQ buffers */
+/** All spans share a center frequency and sample rate. Samples are never
+ * copied; the view holds references to the underlying IQ buffers.
+ */
+struct IQSegments {
+    IQSegments(float fc_, float fs_)
+      : fc(fc_)
+      , fs(fs_)
+      , nsamples_(0)
+    {
+    }
+
+#if !defined(NOUHD)
+    /** @brief Timestamp of the first sample */
+    std::optional<MonoClock::time_point> timestamp;
+#endif /* !defined(NOUHD) */
+
+    /** @brief Sample center frequency */
+    float fc;
+
+    /** @brief Sample rate */
+    float fs;
+
+    /** @brief Spans making up the view */
+    std::vector<IQSpan> spans;
+
+    /** @brief Add an entire IQ buffer to the end of the view */
+    void push_back(const std::shared_ptr<IQBuf> &buf)
+    {
+        push_back(buf, 0, buf->size());
+    }
+
+    /** @brief Add a portion of an IQ buffer to the end of the view */
+    void push_back(const std::shared_ptr<IQBuf> &buf, size_t off, size_t len)
+    {
+        spans.emplace_back(buf, off, len);
+        nsamples_ += len;
+    }
+
+    /** @brief Total number of samples in all spans */
+    size_t size(void) const
+    {
+        return nsamples_;
+    }
+
+    bool empty(void) const
+    {
+        return nsamples_ == 0;
+    }
+
+    /** @brief Copy all samples into a contiguous destination */
+    void copy(std::complex<float> *out) const
+    {
+        for (auto &span : spans) {
+            std::copy(span.data(), span.data() + span.size(), out);
+            out += span.size();
+        }
+    }
+
+    /** @brief Materialize the view as a single, contiguous IQ buffer */
+    std::shared_ptr<IQBuf> combine(void) const
+    {
+        auto buf = std::make_shared<IQBuf>(nsamples_);
+
+#if !defined(NOUHD)
+        buf->timestamp = timestamp;
+#endif /* !defined(NOUHD) */
+        buf->fc = fc;
+        buf->fs = fs;
+        copy(buf->data());
+        buf->complete.store(true, std::memory_order_release);
+
+        return buf;
+    }
+
+protected:
+    /** @brief Total number of samples in all spans */
+    size_t nsamples_;
 };
 
 #endif /* IQBUFFER_H_ */
@@ -1,28 +1,11 @@
 // Copyright 2018-2020 Drexel University
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
+#include <exception>
+
 #include "IQCompression.hh"
 #include "IQCompression/FLAC.hh"
-
-void convert2sc16(const fc32_t *from, sc16_t *to, size_t n)
-{
-    constexpr float k = 32767.;
-    const float     *in = reinterpret_cast<const float*>(from);
-    int16_t         *out = reinterpret_cast<int16_t*>(to);
-
-    for (size_t i = 0; i < 2*n; ++i)
-        out[i] = in[i]*k;
-}
-
-void convert2fc32(const sc16_t *from, fc32_t *to, size_t n)
-{
-    constexpr float k = 1/32767.;
-    const int16_t   *in = reinterpret_cast<const int16_t*>(from);
-    float           *out = reinterpret_cast<float*>(to);
-
-    for (size_t i = 0; i < 2*n; ++i)
-        out[i] = in[i]*k;
-}
+#include "logging.hh"
 
 class BufferEncoder : public FLACMemoryEncoder {
 public:
@@ -74,11 +57,20 @@ protected:
     }
 };
 
-buffer<char> compressIQData(const fc32_t *data, size_t n)
+buffer<char> compressIQData(const fc32_t *data, size_t n, IQStats *stats)
+{
+    static BufferEncoder encoder;
+
+    encoder.encode(data, n, stats);
+
+    return std::move(encoder.encoded);
+}
+
+buffer<char> compressIQData(const IQSegments &segs, IQStats *stats)
 {
     static BufferEncoder encoder;
 
-    encoder.encode(data, n);
+    encoder.encode(segs, stats);
 
     return std::move(encoder.encoded);
 }
@@ -90,3 +82,44 @@ buffer<fc32_t> decompressIQData(const char *data, size_t n)
     decoder.decode(data, n);
     return std::move(decoder.decoded);
 }
+
+IQCompressor::IQCompressor(size_t n)
+  : encoder_(std::make_unique<BufferEncoder>())
+  , finished_(false)
+{
+    encoder_->encodeBegin(n);
+}
+
+IQCompressor::~IQCompressor()
+{
+    // An unfinished compressor is being abandoned, so we only need to release
+    // the encoder's state. Never let an encoder error escape the destructor.
+    if (!finished_) {
+        try {
+            encoder_->encodeEnd();
+        } catch (const std::exception &e) {
+            logSystem(LOGERROR, "Error abandoning IQ compressor: %s", e.what());
+        } catch (...) {
+            logSystem(LOGERROR, "Error abandoning IQ compressor");
+        }
+    }
+}
+
+void IQCompressor::compress(const fc32_t *data, size_t n, IQStats *stats)
+{
+    if (finished_)
+        throw std::logic_error("IQ compressor already finished");
+
+    encoder_->encodeSamples(data, n, stats);
+}
+
+buffer<char> IQCompressor::finish(void)
+{
+    if (finished_)
+        throw std::logic_error("IQ compressor already finished");
+
+    encoder_->encodeEnd();
+    finished_ = true;
+
+    return std::move(encoder_->encoded);
+}
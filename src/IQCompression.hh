@@ -14,21 +14,59 @@
 #include <FLAC++/encoder.h>
 
 #include "IQBuffer.hh"
+#include "IQConvert.hh"
 
-typedef std::complex<int16_t> sc16_t;
-typedef std::complex<float> fc32_t;
-typedef std::complex<double> fc64_t;
+/** @brief Compress fc32 IQ data
+ * @param data IQ data
+ * @param n Number of samples
+ * @param stats If non-null, statistics of the IQ data are added here
+ */
+buffer<char> compressIQData(const fc32_t *data, size_t n, IQStats *stats = nullptr);
 
-/** @brief Convert fc32 format to sc16 */
-void convert2sc16(const fc32_t *from, sc16_t *to, size_t n);
-
-/** @brief Convert sc16 format to fc32 */
-void convert2fc32(const sc16_t *from, fc32_t *to, size_t n);
-
-/** @brief Compress fc32 IQ data */
-buffer<char> compressIQData(const fc32_t *data, size_t n);
+/** @brief Compress segmented fc32 IQ data */
+/** The segments are compressed in place without first being copied into a
+ * contiguous buffer.
+ */
+buffer<char> compressIQData(const IQSegments &segs, IQStats *stats = nullptr);
 
 /** @brief Decompress fc32 IQ data */
 buffer<fc32_t> decompressIQData(const char *data, size_t n);
 
+class BufferEncoder;
+
+/** @brief Streaming compressor for fc32 IQ data */
+class IQCompressor {
+public:
+    /** @brief Construct a streaming compressor
+     * @param n Total number of samples that will be compressed
+     */
+    explicit IQCompressor(size_t n);
+
+    ~IQCompressor();
+
+    IQCompressor() = delete;
+    IQCompressor(const IQCompressor&) = delete;
+    IQCompressor(IQCompressor&&) = delete;
+
+    IQCompressor& operator=(const IQCompressor&) = delete;
+    IQCompressor& operator=(IQCompressor&&) = delete;
+
+    /** @brief Compress the next block of samples
+     * @param data IQ data
+     * @param n Number of samples
+     * @param stats If non-null, statistics of the IQ data are added here
+     */
+    void compress(const fc32_t *data, size_t n, IQStats *stats = nullptr);
+
+    /** @brief Finish compression and return the compressed data */
+    buffer<char> finish(void);
+
+protected:
+    /** @brief The encoder */
+    std::unique_ptr<BufferEncoder> encoder_;
+
+    /** @brief Flag that is true when compression is finished */
+    bool finished_;
+};
+
 #endif /* IQCOMPRESSION_H_ */
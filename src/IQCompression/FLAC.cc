@@ -9,30 +9,8 @@
 // we certainly don't get more than 14 :)
 constexpr unsigned kBits = 14;
 
-/** @brief Convert fc32_t IQ data to interleaved int32 format */
-void convert2int32(const fc32_t *in_, const size_t n, int32_t *out)
-{
-    using vec_type = xsimd::simd_type<float>;
-
-    constexpr float k = 1 << (kBits - 1);
-    const vec_type  kvec(k);
-
-    const float *in = reinterpret_cast<const float*>(in_);
-
-    size_t size = 2*n;
-    size_t inc = vec_type::size;
-    size_t vec_size = size - size % inc;
-
-    for (size_t i = 0; i < vec_size; i += inc) {
-        vec_type invec = xsimd::load_unaligned(&in[i]);
-
-        xsimd::store_unaligned<int32_t, float>(&out[i], kvec*invec);
-    }
-
-    // Remaining part that cannot be vectorized
-    for (size_t i = vec_size; i < size; ++i)
-        out[i] = k*in[i];
-}
+/** @brief Number of samples converted to int32 at a time during encoding */
+constexpr size_t kEncodeChunkSize = 16*1024;
 
 template<class T>
 void interleave(const T &c, const T &y, T *res);
@@ -101,7 +79,24 @@ void convert2fc32(const int32_t *const in[], const size_t size, fc32_t *out_)
         interleave(k*in[0][i], k*in[1][i], reinterpret_cast<float*>(&out_[i]));
 }
 
-void FLACMemoryEncoder::encode(const fc32_t *sig, size_t n)
+void FLACMemoryEncoder::encode(const fc32_t *sig, size_t n, IQStats *stats)
+{
+    encodeBegin(n);
+    encodeSamples(sig, n, stats);
+    encodeEnd();
+}
+
+void FLACMemoryEncoder::encode(const IQSegments &segs, IQStats *stats)
+{
+    encodeBegin(segs.size());
+
+    for (auto &span : segs.spans)
+        encodeSamples(span.data(), span.size(), stats);
+
+    encodeEnd();
+}
+
+void FLACMemoryEncoder::encodeBegin(size_t n)
 {
     off_ = 0;
 
@@ -116,12 +111,28 @@ void FLACMemoryEncoder::encode(const fc32_t *sig, size_t n)
 
     checkInit(init());
 
-    std::unique_ptr<int32_t[]> tempbuf = std::unique_ptr<int32_t[]>(new int32_t[2*n]);
+    if (!tempbuf_)
+        tempbuf_.reset(new int32_t[2*kEncodeChunkSize]);
+}
+
+void FLACMemoryEncoder::encodeSamples(const fc32_t *sig, size_t n, IQStats *stats)
+{
+    // Convert and encode in fixed-size chunks so that the temporary int32
+    // buffer does not scale with the number of samples being encoded.
+    while (n != 0) {
+        size_t m = std::min(n, kEncodeChunkSize);
 
-    convert2int32(sig, n, tempbuf.get());
+        convert2int32(sig, tempbuf_.get(), m, kBits, stats);
 
-    check(process_interleaved(tempbuf.get(), n));
+        check(process_interleaved(tempbuf_.get(), m));
 
+        sig += m;
+        n -= m;
+    }
+}
+
+void FLACMemoryEncoder::encodeEnd(void)
+{
     check(finish());
 }
 
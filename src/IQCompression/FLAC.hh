@@ -13,6 +13,9 @@
 #include <FLAC++/decoder.h>
 #include <FLAC++/encoder.h>
 
+#include "IQBuffer.hh"
+#include "IQConvert.hh"
+
 class FLACException : public std::exception {
 public:
     FLACException(const char *msg) : msg_(msg)
@@ -36,12 +39,34 @@ public:
     FLACMemoryEncoder() = default;
     virtual ~FLACMemoryEncoder() = default;
 
-    virtual void encode(const fc32_t *sig, size_t n);
+    /** @brief Encode contiguous IQ data */
+    virtual void encode(const fc32_t *sig, size_t n, IQStats *stats = nullptr);
+
+    /** @brief Encode segmented IQ data without making it contiguous */
+    virtual void encode(const IQSegments &segs, IQStats *stats = nullptr);
+
+    /** @brief Begin streaming encode
+     * @param n Total number of samples that will be encoded
+     */
+    virtual void encodeBegin(size_t n);
+
+    /** @brief Encode the next block of samples in a streaming encode
+     * @param sig IQ data
+     * @param n Number of samples
+     * @param stats If non-null, statistics of the IQ data are added here
+     */
+    virtual void encodeSamples(const fc32_t *sig, size_t n, IQStats *stats = nullptr);
+
+    /** @brief Finish streaming encode */
+    virtual void encodeEnd(void);
 
 protected:
     /** @brief Offset into buffer at which to write data */
     size_t off_;
 
+    /** @brief Fixed-size buffer for samples converted to int32 */
+    std::unique_ptr<int32_t[]> tempbuf_;
+
     /** @brief Get size of buffer holding encoded */
     virtual size_t size(void) = 0;
 
@@ -0,0 +1,354 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <limits>
+#include <stdexcept>
+
+#include <xsimd/xsimd.hpp>
+
+#include "IQConvert.hh"
+
+/** @brief SIMD vector of complex samples */
+using cvec_type = xsimd::simd_type<fc32_t>;
+
+/** @brief SIMD vector of real and imaginary parts of complex samples */
+using rvec_type = xsimd::batch<float, cvec_type::size>;
+
+/** @brief SIMD vector of power histogram bin indices */
+using ivec_type = xsimd::batch<int32_t, cvec_type::size>;
+
+/** @brief Number of samples processed between reductions of vector
+ * accumulators. Keeps float accumulators exact and in cache.
+ */
+constexpr size_t kBlockSize = 4096;
+
+static_assert(kBlockSize % cvec_type::size == 0, "Block size must be a multiple of the SIMD vector size");
+
+float PowerHistogram::quantile(float q) const
+{
+    if (nsamples == 0)
+        return 0;
+
+    // Index of sample (in sorted order) at quantile q
+    size_t target = q*nsamples;
+
+    if (target >= nsamples)
+        target = nsamples - 1;
+
+    size_t count = 0;
+
+    for (unsigned b = 0; b < kNumBins; ++b) {
+        if (count + counts[b] > target) {
+            // Interpolate linearly within the bin
+            float lo = binLowerEdge(b);
+            float hi = binLowerEdge(b + 1);
+            float frac = (target - count + 0.5f)/counts[b];
+
+            return lo + frac*(hi - lo);
+        }
+
+        count += counts[b];
+    }
+
+    return binLowerEdge(kNumBins);
+}
+
+void PowerHistogram::add(const float *power, size_t n)
+{
+    constexpr size_t inc = ivec_type::size;
+
+    const ivec_type offset(kMinExp << kMantissaBits);
+    const ivec_type minbin(0);
+    const ivec_type maxbin(kNumBins - 1);
+
+    size_t vec_n = n - n % inc;
+
+    alignas(64) int32_t bins[inc];
+
+    for (size_t i = 0; i < vec_n; i += inc) {
+        rvec_type p;
+
+        p.load_unaligned(&power[i]);
+
+        // Power is non-negative, so the sign bit is clear and the shift
+        // leaves the exponent followed by the top mantissa bits.
+        ivec_type b = (xsimd::bitwise_cast<ivec_type>(p) >> (23 - kMantissaBits)) - offset;
+
+        xsimd::min(xsimd::max(b, minbin), maxbin).store_aligned(bins);
+
+        for (size_t j = 0; j < inc; ++j)
+            ++counts[bins[j]];
+    }
+
+    for (size_t i = vec_n; i < n; ++i)
+        ++counts[bin(power[i])];
+
+    nsamples += n;
+}
+
+/** @brief Fused scale, saturate, and statistics kernel.
+ * @param in Input samples
+ * @param n Number of samples
+ * @param g Gain applied to input
+ * @param saturate If true, saturate scaled components at full scale
+ * @param stats Statistics to update, or nullptr
+ * @param hist Power histogram to update, or nullptr
+ * @param store Function called with the index of the first sample, a pointer
+ * to scaled samples, and the number of samples.
+ */
+/** Complex vectors are loaded deinterleaved, so sample power, peak power, and
+ * clipping are all computed lane-wise on vectors of real and imaginary parts.
+ */
+template <class Store>
+static void convertKernel(const fc32_t *in,
+                          size_t n,
+                          float g,
+                          bool saturate,
+                          IQStats *stats,
+                          PowerHistogram *hist,
+                          Store &&store)
+{
+    constexpr size_t inc = cvec_type::size;
+
+    const rvec_type gvec(g);
+    const rvec_type onevec(1.0f);
+    const rvec_type negonevec(-1.0f);
+    const rvec_type zerovec(0.0f);
+
+    const bool need_power = stats != nullptr || hist != nullptr;
+    size_t     vec_n = n - n % inc;
+    float      peak_power = 0;
+    double     total_power = 0;
+    size_t     nclipped = 0;
+
+    alignas(64) float  power[inc];
+    alignas(64) fc32_t out[inc];
+
+    for (size_t blk = 0; blk < vec_n; blk += kBlockSize) {
+        size_t    blk_end = std::min(blk + kBlockSize, vec_n);
+        rvec_type powvec(0.0f);
+        rvec_type peakvec(0.0f);
+        rvec_type clipvec(0.0f);
+
+        for (size_t i = blk; i < blk_end; i += inc) {
+            cvec_type x = xsimd::load_unaligned(&in[i]);
+            rvec_type re = gvec*x.real();
+            rvec_type im = gvec*x.imag();
+
+            if (need_power) {
+                rvec_type p = re*re + im*im;
+
+                powvec += p;
+                peakvec = xsimd::max(peakvec, p);
+                clipvec += xsimd::select(xsimd::abs(re) > onevec, onevec, zerovec);
+                clipvec += xsimd::select(xsimd::abs(im) > onevec, onevec, zerovec);
+
+                if (hist) {
+                    p.store_aligned(power);
+                    hist->add(power, inc);
+                }
+            }
+
+            if (saturate) {
+                re = xsimd::min(xsimd::max(re, negonevec), onevec);
+                im = xsimd::min(xsimd::max(im, negonevec), onevec);
+            }
+
+            cvec_type(re, im).store_aligned(out);
+            store(i, out, inc);
+        }
+
+        if (need_power) {
+            alignas(64) float peak[inc];
+            alignas(64) float clip[inc];
+
+            powvec.store_aligned(power);
+            peakvec.store_aligned(peak);
+            clipvec.store_aligned(clip);
+
+            for (size_t j = 0; j < inc; ++j) {
+                total_power += power[j];
+                peak_power = std::max(peak_power, peak[j]);
+                nclipped += static_cast<size_t>(clip[j]);
+            }
+        }
+    }
+
+    // Remaining part that cannot be vectorized
+    for (size_t i = vec_n; i < n; ++i) {
+        float re = g*in[i].real();
+        float im = g*in[i].imag();
+
+        if (need_power) {
+            float p = re*re + im*im;
+
+            total_power += p;
+            peak_power = std::max(peak_power, p);
+            nclipped += (std::abs(re) > 1.0f) + (std::abs(im) > 1.0f);
+
+            if (hist)
+                hist->add(p);
+        }
+
+        if (saturate) {
+            re = std::min(std::max(re, -1.0f), 1.0f);
+            im = std::min(std::max(im, -1.0f), 1.0f);
+        }
+
+        out[0] = fc32_t(re, im);
+        store(i, out, 1);
+    }
+
+    if (stats) {
+        stats->peak_power = std::max(stats->peak_power, peak_power);
+        stats->total_power += total_power;
+        stats->nclipped += nclipped;
+        stats->nsamples += n;
+    }
+}
+
+/** @brief Convert to a signed integer type, saturating at full scale
+ * @param k Scale factor for full scale
+ * @param imax Maximum integer magnitude
+ */
+template <class I, class C>
+static void convert2int(const fc32_t *from,
+                        C *to,
+                        size_t n,
+                        float g,
+                        float k,
+                        long imax,
+                        IQStats *stats)
+{
+    I *out = reinterpret_cast<I*>(to);
+
+    convertKernel(from, n, g, true, stats, nullptr,
+        [&](size_t i, const fc32_t *xs, size_t count) {
+            const float *x = reinterpret_cast<const float*>(xs);
+
+            // Narrowing loop; the compiler vectorizes this. Round to nearest.
+            // Components have already been saturated at full scale, but k may
+            // map full scale to one past the largest representable value.
+            for (size_t j = 0; j < 2*count; ++j)
+                out[2*i+j] = static_cast<I>(std::min(std::lrintf(k*x[j]), imax));
+        });
+}
+
+void convert2sc16(const fc32_t *from,
+                  sc16_t *to,
+                  size_t n,
+                  float g,
+                  IQStats *stats)
+{
+    convert2int<int16_t>(from, to, n, g,
+                         std::numeric_limits<int16_t>::max(),
+                         std::numeric_limits<int16_t>::max(),
+                         stats);
+}
+
+void convert2sc8(const fc32_t *from,
+                 sc8_t *to,
+                 size_t n,
+                 float g,
+                 IQStats *stats)
+{
+    convert2int<int8_t>(from, to, n, g,
+                        std::numeric_limits<int8_t>::max(),
+                        std::numeric_limits<int8_t>::max(),
+                        stats);
+}
+
+void convert2int32(const fc32_t *from,
+                   int32_t *to,
+                   size_t n,
+                   unsigned bits,
+                   IQStats *stats)
+{
+    if (bits < 1 || bits > 32)
+        throw std::range_error("Integer precision must be between 1 and 32 bits");
+
+    // Compute full scale in 64 bits so that 32 bits of precision does not
+    // overflow.
+    const int64_t full_scale = int64_t(1) << (bits - 1);
+
+    convert2int<int32_t>(from, to, n, 1.0f,
+                         full_scale,
+                         full_scale - 1,
+                         stats);
+}
+
+/** @brief Convert from a signed integer type to fc32 */
+template <class I, class C>
+static void convert2fc32(const C *from, fc32_t *to, size_t n, float k)
+{
+    const I *in = reinterpret_cast<const I*>(from);
+    float   *out = reinterpret_cast<float*>(to);
+
+    // Simple enough for the compiler to vectorize, including the widening
+    // conversion.
+    for (size_t i = 0; i < 2*n; ++i)
+        out[i] = k*in[i];
+}
+
+void convert2fc32(const sc16_t *from, fc32_t *to, size_t n, float g)
+{
+    convert2fc32<int16_t>(from, to, n, g/std::numeric_limits<int16_t>::max());
+}
+
+void convert2fc32(const sc8_t *from, fc32_t *to, size_t n, float g)
+{
+    convert2fc32<int8_t>(from, to, n, g/std::numeric_limits<int8_t>::max());
+}
+
+void scaleIQ(const fc32_t *from,
+             fc32_t *to,
+             size_t n,
+             float g,
+             IQStats *stats,
+             PowerHistogram *hist)
+{
+    convertKernel(from, n, g, false, stats, hist,
+        [&](size_t i, const fc32_t *x, size_t count) {
+            std::copy(x, x + count, &to[i]);
+        });
+}
+
+void computeIQStats(const fc32_t *from,
+                    size_t n,
+                    float g,
+                    IQStats *stats,
+                    PowerHistogram *hist)
+{
+    convertKernel(from, n, g, false, stats, hist,
+        [&](size_t i, const fc32_t *x, size_t count) {});
+}
+
+void samplePower(const fc32_t *from,
+                 size_t n,
+                 float g,
+                 size_t stride,
+                 PowerHistogram &hist)
+{
+    constexpr size_t kChunkSize = 64;
+
+    const float g2 = g*g;
+    float       power[kChunkSize];
+    size_t      count = 0;
+
+    if (stride == 0)
+        stride = 1;
+
+    // Gathering strided samples is scalar; binning the gathered power values
+    // is not.
+    for (size_t i = 0; i < n; i += stride) {
+        power[count++] = g2*std::norm(from[i]);
+
+        if (count == kChunkSize) {
+            hist.add(power, count);
+            count = 0;
+        }
+    }
+
+    if (count != 0)
+        hist.add(power, count);
+}
@@ -0,0 +1,244 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef IQCONVERT_H_
+#define IQCONVERT_H_
+
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+
+typedef std::complex<int8_t> sc8_t;
+typedef std::complex<int16_t> sc16_t;
+typedef std::complex<float> fc32_t;
+typedef std::complex<double> fc64_t;
+
+/** @brief Statistics gathered while converting IQ samples */
+/** All statistics are computed on samples *after* scaling. Full scale is 1.0
+ * for each of the I and Q components.
+ */
+struct IQStats {
+    IQStats()
+      : peak_power(0)
+      , total_power(0)
+      , nclipped(0)
+      , nsamples(0)
+    {
+    }
+
+    /** @brief Peak sample power, |x|^2 */
+    float peak_power;
+
+    /** @brief Sum of sample power, |x|^2 */
+    double total_power;
+
+    /** @brief Number of I or Q components that exceeded full scale */
+    size_t nclipped;
+
+    /** @brief Number of samples */
+    size_t nsamples;
+
+    /** @brief Average sample power */
+    float avgPower(void) const
+    {
+        return nsamples == 0 ? 0 : total_power/nsamples;
+    }
+
+    /** @brief Merge statistics from another set of samples */
+    IQStats &operator +=(const IQStats &other)
+    {
+        peak_power = std::max(peak_power, other.peak_power);
+        total_power += other.total_power;
+        nclipped += other.nclipped;
+        nsamples += other.nsamples;
+
+        return *this;
+    }
+};
+
+/** @brief A histogram of sample power with logarithmically-spaced bins */
+/** Bins are indexed by the exponent and the top kMantissaBits bits of the
+ * mantissa of the IEEE-754 representation of the power, so each octave is
+ * split into 2^kMantissaBits bins and no logarithm is ever computed.
+ */
+struct PowerHistogram {
+    /** @brief Number of mantissa bits used to sub-divide each octave */
+    static constexpr unsigned kMantissaBits = 3;
+
+    /** @brief Smallest binned biased exponent, i.e., 2^-40 */
+    static constexpr unsigned kMinExp = 127 - 40;
+
+    /** @brief Largest binned biased exponent, i.e., 2^8 */
+    static constexpr unsigned kMaxExp = 127 + 8;
+
+    /** @brief Number of bins */
+    static constexpr unsigned kNumBins = (kMaxExp - kMinExp + 1) << kMantissaBits;
+
+    PowerHistogram()
+      : nsamples(0)
+    {
+        counts.fill(0);
+    }
+
+    /** @brief Bin counts */
+    std::array<uint32_t, kNumBins> counts;
+
+    /** @brief Total number of samples in the histogram */
+    size_t nsamples;
+
+    /** @brief Return the bin holding a power value */
+    static unsigned bin(float power)
+    {
+        uint32_t bits;
+
+        std::memcpy(&bits, &power, sizeof(bits));
+
+        int b = static_cast<int>(bits >> (23 - kMantissaBits)) - static_cast<int>(kMinExp << kMantissaBits);
+
+        if (b < 0)
+            return 0;
+        else if (b >= static_cast<int>(kNumBins))
+            return kNumBins - 1;
+        else
+            return b;
+    }
+
+    /** @brief Return the smallest power value in a bin */
+    static float binLowerEdge(unsigned b)
+    {
+        uint32_t bits = (b + (kMinExp << kMantissaBits)) << (23 - kMantissaBits);
+        float    power;
+
+        std::memcpy(&power, &bits, sizeof(power));
+
+        return power;
+    }
+
+    /** @brief Add a power value to the histogram */
+    void add(float power)
+    {
+        ++counts[bin(power)];
+        ++nsamples;
+    }
+
+    /** @brief Add a block of power values to the histogram */
+    /** Bin indices are computed a SIMD vector at a time by reinterpreting the
+     * power values as integers, shifting, and clamping. Incrementing the
+     * counts is a scalar loop, because bin indices within a vector may
+     * collide.
+     */
+    void add(const float *power, size_t n);
+
+    /** @brief Estimate a quantile of sample power
+     * @param q The quantile, in the range [0,1]
+     * @return The estimated power at quantile q, or 0 if the histogram is
+     * empty.
+     */
+    float quantile(float q) const;
+};
+
+/** @brief Convert fc32 format to sc16, saturating at full scale
+ * @param from Source samples
+ * @param to Destination samples
+ * @param n Number of samples
+ * @param g Gain applied before conversion
+ * @param stats If non-null, statistics of scaled samples are added here
+ */
+void convert2sc16(const fc32_t *from,
+                  sc16_t *to,
+                  size_t n,
+                  float g = 1.0f,
+                  IQStats *stats = nullptr);
+
+/** @brief Convert fc32 format to sc8, saturating at full scale
+ * @param from Source samples
+ * @param to Destination samples
+ * @param n Number of samples
+ * @param g Gain applied before conversion
+ * @param stats If non-null, statistics of scaled samples are added here
+ */
+void convert2sc8(const fc32_t *from,
+                 sc8_t *to,
+                 size_t n,
+                 float g = 1.0f,
+                 IQStats *stats = nullptr);
+
+/** @brief Convert fc32 format to interleaved int32 with the given number of
+ * bits of precision, saturating at full scale
+ * @param from Source samples
+ * @param to Destination; must hold 2*n values
+ * @param n Number of samples
+ * @param bits Number of bits of precision, including the sign bit; must be
+ * between 1 and 32
+ * @param stats If non-null, statistics of samples are added here
+ */
+void convert2int32(const fc32_t *from,
+                   int32_t *to,
+                   size_t n,
+                   unsigned bits,
+                   IQStats *stats = nullptr);
+
+/** @brief Convert sc16 format to fc32
+ * @param from Source samples
+ * @param to Destination samples
+ * @param n Number of samples
+ * @param g Gain applied after conversion
+ */
+void convert2fc32(const sc16_t *from, fc32_t *to, size_t n, float g = 1.0f);
+
+/** @brief Convert sc8 format to fc32
+ * @param from Source samples
+ * @param to Destination samples
+ * @param n Number of samples
+ * @param g Gain applied after conversion
+ */
+void convert2fc32(const sc8_t *from, fc32_t *to, size_t n, float g = 1.0f);
+
+/** @brief Scale fc32 samples, computing statistics in the same pass
+ * @param from Source samples
+ * @param to Destination samples; may be the same as from
+ * @param n Number of samples
+ * @param g Gain
+ * @param stats If non-null, statistics of scaled samples are added here
+ * @param hist If non-null, power of scaled samples is added to this histogram
+ */
+/** Samples are not saturated, but components exceeding full scale are
+ * counted as clipped, since they will be clipped by the radio.
+ */
+void scaleIQ(const fc32_t *from,
+             fc32_t *to,
+             size_t n,
+             float g,
+             IQStats *stats = nullptr,
+             PowerHistogram *hist = nullptr);
+
+/** @brief Compute statistics of scaled fc32 samples without writing them
+ * @param from Source samples
+ * @param n Number of samples
+ * @param g Gain
+ * @param stats If non-null, statistics of scaled samples are added here
+ * @param hist If non-null, power of scaled samples is added to this histogram
+ */
+void computeIQStats(const fc32_t *from,
+                    size_t n,
+                    float g,
+                    IQStats *stats,
+                    PowerHistogram *hist = nullptr);
+
+/** @brief Add the power of a strided subset of scaled fc32 samples to a
+ * histogram
+ * @param from Source samples
+ * @param n Number of samples
+ * @param g Gain
+ * @param stride Only every stride-th sample is used
+ * @param hist Power of sampled, scaled samples is added to this histogram
+ */
+void samplePower(const fc32_t *from,
+                 size_t n,
+                 float g,
+                 size_t stride,
+                 PowerHistogram &hist);
+
+#endif /* IQCONVERT_H_ */
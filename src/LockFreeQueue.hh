@@ -0,0 +1,150 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef LOCKFREEQUEUE_H_
+#define LOCKFREEQUEUE_H_
+
+#include <atomic>
+#include <memory>
+
+/** @brief A bounded, lock-free, multi-producer, multi-consumer queue. */
+/** Each cell carries a sequence number that tells producers and consumers
+ * whether the cell is free or full for the current lap around the ring, so
+ * neither push nor pop ever takes a lock. Neither operation blocks: push fails
+ * if the queue is full, and pop fails if the queue is empty. Elements pushed by
+ * a single producer are popped in the order they were pushed.
+ */
+template<typename T>
+class LockFreeQueue {
+public:
+    /** @brief Construct a queue
+     * @param capacity Minimum queue capacity. The actual capacity is the next
+     * power of two.
+     */
+    explicit LockFreeQueue(size_t capacity)
+      : mask_(roundUpPow2(capacity) - 1)
+      , cells_(new Cell[mask_ + 1])
+      , head_(0)
+      , tail_(0)
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue() = delete;
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue(LockFreeQueue&&) = delete;
+
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(LockFreeQueue&&) = delete;
+
+    /** @brief Get queue capacity. */
+    size_t capacity(void) const
+    {
+        return mask_ + 1;
+    }
+
+    /** @brief Return true if the queue is empty. */
+    /** The result is only a snapshot if other threads are pushing or popping.
+     */
+    bool empty(void) const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    /** @brief Try to push an element on the end of the queue.
+     * @param val The element. It is only moved from if the push succeeds.
+     * @return true if the element was pushed, false if the queue was full.
+     */
+    bool try_push(T& val)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell   *cell;
+
+        for (;;) {
+            cell = &cells_[pos & mask_];
+
+            size_t    seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false;
+            else
+                pos = tail_.load(std::memory_order_relaxed);
+        }
+
+        cell->val = std::move(val);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /** @brief Try to pop an element from the front of the queue.
+     * @param val Reference to location where popped value should be stored.
+     * @return true if an element was popped, false if the queue was empty.
+     */
+    bool try_pop(T& val)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell   *cell;
+
+        for (;;) {
+            cell = &cells_[pos & mask_];
+
+            size_t    seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false;
+            else
+                pos = head_.load(std::memory_order_relaxed);
+        }
+
+        val = std::move(cell->val);
+        cell->val = T();
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    /** @brief A queue cell */
+    struct Cell {
+        /** @brief Sequence number */
+        std::atomic<size_t> seq;
+
+        /** @brief Value */
+        T val;
+    };
+
+    /** @brief Mask used to compute cell index */
+    const size_t mask_;
+
+    /** @brief Cells */
+    std::unique_ptr<Cell[]> cells_;
+
+    /** @brief Position of next element to pop */
+    alignas(64) std::atomic<size_t> head_;
+
+    /** @brief Position of next element to push */
+    alignas(64) std::atomic<size_t> tail_;
+
+    /** @brief Round up to the next power of two */
+    static size_t roundUpPow2(size_t n)
+    {
+        size_t pow2 = 1;
+
+        while (pow2 < n)
+            pow2 <<= 1;
+
+        return pow2;
+    }
+};
+
+#endif /* LOCKFREEQUEUE_H_ */
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <algorithm>
 #include <complex>
 
 #include <H5Cpp.h>
@@ -11,6 +12,8 @@
 #include "Clock.hh"
 #include "IQCompression.hh"
 #include "Logger.hh"
+#include "util/sprintf.hh"
+#include "util/threads.hh"
 
 std::shared_ptr<Logger> logger;
 
@@ -245,6 +248,14 @@ Logger::Logger(const WallClock::time_point &t_start,
   , t_last_slot_((time_t) 0)
   , sources_(0)
   , done_(false)
+  , symbol_ring_(SymbolRing::create(kDefaultSymbolBuffers))
+  , symbol_stride_(1)
+  , symbol_invalid_only_(false)
+  , symbol_node_(-1)
+  , symbol_count_(0)
+  , symbol_drops_(0)
+  , nclipped_bufs_(0)
+  , clipping_start_((time_t) 0)
 {
 }
 
@@ -414,7 +425,7 @@ void Logger::open(const std::string& filename)
     arq_event_ = std::make_unique<ExtensibleDataSet>(file_, "arq_event", h5_arq_event);
 
     // Start worker thread
-    worker_thread_ = std::thread(&Logger::worker, this);
+    worker_thread_ = spawnThread("logger", &Logger::worker, this);
 
     is_open_ = true;
 }
@@ -446,6 +457,36 @@ void Logger::close(void)
     }
 }
 
+SymbolRing::Handle Logger::captureSymbols(std::optional<NodeId> node,
+                                          bool payload_valid,
+                                          const std::complex<float> *syms,
+                                          size_t n)
+{
+    if (!getCollectSource(kRecvPackets) || !getCollectSource(kRecvSymbols))
+        return SymbolRing::Handle(nullptr, SymbolRing::Release{nullptr});
+
+    if (payload_valid && symbol_invalid_only_.load(std::memory_order_relaxed))
+        return SymbolRing::Handle(nullptr, SymbolRing::Release{nullptr});
+
+    int node_filter = symbol_node_.load(std::memory_order_relaxed);
+
+    if (node_filter >= 0 && (!node || *node != node_filter))
+        return SymbolRing::Handle(nullptr, SymbolRing::Release{nullptr});
+
+    uint64_t count = symbol_count_.fetch_add(1, std::memory_order_relaxed);
+
+    if (count % symbol_stride_.load(std::memory_order_relaxed) != 0)
+        return SymbolRing::Handle(nullptr, SymbolRing::Release{nullptr});
+
+    auto               ring = std::atomic_load_explicit(&symbol_ring_, std::memory_order_acquire);
+    SymbolRing::Handle h = ring->capture(syms, n);
+
+    if (!h)
+        symbol_drops_.fetch_add(1, std::memory_order_relaxed);
+
+    return h;
+}
+
 void Logger::setAttribute(const std::string& name, const std::string& val)
 {
     H5::StrType   h5_type(H5::PredType::C_S1, H5T_VARIABLE);
@@ -526,7 +567,8 @@ H5::Attribute Logger::createOrOpenAttribute(const std::string &name,
 void Logger::logSlot_(const IQBuf &buf)
 {
     SlotEntry    entry;
-    buffer<char> compressed = compressIQData(buf.data(), buf.size());
+    IQStats      stats;
+    buffer<char> compressed = compressIQData(buf.data(), buf.size(), &stats);
 
     entry.timestamp = (WallClock::to_wall_time(*buf.timestamp) - t_start_).get_real_secs();
     entry.mono_timestamp = (*buf.timestamp - mono_t_start_).get_real_secs();
@@ -537,6 +579,8 @@ void Logger::logSlot_(const IQBuf &buf)
     entry.iq_data.len = compressed.size();
 
     slots_->write(&entry, 1);
+
+    logClipping_(*buf.timestamp, stats);
 }
 
 void Logger::logTXRecord_(const std::optional<MonoClock::time_point> &t, size_t nsamples, double fs)
@@ -556,21 +600,24 @@ void Logger::logSnapshot_(std::shared_ptr<Snapshot> snapshot)
     if (snapshot->slots.empty())
         return;
 
-    SnapshotEntry          entry;
-    double                 timestamp = (WallClock::to_wall_time(snapshot->timestamp) - t_start_).get_real_secs();
-    double                 mono_timestamp = (snapshot->timestamp - mono_t_start_).get_real_secs();
-    std::shared_ptr<IQBuf> buf = *(snapshot->getCombinedSlots());
-    buffer<char>           compressed = compressIQData(buf->data(), buf->size());
+    SnapshotEntry entry;
+    double        timestamp = (WallClock::to_wall_time(snapshot->timestamp) - t_start_).get_real_secs();
+    double        mono_timestamp = (snapshot->timestamp - mono_t_start_).get_real_secs();
+    IQSegments    segs = *(snapshot->getSegmentedSlots());
+    IQStats       stats;
+    buffer<char>  compressed = compressIQData(segs, &stats);
 
     entry.timestamp = timestamp;
     entry.mono_timestamp = mono_timestamp;
-    entry.fs = buf->fs;
-    entry.iq_data_len = buf->size();
+    entry.fs = segs.fs;
+    entry.iq_data_len = segs.size();
     entry.iq_data.p = compressed.data();
     entry.iq_data.len = compressed.size();
 
     snapshots_->write(&entry, 1);
 
+    logClipping_(snapshot->timestamp, stats);
+
     SelfTXEntry selftx_entry;
 
     for (auto&& selftx : snapshot->selftx) {
@@ -626,7 +673,7 @@ void Logger::logRecv_(RadioPacket &pkt)
     entry.demod_latency = pkt.demod_latency;
     entry.tuntap_latency = (pkt.tuntap_timestamp - pkt.timestamp).get_real_secs();
     entry.size = pkt.payload_len;
-    if (pkt.symbols && getCollectSource(kRecvSymbols)) {
+    if (pkt.symbols) {
         entry.symbols.p = pkt.symbols->data();
         entry.symbols.len = pkt.symbols->size();
     } else {
@@ -722,6 +769,45 @@ void Logger::logEvent_(const MonoClock::time_point& t,
     delete[] event;
 }
 
+void Logger::logClipping_(const MonoClock::time_point& t,
+                          const IQStats &stats)
+{
+    if (!getCollectSource(kEvents))
+        return;
+
+    if (stats.nclipped != 0) {
+        if (nclipped_bufs_ == 0)
+            clipping_start_ = t;
+
+        ++nclipped_bufs_;
+        clipping_.peak_power = std::max(clipping_.peak_power, stats.peak_power);
+        clipping_.nclipped += stats.nclipped;
+        clipping_.nsamples += stats.nsamples;
+    }
+
+    // Only log once the interval since the first unlogged clipped buffer has
+    // passed. An aggregate is flushed by the next buffer logged after that,
+    // whether or not it was clipped.
+    if (nclipped_bufs_ == 0 || (t - clipping_start_).get_real_secs() < kClippingInterval)
+        return;
+
+    std::string event = sprintf("PHY: RX clipping: nbufs=%lu; nclipped=%lu; nsamples=%lu; peak_power=%g",
+        (unsigned long) nclipped_bufs_,
+        (unsigned long) clipping_.nclipped,
+        (unsigned long) clipping_.nsamples,
+        (double) clipping_.peak_power);
+
+    clipping_ = IQStats();
+    nclipped_bufs_ = 0;
+
+    std::unique_ptr<char[]> buf(new char[event.length() + 1]);
+
+    event.copy(&buf[0], event.length(), 0);
+    buf[event.length()] = '\0';
+
+    logEvent_(t, buf.release());
+}
+
 void Logger::logARQEvent_(const MonoClock::time_point& t,
                           ARQEventType type,
                           NodeId node,
@@ -6,8 +6,12 @@
 
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <complex>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
 
@@ -18,8 +22,10 @@
 #include "Clock.hh"
 #include "ExtensibleDataSet.hh"
 #include "IQBuffer.hh"
+#include "IQConvert.hh"
 #include "Packet.hh"
 #include "SafeQueue.hh"
+#include "SymbolRing.hh"
 #include "mac/Snapshot.hh"
 
 class Logger;
@@ -41,6 +47,9 @@ public:
         kARQEvents
     };
 
+    /** @brief Default number of symbol capture buffers */
+    static constexpr size_t kDefaultSymbolBuffers = 64;
+
     Logger(const WallClock::time_point &t_start,
            const MonoClock::time_point &mono_t_start);
     ~Logger();
@@ -69,6 +78,93 @@ public:
             sources_ &= ~(1 << src);
     }
 
+    /** @brief Get number of symbol capture buffers */
+    size_t getSymbolBuffers(void) const
+    {
+        return std::atomic_load_explicit(&symbol_ring_, std::memory_order_acquire)->size();
+    }
+
+    /** @brief Set number of symbol capture buffers */
+    /** Packets that still hold buffers from the old ring keep it alive until
+     * they are logged.
+     */
+    void setSymbolBuffers(size_t n)
+    {
+        std::atomic_store_explicit(&symbol_ring_, SymbolRing::create(n), std::memory_order_release);
+    }
+
+    /** @brief Get symbol capture stride */
+    unsigned getSymbolStride(void) const
+    {
+        return symbol_stride_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set symbol capture stride */
+    /** Only every Nth frame that passes the other sampling filters has its
+     * symbols captured.
+     */
+    void setSymbolStride(unsigned stride)
+    {
+        symbol_stride_.store(std::max(stride, 1u), std::memory_order_relaxed);
+    }
+
+    /** @brief Get flag indicating only frames with invalid payloads have
+     * their symbols captured
+     */
+    bool getSymbolInvalidOnly(void) const
+    {
+        return symbol_invalid_only_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set flag indicating only frames with invalid payloads have
+     * their symbols captured
+     */
+    void setSymbolInvalidOnly(bool invalid_only)
+    {
+        symbol_invalid_only_.store(invalid_only, std::memory_order_relaxed);
+    }
+
+    /** @brief Get node whose frames have their symbols captured */
+    std::optional<NodeId> getSymbolNode(void) const
+    {
+        int node = symbol_node_.load(std::memory_order_relaxed);
+
+        if (node < 0)
+            return std::nullopt;
+        else
+            return static_cast<NodeId>(node);
+    }
+
+    /** @brief Set node whose frames have their symbols captured */
+    /** If no node is given, frames from all nodes are captured.
+     */
+    void setSymbolNode(std::optional<NodeId> node)
+    {
+        symbol_node_.store(node ? *node : -1, std::memory_order_relaxed);
+    }
+
+    /** @brief Get number of frames whose symbols were not captured because
+     * every capture buffer was in use
+     */
+    uint64_t getSymbolDrops(void) const
+    {
+        return symbol_drops_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Capture a received frame's symbols
+     * @param node The transmitting node, or std::nullopt if the header is
+     * invalid
+     * @param payload_valid Flag indicating whether the payload is valid
+     * @param syms Symbols
+     * @param n Number of symbols
+     * @return A handle to the captured symbols, or nullptr if symbols are not
+     * being logged, the frame was not sampled, or no buffer was free
+     */
+    SymbolRing::Handle captureSymbols(std::optional<NodeId> node,
+                                      bool payload_valid,
+                                      const std::complex<float> *syms,
+                                      size_t n);
+
     void setAttribute(const std::string& name, const std::string& val);
     void setAttribute(const std::string& name, uint8_t val);
     void setAttribute(const std::string& name, uint32_t val);
@@ -221,6 +317,35 @@ private:
     /** @brief Flag indicating we should terminate the logger. */
     bool done_;
 
+    /** @brief Ring of symbol capture buffers */
+    std::shared_ptr<SymbolRing> symbol_ring_;
+
+    /** @brief Symbol capture stride */
+    std::atomic<unsigned> symbol_stride_;
+
+    /** @brief Only capture symbols of frames with invalid payloads */
+    std::atomic<bool> symbol_invalid_only_;
+
+    /** @brief Only capture symbols of frames from this node, or -1 for all
+     * nodes
+     */
+    std::atomic<int> symbol_node_;
+
+    /** @brief Number of frames that passed the symbol capture filters */
+    std::atomic<uint64_t> symbol_count_;
+
+    /** @brief Number of symbol captures dropped for lack of a buffer */
+    std::atomic<uint64_t> symbol_drops_;
+
+    /** @brief Clipping statistics not yet logged */
+    IQStats clipping_;
+
+    /** @brief Number of clipped buffers not yet logged */
+    size_t nclipped_bufs_;
+
+    /** @brief Time of first clipped buffer not yet logged */
+    MonoClock::time_point clipping_start_;
+
     /** @brief Pending log entries. */
     SafeQueue<std::function<void(void)>> log_q_;
 
@@ -255,6 +380,17 @@ private:
     void logEvent_(const MonoClock::time_point& t,
                    char *event);
 
+    /** @brief Minimum interval between clipping events (sec) */
+    static constexpr double kClippingInterval = 1.0;
+
+    /** @brief Aggregate clipping statistics for received IQ data */
+    /** Clipping is logged as at most one event per kClippingInterval seconds,
+     * summarizing every clipped buffer seen since the previous event, so a
+     * saturated front end cannot flood the log.
+     */
+    void logClipping_(const MonoClock::time_point& t,
+                      const IQStats &stats);
+
     enum ARQEventType {
         kSendNAK = 0,
         kSendSACK,
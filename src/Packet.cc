@@ -237,93 +237,102 @@ void Packet::appendSetUnack(const Seq &unack)
     appendControl(msg);
 }
 
-const struct mgenhdr *Packet::getMGENHdr(void) const
+PacketLayout Packet::parseLayout(void) const
 {
-    const struct ip *iph = getIPHdr();
+    PacketLayout layout = {0};
+
+    layout.valid = true;
+
+    // IP header
+    const struct ether_header *eth = getEthernetHdr();
+
+    if (!eth || ntohs(eth->ether_type) != ETHERTYPE_IP)
+        return layout;
+
+    size_t ip_off = sizeof(ExtendedHeader) + sizeof(struct ether_header);
+
+    if (size() < ip_off + sizeof(struct ip))
+        return layout;
 
-    if (!iph)
-       return nullptr;
+    const struct ip *iph = reinterpret_cast<const struct ip*>(data() + ip_off);
 
-    size_t ip_hl = iph->ip_hl*4;
+    layout.ip = ip_off;
+    layout.ip_proto = iph->ip_p;
 
-    const struct mgenhdr *mgenh = nullptr;
+    // UDP or TCP header
+    size_t l4_off = ip_off + iph->ip_hl*4;
 
     switch (iph->ip_p) {
         case IPPROTO_UDP:
         {
-           if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct udphdr) + sizeof(struct mgenhdr))
-               return nullptr;
+            if (size() < l4_off + sizeof(struct udphdr))
+                return layout;
 
-            mgenh = reinterpret_cast<const struct mgenhdr*>(reinterpret_cast<const char*>(iph) + ip_hl + sizeof(struct udphdr));
+            const struct udphdr *udph = reinterpret_cast<const struct udphdr*>(data() + l4_off);
+
+            layout.l4 = l4_off;
+            layout.payload = l4_off + sizeof(struct udphdr);
+            layout.sport = ntohs(udph->uh_sport);
+            layout.dport = ntohs(udph->uh_dport);
         }
         break;
 
         case IPPROTO_TCP:
         {
-           const struct tcphdr *tcph;
-           size_t tcp_hl;
-
-           if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct tcphdr))
-               return nullptr;
-
-           tcph = reinterpret_cast<const struct tcphdr*>(reinterpret_cast<const char*>(iph) + ip_hl);
-           tcp_hl = tcph->th_off*4;
+            if (size() < l4_off + sizeof(struct tcphdr))
+                return layout;
 
-           if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + tcp_hl + sizeof(struct mgenhdr))
-               return nullptr;
+            const struct tcphdr *tcph = reinterpret_cast<const struct tcphdr*>(data() + l4_off);
 
-           mgenh = reinterpret_cast<const struct mgenhdr*>(reinterpret_cast<const char*>(iph) + ip_hl + tcp_hl);
+            layout.l4 = l4_off;
+            layout.payload = l4_off + tcph->th_off*4;
+            layout.sport = ntohs(tcph->th_sport);
+            layout.dport = ntohs(tcph->th_dport);
         }
         break;
     }
 
-    if (mgenh) {
-        uint16_t messageSize;
+    return layout;
+}
+
+const struct mgenhdr *Packet::getMGENHdr(void) const
+{
+    PacketLayout layout = getLayout();
+
+    if (layout.l4 == 0 || size() < layout.payload + sizeof(struct mgenhdr))
+        return nullptr;
+
+    const struct mgenhdr *mgenh = reinterpret_cast<const struct mgenhdr*>(data() + layout.payload);
+    uint16_t             messageSize;
 
-        // Make sure the MGEN-specified data length and version are correct
-        std::memcpy(&messageSize, reinterpret_cast<const uint16_t*>(mgenh) + offsetof(struct mgenhdr, messageSize), sizeof(messageSize));
+    // Make sure the MGEN-specified data length and version are correct
+    std::memcpy(&messageSize, reinterpret_cast<const uint16_t*>(mgenh) + offsetof(struct mgenhdr, messageSize), sizeof(messageSize));
 
-        if (ntohs(messageSize) == payload_size &&
-            (mgenh->version == MGEN_VERSION || mgenh->version == DARPA_MGEN_VERSION))
-            return mgenh;
-        else
-            return nullptr;
-    } else
+    if (ntohs(messageSize) == payload_size &&
+        (mgenh->version == MGEN_VERSION || mgenh->version == DARPA_MGEN_VERSION))
+        return mgenh;
+    else
         return nullptr;
 }
 
 size_t Packet::getPayloadSize(void) const
 {
-    const struct ip *iph = getIPHdr();
+    PacketLayout layout = getLayout();
 
-    if (!iph)
+    if (layout.l4 == 0)
        return 0;
 
-    size_t ip_hl = iph->ip_hl*4;
-
-    switch (iph->ip_p) {
+    switch (layout.ip_proto) {
         case IPPROTO_UDP:
         {
-            if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct udphdr))
-               return 0;
-
-            const struct udphdr *udph = reinterpret_cast<const struct udphdr*>(reinterpret_cast<const char*>(iph) + ip_hl);
+            const struct udphdr *udph = reinterpret_cast<const struct udphdr*>(data() + layout.l4);
 
             return ntohs(udph->uh_ulen) - sizeof(struct udphdr);
         }
         break;
 
         case IPPROTO_TCP:
-        {
-           if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct tcphdr))
-               return 0;
-
-           const struct tcphdr *tcph = reinterpret_cast<const struct tcphdr*>(reinterpret_cast<const char*>(iph) + ip_hl);
-           size_t tcp_hl = tcph->th_off*4;
-
-           return size() - (sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + tcp_hl);
-        }
-        break;
+            return size() - layout.payload;
     }
 
     return 0;
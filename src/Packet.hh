@@ -22,6 +22,7 @@
 #include "Clock.hh"
 #include "Header.hh"
 #include "IQBuffer.hh"
+#include "SymbolRing.hh"
 #include "net/mgen.h"
 #include "phy/Channel.hh"
 #include "phy/Modem.hh"
@@ -135,6 +136,33 @@ struct ControlMsg {
 /** @brief A flow UID. */
 typedef uint16_t FlowUID;
 
+/** @brief Offsets of a packet's protocol headers */
+/** Offsets are from the start of the packet's data. An offset of 0 means the
+ * corresponding header is not present.
+ */
+struct PacketLayout {
+    /** @brief Offset of IP header */
+    uint16_t ip;
+
+    /** @brief Offset of UDP or TCP header */
+    uint16_t l4;
+
+    /** @brief Offset of UDP or TCP payload */
+    uint16_t payload;
+
+    /** @brief UDP or TCP source port, in host byte order */
+    uint16_t sport;
+
+    /** @brief UDP or TCP destination port, in host byte order */
+    uint16_t dport;
+
+    /** @brief IP protocol */
+    uint8_t ip_proto;
+
+    /** @brief Set if this layout has been computed */
+    bool valid;
+};
+
 /** @brief A packet. */
 struct Packet : public buffer<unsigned char>
 {
@@ -169,6 +197,7 @@ struct Packet : public buffer<unsigned char>
       , hdr(hdr_)
       , payload_size(0)
       , internal_flags({0})
+      , layout_({0})
     {
     }
 
@@ -177,6 +206,7 @@ struct Packet : public buffer<unsigned char>
       , hdr({0})
       , payload_size(0)
       , internal_flags({0})
+      , layout_({0})
     {
         assert(n >= sizeof(ExtendedHeader));
     }
@@ -186,6 +216,7 @@ struct Packet : public buffer<unsigned char>
       , hdr(hdr_)
       , payload_size(0)
       , internal_flags({0})
+      , layout_({0})
     {
         assert(n >= sizeof(ExtendedHeader));
     }
@@ -336,6 +367,31 @@ struct Packet : public buffer<unsigned char>
         return iterator(*this, 0);
     }
 
+    /** @brief Parse packet headers and cache their layout */
+    /** Once a packet is classified, header accessors use the cached layout
+     * instead of re-parsing headers. A packet must be re-classified, or its
+     * layout invalidated, whenever its headers are rewritten.
+     */
+    void classify(void)
+    {
+        layout_ = parseLayout();
+    }
+
+    /** @brief Invalidate cached header layout */
+    void invalidateLayout(void)
+    {
+        layout_.valid = false;
+    }
+
+    /** @brief Get header layout
+     * @return The cached layout if the packet has been classified, otherwise
+     * a freshly parsed layout.
+     */
+    PacketLayout getLayout(void) const
+    {
+        return layout_.valid ? layout_ : parseLayout();
+    }
+
     /** @brief Get Ethernet header
      * @return A pointer to the Ethernet header or nullptr if this is not an
      * Ethernet packet
@@ -353,15 +409,12 @@ struct Packet : public buffer<unsigned char>
      */
     const struct ip *getIPHdr(void) const
     {
-        const struct ether_header *eth = getEthernetHdr();
+        PacketLayout layout = getLayout();
 
-        if (!eth || ntohs(eth->ether_type) != ETHERTYPE_IP)
+        if (layout.ip == 0)
             return nullptr;
 
-        if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + sizeof(struct ip))
-            return nullptr;
-
-        return reinterpret_cast<const struct ip*>(data() + sizeof(ExtendedHeader) + sizeof(struct ether_header));
+        return reinterpret_cast<const struct ip*>(data() + layout.ip);
     }
 
     /** @brief Get IP header
@@ -378,17 +431,12 @@ struct Packet : public buffer<unsigned char>
      */
     const struct udphdr *getUDPHdr(void) const
     {
-        const struct ip *iph = getIPHdr();
-
-        if (!iph || iph->ip_p != IPPROTO_UDP)
-            return nullptr;
-
-        size_t ip_hl = iph->ip_hl*4;
+        PacketLayout layout = getLayout();
 
-        if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct udphdr))
+        if (layout.l4 == 0 || layout.ip_proto != IPPROTO_UDP)
             return nullptr;
 
-        return reinterpret_cast<const struct udphdr*>(reinterpret_cast<const char*>(iph) + ip_hl);
+        return reinterpret_cast<const struct udphdr*>(data() + layout.l4);
     }
 
     /** @brief Get UDP header
@@ -406,17 +454,12 @@ struct Packet : public buffer<unsigned char>
      */
     const struct tcphdr *getTCPHdr(void) const
     {
-        const struct ip *iph = getIPHdr();
+        PacketLayout layout = getLayout();
 
-        if (!iph || iph->ip_p != IPPROTO_TCP)
+        if (layout.l4 == 0 || layout.ip_proto != IPPROTO_TCP)
             return nullptr;
 
-        size_t ip_hl = iph->ip_hl*4;
-
-        if (size() < sizeof(ExtendedHeader) + sizeof(struct ether_header) + ip_hl + sizeof(struct tcphdr))
-            return nullptr;
-
-        return reinterpret_cast<const struct tcphdr*>(reinterpret_cast<const char*>(iph) + ip_hl);
+        return reinterpret_cast<const struct tcphdr*>(data() + layout.l4);
     }
 
     /** @brief Get TCP header
@@ -459,9 +502,9 @@ struct Packet : public buffer<unsigned char>
      */
     bool isIPProto(uint8_t proto) const
     {
-        const struct ip *iph = getIPHdr();
+        PacketLayout layout = getLayout();
 
-        return iph != nullptr && iph->ip_p == proto;
+        return layout.ip != 0 && layout.ip_proto == proto;
     }
 
     /** @brief Return true if this is a TCP packet, false otherwise */
@@ -479,6 +522,13 @@ struct Packet : public buffer<unsigned char>
     /** @brief Initialize MGEN info */
     /** Initialize flow and MGEN sequence number info */
     void initMGENInfo(void);
+
+protected:
+    /** @brief Cached header layout */
+    PacketLayout layout_;
+
+    /** @brief Parse packet headers */
+    PacketLayout parseLayout(void) const;
 };
 
 /** @brief A packet received from the network. */
@@ -604,10 +654,12 @@ struct RadioPacket : public Packet
     MonoClock::time_point slot_timestamp;
 
     /** @brief Offset of start of packet from MAC slot */
-    size_t start_samples;
+    /** This is negative if the packet started before the slot. */
+    ssize_t start_samples;
 
     /** @brief Offset of end of packet from MAC slot */
-    size_t end_samples;
+    /** This is negative if the packet ended before the slot. */
+    ssize_t end_samples;
 
     /** @brief Demodulation latency */
     double demod_latency;
@@ -618,8 +670,8 @@ struct RadioPacket : public Packet
     /** @brief Size of received payload, including controll information */
     size_t payload_len;
 
-    /** @brief Symbols */
-    std::unique_ptr<std::vector<std::complex<float>>> symbols;
+    /** @brief Captured symbols, or nullptr if symbols were not captured */
+    SymbolRing::Handle symbols;
 };
 
 /** @brief Compute the size of the specified control message. */
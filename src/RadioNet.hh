@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "Packet.hh"
+#include "TimeSync.hh"
 #include "net/TunTap.hh"
 
 struct GPSLocation {
@@ -40,9 +41,6 @@ struct GPSLocation {
 /** @brief Map from timestamp sequence number to timestamp. */
 using timestamp_map = std::unordered_map<TimestampSeq, MonoClock::time_point>;
 
-/** @brief Map from timestamp sequence number to pair of sent, received timestamps. */
-using timestamps_map = std::unordered_map<TimestampSeq, std::pair<MonoClock::time_point, MonoClock::time_point>>;
-
 /** @brief Vector of pairs of timestamps. */
 using timestampseq_set = std::unordered_set<TimestampSeq>;
 
@@ -91,8 +89,9 @@ struct Node {
     /** @brief Echoed timestamp sequences */
     timestampseq_set timestamps_echoed;
 
-    /** @brief Timestamps received from this node */
-    timestamps_map timestamps;
+    /** @brief Clock estimate from (sent, received) timestamp pairs */
+    /** Updates are protected by timestamps_mutex. */
+    TimeSync timesync;
 
     /** @brief Set soft TX gain.
      * @param dB The soft gain (dBFS).
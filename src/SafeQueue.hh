@@ -117,6 +117,22 @@ public:
         }
     }
 
+    /** @brief Wait until the queue is non-empty or stopped.
+     * @return true if the queue is non-empty, false if it was stopped.
+     */
+    /** The element is not popped, so another consumer may take it first; a
+     * caller that must not block while holding a lock can wait here and then
+     * call try_pop with its lock held.
+     */
+    bool wait(void)
+    {
+        std::unique_lock<std::mutex> lock(m_);
+
+        cond_.wait(lock, [this]{ return done_ || !q_.empty(); });
+
+        return !done_;
+    }
+
     /** @brief Access the first element of the queue and pop it without waiting.
      * @param val Reference to location where popped value should be copied.
      * @return true if a value was popped, false otherwise.
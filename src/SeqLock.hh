@@ -0,0 +1,77 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef SEQLOCK_HH_
+#define SEQLOCK_HH_
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/** @brief A single-writer, multiple-reader sequence lock */
+/** Readers never block the writer and never take a lock; they retry if the
+ * writer was active while they were reading.
+ */
+template <class T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock can only hold trivially copyable types");
+public:
+    SeqLock()
+      : seq_(0)
+      , data_()
+    {
+    }
+
+    explicit SeqLock(const T &x)
+      : seq_(0)
+      , data_(x)
+    {
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock(SeqLock&&) = delete;
+
+    SeqLock& operator=(const SeqLock&) = delete;
+    SeqLock& operator=(SeqLock&&) = delete;
+
+    /** @brief Publish a new value. Must only be called by a single writer. */
+    void store(const T &x)
+    {
+        unsigned seq = seq_.load(std::memory_order_relaxed);
+
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&data_, &x, sizeof(T));
+
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /** @brief Read the most recently published value */
+    T load(void) const
+    {
+        T        x;
+        unsigned seq1;
+        unsigned seq2;
+
+        do {
+            seq1 = seq_.load(std::memory_order_acquire);
+
+            std::memcpy(&x, &data_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            seq2 = seq_.load(std::memory_order_relaxed);
+        } while ((seq1 & 1) || seq1 != seq2);
+
+        return x;
+    }
+
+private:
+    /** @brief Sequence number. Odd while a write is in progress. */
+    std::atomic<unsigned> seq_;
+
+    /** @brief Protected data */
+    T data_;
+};
+
+#endif /* SEQLOCK_HH_ */
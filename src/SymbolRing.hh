@@ -0,0 +1,125 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef SYMBOLRING_HH_
+#define SYMBOLRING_HH_
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include "LockFreeQueue.hh"
+
+class SymbolRing;
+
+/** @brief A buffer of received symbols owned by a SymbolRing */
+struct SymbolBuffer {
+    using C = std::complex<float>;
+
+    /** @brief Index of buffer in its ring */
+    size_t index;
+
+    /** @brief Symbols */
+    std::vector<C> symbols;
+
+    /** @brief Return pointer to symbols */
+    const C *data(void) const
+    {
+        return symbols.data();
+    }
+
+    /** @brief Return number of symbols */
+    size_t size(void) const
+    {
+        return symbols.size();
+    }
+};
+
+/** @brief A fixed pool of reusable symbol buffers */
+/** Demodulators copy a frame's symbols into a buffer acquired from the ring
+ * instead of allocating a fresh vector for every frame. A buffer's storage is
+ * kept when it is returned to the ring, so once every buffer has grown to the
+ * largest frame seen, capturing symbols no longer touches the heap. A handle
+ * keeps its ring alive, so the ring may be replaced while packets still
+ * reference buffers from it.
+ */
+class SymbolRing : public std::enable_shared_from_this<SymbolRing> {
+public:
+    using C = std::complex<float>;
+
+    /** @brief Return a buffer to its ring */
+    struct Release {
+        std::shared_ptr<SymbolRing> ring;
+
+        void operator()(SymbolBuffer *buf) const
+        {
+            size_t index = buf->index;
+
+            ring->free_.try_push(index);
+        }
+    };
+
+    /** @brief A handle to a buffer in a ring */
+    using Handle = std::unique_ptr<SymbolBuffer, Release>;
+
+    /** @brief Create a ring
+     * @param n Number of buffers
+     */
+    static std::shared_ptr<SymbolRing> create(size_t n)
+    {
+        return std::shared_ptr<SymbolRing>(new SymbolRing(n));
+    }
+
+    SymbolRing() = delete;
+    SymbolRing(const SymbolRing&) = delete;
+    SymbolRing(SymbolRing&&) = delete;
+
+    SymbolRing& operator=(const SymbolRing&) = delete;
+    SymbolRing& operator=(SymbolRing&&) = delete;
+
+    /** @brief Return number of buffers in ring */
+    size_t size(void) const
+    {
+        return bufs_.size();
+    }
+
+    /** @brief Copy symbols into a buffer from the ring
+     * @param syms Symbols
+     * @param n Number of symbols
+     * @return A handle to the buffer, or nullptr if every buffer is in use
+     */
+    Handle capture(const C *syms, size_t n)
+    {
+        size_t index;
+
+        if (!free_.try_pop(index))
+            return Handle(nullptr, Release{nullptr});
+
+        SymbolBuffer &buf = bufs_[index];
+
+        buf.symbols.assign(syms, syms + n);
+
+        return Handle(&buf, Release{shared_from_this()});
+    }
+
+protected:
+    explicit SymbolRing(size_t n)
+      : bufs_(n)
+      , free_(n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            size_t index = i;
+
+            bufs_[i].index = i;
+            free_.try_push(index);
+        }
+    }
+
+    /** @brief Buffers */
+    std::vector<SymbolBuffer> bufs_;
+
+    /** @brief Indices of free buffers */
+    LockFreeQueue<size_t> free_;
+};
+
+#endif /* SYMBOLRING_HH_ */
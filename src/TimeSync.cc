@@ -0,0 +1,136 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "TimeSync.hh"
+
+/** @brief Return seconds since the WallClock's time zero */
+static double sinceTimeZero(const MonoClock::time_point &t)
+{
+    WallClock clock;
+
+    return (t - clock.getTimeZero()).get_real_secs();
+}
+
+TimeSync::TimeSync(size_t capacity)
+  : pairs_(std::max(capacity, static_cast<size_t>(2)))
+  , seqs_(pairs_.size())
+  , head_(0)
+  , n_(0)
+  , mx_(0)
+  , my_(0)
+  , cxx_(0)
+  , cxy_(0)
+  , cyy_(0)
+{
+}
+
+TimeSync::PairMap TimeSync::getPairs(void) const
+{
+    PairMap pairs;
+
+    pairs.reserve(n_);
+
+    for (size_t i = 0; i < n_; ++i) {
+        size_t j = (head_ + i) % pairs_.size();
+
+        pairs.insert_or_assign(seqs_[j], pairs_[j]);
+    }
+
+    return pairs;
+}
+
+std::shared_ptr<const TimeSync::Estimate>
+TimeSync::update(TimestampSeq tseq,
+                 const MonoClock::time_point &t_sent,
+                 const MonoClock::time_point &t_recv)
+{
+    // Evict the oldest pair if the ring is full
+    if (n_ == pairs_.size()) {
+        const auto &[old_sent, old_recv] = pairs_[head_];
+
+        remove(sinceTimeZero(old_sent), sinceTimeZero(old_recv));
+        head_ = (head_ + 1) % pairs_.size();
+    }
+
+    size_t i = (head_ + n_) % pairs_.size();
+
+    pairs_[i] = std::make_pair(t_sent, t_recv);
+    seqs_[i] = tseq;
+    add(sinceTimeZero(t_sent), sinceTimeZero(t_recv));
+
+    auto est = std::make_shared<Estimate>();
+
+    est->n = n_;
+
+    // With fewer than two distinct send times there is no skew to fit, so
+    // assume the clocks run at the same rate.
+    if (n_ < 2 || cxx_ <= 0) {
+        est->skew = 1.0;
+        est->offset = my_ - mx_;
+        est->residual = 0;
+    } else {
+        est->skew = cxy_/cxx_;
+        est->offset = my_ - est->skew*mx_;
+        est->residual = sqrt(std::max(cyy_ - est->skew*cxy_, 0.0)/n_);
+    }
+
+    std::shared_ptr<const Estimate> result(std::move(est));
+
+    std::atomic_store_explicit(&estimate_, result, std::memory_order_release);
+
+    return result;
+}
+
+void TimeSync::reset(void)
+{
+    head_ = 0;
+    n_ = 0;
+    mx_ = 0;
+    my_ = 0;
+    cxx_ = 0;
+    cxy_ = 0;
+    cyy_ = 0;
+
+    std::atomic_store_explicit(&estimate_,
+                               std::shared_ptr<const Estimate>(),
+                               std::memory_order_release);
+}
+
+void TimeSync::add(double x, double y)
+{
+    // Welford's update, extended to the cross term
+    ++n_;
+
+    double dx = x - mx_;
+    double dy = y - my_;
+
+    mx_ += dx/n_;
+    my_ += dy/n_;
+    cxx_ += dx*(x - mx_);
+    cxy_ += dx*(y - my_);
+    cyy_ += dy*(y - my_);
+}
+
+void TimeSync::remove(double x, double y)
+{
+    if (n_ == 1) {
+        n_ = 0;
+        mx_ = my_ = cxx_ = cxy_ = cyy_ = 0;
+        return;
+    }
+
+    // Exact inverse of add
+    double mx_old = (n_*mx_ - x)/(n_ - 1);
+    double my_old = (n_*my_ - y)/(n_ - 1);
+
+    cxx_ -= (x - mx_old)*(x - mx_);
+    cxy_ -= (x - mx_old)*(y - my_);
+    cyy_ -= (y - my_old)*(y - my_);
+    mx_ = mx_old;
+    my_ = my_old;
+    --n_;
+}
@@ -0,0 +1,127 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef TIMESYNC_HH_
+#define TIMESYNC_HH_
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Clock.hh"
+#include "Packet.hh"
+
+/** @brief Estimate clock offset and skew from pairs of timestamps */
+/** Each pair is the time at which a node sent a timestamped packet, according
+ * to the sender's clock, and the time at which it was received, according to
+ * the receiver's clock. The estimator keeps the most recent pairs in a
+ * fixed-size ring and maintains a least-squares fit
+ *
+ *     t_recv - t0 = offset + skew*(t_sent - t0)
+ *
+ * over the ring, where t0 is the WallClock's time zero, so the fit can be
+ * handed directly to WallClock::setTimeOffsetAndSkew. The fit
+ * is updated incrementally as pairs enter and leave the ring, and each update
+ * publishes a new immutable estimate with a single atomic store, so readers
+ * never take the lock that protects the ring.
+ *
+ * Updates must be serialized by the caller.
+ */
+class TimeSync {
+public:
+    /** @brief Default number of timestamp pairs used in the fit */
+    static constexpr size_t kDefaultCapacity = 64;
+
+    /** @brief A (sent, received) timestamp pair */
+    using Pair = std::pair<MonoClock::time_point, MonoClock::time_point>;
+
+    /** @brief Map from timestamp sequence number to timestamp pair */
+    using PairMap = std::unordered_map<TimestampSeq, Pair>;
+
+    /** @brief A clock estimate */
+    struct Estimate {
+        /** @brief Number of timestamp pairs used in the fit */
+        size_t n;
+
+        /** @brief Clock offset (sec) */
+        double offset;
+
+        /** @brief Clock skew */
+        double skew;
+
+        /** @brief RMS residual of the fit (sec) */
+        double residual;
+    };
+
+    explicit TimeSync(size_t capacity = kDefaultCapacity);
+
+    TimeSync(const TimeSync&) = delete;
+    TimeSync(TimeSync&&) = delete;
+
+    TimeSync& operator=(const TimeSync&) = delete;
+    TimeSync& operator=(TimeSync&&) = delete;
+
+    /** @brief Get the most recent estimate */
+    /** @return The estimate, or nullptr if no timestamp pairs have been seen.
+     */
+    std::shared_ptr<const Estimate> getEstimate(void) const
+    {
+        return std::atomic_load_explicit(&estimate_, std::memory_order_acquire);
+    }
+
+    /** @brief Get the timestamp pairs currently in the ring */
+    PairMap getPairs(void) const;
+
+    /** @brief Add a timestamp pair and publish a new estimate */
+    /** @param tseq Timestamp sequence number of the pair
+     * @param t_sent Time the timestamp was sent
+     * @param t_recv Time the timestamp was received
+     * @return The new estimate
+     */
+    std::shared_ptr<const Estimate> update(TimestampSeq tseq,
+                                           const MonoClock::time_point &t_sent,
+                                           const MonoClock::time_point &t_recv);
+
+    /** @brief Discard all timestamp pairs */
+    void reset(void);
+
+protected:
+    /** @brief Timestamp pairs */
+    std::vector<Pair> pairs_;
+
+    /** @brief Timestamp sequence numbers of pairs */
+    std::vector<TimestampSeq> seqs_;
+
+    /** @brief Index of oldest pair */
+    size_t head_;
+
+    /** @brief Number of pairs in ring */
+    size_t n_;
+
+    /** @brief Mean of sent times (sec since t0) */
+    double mx_;
+
+    /** @brief Mean of received times (sec since t0) */
+    double my_;
+
+    /** @brief Sum of squared deviations of sent times */
+    double cxx_;
+
+    /** @brief Sum of products of deviations of sent and received times */
+    double cxy_;
+
+    /** @brief Sum of squared deviations of received times */
+    double cyy_;
+
+    /** @brief Most recent estimate */
+    std::shared_ptr<const Estimate> estimate_;
+
+    /** @brief Add a point to the fit */
+    void add(double x, double y);
+
+    /** @brief Remove a point from the fit */
+    void remove(double x, double y);
+};
+
+#endif /* TIMESYNC_HH_ */
@@ -4,6 +4,7 @@
 #include <algorithm>
 
 #include "TimerQueue.hh"
+#include "VirtualTime.hh"
 #include "util/threads.hh"
 
 TimerQueue::TimerQueue() : done_(true)
@@ -58,7 +59,7 @@ void TimerQueue::run(void)
 
     std::unique_lock<std::mutex> lock(mutex_);
 
-    while (!timer_queue_.empty() && (timer_queue_.top().deadline < now)) {
+    while (!timer_queue_.empty() && !(now < timer_queue_.top().deadline)) {
         Timer &t = timer_queue_.top();
 
         timer_queue_.pop();
@@ -74,7 +75,7 @@ void TimerQueue::start(void)
     if (done_) {
         done_ = false;
 
-        timer_worker_thread_ = std::thread(&TimerQueue::timer_worker, this);
+        timer_worker_thread_ = spawnThread("timer", &TimerQueue::timer_worker, this);
     }
 }
 
@@ -92,15 +93,19 @@ void TimerQueue::stop(void)
 
 void TimerQueue::timer_worker(void)
 {
+    VirtualTime::Participant participant;
+
     makeThreadWakeable();
 
     while (!done_) {
         time_type now = MonoClock::now();
 
-        // Run all pending timers
+        // Run all pending timers. A timer whose deadline is exactly now is
+        // due: under virtual time, doze wakes us exactly at the deadline, and
+        // time cannot advance again until we run the timer.
         std::unique_lock<std::mutex> lock(mutex_);
 
-        while (!timer_queue_.empty() && (timer_queue_.top().deadline < now)) {
+        while (!timer_queue_.empty() && !(now < timer_queue_.top().deadline)) {
             Timer &t = timer_queue_.top();
 
             timer_queue_.pop();
@@ -113,10 +118,15 @@ void TimerQueue::timer_worker(void)
         // Sleep until our either our next timer fires or we are awoken by a
         // signal.
         if (timer_queue_.empty()) {
-            BlockSignal block(SIGWAKE);
-
-            lock.unlock();
-            block.unblockAndPause();
+            if (VirtualTime::enabled()) {
+                lock.unlock();
+                VirtualTime::sleep();
+            } else {
+                BlockSignal block(SIGWAKE);
+
+                lock.unlock();
+                block.unblockAndPause();
+            }
         } else {
             double delta = (timer_queue_.top().deadline - now).get_real_secs();
 
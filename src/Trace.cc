@@ -0,0 +1,349 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Trace.hh"
+
+std::atomic<uint64_t> Tracer::deadline_(0);
+
+/** @brief A thread's ring of completed spans */
+struct TraceBuffer {
+    TraceBuffer()
+      : tid(0)
+      , records(Tracer::kRecordsPerThread)
+      , first(0)
+      , head(0)
+    {
+    }
+
+    /** @brief Hand the buffer to the calling thread */
+    /** Must be called with the registry lock held. */
+    void acquire(void)
+    {
+        char buf[16];
+
+        tid = syscall(SYS_gettid);
+
+        if (pthread_getname_np(pthread_self(), buf, sizeof(buf)) == 0)
+            name = buf;
+        else
+            name.clear();
+
+        // Records written by a previous owner are still in the ring, so skip
+        // them. Record indices keep increasing across owners, so a previous
+        // owner's record can never be mistaken for ours.
+        first = head.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Thread ID */
+    pid_t tid;
+
+    /** @brief Thread name */
+    std::string name;
+
+    /** @brief Records. Record i is stored in slot i % kRecordsPerThread. */
+    std::vector<Tracer::Record> records;
+
+    /** @brief Index of first record written by the current owner */
+    uint64_t first;
+
+    /** @brief Number of records ever written. Only the owning thread writes. */
+    /** This doubles as the sequence number for the whole ring: once head is
+     * h, the owning thread may be overwriting record h - kRecordsPerThread,
+     * so a reader must discard any record it copied whose index is no greater
+     * than that.
+     */
+    std::atomic<uint64_t> head;
+};
+
+/** @brief Span names and per-thread buffers */
+struct TraceRegistry {
+    std::mutex mutex;
+
+    /** @brief Span names, indexed by span ID */
+    std::vector<std::string> names;
+
+    /** @brief Map from span name to span ID */
+    std::unordered_map<std::string, uint32_t> ids;
+
+    /** @brief Per-thread buffers */
+    std::vector<TraceBuffer*> buffers;
+
+    /** @brief Buffers whose threads have exited */
+    std::vector<TraceBuffer*> free_buffers;
+
+    /** @brief Tick count when tracing started */
+    uint64_t start_ticks = 0;
+
+    /** @brief Clock time when tracing started */
+    std::chrono::steady_clock::time_point start_time;
+};
+
+static TraceRegistry &traceRegistry(void)
+{
+    // The registry and buffers are never freed, because threads may record
+    // spans while static objects are destroyed.
+    static TraceRegistry *registry = new TraceRegistry();
+
+    return *registry;
+}
+
+/** @brief Returns a thread's buffer to the registry when the thread exits */
+struct TraceBufferOwner {
+    ~TraceBufferOwner()
+    {
+        if (buf) {
+            TraceRegistry               &reg = traceRegistry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+
+            reg.free_buffers.push_back(buf);
+        }
+    }
+
+    /** @brief The owned buffer */
+    TraceBuffer *buf = nullptr;
+};
+
+/** @brief The calling thread's buffer */
+/** This is a plain pointer so that recording a span does not go through a
+ * thread-local wrapper; trace_buffer_owner is only touched when the buffer is
+ * allocated.
+ */
+static thread_local TraceBuffer *trace_buffer = nullptr;
+
+/** @brief Owner of the calling thread's buffer */
+static thread_local TraceBufferOwner trace_buffer_owner;
+
+uint32_t Tracer::registerSpan(const char *name)
+{
+    TraceRegistry               &reg = traceRegistry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto                        it = reg.ids.find(name);
+
+    if (it != reg.ids.end())
+        return it->second;
+
+    uint32_t id = reg.names.size();
+
+    reg.names.push_back(name);
+    reg.ids.emplace(name, id);
+
+    return id;
+}
+
+void Tracer::record(uint64_t start, uint64_t end, uint32_t span, int64_t arg)
+{
+    TraceBuffer *buf = trace_buffer;
+
+    if (buf == nullptr) {
+        TraceRegistry               &reg = traceRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+
+        if (!reg.free_buffers.empty()) {
+            buf = reg.free_buffers.back();
+            reg.free_buffers.pop_back();
+        } else {
+            buf = new TraceBuffer();
+            reg.buffers.push_back(buf);
+        }
+
+        buf->acquire();
+        trace_buffer = trace_buffer_owner.buf = buf;
+    }
+
+    uint64_t head = buf->head.load(std::memory_order_relaxed);
+
+    // Order the store of head by the previous record before the overwrite of
+    // the slot below. Pairs with the acquire fence in dump. On x86 this costs
+    // nothing at run time.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    buf->records[head % kRecordsPerThread] = Record{start, end, span, arg};
+    buf->head.store(head + 1, std::memory_order_release);
+}
+
+/** @brief Measure tick rate (ticks per second) between two instants */
+static double tickRate(uint64_t ticks0,
+                       std::chrono::steady_clock::time_point t0,
+                       uint64_t ticks1,
+                       std::chrono::steady_clock::time_point t1)
+{
+    return (ticks1 - ticks0)/std::chrono::duration<double>(t1 - t0).count();
+}
+
+void Tracer::start(double duration)
+{
+    TraceRegistry &reg = traceRegistry();
+    uint64_t       ticks0 = now();
+    auto           t0 = std::chrono::steady_clock::now();
+
+    // Calibrate the tick counter so we can convert the duration to ticks. The
+    // rate used for the dump is re-measured over the whole trace.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    uint64_t ticks1 = now();
+    auto     t1 = std::chrono::steady_clock::now();
+    double   rate = tickRate(ticks0, t0, ticks1, t1);
+
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+
+        reg.start_ticks = ticks1;
+        reg.start_time = t1;
+    }
+
+    deadline_.store(ticks1 + static_cast<uint64_t>(duration*rate), std::memory_order_relaxed);
+}
+
+void Tracer::stop(void)
+{
+    deadline_.store(0, std::memory_order_relaxed);
+}
+
+/** @brief Write a string as a JSON string literal */
+static void writeJSONString(std::ostream &os, const std::string &s)
+{
+    os << '"';
+
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            os << ' ';
+        else
+            os << c;
+    }
+
+    os << '"';
+}
+
+void Tracer::dump(const std::string &path)
+{
+    /** @brief A buffer and its owner at the time of the dump */
+    struct BufferSnapshot {
+        /** @brief The buffer */
+        const TraceBuffer *buf;
+
+        /** @brief Owner's thread ID */
+        pid_t tid;
+
+        /** @brief Owner's thread name */
+        std::string name;
+
+        /** @brief Index of first record written by the owner */
+        uint64_t first;
+
+        /** @brief Number of records written when the snapshot was taken */
+        uint64_t head;
+    };
+
+    TraceRegistry                         &reg = traceRegistry();
+    std::vector<BufferSnapshot>           snapshots;
+    std::vector<std::string>              names;
+    uint64_t                              start_ticks;
+    std::chrono::steady_clock::time_point start_time;
+
+    // Copy everything we need under the lock, and write the file after
+    // releasing it, so that threads taking their first span or registering a
+    // span never wait on file I/O. Buffers are never freed, so the pointers
+    // stay valid. A buffer may be handed to a new thread after we release the
+    // lock, but the new owner only writes records at or after the head we
+    // copy here, so every record we read belongs to the owner we copied.
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+
+        if (reg.start_ticks == 0)
+            throw std::runtime_error("Tracing has not been started");
+
+        for (auto buf : reg.buffers) {
+            // Buffers that have never been handed to a thread hold no records
+            if (buf->tid == 0)
+                continue;
+
+            snapshots.push_back({buf,
+                                 buf->tid,
+                                 buf->name,
+                                 buf->first,
+                                 buf->head.load(std::memory_order_acquire)});
+        }
+
+        names = reg.names;
+        start_ticks = reg.start_ticks;
+        start_time = reg.start_time;
+    }
+
+    uint64_t ticks = now();
+    auto     t = std::chrono::steady_clock::now();
+    double   rate = tickRate(start_ticks, start_time, ticks, t);
+    pid_t    pid = getpid();
+
+    std::ofstream os(path, std::ios::trunc);
+
+    if (!os)
+        throw std::runtime_error(strerror(errno));
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool                first = true;
+    std::vector<Record> recs;
+
+    for (auto &snap : snapshots) {
+        uint64_t head = snap.head;
+        uint64_t tail = std::max(snap.first, head > kRecordsPerThread ? head - kRecordsPerThread : 0);
+
+        os << (first ? "" : ",")
+           << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+           << ",\"tid\":" << snap.tid
+           << ",\"args\":{\"name\":";
+        writeJSONString(os, snap.name.empty() ? std::to_string(snap.tid) : snap.name);
+        os << "}}";
+
+        first = false;
+
+        // Copy the records from oldest to newest. The owning thread may keep
+        // writing while we copy, so once we are done, discard every record
+        // whose slot it may have overwritten in the meantime.
+        recs.assign(snap.buf->records.begin() + tail % kRecordsPerThread,
+                    snap.buf->records.begin() + std::min(tail % kRecordsPerThread + (head - tail), kRecordsPerThread));
+        recs.insert(recs.end(),
+                    snap.buf->records.begin(),
+                    snap.buf->records.begin() + (head - tail - recs.size()));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint64_t now_head = snap.buf->head.load(std::memory_order_relaxed);
+        uint64_t valid = now_head >= kRecordsPerThread ? now_head - kRecordsPerThread + 1 : 0;
+
+        for (uint64_t i = std::max(tail, valid); i < head; ++i) {
+            const Record &rec = recs[i - tail];
+
+            if (rec.start < start_ticks || rec.span >= names.size())
+                continue;
+
+            os << ",\n{\"ph\":\"X\",\"name\":";
+            writeJSONString(os, names[rec.span]);
+            os << ",\"pid\":" << pid
+               << ",\"tid\":" << snap.tid
+               << ",\"ts\":" << 1e6*(rec.start - start_ticks)/rate
+               << ",\"dur\":" << 1e6*(rec.end - rec.start)/rate
+               << ",\"args\":{\"arg\":" << rec.arg << "}}";
+        }
+    }
+
+    os << "\n]}\n";
+
+    if (!os.flush())
+        throw std::runtime_error(strerror(errno));
+}
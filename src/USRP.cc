@@ -8,8 +8,10 @@
 
 #include "logging.hh"
 #include "Clock.hh"
+#include "Trace.hh"
 #include "USRP.hh"
 #include "util/capabilities.hh"
+#include "util/threads.hh"
 
 USRP::USRP(const std::string& addr,
            const std::optional<std::string>& tx_subdev,
@@ -21,6 +23,8 @@ USRP::USRP(const std::string& addr,
            float rx_gain)
   : auto_dc_offset_(false)
   , done_(false)
+  , tx_underflow_metric_(metrics(), "dragonradio_usrp_tx_underflow_total", "TX underflows")
+  , tx_late_metric_(metrics(), "dragonradio_usrp_tx_late_total", "Late TX packets")
 {
     RaiseCaps caps({CAP_SYS_NICE});
 
@@ -75,7 +79,7 @@ USRP::USRP(const std::string& addr,
     }
 
     // Start thread that receives TX errors
-    tx_error_thread_ = std::thread(&USRP::txErrorWorker, this);
+    tx_error_thread_ = spawnThread("usrp_tx_error", &USRP::txErrorWorker, this);
 }
 
 USRP::~USRP()
@@ -150,6 +154,8 @@ void USRP::burstTX(std::optional<MonoClock::time_point> when_,
                    bool end_of_burst,
                    std::list<std::shared_ptr<IQBuf>>& bufs)
 {
+    TRACE_SPAN_ARG("usrp_burst_tx", bufs.size());
+
     uhd::tx_metadata_t tx_md; // TX metadata for UHD
     size_t             n;     // Size of next send
 
@@ -230,6 +236,8 @@ void USRP::stopRXStream(void)
 
 bool USRP::burstRX(MonoClock::time_point t_start, size_t nsamps, IQBuf& buf)
 {
+    TRACE_SPAN_ARG("usrp_burst_rx", nsamps);
+
     uhd::time_spec_t t_end = t_start.t + static_cast<double>(nsamps)/rx_rate_;
     size_t           ndelivered = 0;
 
@@ -251,7 +259,7 @@ bool USRP::burstRX(MonoClock::time_point t_start, size_t nsamps, IQBuf& buf)
 
             if (rx_md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT) {
                 // Mark the buffer as complete.
-                buf.complete.store(true, std::memory_order_release);
+                buf.markComplete();
 
                 // We're done, and we've failed
                 return false;
@@ -282,15 +290,15 @@ bool USRP::burstRX(MonoClock::time_point t_start, size_t nsamps, IQBuf& buf)
 
             // One last store to the atomic nsamples field to ensure write
             // ordering.
-            buf.nsamples.store(ndelivered, std::memory_order_release);
+            buf.publishSamples(ndelivered);
 
             // Mark the buffer as complete.
-            buf.complete.store(true, std::memory_order_release);
+            buf.markComplete();
 
             // We're done
             return true;
         } else {
-            buf.nsamples.store(ndelivered, std::memory_order_release);
+            buf.publishSamples(ndelivered);
 
             // It's also possible that we don't have enough buffer space to hold
             // upcoming samples if RX started before we expected it to, in which
@@ -308,7 +316,7 @@ bool USRP::burstRX(MonoClock::time_point t_start, size_t nsamps, IQBuf& buf)
                     rx_max_samps_);
 
                 // Mark the buffer as complete.
-                buf.complete.store(true, std::memory_order_release);
+                buf.markComplete();
 
                 // We're done
                 return true;
@@ -354,6 +362,7 @@ void USRP::txErrorWorker(void)
                 case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW:
                     msg = "TX error: an internal send buffer has emptied";
                     tx_underflow_count_.fetch_add(1, std::memory_order_relaxed);
+                    tx_underflow_metric_.inc();
                     break;
 
                 case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR:
@@ -363,11 +372,13 @@ void USRP::txErrorWorker(void)
                 case uhd::async_metadata_t::EVENT_CODE_TIME_ERROR:
                     msg = "TX error: packet had time that was late";
                     tx_late_count_.fetch_add(1, std::memory_order_relaxed);
+                    tx_late_metric_.inc();
                     break;
 
                 case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET:
                     msg = "TX error: underflow occurred inside a packet";
                     tx_underflow_count_.fetch_add(1, std::memory_order_relaxed);
+                    tx_underflow_metric_.inc();
                     break;
 
                 case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST:
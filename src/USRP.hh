@@ -14,6 +14,7 @@
 #include "logging.hh"
 #include "Clock.hh"
 #include "IQBuffer.hh"
+#include "stats/Metrics.hh"
 
 /** @brief A USRP. */
 class USRP
@@ -293,6 +294,20 @@ public:
         return tx_late_count_.exchange(0, std::memory_order_relaxed);
     }
 
+    /** @brief Get the total number of TX underflow errors */
+    /** Unlike getTXUnderflowCount, this does not reset the counter. */
+    uint64_t getTXUnderflowTotal(void) const
+    {
+        return tx_underflow_metric_.value();
+    }
+
+    /** @brief Get the total number of late TX packet errors */
+    /** Unlike getTXLateCount, this does not reset the counter. */
+    uint64_t getTXLateTotal(void) const
+    {
+        return tx_late_metric_.value();
+    }
+
     /** @brief Stop processing data. */
     void stop(void);
 
@@ -346,6 +361,12 @@ private:
     /** @brief TX late count. */
     std::atomic<uint64_t> tx_late_count_;
 
+    /** @brief Exported TX underflow counter. */
+    Counter tx_underflow_metric_;
+
+    /** @brief Exported TX late counter. */
+    Counter tx_late_metric_;
+
     /** @brief Thread that receives TX errors. */
     std::thread tx_error_thread_;
 
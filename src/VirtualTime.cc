@@ -0,0 +1,248 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "VirtualTime.hh"
+
+std::atomic<bool> VirtualTime::enabled_(false);
+
+namespace {
+
+/** @brief A thread sleeping in virtual time */
+struct Sleeper {
+    /** @brief The sleeping thread */
+    std::thread::id id;
+
+    /** @brief Wake-up time */
+    uhd::time_spec_t deadline;
+
+    /** @brief Flag that is true if the thread sleeps until woken */
+    bool forever;
+
+    /** @brief Flag that is true if the sleeping thread is a participant */
+    bool participant;
+
+    /** @brief Flag that is true once the thread may run again */
+    bool ready;
+
+    /** @brief Flag that is true if the thread was woken early */
+    bool woken;
+};
+
+/** @brief Virtual time scheduler state */
+struct Scheduler {
+    std::mutex mutex;
+
+    /** @brief Condition variable signaled when sleepers are released or time
+     * advances
+     */
+    std::condition_variable cond;
+
+    /** @brief Current virtual time */
+    uhd::time_spec_t now;
+
+    /** @brief Time past which virtual time may not advance */
+    uhd::time_spec_t horizon;
+
+    /** @brief Sleeping threads */
+    std::vector<Sleeper*> sleepers;
+
+    /** @brief Threads woken while they were not sleeping */
+    std::unordered_set<std::thread::id> pending;
+
+    /** @brief Number of participants */
+    unsigned nparticipants = 0;
+
+    /** @brief Number of participants that are asleep and not yet released */
+    unsigned nasleep = 0;
+
+    /** @brief Release a sleeper */
+    void release(Sleeper &s)
+    {
+        s.ready = true;
+
+        if (s.participant)
+            --nasleep;
+    }
+
+    /** @brief Advance time if every participant is asleep */
+    /** Time advances to the earliest wake-up, bounded by the horizon, and
+     * every thread whose wake-up time has arrived is released.
+     */
+    void advance(void)
+    {
+        if (nasleep < nparticipants)
+            return;
+
+        uhd::time_spec_t next = horizon;
+
+        for (auto s : sleepers) {
+            if (!s->ready && !s->forever && s->deadline < next)
+                next = s->deadline;
+        }
+
+        if (next > now)
+            now = next;
+
+        for (auto s : sleepers) {
+            if (!s->ready && !s->forever && !(s->deadline > now))
+                release(*s);
+        }
+
+        cond.notify_all();
+    }
+};
+
+/** @brief Flag that is true if the calling thread is a participant */
+thread_local bool is_participant = false;
+
+}
+
+static Scheduler &scheduler(void)
+{
+    // The scheduler is never destroyed, because participants may still be
+    // running while static objects are destroyed.
+    static Scheduler *sched = new Scheduler();
+
+    return *sched;
+}
+
+void VirtualTime::enable(const uhd::time_spec_t &t0)
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    sched.now = t0;
+    sched.horizon = t0;
+    sched.pending.clear();
+
+    enabled_.store(true, std::memory_order_release);
+}
+
+void VirtualTime::disable(void)
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    enabled_.store(false, std::memory_order_release);
+
+    for (auto s : sched.sleepers) {
+        if (!s->ready) {
+            s->woken = true;
+            sched.release(*s);
+        }
+    }
+
+    sched.cond.notify_all();
+}
+
+uhd::time_spec_t VirtualTime::now(void)
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    return sched.now;
+}
+
+/** @brief Sleep until released
+ * @param deadline Wake-up time
+ * @param forever true if the thread sleeps until woken
+ * @return false if the thread was woken early
+ */
+static bool sleepUntil(const uhd::time_spec_t &deadline, bool forever)
+{
+    Scheduler                    &sched = scheduler();
+    std::unique_lock<std::mutex> lock(sched.mutex);
+    auto                         id = std::this_thread::get_id();
+
+    // A wake that arrived while we were running interrupts this sleep
+    if (sched.pending.erase(id) != 0)
+        return false;
+
+    if (!forever && !(deadline > sched.now))
+        return true;
+
+    if (!VirtualTime::enabled())
+        return false;
+
+    Sleeper s{id, deadline, forever, is_participant, false, false};
+
+    sched.sleepers.push_back(&s);
+
+    if (s.participant)
+        ++sched.nasleep;
+
+    sched.advance();
+    sched.cond.wait(lock, [&]{ return s.ready; });
+    sched.sleepers.erase(std::find(sched.sleepers.begin(), sched.sleepers.end(), &s));
+
+    return !s.woken;
+}
+
+bool VirtualTime::sleepUntil(const uhd::time_spec_t &t)
+{
+    return ::sleepUntil(t, false);
+}
+
+bool VirtualTime::sleepFor(double secs)
+{
+    return ::sleepUntil(now() + secs, false);
+}
+
+bool VirtualTime::sleep(void)
+{
+    return ::sleepUntil(uhd::time_spec_t(0.0), true);
+}
+
+void VirtualTime::wake(std::thread::id id)
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    for (auto s : sched.sleepers) {
+        if (s->id == id && !s->ready) {
+            s->woken = true;
+            sched.release(*s);
+            sched.cond.notify_all();
+            return;
+        }
+    }
+
+    sched.pending.insert(id);
+}
+
+void VirtualTime::runUntil(const uhd::time_spec_t &t)
+{
+    Scheduler                    &sched = scheduler();
+    std::unique_lock<std::mutex> lock(sched.mutex);
+
+    if (t > sched.horizon)
+        sched.horizon = t;
+
+    sched.advance();
+    sched.cond.wait(lock, [&]{ return !enabled() || !(t > sched.now); });
+}
+
+VirtualTime::Participant::Participant()
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    is_participant = true;
+    ++sched.nparticipants;
+}
+
+VirtualTime::Participant::~Participant()
+{
+    Scheduler                   &sched = scheduler();
+    std::lock_guard<std::mutex> lock(sched.mutex);
+
+    is_participant = false;
+    --sched.nparticipants;
+    sched.advance();
+}
@@ -0,0 +1,102 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef VIRTUALTIME_HH_
+#define VIRTUALTIME_HH_
+
+#include <atomic>
+#include <thread>
+
+#include <uhd/types/time_spec.hpp>
+
+/** @brief Discrete-event virtual time */
+/** When virtual time is enabled, the clocks report virtual time instead of the
+ * USRP's time, and doze blocks until virtual time reaches the wake-up time
+ * instead of sleeping. Virtual time stands still while any participant is
+ * running. Once every participant is asleep, time jumps directly to the
+ * earliest pending wake-up, so idle periods cost nothing and a scenario runs
+ * as fast as its participants can compute.
+ *
+ * Participants are the threads whose progress defines the simulation, such as
+ * the timer queue. Other threads run freely, but a participant that waits for
+ * them holds virtual time still until they finish. Time never
+ * advances past the horizon set by runUntil, so the driver decides how far a
+ * scenario runs.
+ *
+ * Runs are bounded, but they are not reproducible in general. Threads that
+ * are not participants run in real time, so whenever a participant consumes
+ * their results without waiting for them, for example a packet that a
+ * modulation worker has or has not finished by the time a slot is finalized,
+ * what happens at a given virtual time depends on how fast those threads ran.
+ * Only the sequence of participant wake-ups is fixed.
+ *
+ * There is no simulated radio device. Virtual time and a USRP are mutually
+ * exclusive, which Clock enforces, so the MAC, which requires a USRP, cannot
+ * run under virtual time. Virtual time currently drives the timer queue, and
+ * with it the controller's timers, and nothing else.
+ */
+class VirtualTime {
+public:
+    VirtualTime() = delete;
+
+    /** @brief Return true if virtual time is enabled */
+    static bool enabled(void)
+    {
+        return enabled_.load(std::memory_order_acquire);
+    }
+
+    /** @brief Enable virtual time
+     * @param t0 The initial virtual time
+     */
+    /** Virtual time starts paused at t0. Call runUntil to advance it.
+     */
+    static void enable(const uhd::time_spec_t &t0);
+
+    /** @brief Disable virtual time, waking every sleeping thread */
+    static void disable(void);
+
+    /** @brief Get the current virtual time */
+    static uhd::time_spec_t now(void);
+
+    /** @brief Sleep until virtual time t
+     * @return false if the sleeping thread was woken early
+     */
+    static bool sleepUntil(const uhd::time_spec_t &t);
+
+    /** @brief Sleep for secs seconds of virtual time
+     * @return false if the sleeping thread was woken early
+     */
+    static bool sleepFor(double secs);
+
+    /** @brief Sleep until woken
+     * @return false if the sleeping thread was woken
+     */
+    static bool sleep(void);
+
+    /** @brief Wake a thread sleeping in virtual time */
+    /** If the thread is not sleeping, its next sleep returns immediately.
+     */
+    static void wake(std::thread::id id);
+
+    /** @brief Allow virtual time to advance to t, and wait until it does */
+    static void runUntil(const uhd::time_spec_t &t);
+
+    /** @brief Mark the calling thread as a participant for its lifetime */
+    class Participant {
+    public:
+        Participant();
+        ~Participant();
+
+        Participant(const Participant&) = delete;
+        Participant(Participant&&) = delete;
+
+        Participant& operator=(const Participant&) = delete;
+        Participant& operator=(Participant&&) = delete;
+    };
+
+private:
+    /** @brief Flag that is true when virtual time is enabled */
+    static std::atomic<bool> enabled_;
+};
+
+#endif /* VIRTUALTIME_HH_ */
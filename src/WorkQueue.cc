@@ -2,6 +2,7 @@
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
 #include "WorkQueue.hh"
+#include "util/threads.hh"
 
 WorkQueue work_queue;
 
@@ -19,7 +20,7 @@ WorkQueue::~WorkQueue()
 void WorkQueue::addThreads(unsigned int nthreads)
 {
     for (unsigned int i = 0; i < nthreads; ++i)
-        threads_.emplace_back(&WorkQueue::run_worker, this);
+        threads_.emplace_back(spawnThread("work", &WorkQueue::run_worker, this));
 }
 
 void WorkQueue::stop(void)
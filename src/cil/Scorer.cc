@@ -3,10 +3,15 @@
 
 #include "cil/CIL.hh"
 #include "cil/Scorer.hh"
+#include "logging.hh"
+#include "util/sprintf.hh"
 
 const double kFTSuccessMandate = 0.9;
 
 Scorer::Scorer()
+  : history_(kDefaultHistory)
+  , total_score_metric_(metrics(), "dragonradio_score_total", "Total score of the most recently scored MP")
+  , stale_updates_metric_(metrics(), "dragonradio_score_stale_updates_total", "Per-MP statistics dropped because the MP was older than the scoring history")
 {
 }
 
@@ -22,15 +27,22 @@ void Scorer::setMandates(const MandateMap &mandates)
     // Reset scores
     scores_.clear();
 
-    for (auto mandate = mandates.begin(); mandate != mandates.end(); ++mandate)
-        scores_.insert({mandate->second.flow_uid, Scores()});
+    for (auto mandate = mandates.begin(); mandate != mandates.end(); ++mandate) {
+        FlowUID flow_uid = mandate->second.flow_uid;
+
+        scores_.insert({flow_uid, Scores()});
+        score_metrics_.try_emplace(flow_uid,
+            metrics(),
+            sprintf("dragonradio_score{flow=\"%u\"}", (unsigned) flow_uid),
+            "Score of the most recently scored MP");
+    }
 }
 
 void Scorer::updateSentStatistics(FlowUID flow,
                                   double timestamp,
                                   unsigned first_mp,
-                                  std::vector<size_t> npackets,
-                                  std::vector<size_t> nbytes)
+                                  const MPCounts &npackets,
+                                  const MPCounts &nbytes)
 {
     // Find scores for given flow
     auto it = scores_.find(flow);
@@ -43,27 +55,29 @@ void Scorer::updateSentStatistics(FlowUID flow,
     // The npackets and nbytes arrays should be the same size, but to be safe,
     // take n to be the minimum of the two sizes so we are guaranteed both have
     // at least n entries.
-    unsigned n = std::min(npackets.size(), nbytes.size());
+    unsigned n = std::min(npackets.size, nbytes.size);
+
+    // Data for finalized MP's can no longer change the score
+    unsigned nstale = scores.base_mp > first_mp ? std::min(scores.base_mp - first_mp, n) : 0;
 
-    // Resize scores if we have data for new MP's
-    if (first_mp + n >= scores.size())
-        scores.resize(first_mp + n);
+    if (nstale != 0)
+        dropStaleUpdates(flow, first_mp, nstale);
 
     // Add the new data
-    for (unsigned i = 0; i < n; i++) {
+    for (unsigned i = nstale; i < n; i++) {
         unsigned mp = first_mp + i;
-        Score    &score = scores[mp];
+        Score    *score = scores.get(mp);
 
         // Don't add data with a timestamp that is before the timestamp on the
         // data we have right now.
-        if (timestamp > score.update_timestamp_sent) {
+        if (timestamp > score->update_timestamp_sent) {
             // Make sure this MP is invalidated since we have new data for it.
-            if (mp < scores.invalid_mp)
-                scores.invalid_mp = mp;
+            if (score->npackets_sent != npackets[i] || score->nbytes_sent != nbytes[i])
+                scores.invalidate(mp);
 
-            score.npackets_sent = npackets[i];
-            score.nbytes_sent = nbytes[i];
-            score.update_timestamp_sent = timestamp;
+            score->npackets_sent = npackets[i];
+            score->nbytes_sent = nbytes[i];
+            score->update_timestamp_sent = timestamp;
         }
     }
 }
@@ -71,8 +85,8 @@ void Scorer::updateSentStatistics(FlowUID flow,
 void Scorer::updateReceivedStatistics(FlowUID flow,
                                       double timestamp,
                                       unsigned first_mp,
-                                      std::vector<size_t> npackets,
-                                      std::vector<size_t> nbytes)
+                                      const MPCounts &npackets,
+                                      const MPCounts &nbytes)
 {
     // Just like updateSentStatistics, except for received bytes and packets...
     auto it = scores_.find(flow);
@@ -81,69 +95,178 @@ void Scorer::updateReceivedStatistics(FlowUID flow,
         return;
 
     Scores   &scores = it->second;
-    unsigned n = std::min(npackets.size(), nbytes.size());
+    unsigned n = std::min(npackets.size, nbytes.size);
+    unsigned nstale = scores.base_mp > first_mp ? std::min(scores.base_mp - first_mp, n) : 0;
 
-    if (first_mp + n >= scores.size())
-        scores.resize(first_mp + n);
+    if (nstale != 0)
+        dropStaleUpdates(flow, first_mp, nstale);
 
-    for (unsigned i = 0; i < n; i++) {
+    for (unsigned i = nstale; i < n; i++) {
         unsigned mp = first_mp + i;
-        Score    &score = scores[mp];
+        Score    *score = scores.get(mp);
 
-        if (timestamp > score.update_timestamp_recv) {
-            if (mp < scores.invalid_mp)
-                scores.invalid_mp = mp;
+        if (timestamp > score->update_timestamp_recv) {
+            if (score->npackets_recv != npackets[i] || score->nbytes_recv != nbytes[i])
+                scores.invalidate(mp);
 
-            score.npackets_recv = npackets[i];
-            score.nbytes_recv = nbytes[i];
-            score.update_timestamp_recv = timestamp;
+            score->npackets_recv = npackets[i];
+            score->nbytes_recv = nbytes[i];
+            score->update_timestamp_recv = timestamp;
         }
     }
 }
 
+void Scorer::dropStaleUpdates(FlowUID flow, unsigned first_mp, unsigned n)
+{
+    stale_updates_metric_.inc(n);
+
+    logSystem(LOGDEBUG, "Dropping statistics for %u MP's older than scoring history: flow=%u; first_mp=%u",
+        n,
+        (unsigned) flow,
+        first_mp);
+}
+
 void Scorer::updateScore(unsigned final_mp)
 {
+    unsigned total = 0;
+
     for (auto it = scores_.begin(); it != scores_.end(); ++it) {
         auto mit = mandates_.find(it->first);
 
         if (mit == mandates_.end())
             continue;
 
-        Scores  &scores = it->second;
-        Mandate &mandate = mit->second;
-
-        if (final_mp >= scores.size())
-            scores.resize(final_mp + 1);
-
-        for (unsigned mp = scores.invalid_mp; mp <= final_mp; ++mp) {
-            Score &score = scores[mp];
-
-            if (score.nbytes_sent == 0) {
-                // If no bytes were sent, use value from previous MP
-                if (mp > 0)
-                    score.goal = scores[mp-1].goal;
-            } else if (mandate.max_latency_s) {
-                // This is a throughput mandate
-                score.goal = (score.nbytes_recv*8 >= *mandate.min_throughput_bps) ||
-                             (score.nbytes_recv == score.nbytes_sent);
-            } else {
-                // This is a file transfer mandate
-                score.goal = (static_cast<double>(score.npackets_recv)/score.npackets_sent) >= kFTSuccessMandate;
-            }
-
-            if (score.goal) {
-                if (mp == 0)
-                    score.achieved_duration = 1;
-                else
-                    score.achieved_duration = scores[mp-1].achieved_duration + 1;
-            } else
-                score.achieved_duration = 0;
-
-            score.goal_stable = score.achieved_duration >= mandate.hold_period;
-
-            score.mp_score = score.goal_stable ? mandate.point_value : 0;
+        unsigned mp_score = updateScore(it->second, mit->second, final_mp);
+
+        // Export score
+        auto git = score_metrics_.find(it->first);
+
+        if (git != score_metrics_.end())
+            git->second.set(mp_score);
+
+        total += mp_score;
+    }
+
+    total_score_metric_.set(total);
+}
+
+unsigned Scorer::updateScore(Scores &scores, const Mandate &mandate, unsigned final_mp)
+{
+    // All MP's up to final_mp have already been finalized
+    if (final_mp < scores.base_mp)
+        return 0;
+
+    scores.get(final_mp);
+
+    unsigned mp = std::max(std::min(scores.invalid_mp, scores.scored_mp), scores.base_mp);
+
+    while (mp <= final_mp) {
+        Score &score = scores[mp - scores.base_mp];
+        bool  prev_goal;
+        bool  goal = score.goal;
+        unsigned prev_achieved_duration;
+
+        if (mp == 0) {
+            prev_goal = false;
+            prev_achieved_duration = 0;
+        } else if (mp == scores.base_mp) {
+            prev_goal = scores.finalized_goal;
+            prev_achieved_duration = scores.finalized_achieved_duration;
+        } else {
+            const Score &prev = scores[mp - scores.base_mp - 1];
+
+            prev_goal = prev.goal;
+            prev_achieved_duration = prev.achieved_duration;
         }
 
-        scores.invalid_mp = final_mp + 1;
+        if (score.nbytes_sent == 0) {
+            // If no bytes were sent, use value from previous MP
+            if (mp > 0)
+                goal = prev_goal;
+        } else if (mandate.max_latency_s) {
+            // This is a throughput mandate
+            goal = (score.nbytes_recv*8 >= *mandate.min_throughput_bps) ||
+                   (score.nbytes_recv == score.nbytes_sent);
+        } else {
+            // This is a file transfer mandate
+            goal = (static_cast<double>(score.npackets_recv)/score.npackets_sent) >= kFTSuccessMandate;
+        }
+
+        unsigned achieved_duration;
+
+        if (goal)
+            achieved_duration = mp == 0 ? 1 : prev_achieved_duration + 1;
+        else
+            achieved_duration = 0;
+
+        bool     goal_stable = achieved_duration >= mandate.hold_period;
+        unsigned mp_score = goal_stable ? mandate.point_value : 0;
+        bool     unchanged = mp < scores.scored_mp &&
+                             goal == score.goal &&
+                             achieved_duration == score.achieved_duration;
+
+        score.goal = goal;
+        score.achieved_duration = achieved_duration;
+        score.goal_stable = goal_stable;
+        score.mp_score = mp_score;
+
+        // If this MP has no new data and scored exactly as before, the
+        // following MP's that have already been scored will also score exactly
+        // as before, so skip to the first MP that has not yet been scored.
+        if (unchanged && mp > scores.dirty_mp)
+            mp = std::min(scores.scored_mp, final_mp + 1);
+        else
+            ++mp;
     }
+
+    scores.invalid_mp = final_mp + 1;
+    scores.scored_mp = std::max(scores.scored_mp, final_mp + 1);
+
+    if (scores.dirty_mp <= final_mp)
+        scores.dirty_mp = 0;
+
+    unsigned mp_score = scores[final_mp - scores.base_mp].mp_score;
+
+    // Finalize MP's that can no longer be updated. We finalize in batches so
+    // that the cost of removing entries is amortized.
+    if (final_mp + 1 > history_) {
+        unsigned horizon = final_mp + 1 - history_;
+
+        if (horizon >= scores.base_mp + std::max(history_/4, 1u))
+            scores.finalize(horizon);
+    }
+
+    return mp_score;
+}
+
+void Scores::finalize(unsigned mp)
+{
+    mp = std::min({mp, invalid_mp, scored_mp});
+
+    if (mp <= base_mp)
+        return;
+
+    unsigned n = std::min<size_t>(mp - base_mp, size());
+
+    if (n == 0)
+        return;
+
+    for (unsigned i = 0; i < n; ++i)
+        finalized_score += (*this)[i].mp_score;
+
+    finalized_goal = (*this)[n-1].goal;
+    finalized_achieved_duration = (*this)[n-1].achieved_duration;
+
+    erase(begin(), begin() + n);
+    base_mp += n;
+}
+
+uint64_t Scores::totalScore(void) const
+{
+    uint64_t total = finalized_score;
+
+    for (auto it = begin(); it != end(); ++it)
+        total += it->mp_score;
+
+    return total;
 }
@@ -4,6 +4,12 @@
 #ifndef SCORING_HH_
 #define SCORING_HH_
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "stats/Metrics.hh"
+
 /** @brief Scoring a single measurement period */
 struct Score {
     Score()
@@ -51,21 +57,140 @@ struct Score {
     unsigned mp_score;
 };
 
+/** @brief A view of per-MP counts */
+/** This lets the scorer read counts directly from caller-owned storage,
+ * whether that is a plain array or a field of an array of structs. A view of
+ * a field indexes the array of structs itself through an accessor, so no
+ * pointer ever walks from one struct's field to the next.
+ */
+struct MPCounts {
+    /** @brief Accessor returning count i of an array */
+    using Accessor = size_t (*)(const void *data, size_t i);
+
+    /** @brief View a plain array of counts */
+    MPCounts(const size_t *data_, size_t size_)
+      : data(data_)
+      , size(size_)
+      , get(index)
+    {
+    }
+
+    /** @brief View an array through an accessor */
+    MPCounts(const void *data_, size_t size_, Accessor get_)
+      : data(data_)
+      , size(size_)
+      , get(get_)
+    {
+    }
+
+    /** @brief Pointer to array */
+    const void *data;
+
+    /** @brief Number of counts */
+    size_t size;
+
+    /** @brief Accessor for counts */
+    Accessor get;
+
+    size_t operator [](size_t i) const
+    {
+        return get(data, i);
+    }
+
+private:
+    static size_t index(const void *data, size_t i)
+    {
+        return static_cast<const size_t*>(data)[i];
+    }
+};
+
+/** @brief Scores for a single flow */
+/** Only MP's that may still change are stored; entry i holds MP base_mp + i.
+ * Once an MP is older than the scorer's history and is no longer invalid, it
+ * is finalized: its score is folded into finalized_score and only the goal
+ * and achieved duration of the last finalized MP are retained, which is all
+ * that is needed to score the MP that follows it.
+ */
 struct Scores : public std::vector<Score> {
-    Scores() : invalid_mp(0)
+    Scores()
+      : base_mp(0)
+      , invalid_mp(0)
+      , dirty_mp(0)
+      , scored_mp(0)
+      , finalized_score(0)
+      , finalized_goal(false)
+      , finalized_achieved_duration(0)
     {
     }
 
+    /** @brief MP of first entry */
+    unsigned base_mp;
+
     /** @brief First invalid MP */
     /** MP's from this MP on have been invalidated and need to be scored */
     unsigned invalid_mp;
+
+    /** @brief Last MP with new data since the last time scores were updated */
+    unsigned dirty_mp;
+
+    /** @brief One past the last MP that has been scored */
+    unsigned scored_mp;
+
+    /** @brief Total score of finalized MP's */
+    uint64_t finalized_score;
+
+    /** @brief True if goal met in last finalized MP */
+    bool finalized_goal;
+
+    /** @brief Achieved duration in last finalized MP */
+    unsigned finalized_achieved_duration;
+
+    /** @brief Get the entry for an MP, growing the window if necessary
+     * @return The entry, or nullptr if the MP has been finalized.
+     */
+    Score *get(unsigned mp)
+    {
+        if (mp < base_mp)
+            return nullptr;
+
+        if (mp - base_mp >= size())
+            resize(mp - base_mp + 1);
+
+        return &(*this)[mp - base_mp];
+    }
+
+    /** @brief Mark an MP as having new data */
+    void invalidate(unsigned mp)
+    {
+        if (mp < invalid_mp)
+            invalid_mp = mp;
+
+        if (mp > dirty_mp)
+            dirty_mp = mp;
+    }
+
+    /** @brief Finalize all MP's before an MP */
+    void finalize(unsigned mp);
+
+    /** @brief Get total score of all MP's */
+    uint64_t totalScore(void) const;
 };
 
 using ScoreMap = std::unordered_map<FlowUID, Scores>;
 
+/** @brief Incremental CIL scorer */
+/** Scoring an MP only depends on the MP's statistics and the previous MP's
+ * goal and achieved duration. When new statistics arrive, only MP's from the
+ * first invalid MP are rescored, and rescoring stops as soon as an MP past
+ * the last MP with new data scores exactly as it did before, since every
+ * following MP must then score the same, too.
+ */
 class Scorer
 {
 public:
+    /** @brief Default number of MP's that may still be updated */
+    static constexpr unsigned kDefaultHistory = 600;
+
     Scorer();
     virtual ~Scorer();
 
@@ -84,24 +209,85 @@ public:
         return scores_;
     }
 
+    /** @brief Get number of MP's before the latest scored MP that may still
+     * be updated
+     */
+    unsigned getHistory(void) const
+    {
+        return history_;
+    }
+
+    /** @brief Set number of MP's before the latest scored MP that may still
+     * be updated
+     */
+    void setHistory(unsigned history)
+    {
+        history_ = std::max(history, 1u);
+    }
+
+    /** @brief Get number of per-MP updates dropped because the MP was older
+     * than the history
+     */
+    uint64_t getNumStaleUpdates(void) const
+    {
+        return stale_updates_metric_.value();
+    }
+
+    /** @brief Update statistics for sent data
+     * @param flow The flow
+     * @param timestamp Timestamp of statistics
+     * @param first_mp MP of first entry in npackets and nbytes
+     * @param npackets Number of packets sent in each MP
+     * @param nbytes Number of bytes sent in each MP
+     */
     void updateSentStatistics(FlowUID flow,
                               double timestamp,
                               unsigned first_mp,
-                              std::vector<size_t> npackets,
-                              std::vector<size_t> nbytes);
+                              const MPCounts &npackets,
+                              const MPCounts &nbytes);
 
+    /** @brief Update statistics for received data
+     * @param flow The flow
+     * @param timestamp Timestamp of statistics
+     * @param first_mp MP of first entry in npackets and nbytes
+     * @param npackets Number of packets received in each MP
+     * @param nbytes Number of bytes received in each MP
+     */
     void updateReceivedStatistics(FlowUID flow,
                                   double timestamp,
                                   unsigned first_mp,
-                                  std::vector<size_t> npackets,
-                                  std::vector<size_t> nbytes);
+                                  const MPCounts &npackets,
+                                  const MPCounts &nbytes);
 
+    /** @brief Score all MP's up to and including final_mp */
     void updateScore(unsigned final_mp);
 
 protected:
     MandateMap mandates_;
 
     ScoreMap scores_;
+
+    /** @brief Number of MP's before the latest scored MP that may still be
+     * updated
+     */
+    unsigned history_;
+
+    /** @brief Exported per-flow score of the most recently scored MP */
+    std::unordered_map<FlowUID, Gauge> score_metrics_;
+
+    /** @brief Exported total score of the most recently scored MP */
+    Gauge total_score_metric_;
+
+    /** @brief Number of per-MP updates dropped because the MP was finalized */
+    Counter stale_updates_metric_;
+
+    /** @brief Record per-MP updates dropped because their MP was finalized */
+    void dropStaleUpdates(FlowUID flow, unsigned first_mp, unsigned n);
+
+    /** @brief Score MP's of a single flow
+     * @return The score of final_mp
+     */
+    unsigned updateScore(Scores &scores, const Mandate &mandate, unsigned final_mp);
 };
 
 #endif /* SCORING_HH_ */
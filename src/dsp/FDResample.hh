@@ -104,6 +104,36 @@ public:
                     size_t &nsamples,
                     size_t max_nsamples,
                     size_t &fdnsamples)
+    {
+        return upsample(in,
+                        count,
+                        g,
+                        flush,
+                        nsamples,
+                        max_nsamples,
+                        [&]() {
+                            T *block = out + fdnsamples;
+
+                            fdnsamples += N;
+                            return block;
+                        });
+    }
+
+    /** @brief Upsample, writing each frequency-domain block where directed
+     * @param next Function returning a pointer to the N frequency-domain
+     * samples into which the next block is written.
+     */
+    /** Bins outside the upsampled signal are left untouched, so a block may
+     * be written directly into a wideband spectrum shared with other signals.
+     */
+    template <class F>
+    size_t upsample(const T *in,
+                    size_t count,
+                    const float g,
+                    bool flush,
+                    size_t &nsamples,
+                    size_t max_nsamples,
+                    F &&next)
     {
         const unsigned Ni = X*N/I; // Size of forward FFT for input
         const unsigned Li = X*L/I; // Number of samples consumed per input block
@@ -150,8 +180,7 @@ public:
 
             // Copy FFT buffer to output, upsampling and frequency shifting by
             // shifting bins.
-            upsampleBlock(out + fdnsamples);
-            fdnsamples += N;
+            upsampleBlock(next());
 
             // If the FFT buffer held up to Ni - Oi samples, we can get all the
             // data we need for the next FFT from the input buffer.
@@ -228,19 +257,27 @@ public:
                 // Copy data into IFFT buffer
                 std::copy(in, in + N, ifft.in.begin());
 
-                // Perform IFFT
-                ifft.execute();
-
-                // Copy time-domain data into IQ buffer
-                std::copy(ifft.out.begin() + O,
-                          ifft.out.end() - O,
-                          out + outoff);
+                toTimeDomain(out + outoff);
                 outoff += L;
             }
 
             return outoff;
         }
 
+        /** @brief Convert the block in the IFFT input buffer to the time
+         * domain, writing L samples to out.
+         */
+        void toTimeDomain(T *out)
+        {
+            // Perform IFFT
+            ifft.execute();
+
+            // Copy time-domain data into IQ buffer
+            std::copy(ifft.out.begin() + O,
+                      ifft.out.end() - O,
+                      out);
+        }
+
         /** @brief FFT */
         fftw::FFT<T> ifft;
     };
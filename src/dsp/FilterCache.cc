@@ -0,0 +1,431 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <math.h>
+#include <string.h>
+
+#include <fstream>
+
+#include <boost/functional/hash.hpp>
+#include <firpm/pm.h>
+#include <liquid/liquid.h>
+
+#include "dsp/FIRDesign.hh"
+#include "dsp/FilterCache.hh"
+#include "liquid/Filter.hh"
+
+/** @brief Magic number identifying a filter cache file */
+static constexpr uint32_t kCacheMagic = 0x43465244; // "DRFC"
+
+/** @brief Filter cache file format version */
+static constexpr uint32_t kCacheVersion = 1;
+
+/** @brief Maximum number of elements in a vector read from a cache file */
+/** The largest vectors are frequency responses, which have one element per FFT
+ * bin.
+ */
+static constexpr uint64_t kMaxVectorSize = 1 << 20;
+
+/** @brief Tags for filter cache file entries */
+enum EntryTag : uint32_t {
+    kRealEntry = 0,
+    kPMEntry,
+    kResponseEntry
+};
+
+size_t FilterCache::DesignKeyHash::operator()(const DesignKey &key) const
+{
+    size_t h = std::hash<uint32_t>{}(key.design);
+
+    for (auto x : key.params)
+        boost::hash_combine(h, std::hash<double>{}(x));
+
+    return h;
+}
+
+size_t FilterCache::ResponseKeyHash::operator()(const ResponseKey &key) const
+{
+    size_t h = std::hash<unsigned>{}(key.N);
+
+    boost::hash_combine(h, std::hash<float>{}(key.scale));
+
+    for (auto x : key.taps) {
+        boost::hash_combine(h, std::hash<float>{}(x.real()));
+        boost::hash_combine(h, std::hash<float>{}(x.imag()));
+    }
+
+    return h;
+}
+
+std::shared_ptr<const FilterCache::RealTaps>
+FilterCache::lookupReal(const DesignKey &key,
+                        const std::function<RealTaps(void)> &f)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = real_.find(key);
+
+    if (it != real_.end())
+        return it->second;
+
+    auto taps = std::make_shared<const RealTaps>(f());
+
+    real_.emplace(key, taps);
+
+    return taps;
+}
+
+std::shared_ptr<const FilterCache::RealTaps>
+FilterCache::kaiser(unsigned n, float fc, float As)
+{
+    return lookupReal({kKaiser, {static_cast<double>(n), fc, As}},
+                      [&]() { return liquid::kaiser(n, fc, As); });
+}
+
+std::shared_ptr<const FilterCache::RealTaps>
+FilterCache::parks_mcclellan(unsigned n, float fc, float As)
+{
+    return lookupReal({kParksMcClellan, {static_cast<double>(n), fc, As}},
+                      [&]() { return liquid::parks_mcclellan(n, fc, As); });
+}
+
+std::shared_ptr<const PMOutput>
+FilterCache::firpm(Design design,
+                   std::size_t N,
+                   const std::vector<double> &f,
+                   const std::vector<double> &a,
+                   const std::vector<double> &w,
+                   double fs,
+                   double epsT,
+                   int Nmax)
+{
+    // Parameters are N, fs, epsT, Nmax, followed by the band edges, desired
+    // amplitudes, and weights, each prefixed by its length.
+    DesignKey key{design, {static_cast<double>(N), fs, epsT, static_cast<double>(Nmax)}};
+
+    for (auto v : {&f, &a, &w}) {
+        key.params.push_back(v->size());
+        key.params.insert(key.params.end(), v->begin(), v->end());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = pm_.find(key);
+
+        if (it != pm_.end())
+            return it->second;
+    }
+
+    PMOutput output;
+
+    switch (design) {
+        case kFIRPM:
+            output = dragonradio::signal::firpm(N, f, a, w, fs, epsT, Nmax);
+            break;
+
+        case kFIRPM1f:
+            output = dragonradio::signal::firpm1f(N, f, a, w, fs, epsT, Nmax);
+            break;
+
+        case kFIRPM1f2:
+            output = dragonradio::signal::firpm1f2(N, f, a, w, fs, epsT, Nmax);
+            break;
+
+        default:
+            throw std::range_error("Not a Remez filter design");
+    }
+
+    auto result = std::make_shared<const PMOutput>(std::move(output));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return pm_.emplace(key, result).first->second;
+}
+
+std::shared_ptr<const FilterCache::Response>
+FilterCache::frequencyResponse(const ComplexTaps &taps,
+                               unsigned N,
+                               float scale)
+{
+    ResponseKey key{N, scale, taps};
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = responses_.find(key);
+
+        if (it != responses_.end()) {
+            it->second.last_use = ++clock_;
+            return it->second.H;
+        }
+    }
+
+    if (taps.size() > N)
+        throw std::range_error("Filter is longer than FFT");
+
+    // Compute frequency response of zero-padded filter. The plan is only used
+    // once, so don't pay for FFTW_MEASURE.
+    fftw::FFT<C> fft(N, FFTW_FORWARD, FFTW_ESTIMATE);
+    auto         H = std::make_shared<Response>(N);
+
+    std::fill(fft.in.begin(), fft.in.end(), 0);
+    std::copy(taps.begin(), taps.end(), fft.in.begin());
+    fft.execute(fft.in.data(), H->data());
+
+    for (auto &x : *H)
+        x *= scale;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = responses_.emplace(std::move(key), CachedResponse{std::move(H), 0});
+
+    it->second.last_use = ++clock_;
+
+    if (inserted) {
+        // Hold a reference so the response survives its own eviction
+        auto result = it->second.H;
+
+        response_bytes_ += result->size()*sizeof(C);
+        evictResponses();
+
+        return result;
+    }
+
+    return it->second.H;
+}
+
+void FilterCache::evictResponses(void)
+{
+    // Responses are only inserted on a miss, which also pays for an FFT, and
+    // the cap admits only a few dozen responses, so a linear scan is cheap.
+    while (response_bytes_ > kMaxResponseBytes && !responses_.empty()) {
+        auto lru = responses_.begin();
+
+        for (auto it = responses_.begin(); it != responses_.end(); ++it) {
+            if (it->second.last_use < lru->second.last_use)
+                lru = it;
+        }
+
+        response_bytes_ -= lru->second.H->size()*sizeof(C);
+        responses_.erase(lru);
+    }
+}
+
+size_t FilterCache::size(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return real_.size() + pm_.size() + responses_.size();
+}
+
+void FilterCache::clear(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    real_.clear();
+    pm_.clear();
+    responses_.clear();
+    response_bytes_ = 0;
+}
+
+template <class T>
+static void write(std::ostream &os, const T &x)
+{
+    os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template <class V>
+static void writeVector(std::ostream &os, const V &v)
+{
+    write<uint64_t>(os, v.size());
+    os.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(typename V::value_type));
+}
+
+template <class T>
+static T read(std::istream &is)
+{
+    T x;
+
+    if (!is.read(reinterpret_cast<char*>(&x), sizeof(T)))
+        throw std::runtime_error("Truncated filter cache file");
+
+    return x;
+}
+
+/** @brief Return the number of bytes left in a stream */
+static uint64_t remaining(std::istream &is)
+{
+    auto pos = is.tellg();
+
+    is.seekg(0, std::ios::end);
+
+    auto end = is.tellg();
+
+    is.seekg(pos);
+
+    if (pos < 0 || end < pos)
+        throw std::runtime_error("Cannot determine size of filter cache file");
+
+    return end - pos;
+}
+
+template <class V>
+static void readVector(std::istream &is, V &v)
+{
+    using T = typename V::value_type;
+
+    uint64_t n = read<uint64_t>(is);
+
+    // Check the length before allocating so that a corrupt length cannot
+    // trigger a huge allocation
+    if (n > kMaxVectorSize || n*sizeof(T) > remaining(is))
+        throw std::runtime_error("Corrupt filter cache file");
+
+    v.resize(n);
+
+    if (!is.read(reinterpret_cast<char*>(v.data()), n*sizeof(T)))
+        throw std::runtime_error("Truncated filter cache file");
+}
+
+static void writeDesignKey(std::ostream &os, uint32_t design, const std::vector<double> &params)
+{
+    write<uint32_t>(os, design);
+    writeVector(os, params);
+}
+
+void FilterCache::save(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream               os(path, std::ios::binary | std::ios::trunc);
+
+    if (!os)
+        throw std::runtime_error(strerror(errno));
+
+    write<uint32_t>(os, kCacheMagic);
+    write<uint32_t>(os, kCacheVersion);
+
+    for (auto &[key, taps] : real_) {
+        write<uint32_t>(os, kRealEntry);
+        writeDesignKey(os, key.design, key.params);
+        writeVector(os, *taps);
+    }
+
+    for (auto &[key, pm] : pm_) {
+        write<uint32_t>(os, kPMEntry);
+        writeDesignKey(os, key.design, key.params);
+        writeVector(os, pm->h);
+        writeVector(os, pm->x);
+        write<uint64_t>(os, pm->iter);
+        write<double>(os, pm->delta);
+        write<double>(os, pm->Q);
+    }
+
+    for (auto &[key, entry] : responses_) {
+        write<uint32_t>(os, kResponseEntry);
+        write<uint32_t>(os, key.N);
+        write<float>(os, key.scale);
+        writeVector(os, key.taps);
+        writeVector(os, *entry.H);
+    }
+
+    if (!os.flush())
+        throw std::runtime_error(strerror(errno));
+}
+
+void FilterCache::load(const std::string &path)
+{
+    std::ifstream is(path, std::ios::binary);
+
+    if (!is)
+        throw std::runtime_error(strerror(errno));
+
+    if (read<uint32_t>(is) != kCacheMagic)
+        throw std::runtime_error("Not a filter cache file: " + path);
+
+    if (read<uint32_t>(is) != kCacheVersion)
+        throw std::runtime_error("Unsupported filter cache version: " + path);
+
+    // Read the entire file before touching the cache so that a corrupt file
+    // leaves the cache unchanged.
+    decltype(real_)      real;
+    decltype(pm_)        pm;
+    decltype(responses_) responses;
+
+    while (is.peek() != std::char_traits<char>::eof()) {
+        auto tag = read<uint32_t>(is);
+
+        switch (tag) {
+            case kRealEntry:
+            case kPMEntry:
+            {
+                DesignKey key;
+
+                key.design = static_cast<Design>(read<uint32_t>(is));
+                readVector(is, key.params);
+
+                if (tag == kRealEntry) {
+                    RealTaps taps;
+
+                    readVector(is, taps);
+                    real.emplace(std::move(key), std::make_shared<const RealTaps>(std::move(taps)));
+                } else {
+                    PMOutput output;
+
+                    readVector(is, output.h);
+                    readVector(is, output.x);
+                    output.iter = read<uint64_t>(is);
+                    output.delta = read<double>(is);
+                    output.Q = read<double>(is);
+                    pm.emplace(std::move(key), std::make_shared<const PMOutput>(std::move(output)));
+                }
+            }
+            break;
+
+            case kResponseEntry:
+            {
+                ResponseKey key;
+                auto        H = std::make_shared<Response>();
+
+                key.N = read<uint32_t>(is);
+                key.scale = read<float>(is);
+                readVector(is, key.taps);
+                readVector(is, *H);
+
+                if (H->size() != key.N)
+                    throw std::runtime_error("Corrupt filter cache file: " + path);
+
+                responses.emplace(std::move(key), CachedResponse{std::move(H), 0});
+            }
+            break;
+
+            default:
+                throw std::runtime_error("Corrupt filter cache file: " + path);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    real_.merge(real);
+    pm_.merge(pm);
+
+    // Loaded responses count as used now. Responses already in the cache are
+    // kept, so only count those that were actually moved in.
+    for (auto it = responses.begin(); it != responses.end(); ) {
+        auto node = responses.extract(it++);
+
+        node.mapped().last_use = ++clock_;
+
+        size_t nbytes = node.mapped().H->size()*sizeof(C);
+
+        if (responses_.insert(std::move(node)).inserted)
+            response_bytes_ += nbytes;
+    }
+
+    evictResponses();
+}
+
+FilterCache &filterCache(void)
+{
+    // The global cache is never destroyed, because threads may still be
+    // reconfiguring while static objects are destroyed.
+    static FilterCache *cache = new FilterCache();
+
+    return *cache;
+}
@@ -0,0 +1,198 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef FILTERCACHE_HH_
+#define FILTERCACHE_HH_
+
+#include <complex>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <firpm/pm.h>
+
+#include "dsp/FFTW.hh"
+
+/** @brief A process-wide cache of filter designs and frequency responses */
+/** Channel plans are drawn from a small set of bandwidths and sample rates, so
+ * the same filters are designed over and over again, every time we reconfigure.
+ * The cache memoizes filter designs and the frequency responses used by
+ * frequency-domain channelizers. Cached values are immutable and shared, so
+ * a hit costs a hash lookup and a shared_ptr copy. The cache can be saved to
+ * and loaded from disk so that designs are paid for once, not once per run.
+ *
+ * Designs are a few kilobytes each, but a frequency response for a
+ * frequency-domain channelizer is hundreds of kilobytes, so responses are
+ * evicted in least-recently-used order once they occupy more than
+ * kMaxResponseBytes.
+ */
+class FilterCache {
+public:
+    using C = std::complex<float>;
+
+    /** @brief Real filter taps */
+    using RealTaps = std::vector<float>;
+
+    /** @brief Complex filter taps */
+    using ComplexTaps = std::vector<C>;
+
+    /** @brief A frequency response */
+    using Response = fftw::vector<C>;
+
+    /** @brief Maximum number of bytes occupied by cached frequency responses */
+    static constexpr size_t kMaxResponseBytes = 16*1024*1024;
+
+    /** @brief Kind of filter design */
+    enum Design : uint32_t {
+        kKaiser = 0,
+        kParksMcClellan,
+        kFIRPM,
+        kFIRPM1f,
+        kFIRPM1f2
+    };
+
+    FilterCache() = default;
+
+    FilterCache(const FilterCache&) = delete;
+    FilterCache(FilterCache&&) = delete;
+
+    FilterCache& operator=(const FilterCache&) = delete;
+    FilterCache& operator=(FilterCache&&) = delete;
+
+    /** @brief Design a lowpass filter using Liquid's Kaiser window
+     * implementation.
+     * @param n Filter length
+     * @param fc Cutoff frequency
+     * @param As Stop-band attenuation (dB)
+     */
+    std::shared_ptr<const RealTaps> kaiser(unsigned n, float fc, float As);
+
+    /** @brief Design a lowpass filter using Liquid's Parks-McClellan
+     * implementation.
+     * @param n Filter length
+     * @param fc Cutoff frequency
+     * @param As Stop-band attenuation (dB)
+     */
+    std::shared_ptr<const RealTaps> parks_mcclellan(unsigned n, float fc, float As);
+
+    /** @brief Design a filter using the Remez exchange algorithm
+     * @param design One of kFIRPM, kFIRPM1f, or kFIRPM1f2
+     */
+    std::shared_ptr<const PMOutput> firpm(Design design,
+                                          std::size_t N,
+                                          const std::vector<double> &f,
+                                          const std::vector<double> &a,
+                                          const std::vector<double> &w,
+                                          double fs = 2,
+                                          double epsT = 0.01,
+                                          int Nmax = 4);
+
+    /** @brief Compute a scaled frequency response
+     * @param taps Filter taps
+     * @param N FFT size
+     * @param scale Scale factor applied to the response
+     * @return The N-point FFT of the zero-padded taps, multiplied by scale
+     */
+    std::shared_ptr<const Response> frequencyResponse(const ComplexTaps &taps,
+                                                      unsigned N,
+                                                      float scale);
+
+    /** @brief Return number of cached entries */
+    size_t size(void);
+
+    /** @brief Remove all cached entries */
+    void clear(void);
+
+    /** @brief Save cache to a file */
+    void save(const std::string &path);
+
+    /** @brief Load cache entries from a file */
+    /** Entries in the file are added to the cache. Entries already in the
+     * cache are kept. A file whose lengths are inconsistent with its size is
+     * rejected without modifying the cache.
+     */
+    void load(const std::string &path);
+
+protected:
+    /** @brief Key for a filter design */
+    struct DesignKey {
+        /** @brief Kind of design */
+        Design design;
+
+        /** @brief Design parameters */
+        std::vector<double> params;
+
+        bool operator ==(const DesignKey &other) const
+        {
+            return design == other.design && params == other.params;
+        }
+    };
+
+    /** @brief Key for a frequency response */
+    struct ResponseKey {
+        /** @brief FFT size */
+        unsigned N;
+
+        /** @brief Scale factor */
+        float scale;
+
+        /** @brief Filter taps */
+        ComplexTaps taps;
+
+        bool operator ==(const ResponseKey &other) const
+        {
+            return N == other.N && scale == other.scale && taps == other.taps;
+        }
+    };
+
+    /** @brief A cached frequency response */
+    struct CachedResponse {
+        /** @brief The response */
+        std::shared_ptr<const Response> H;
+
+        /** @brief Time of last use, in cache lookups */
+        uint64_t last_use;
+    };
+
+    struct DesignKeyHash {
+        size_t operator()(const DesignKey &key) const;
+    };
+
+    struct ResponseKeyHash {
+        size_t operator()(const ResponseKey &key) const;
+    };
+
+    /** @brief Mutex protecting the cache */
+    std::mutex mutex_;
+
+    /** @brief Cached real designs */
+    std::unordered_map<DesignKey, std::shared_ptr<const RealTaps>, DesignKeyHash> real_;
+
+    /** @brief Cached Remez designs */
+    std::unordered_map<DesignKey, std::shared_ptr<const PMOutput>, DesignKeyHash> pm_;
+
+    /** @brief Cached frequency responses */
+    std::unordered_map<ResponseKey, CachedResponse, ResponseKeyHash> responses_;
+
+    /** @brief Number of bytes occupied by cached frequency responses */
+    size_t response_bytes_ = 0;
+
+    /** @brief Logical clock used to order response lookups */
+    uint64_t clock_ = 0;
+
+    /** @brief Look up a real design, designing it if it is not cached */
+    std::shared_ptr<const RealTaps> lookupReal(const DesignKey &key,
+                                               const std::function<RealTaps(void)> &f);
+
+    /** @brief Evict least-recently-used responses until under the size cap */
+    /** The cache mutex must be held. */
+    void evictResponses(void);
+};
+
+/** @brief Get the global filter cache */
+FilterCache &filterCache(void);
+
+#endif /* FILTERCACHE_HH_ */
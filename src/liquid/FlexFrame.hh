@@ -6,6 +6,7 @@
 
 #include <complex>
 #include <functional>
+#include <vector>
 
 #include <liquid/liquid.h>
 
@@ -22,21 +23,21 @@ public:
         std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
         std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
 
-        origflexframegenprops_s props;
-
-        mcs2genprops(payload_mcs_, props);
-        fg_ = origflexframegen_create(&props);
-
-        reconfigureHeader();
+        fg0_ = createGenerator(payload_mcs_);
+        fg_ = fg0_;
     }
 
     virtual ~FlexFrameModulator()
     {
-        if (fg_) {
-            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
-            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+        std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+        std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+        if (fg0_)
+            origflexframegen_destroy(fg0_);
 
-            origflexframegen_destroy(fg_);
+        for (auto fg : fgs_) {
+            if (fg)
+                origflexframegen_destroy(fg);
         }
     }
 
@@ -89,17 +90,62 @@ public:
         return origflexframegen_write_samples(fg_, buf);
     }
 
+    void prepareMCS(mcsidx_t mcsidx, const MCS &mcs) override
+    {
+        if (mcsidx >= fgs_.size())
+            fgs_.resize(mcsidx + 1, nullptr);
+
+        if (!fgs_[mcsidx]) {
+            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+            fgs_[mcsidx] = createGenerator(mcs);
+        }
+    }
+
 protected:
-    /* @brief Flexframe generator object */
+    /* @brief Current flexframe generator object */
     origflexframegen fg_;
 
-    void reconfigureHeader(void) override
+    /* @brief Flexframe generator reconfigured by setPayloadMCS */
+    origflexframegen fg0_;
+
+    /* @brief Flexframe generators for each MCS table entry */
+    std::vector<origflexframegen> fgs_;
+
+    /* @brief Create a generator for an MCS. Caller must hold liquid and FFTW
+     * locks.
+     */
+    origflexframegen createGenerator(const MCS &mcs)
+    {
+        origflexframegenprops_s props;
+
+        mcs2genprops(mcs, props);
+
+        origflexframegen fg = origflexframegen_create(&props);
+
+        configureHeader(fg);
+
+        return fg;
+    }
+
+    void configureHeader(origflexframegen fg)
     {
         origflexframegenprops_s props;
 
         mcs2genprops(header_mcs_, props);
-        origflexframegen_set_header_props(fg_, &props);
-        origflexframegen_set_header_len(fg_, sizeof(Header));
+        origflexframegen_set_header_props(fg, &props);
+        origflexframegen_set_header_len(fg, sizeof(Header));
+    }
+
+    void reconfigureHeader(void) override
+    {
+        configureHeader(fg0_);
+
+        for (auto fg : fgs_) {
+            if (fg)
+                configureHeader(fg);
+        }
     }
 
     void reconfigurePayload(void) override
@@ -107,7 +153,14 @@ protected:
         origflexframegenprops_s props;
 
         mcs2genprops(payload_mcs_, props);
-        origflexframegen_setprops(fg_, &props);
+        origflexframegen_setprops(fg0_, &props);
+        fg_ = fg0_;
+    }
+
+    void selectPayload(mcsidx_t mcsidx) override
+    {
+        prepareMCS(mcsidx, payload_mcs_);
+        fg_ = fgs_[mcsidx];
     }
 };
 
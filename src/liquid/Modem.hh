@@ -142,6 +142,28 @@ public:
         }
     }
 
+    /** @brief Select payload MCS by its index in an MCS table
+     * @param mcsidx Index of the MCS in the table
+     * @param mcs The MCS at index mcsidx
+     */
+    /** Reconfiguring a liquid frame generator for a new payload MCS rebuilds
+     * its FEC and interleaver objects. Modulators that keep one frame generator
+     * per MCS table entry instead switch to the generator for mcsidx.
+     */
+    void selectPayloadMCS(mcsidx_t mcsidx, const MCS &mcs)
+    {
+        payload_mcs_ = mcs;
+        selectPayload(mcsidx);
+    }
+
+    /** @brief Build the frame generator for an MCS table entry ahead of use
+     * @param mcsidx Index of the MCS in the table
+     * @param mcs The MCS at index mcsidx
+     */
+    virtual void prepareMCS(mcsidx_t mcsidx, const MCS &mcs)
+    {
+    }
+
 protected:
     /** @brief Header MCS */
     MCS header_mcs_;
@@ -154,6 +176,15 @@ protected:
 
     /** @brief Reconfigure modulator based on new payload parameters */
     virtual void reconfigurePayload(void) = 0;
+
+    /** @brief Select payload parameters for an MCS table entry */
+    /** By default, this reconfigures the modulator for the current payload
+     * MCS.
+     */
+    virtual void selectPayload(mcsidx_t mcsidx)
+    {
+        reconfigurePayload();
+    }
 };
 
 class Demodulator : public ::Demodulator {
@@ -6,6 +6,7 @@
 
 #include <complex>
 #include <functional>
+#include <vector>
 
 #include <liquid/liquid.h>
 
@@ -22,21 +23,21 @@ public:
         std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
         std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
 
-        flexframegenprops_s props;
-
-        mcs2genprops(payload_mcs_, props);
-        fg_ = flexframegen_create(&props);
-
-        reconfigureHeader();
+        fg0_ = createGenerator(payload_mcs_);
+        fg_ = fg0_;
     }
 
     virtual ~NewFlexFrameModulator()
     {
-        if (fg_) {
-            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
-            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+        std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+        std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+        if (fg0_)
+            flexframegen_destroy(fg0_);
 
-            flexframegen_destroy(fg_);
+        for (auto fg : fgs_) {
+            if (fg)
+                flexframegen_destroy(fg);
         }
     }
 
@@ -89,17 +90,62 @@ public:
         return flexframegen_write_samples(fg_, buf, NGEN);
     }
 
+    void prepareMCS(mcsidx_t mcsidx, const MCS &mcs) override
+    {
+        if (mcsidx >= fgs_.size())
+            fgs_.resize(mcsidx + 1, nullptr);
+
+        if (!fgs_[mcsidx]) {
+            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+            fgs_[mcsidx] = createGenerator(mcs);
+        }
+    }
+
 protected:
-    /* @brief Flexframe generator object */
+    /* @brief Current flexframe generator object */
     flexframegen fg_;
 
-    void reconfigureHeader(void) override
+    /* @brief Flexframe generator reconfigured by setPayloadMCS */
+    flexframegen fg0_;
+
+    /* @brief Flexframe generators for each MCS table entry */
+    std::vector<flexframegen> fgs_;
+
+    /* @brief Create a generator for an MCS. Caller must hold liquid and FFTW
+     * locks.
+     */
+    flexframegen createGenerator(const MCS &mcs)
+    {
+        flexframegenprops_s props;
+
+        mcs2genprops(mcs, props);
+
+        flexframegen fg = flexframegen_create(&props);
+
+        configureHeader(fg);
+
+        return fg;
+    }
+
+    void configureHeader(flexframegen fg)
     {
         flexframegenprops_s props;
 
         mcs2genprops(header_mcs_, props);
-        flexframegen_set_header_props(fg_, &props);
-        flexframegen_set_header_len(fg_, sizeof(Header));
+        flexframegen_set_header_props(fg, &props);
+        flexframegen_set_header_len(fg, sizeof(Header));
+    }
+
+    void reconfigureHeader(void) override
+    {
+        configureHeader(fg0_);
+
+        for (auto fg : fgs_) {
+            if (fg)
+                configureHeader(fg);
+        }
     }
 
     void reconfigurePayload(void) override
@@ -107,7 +153,14 @@ protected:
         flexframegenprops_s props;
 
         mcs2genprops(payload_mcs_, props);
-        flexframegen_setprops(fg_, &props);
+        flexframegen_setprops(fg0_, &props);
+        fg_ = fg0_;
+    }
+
+    void selectPayload(mcsidx_t mcsidx) override
+    {
+        prepareMCS(mcsidx, payload_mcs_);
+        fg_ = fgs_[mcsidx];
     }
 };
 
@@ -7,6 +7,7 @@
 #include <complex>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include <liquid/liquid.h>
 
@@ -59,25 +60,21 @@ public:
         std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
         std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
 
-        ofdmflexframegenprops_s props;
-
-        mcs2genprops(payload_mcs_, props);
-        fg_ = ofdmflexframegen_create(M_,
-                                      cp_len_,
-                                      taper_len_,
-                                      reinterpret_cast<unsigned char*>(p_.data()),
-                                      &props);
-
-        reconfigureHeader();
+        fg0_ = createGenerator(payload_mcs_);
+        fg_ = fg0_;
     }
 
     virtual ~OFDMModulator()
     {
-        if (fg_) {
-            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
-            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+        std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+        std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+        if (fg0_)
+            ofdmflexframegen_destroy(fg0_);
 
-            ofdmflexframegen_destroy(fg_);
+        for (auto fg : fgs_) {
+            if (fg)
+                ofdmflexframegen_destroy(fg);
         }
     }
 
@@ -122,6 +119,19 @@ public:
         return ofdmflexframegen_write(fg_, buf, nw);
     }
 
+    void prepareMCS(mcsidx_t mcsidx, const MCS &mcs) override
+    {
+        if (mcsidx >= fgs_.size())
+            fgs_.resize(mcsidx + 1, nullptr);
+
+        if (!fgs_[mcsidx]) {
+            std::lock_guard<std::mutex> liquid_lock(liquid::mutex);
+            std::lock_guard<std::mutex> fftw_lock(fftw::mutex);
+
+            fgs_[mcsidx] = createGenerator(mcs);
+        }
+    }
+
 protected:
     /* @brief The number of subcarriers */
     unsigned M_;
@@ -137,16 +147,52 @@ protected:
      */
     OFDMSubcarriers p_;
 
-    /* @brief OFDM flexframe generator object */
+    /* @brief Current OFDM flexframe generator object */
     ofdmflexframegen fg_;
 
-    void reconfigureHeader(void) override
+    /* @brief OFDM flexframe generator reconfigured by setPayloadMCS */
+    ofdmflexframegen fg0_;
+
+    /* @brief OFDM flexframe generators for each MCS table entry */
+    std::vector<ofdmflexframegen> fgs_;
+
+    /* @brief Create a generator for an MCS. Caller must hold liquid and FFTW
+     * locks.
+     */
+    ofdmflexframegen createGenerator(const MCS &mcs)
+    {
+        ofdmflexframegenprops_s props;
+
+        mcs2genprops(mcs, props);
+
+        ofdmflexframegen fg = ofdmflexframegen_create(M_,
+                                                      cp_len_,
+                                                      taper_len_,
+                                                      reinterpret_cast<unsigned char*>(p_.data()),
+                                                      &props);
+
+        configureHeader(fg);
+
+        return fg;
+    }
+
+    void configureHeader(ofdmflexframegen fg)
     {
         ofdmflexframegenprops_s props;
 
         mcs2genprops(header_mcs_, props);
-        ofdmflexframegen_set_header_props(fg_, &props);
-        ofdmflexframegen_set_header_len(fg_, sizeof(Header));
+        ofdmflexframegen_set_header_props(fg, &props);
+        ofdmflexframegen_set_header_len(fg, sizeof(Header));
+    }
+
+    void reconfigureHeader(void) override
+    {
+        configureHeader(fg0_);
+
+        for (auto fg : fgs_) {
+            if (fg)
+                configureHeader(fg);
+        }
     }
 
     void reconfigurePayload(void) override
@@ -154,7 +200,14 @@ protected:
         ofdmflexframegenprops_s props;
 
         mcs2genprops(payload_mcs_, props);
-        ofdmflexframegen_setprops(fg_, &props);
+        ofdmflexframegen_setprops(fg0_, &props);
+        fg_ = fg0_;
+    }
+
+    void selectPayload(mcsidx_t mcsidx) override
+    {
+        prepareMCS(mcsidx, payload_mcs_);
+        fg_ = fgs_[mcsidx];
     }
 };
 
@@ -1,10 +1,14 @@
 // Copyright 2018-2020 Drexel University
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
+#include <algorithm>
+
 #include <xsimd/xsimd.hpp>
 #include <xsimd/stl/algorithms.hpp>
 
+#include "IQConvert.hh"
 #include "Logger.hh"
+#include "Trace.hh"
 #include "WorkQueue.hh"
 #include "dsp/NCO.hh"
 #include "liquid/PHY.hh"
@@ -28,6 +32,7 @@ PHY::PHY(const MCS &header_mcs,
     for (unsigned i = 0; i < mcs_table_.size(); ++i) {
         mcs_table_[i] = mcstab[i].first;
         mcs_table[i] = { &mcs_table_[i], mcstab[i].second, true };
+        sizes_.emplace_back(kSizeTableSize);
     }
 }
 
@@ -35,6 +40,8 @@ void PHY::PacketModulator::modulate(std::shared_ptr<NetPacket> pkt,
                                     const float g,
                                     ModPacket &mpkt)
 {
+    TRACE_SPAN_ARG("modulate", pkt->size());
+
     MonoClock::time_point mod_start = MonoClock::now();
 
     // Set team in header
@@ -42,7 +49,7 @@ void PHY::PacketModulator::modulate(std::shared_ptr<NetPacket> pkt,
 
     // Set MCS based on MCS index
     assert(pkt->mcsidx < phy_.mcs_table.size());
-    setPayloadMCS(*reinterpret_cast<const MCS*>(phy_.mcs_table[pkt->mcsidx].mcs));
+    selectPayloadMCS(pkt->mcsidx, *reinterpret_cast<const MCS*>(phy_.mcs_table[pkt->mcsidx].mcs));
 
     // Assemble the modulated packet
     assemble(&pkt->hdr, pkt->data(), pkt->size());
@@ -73,21 +80,28 @@ void PHY::PacketModulator::modulate(std::shared_ptr<NetPacket> pkt,
     // Resize the final buffer to the number of samples generated.
     iqbuf->resize(nsamples);
 
-    // Apply soft gain.
-    if (g != 1.0)
-        xsimd::transform(iqbuf->data(),
-                         iqbuf->data() + nsamples,
-                         iqbuf->data(),
-                         [&](const auto& x) { return x*g; });
+    // Apply soft gain. If the 0dBFS estimator needs every sample, gather the
+    // power histogram it needs in the same pass so the modulated samples are
+    // only touched once. Otherwise, it only looks at a strided subset of the
+    // scaled samples.
+    AutoGain &autogain = phy_.mcs_table[pkt->mcsidx].autogain;
+    bool     need_estimate = autogain.needCalcAutoSoftGain0dBFS();
 
-    // Timestamp
-    MonoClock::time_point mod_end = MonoClock::now();
+    if (need_estimate && autogain.getEstimateStride() == 1) {
+        PowerHistogram hist;
 
-    // Pass the modulated packet to the 0dBFS estimator if requested
-    AutoGain &autogain = phy_.mcs_table[pkt->mcsidx].autogain;
+        scaleIQ(iqbuf->data(), iqbuf->data(), nsamples, g, nullptr, &hist);
+        autogain.autoSoftGain0dBFS(g, hist);
+    } else {
+        if (g != 1.0)
+            scaleIQ(iqbuf->data(), iqbuf->data(), nsamples, g);
+
+        if (need_estimate)
+            autogain.autoSoftGain0dBFS(g, iqbuf->data(), nsamples);
+    }
 
-    if (autogain.needCalcAutoSoftGain0dBFS())
-        work_queue.submit(&AutoGain::autoSoftGain0dBFS, &autogain, g, iqbuf);
+    // Timestamp
+    MonoClock::time_point mod_end = MonoClock::now();
 
     // Record modulation latency
     pkt->mod_start_timestamp = mod_start;
@@ -100,6 +114,12 @@ void PHY::PacketModulator::modulate(std::shared_ptr<NetPacket> pkt,
     mpkt.pkt = std::move(pkt);
 }
 
+void PHY::PacketModulator::prepareMCSTable(void)
+{
+    for (mcsidx_t mcsidx = 0; mcsidx < phy_.mcs_table.size(); ++mcsidx)
+        prepareMCS(mcsidx, *reinterpret_cast<const MCS*>(phy_.mcs_table[mcsidx].mcs));
+}
+
 PHY::PacketDemodulator::PacketDemodulator(PHY &phy,
                                           const MCS &header_mcs,
                                           bool soft_header,
@@ -207,11 +227,11 @@ int PHY::PacketDemodulator::callback(unsigned char *  header_,
 
     pkt->payload_len = payload_len_;
 
-    if (logger_ &&
-        logger_->getCollectSource(Logger::kRecvPackets) &&
-        logger_->getCollectSource(Logger::kRecvSymbols) &&
-        (header_valid_ || log_invalid_headers_))
-        pkt->symbols = std::make_unique<std::vector<std::complex<float>>>(stats_.framesyms, stats_.framesyms + stats_.num_framesyms);
+    if (logger_ && (header_valid_ || log_invalid_headers_))
+        pkt->symbols = logger_->captureSymbols(header_valid_ ? std::optional<NodeId>(hdr->curhop) : std::nullopt,
+                                               payload_valid_,
+                                               stats_.framesyms,
+                                               stats_.num_framesyms);
 
     // Call callback with received packet
     callback_(std::move(pkt));
@@ -258,17 +278,80 @@ void PHY::PacketDemodulator::timestamp(const MonoClock::time_point &timestamp,
 
 size_t PHY::getModulatedSize(mcsidx_t mcsidx, size_t n)
 {
-    std::unique_ptr<Modulator> mod = mkLiquidModulator();
-
     assert(mcsidx < mcs_table.size());
-    mod->setPayloadMCS(mcs_table_[mcsidx]);
 
+    if (n < kSizeTableSize) {
+        std::atomic<size_t> &entry = sizes_[mcsidx][n];
+        size_t              sz = entry.load(std::memory_order_relaxed);
+
+        if (sz != 0)
+            return sz;
+
+        std::lock_guard<std::mutex> lock(size_mod_mutex_);
+
+        sz = probeModulatedSize(sizeModulator(), mcsidx, n);
+        entry.store(sz, std::memory_order_relaxed);
+
+        return sz;
+    }
+
+    std::lock_guard<std::mutex> lock(size_mod_mutex_);
+
+    return probeModulatedSize(sizeModulator(), mcsidx, n);
+}
+
+size_t PHY::verifyModulatedSizes(void)
+{
+    std::unique_ptr<liquid::Modulator> mod = mkLiquidModulator();
+    size_t                             nchecked = 0;
+    size_t                             nmismatched = 0;
+
+    for (mcsidx_t mcsidx = 0; mcsidx < sizes_.size(); ++mcsidx) {
+        for (size_t n = 0; n < kSizeTableSize; ++n) {
+            size_t cached = sizes_[mcsidx][n].load(std::memory_order_relaxed);
+
+            if (cached == 0)
+                continue;
+
+            size_t actual = probeModulatedSize(*mod, mcsidx, n);
+
+            ++nchecked;
+
+            if (cached != actual) {
+                logPHY(LOGERROR, "Modulated size mismatch: mcsidx=%u; n=%lu; cached=%lu; actual=%lu",
+                    (unsigned) mcsidx,
+                    n,
+                    cached,
+                    actual);
+                ++nmismatched;
+            }
+        }
+    }
+
+    logPHY(LOGDEBUG, "Verified modulated sizes: nchecked=%lu; nmismatched=%lu",
+        nchecked,
+        nmismatched);
+
+    return nmismatched;
+}
+
+liquid::Modulator &PHY::sizeModulator(void)
+{
+    if (!size_mod_)
+        size_mod_ = mkLiquidModulator();
+
+    return *size_mod_;
+}
+
+size_t PHY::probeModulatedSize(liquid::Modulator &mod, mcsidx_t mcsidx, size_t n)
+{
     Header                     hdr = {0};
     std::vector<unsigned char> body(sizeof(ExtendedHeader) + n);
 
-    mod->assemble(&hdr, body.data(), body.size());
+    mod.setPayloadMCS(mcs_table_[mcsidx]);
+    mod.assemble(&hdr, body.data(), body.size());
 
-    return mod->assembledSize();
+    return mod.assembledSize();
 }
 
 }
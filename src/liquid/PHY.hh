@@ -4,9 +4,13 @@
 #ifndef LIQUID_PHY_HH_
 #define LIQUID_PHY_HH_
 
+#include <atomic>
 #include <complex>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <type_traits>
+#include <vector>
 
 #include <liquid/liquid.h>
 
@@ -45,6 +49,14 @@ public:
         void modulate(std::shared_ptr<NetPacket> pkt,
                       const float g,
                       ModPacket &mpkt) override final;
+
+    protected:
+        /** @brief Build frame generators for every entry in the MCS table */
+        /** Subclasses call this from their constructor, which runs when the
+         * synthesizer is configured, so switching MCS while modulating never
+         * has to build a generator.
+         */
+        void prepareMCSTable(void);
     };
 
     class PacketDemodulator : public ::PHY::PacketDemodulator, virtual protected liquid::Demodulator {
@@ -167,9 +179,47 @@ public:
         return soft_payload_;
     }
 
+    /** @brief Calculate size of modulated data */
+    /** Sizes of payloads shorter than kSizeTableSize are cached in a per-MCS
+     * table. The first request for a given MCS and payload size assembles a
+     * probe frame; every later request is a lock-free table lookup, cheap
+     * enough to make for every packet. Larger payloads are always sized by
+     * assembling a probe frame.
+     */
     size_t getModulatedSize(mcsidx_t mcsidx, size_t n) override;
 
+    /** @brief Verify cached modulated sizes
+     * @return The number of cached sizes that do not match a fresh probe
+     */
+    /** Every cached entry is re-computed by assembling a frame with a newly
+     * created modulator, and mismatches are logged. Entries that have not
+     * been requested yet are skipped.
+     */
+    size_t verifyModulatedSizes(void);
+
 protected:
+    /** @brief Number of payload sizes in a modulated size table */
+    static constexpr size_t kSizeTableSize = 2048;
+
+    /** @brief Modulated size, indexed by MCS index and then payload size */
+    /** An entry is zero until its size has been probed. Once set, an entry
+     * never changes.
+     */
+    std::vector<std::vector<std::atomic<size_t>>> sizes_;
+
+    /** @brief Mutex protecting size_mod_ */
+    std::mutex size_mod_mutex_;
+
+    /** @brief Modulator used to probe modulated sizes */
+    std::unique_ptr<liquid::Modulator> size_mod_;
+
+    /** @brief Return the modulator used to probe modulated sizes */
+    /** The caller must hold size_mod_mutex_. */
+    liquid::Modulator &sizeModulator(void);
+
+    /** @brief Compute modulated size by assembling a frame with mod */
+    size_t probeModulatedSize(liquid::Modulator &mod, mcsidx_t mcsidx, size_t n);
+
     /** @brief Modulation and coding scheme for headers. */
     MCS header_mcs_;
 
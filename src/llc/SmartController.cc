@@ -2,7 +2,9 @@
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
 #include "Logger.hh"
+#include "Trace.hh"
 #include "llc/SmartController.hh"
+#include "util/sprintf.hh"
 
 #define DEBUG 0
 
@@ -55,6 +57,9 @@ SmartController::SmartController(std::shared_ptr<RadioNet> radionet,
   , move_along_(true)
   , decrease_retrans_mcsidx_(false)
   , timestamp_seq_(0)
+  , sync_clock_(false)
+  , min_sync_pairs_(2)
+  , min_sync_change_(1e-6)
   , gen_(std::random_device()())
   , dist_(0, 1.0)
 {
@@ -70,6 +75,15 @@ SmartController::SmartController(std::shared_ptr<RadioNet> radionet,
     for (mcsidx_t mcsidx = 0; mcsidx < phy->mcs_table.size(); ++mcsidx)
         max_packet_samples_[mcsidx] =  phy->getModulatedSize(mcsidx, max_pkt_size);
 
+    for (auto &sendw : send_windows_)
+        sendw.store(nullptr, std::memory_order_relaxed);
+
+    for (auto &recvw : recv_windows_)
+        recvw.store(nullptr, std::memory_order_relaxed);
+
+    retransmissions_metric_ = Counter(metrics(), "dragonradio_arq_retransmissions_total", "ARQ retransmissions");
+    drops_metric_ = Counter(metrics(), "dragonradio_arq_drops_total", "ARQ link-layer drops");
+
     timer_queue_.start();
 }
 
@@ -80,6 +94,8 @@ SmartController::~SmartController()
 
 bool SmartController::pull(std::shared_ptr<NetPacket> &pkt)
 {
+    TRACE_SPAN("controller_pull");
+
 get_packet:
     // Get a packet to send. We look for a packet on our internal queue first.
     if (!getPacket(pkt))
@@ -214,6 +230,8 @@ get_packet:
 
 void SmartController::received(std::shared_ptr<RadioPacket> &&pkt)
 {
+    TRACE_SPAN("controller_received");
+
     // Skip packets with invalid header
     if (pkt->internal_flags.invalid_header)
         return;
@@ -242,6 +260,20 @@ void SmartController::received(std::shared_ptr<RadioPacket> &&pkt)
         recvw.short_rssi.update(pkt->timestamp, pkt->rssi);
         recvw.long_rssi.update(pkt->timestamp, pkt->rssi);
 
+        // A sample that is already outside the window is dropped, so a window
+        // may be empty here. Don't publish the NaN mean of an empty window.
+        if (recvw.short_evm.size() != 0) {
+            recvw.short_evm_metric.set(*recvw.short_evm);
+            recvw.short_rssi_metric.set(*recvw.short_rssi);
+        }
+
+        if (recvw.long_evm.size() != 0) {
+            recvw.long_evm_metric.set(*recvw.long_evm);
+            recvw.long_rssi_metric.set(*recvw.long_rssi);
+        }
+
+        recvw.publishStats();
+
         // In the fast adjustment period, provide feedback as quickly as possible
         if (recvw.short_evm && recvw.short_rssi && isMCSFastAdjustmentPeriod())
             startSACKTimer(recvw);
@@ -829,6 +861,8 @@ void SmartController::environmentDiscontinuity(void)
             sendw.long_evm.reset();
             sendw.short_rssi.reset();
             sendw.long_rssi.reset();
+
+            sendw.publishStats();
         }
     }
 
@@ -846,6 +880,8 @@ void SmartController::environmentDiscontinuity(void)
             recvw.long_evm.reset();
             recvw.short_rssi.reset();
             recvw.long_rssi.reset();
+
+            recvw.publishStats();
         }
     }
 
@@ -916,6 +952,8 @@ void SmartController::retransmit(SendWindow::Entry &entry)
         // Mark the packet as a retransmission
         pkt->internal_flags.retransmission = 1;
 
+        retransmissions_metric_.inc();
+
         // Re-queue the packet. The ACK and MCS will be set properly upon
         // retransmission.
         if (netq_)
@@ -936,6 +974,8 @@ void SmartController::drop(SendWindow::Entry &entry)
     if (logger)
         logger->logLinkLayerDrop(MonoClock::now(), entry.pkt);
 
+    drops_metric_.inc();
+
     dprintf("dropping packet: node=%u; seq=%u",
         (unsigned) sendw.node.id,
         (unsigned) entry.pkt->hdr.seq);
@@ -1109,7 +1149,7 @@ void SmartController::handleCtrlTimestamp(RadioPacket &pkt, Node &node)
                 if (ts != node.timestamps_recv.end()) {
                     MonoClock::time_point t_recv = ts->second;
 
-                    node.timestamps.insert_or_assign(tseq, std::make_pair(t_sent, t_recv));
+                    node.timesync.update(tseq, t_sent, t_recv);
 
                     logTimeSync(LOGDEBUG, "Timestamp pair: node=%u; t_sent=%f; t_recv=%f",
                         (unsigned) pkt.hdr.curhop,
@@ -1135,7 +1175,21 @@ void SmartController::handleCtrlTimestamp(RadioPacket &pkt, Node &node)
                     if (ts != me.timestamps_sent.end()) {
                         MonoClock::time_point t_sent = ts->second;
 
-                        me.timestamps.insert_or_assign(tseq, std::make_pair(t_sent, t_recv));
+                        auto est = me.timesync.update(tseq, t_sent, t_recv);
+
+                        if (sync_clock_.load(std::memory_order_relaxed) && est->n >= min_sync_pairs_.load(std::memory_order_relaxed)) {
+                            WallClock             clock;
+                            MonoClock::time_point now = MonoClock::now();
+                            uhd::time_spec_t      t0 = clock.getTimeZero().t;
+                            uhd::time_spec_t      wall_now = t0 + est->offset + est->skew*(now.t - t0).get_real_secs();
+                            double                change = (wall_now - WallClock::to_wall_time(now).t).get_real_secs();
+
+                            // Only publish a material change. Offset and skew
+                            // are published together so WallClock::now never
+                            // sees one without the other.
+                            if (std::abs(change) >= min_sync_change_.load(std::memory_order_relaxed))
+                                clock.setTimeOffsetAndSkew(MonoClock::time_point { est->offset }, est->skew);
+                        }
 
                         logTimeSync(LOGDEBUG, "Timestamp pair for us: node=%u; t_sent=%f; t_recv=%f",
                             (unsigned) pkt.hdr.curhop,
@@ -1297,6 +1351,8 @@ void SmartController::handleReceiverStats(RadioPacket &pkt, SendWindow &sendw)
                 break;
         }
     }
+
+    sendw.publishStats();
 }
 
 void SmartController::handleACK(SendWindow &sendw, const Seq &seq)
@@ -1604,6 +1660,34 @@ bool SmartController::getPacket(std::shared_ptr<NetPacket>& pkt)
     }
 }
 
+std::vector<SmartController::SendWindowStats> SmartController::getSendWindowStats(void)
+{
+    std::vector<SendWindowStats> stats;
+
+    for (auto &p : send_windows_) {
+        SendWindow *sendw = p.load(std::memory_order_acquire);
+
+        if (sendw)
+            stats.push_back(sendw->stats.load());
+    }
+
+    return stats;
+}
+
+std::vector<SmartController::ReceiveWindowStats> SmartController::getReceiveWindowStats(void)
+{
+    std::vector<ReceiveWindowStats> stats;
+
+    for (auto &p : recv_windows_) {
+        RecvWindow *recvw = p.load(std::memory_order_acquire);
+
+        if (recvw)
+            stats.push_back(recvw->stats.load());
+    }
+
+    return stats;
+}
+
 SendWindow &SmartController::getSendWindow(NodeId node_id)
 {
     std::lock_guard<std::mutex> lock(send_mutex_);
@@ -1619,6 +1703,8 @@ SendWindow &SmartController::getSendWindow(NodeId node_id)
                                                           max_sendwin_,
                                                           retransmission_delay_));
 
+        send_windows_[node_id].store(&result.first->second, std::memory_order_release);
+
         return result.first->second;
     }
 }
@@ -1638,6 +1724,8 @@ RecvWindow &SmartController::getReceiveWindow(NodeId node_id)
                                                           recvwin_,
                                                           explicit_nak_win_));
 
+        recv_windows_[node_id].store(&result.first->second, std::memory_order_release);
+
         return result.first->second;
     }
 }
@@ -1670,6 +1758,7 @@ SendWindow::SendWindow(Node &n,
     , entries_(maxwin, *this)
 {
     setMCS(controller.mcsidx_init_);
+    publishStats();
 }
 
 void SendWindow::setSendWindowStatus(bool open)
@@ -1697,12 +1786,14 @@ void SendWindow::txSuccess(void)
 {
     short_per.update(0.0);
     long_per.update(0.0);
+    publishStats();
 }
 
 void SendWindow::txFailure(void)
 {
     short_per.update(1.0);
     long_per.update(1.0);
+    publishStats();
 }
 
 void SendWindow::updateMCS(bool fast_adjust)
@@ -1918,6 +2009,29 @@ void SendWindow::resetPEREstimates(void)
 
     long_per.setWindowSize(std::max(1.0, controller.long_per_window_*controller.min_channel_bandwidth_/controller.max_packet_samples_[mcsidx]));
     long_per.reset();
+
+    publishStats();
+}
+
+void SendWindow::publishStats(void)
+{
+    stats.store({ node.id,
+                  mcsidx,
+                  short_per.value(),
+                  long_per.value(),
+                  short_evm,
+                  long_evm,
+                  short_rssi,
+                  long_rssi });
+}
+
+void RecvWindow::publishStats(void)
+{
+    stats.store({ node.id,
+                  short_evm.value(),
+                  long_evm.value(),
+                  short_rssi.value(),
+                  long_rssi.value() });
 }
 
 void SendWindow::Entry::operator()()
@@ -1945,6 +2059,15 @@ RecvWindow::RecvWindow(Node &n,
     long_evm.setTimeWindow(controller.long_stats_window_);
     short_rssi.setTimeWindow(controller.short_stats_window_);
     long_rssi.setTimeWindow(controller.long_stats_window_);
+
+    unsigned id = n.id;
+
+    short_evm_metric = Gauge(metrics(), sprintf("dragonradio_recv_short_evm_db{node=\"%u\"}", id), "Short-term EVM");
+    long_evm_metric = Gauge(metrics(), sprintf("dragonradio_recv_long_evm_db{node=\"%u\"}", id), "Long-term EVM");
+    short_rssi_metric = Gauge(metrics(), sprintf("dragonradio_recv_short_rssi_db{node=\"%u\"}", id), "Short-term RSSI");
+    long_rssi_metric = Gauge(metrics(), sprintf("dragonradio_recv_long_rssi_db{node=\"%u\"}", id), "Long-term RSSI");
+
+    publishStats();
 }
 
 void RecvWindow::reset(Seq seq)
@@ -7,6 +7,8 @@
 #include <sys/types.h>
 #include <netinet/if_ether.h>
 
+#include <array>
+#include <atomic>
 #include <list>
 #include <map>
 #include <random>
@@ -19,10 +21,58 @@
 #include "phy/Gain.hh"
 #include "phy/PHY.hh"
 #include "stats/Estimator.hh"
-#include "stats/TimeWindowEstimator.hh"
+#include "stats/Metrics.hh"
+#include "stats/SlidingWindowEstimator.hh"
 
 class SmartController;
 
+/** @brief Statistics for a send window */
+struct SendWindowStats {
+    /** @brief Destination node */
+    NodeId node_id;
+
+    /** @brief Modulation index */
+    size_t mcsidx;
+
+    /** @brief Short-term PER */
+    std::optional<double> short_per;
+
+    /** @brief Long-term PER */
+    std::optional<double> long_per;
+
+    /** @brief Short-term EVM, as reported by receiver */
+    std::optional<float> short_evm;
+
+    /** @brief Long-term EVM, as reported by receiver */
+    std::optional<float> long_evm;
+
+    /** @brief Short-term RSSI, as reported by receiver */
+    std::optional<float> short_rssi;
+
+    /** @brief Long-term RSSI, as reported by receiver */
+    std::optional<float> long_rssi;
+};
+
+/** @brief Statistics for a receive window */
+/** Estimates are as of the last update to the window, not the current time.
+ */
+struct ReceiveWindowStats {
+    /** @brief Source node */
+    NodeId node_id;
+
+    /** @brief Short-term EVM */
+    std::optional<float> short_evm;
+
+    /** @brief Long-term EVM */
+    std::optional<float> long_evm;
+
+    /** @brief Short-term RSSI */
+    std::optional<float> short_rssi;
+
+    /** @brief Long-term RSSI */
+    std::optional<float> long_rssi;
+};
+
 struct SendWindow {
     struct Entry;
 
@@ -118,7 +168,13 @@ struct SendWindow {
     double retransmission_delay;
 
     /** @brief ACK delay estimator */
-    TimeWindowMax<MonoClock, double> ack_delay;
+    BucketedTimeWindowMax<MonoClock, double> ack_delay;
+
+    /** @brief Published statistics */
+    /** Updated whenever the MCS, PER, or receiver statistics change, so
+     * statistics can be read from any thread without taking mutex.
+     */
+    SeqLock<SendWindowStats> stats;
 
     /** @brief Return the packet with the given sequence number in the window */
     Entry& operator[](Seq seq)
@@ -162,6 +218,9 @@ struct SendWindow {
     /** @brief Reconfigure a node's PER estimates */
     void resetPEREstimates(void);
 
+    /** @brief Publish statistics. Must hold mutex. */
+    void publishStats(void);
+
     struct Entry : public TimerQueue::Timer {
         Entry(SendWindow &sendw)
           : sendw(sendw)
@@ -267,16 +326,34 @@ struct RecvWindow : public TimerQueue::Timer  {
     std::mutex mutex;
 
     /** @brief Short-term packet EVM */
-    TimeWindowMean<MonoClock, float> short_evm;
+    BucketedTimeWindowMean<MonoClock, float> short_evm;
 
     /** @brief Long-term packet EVM */
-    TimeWindowMean<MonoClock, float> long_evm;
+    BucketedTimeWindowMean<MonoClock, float> long_evm;
 
     /** @brief Short-term packet RSSI */
-    TimeWindowMean<MonoClock, float> short_rssi;
+    BucketedTimeWindowMean<MonoClock, float> short_rssi;
 
     /** @brief Long-term packet RSSI */
-    TimeWindowMean<MonoClock, float> long_rssi;
+    BucketedTimeWindowMean<MonoClock, float> long_rssi;
+
+    /** @brief Exported short-term packet EVM */
+    Gauge short_evm_metric;
+
+    /** @brief Exported long-term packet EVM */
+    Gauge long_evm_metric;
+
+    /** @brief Exported short-term packet RSSI */
+    Gauge short_rssi_metric;
+
+    /** @brief Exported long-term packet RSSI */
+    Gauge long_rssi_metric;
+
+    /** @brief Published statistics */
+    /** Updated whenever the EVM and RSSI estimates change, so statistics can
+     * be read from any thread without taking mutex.
+     */
+    SeqLock<ReceiveWindowStats> stats;
 
     /** @brief True when this is an active window that has received a packet */
     bool active;
@@ -326,6 +403,9 @@ struct RecvWindow : public TimerQueue::Timer  {
     /** @brief Reset the receive window */
     void reset(Seq seq);
 
+    /** @brief Publish statistics. Must hold mutex. */
+    void publishStats(void);
+
     /** @brief Return the packet with the given sequence number in the window */
     Entry& operator[](Seq seq)
     {
@@ -395,6 +475,10 @@ class SmartController : public Controller
 public:
     using evm_thresh_t = std::optional<double>;
 
+    using SendWindowStats = ::SendWindowStats;
+
+    using ReceiveWindowStats = ::ReceiveWindowStats;
+
     SmartController(std::shared_ptr<RadioNet> radionet_,
                     size_t mtu,
                     std::shared_ptr<PHY> phy,
@@ -423,6 +507,18 @@ public:
             (MonoClock::now() - *env_timestamp_).get_real_secs() < mcs_fast_adjustment_period_;
     }
 
+    /** @brief Get statistics for all send windows */
+    /** Send window statistics are read from published snapshots, so this
+     * never takes a lock.
+     */
+    std::vector<SendWindowStats> getSendWindowStats(void);
+
+    /** @brief Get statistics for all receive windows */
+    /** Receive window statistics are read from published snapshots, so this
+     * never takes a lock.
+     */
+    std::vector<ReceiveWindowStats> getReceiveWindowStats(void);
+
     /** @brief Get short time window over which to calculate PER (sec) */
     double getShortPERWindow(void)
     {
@@ -824,6 +920,58 @@ public:
         decrease_retrans_mcsidx_ = decrease_retrans_mcsidx;
     }
 
+    /** @brief Get whether or not we synchronize our clock to the time master. */
+    bool getSyncClock(void)
+    {
+        return sync_clock_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set whether or not we synchronize our clock to the time master. */
+    /** When set, every timestamp pair echoed by the time master refits this
+     * node's clock estimate, and the WallClock's offset and skew are updated
+     * together whenever the estimate changes by at least min_sync_change.
+     */
+    void setSyncClock(bool sync_clock)
+    {
+        sync_clock_.store(sync_clock, std::memory_order_relaxed);
+    }
+
+    /** @brief Get minimum number of timestamp pairs needed to synchronize our
+     * clock.
+     */
+    size_t getMinSyncPairs(void)
+    {
+        return min_sync_pairs_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set minimum number of timestamp pairs needed to synchronize our
+     * clock.
+     */
+    void setMinSyncPairs(size_t n)
+    {
+        min_sync_pairs_.store(n, std::memory_order_relaxed);
+    }
+
+    /** @brief Get minimum clock change (sec) applied when synchronizing our
+     * clock.
+     */
+    double getMinSyncChange(void)
+    {
+        return min_sync_change_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set minimum clock change (sec) applied when synchronizing our
+     * clock.
+     */
+    /** A new clock estimate is only applied if it moves the current wall-clock
+     * time by at least this much, so the clock isn't rewritten on every
+     * timestamp pair.
+     */
+    void setMinSyncChange(double sec)
+    {
+        min_sync_change_.store(sec, std::memory_order_relaxed);
+    }
+
     bool pull(std::shared_ptr<NetPacket> &pkt) override;
 
     void received(std::shared_ptr<RadioPacket> &&pkt) override;
@@ -889,9 +1037,27 @@ protected:
     /** @brief Receive windows */
     std::map<NodeId, RecvWindow> recv_;
 
+    /** @brief Send windows indexed by node ID */
+    /** Windows are never removed, so these can be scanned without taking
+     * send_mutex_.
+     */
+    std::array<std::atomic<SendWindow*>, 256> send_windows_;
+
+    /** @brief Receive windows indexed by node ID */
+    /** Windows are never removed, so these can be scanned without taking
+     * recv_mutex_.
+     */
+    std::array<std::atomic<RecvWindow*>, 256> recv_windows_;
+
     /** @brief Timer queue */
     TimerQueue timer_queue_;
 
+    /** @brief Exported retransmission counter */
+    Counter retransmissions_metric_;
+
+    /** @brief Exported link-layer drop counter */
+    Counter drops_metric_;
+
     /** @brief Samples in modulated packet of max size at each MCS */
     std::vector<size_t> max_packet_samples_;
 
@@ -1001,6 +1167,19 @@ protected:
     /** @brief Current timestamp sequence number */
     std::atomic<TimestampSeq> timestamp_seq_;
 
+    /** @brief Synchronize our clock to the time master */
+    std::atomic<bool> sync_clock_;
+
+    /** @brief Minimum number of timestamp pairs needed to synchronize our
+     * clock
+     */
+    std::atomic<size_t> min_sync_pairs_;
+
+    /** @brief Minimum clock change (sec) applied when synchronizing our
+     * clock
+     */
+    std::atomic<double> min_sync_change_;
+
     /** @brief Mutex for random number generator */
     std::mutex gen_mutex_;
 
@@ -19,62 +19,44 @@ public:
 
     std::optional<double> getShortPER(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        return sendw.short_per.value();
+        return sendw.stats.load().short_per;
     }
 
     std::optional<double> getLongPER(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        return sendw.long_per.value();
+        return sendw.stats.load().long_per;
     }
 
     std::optional<double> getShortEVM(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        if (sendw.short_evm)
-            return *sendw.short_evm;
-        else
-            return std::nullopt;
+        return sendw.stats.load().short_evm;
     }
 
     std::optional<double> getLongEVM(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        if (sendw.long_evm)
-            return *sendw.long_evm;
-        else
-            return std::nullopt;
+        return sendw.stats.load().long_evm;
     }
 
     std::optional<double> getShortRSSI(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        if (sendw.short_rssi)
-            return *sendw.short_rssi;
-        else
-            return std::nullopt;
+        return sendw.stats.load().short_rssi;
     }
 
     std::optional<double> getLongRSSI(void)
     {
-        SendWindow                  &sendw = controller_->getSendWindow(node_id_);
-        std::lock_guard<std::mutex> lock(sendw.mutex);
+        SendWindow &sendw = controller_->getSendWindow(node_id_);
 
-        if (sendw.long_rssi)
-            return *sendw.long_rssi;
-        else
-            return std::nullopt;
+        return sendw.stats.load().long_rssi;
     }
 
 private:
@@ -120,34 +102,30 @@ public:
 
     std::optional<double> getShortEVM(void)
     {
-        RecvWindow                  &recvw = controller_->getReceiveWindow(node_id_);
-        std::lock_guard<std::mutex> lock(recvw.mutex);
+        RecvWindow &recvw = controller_->getReceiveWindow(node_id_);
 
-        return recvw.short_evm.value();
+        return recvw.stats.load().short_evm;
     }
 
     std::optional<double> getLongEVM(void)
     {
-        RecvWindow                  &recvw = controller_->getReceiveWindow(node_id_);
-        std::lock_guard<std::mutex> lock(recvw.mutex);
+        RecvWindow &recvw = controller_->getReceiveWindow(node_id_);
 
-        return recvw.long_evm.value();
+        return recvw.stats.load().long_evm;
     }
 
     std::optional<double> getShortRSSI(void)
     {
-        RecvWindow                  &recvw = controller_->getReceiveWindow(node_id_);
-        std::lock_guard<std::mutex> lock(recvw.mutex);
+        RecvWindow &recvw = controller_->getReceiveWindow(node_id_);
 
-        return recvw.short_rssi.value();
+        return recvw.stats.load().short_rssi;
     }
 
     std::optional<double> getLongRSSI(void)
     {
-        RecvWindow                  &recvw = controller_->getReceiveWindow(node_id_);
-        std::lock_guard<std::mutex> lock(recvw.mutex);
+        RecvWindow &recvw = controller_->getReceiveWindow(node_id_);
 
-        return recvw.long_rssi.value();
+        return recvw.stats.load().long_rssi;
     }
 
 private:
@@ -4,6 +4,7 @@
 #include "Clock.hh"
 #include "USRP.hh"
 #include "mac/FDMA.hh"
+#include "util/threads.hh"
 
 FDMA::FDMA(std::shared_ptr<USRP> usrp,
            std::shared_ptr<PHY> phy,
@@ -24,9 +25,9 @@ FDMA::FDMA(std::shared_ptr<USRP> usrp,
   , timed_tx_delay_(500e-6)
   , channel_synthesizer_(synthesizer)
 {
-    rx_thread_ = std::thread(&FDMA::rxWorker, this);
-    tx_thread_ = std::thread(&FDMA::txWorker, this);
-    tx_notifier_thread_ = std::thread(&FDMA::txNotifier, this);
+    rx_thread_ = spawnThread("mac_rx", &FDMA::rxWorker, this);
+    tx_thread_ = spawnThread("mac_tx", &FDMA::txWorker, this);
+    tx_notifier_thread_ = spawnThread("mac_tx_notifier", &FDMA::txNotifier, this);
 }
 
 FDMA::~FDMA()
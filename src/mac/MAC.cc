@@ -2,6 +2,7 @@
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
 #include "mac/MAC.hh"
+#include "util/sprintf.hh"
 #include "util/threads.hh"
 
 MAC::MAC(std::shared_ptr<USRP> usrp,
@@ -23,6 +24,7 @@ MAC::MAC(std::shared_ptr<USRP> usrp,
   , rx_period_samps_(0)
   , rx_bufsize_(0)
   , logger_(logger)
+  , tx_packets_metric_(metrics(), "dragonradio_mac_tx_packets_total", "Transmitted packets")
 {
     rx_rate_ = usrp->getRXRate();
     tx_rate_ = usrp->getTXRate();
@@ -143,8 +145,17 @@ void MAC::txNotifier(void)
 
                     if (chanidx < load_.nsamples.size())
                         load_.nsamples[chanidx] += (*it)->nsamples;
+
+                    while (chanidx >= tx_samples_metrics_.size())
+                        tx_samples_metrics_.emplace_back(metrics(),
+                            sprintf("dragonradio_mac_tx_samples_total{chan=\"%zu\"}", tx_samples_metrics_.size()),
+                            "Transmitted samples");
+
+                    tx_samples_metrics_[chanidx].inc((*it)->nsamples);
                 }
 
+                tx_packets_metric_.inc(record.mpkts.size());
+
                 load_.end = WallClock::to_wall_time(*record.timestamp) + (record.delay + record.nsamples)/tx_rate_;
             }
         }
@@ -15,6 +15,7 @@
 #include "phy/Channelizer.hh"
 #include "phy/PHY.hh"
 #include "phy/Synthesizer.hh"
+#include "stats/Metrics.hh"
 
 /** @brief A MAC protocol. */
 class MAC
@@ -203,6 +204,14 @@ protected:
     /** @brief Number of sent samples */
     Load load_;
 
+    /** @brief Exported per-channel sent sample counters. Protected by
+     * load_mutex_.
+     */
+    std::vector<Counter> tx_samples_metrics_;
+
+    /** @brief Exported sent packet counter */
+    Counter tx_packets_metric_;
+
     /** @brief A transmission record */
     struct TXRecord {
         TXRecord() = default;
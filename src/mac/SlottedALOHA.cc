@@ -33,10 +33,10 @@ SlottedALOHA::SlottedALOHA(std::shared_ptr<USRP> usrp,
 {
     reconfigure();
 
-    rx_thread_ = std::thread(&SlottedALOHA::rxWorker, this);
-    tx_thread_ = std::thread(&SlottedALOHA::txWorker, this);
-    tx_slot_thread_ = std::thread(&SlottedALOHA::txSlotWorker, this);
-    tx_notifier_thread_ = std::thread(&SlottedALOHA::txNotifier, this);
+    rx_thread_ = spawnThread("mac_rx", &SlottedALOHA::rxWorker, this);
+    tx_thread_ = spawnThread("mac_tx", &SlottedALOHA::txWorker, this);
+    tx_slot_thread_ = spawnThread("mac_tx_slot", &SlottedALOHA::txSlotWorker, this);
+    tx_notifier_thread_ = spawnThread("mac_tx_notifier", &SlottedALOHA::txNotifier, this);
 }
 
 SlottedALOHA::~SlottedALOHA()
@@ -3,6 +3,7 @@
 
 #include "Logger.hh"
 #include "SlottedMAC.hh"
+#include "Trace.hh"
 #include "liquid/Modem.hh"
 #include "util/threads.hh"
 
@@ -92,6 +93,8 @@ void SlottedMAC::modulateSlot(slot_queue &q,
 std::shared_ptr<Slot> SlottedMAC::finalizeSlot(slot_queue &q,
                                                WallClock::time_point when)
 {
+    TRACE_SPAN("finalize_slot");
+
     std::shared_ptr<Slot> slot;
     WallClock::time_point deadline;
 
@@ -5,36 +5,33 @@
 
 #include "mac/Snapshot.hh"
 
-std::optional<std::shared_ptr<IQBuf>> Snapshot::getCombinedSlots(void) const
+std::optional<IQSegments> Snapshot::getSegmentedSlots(void) const
 {
     if (slots.empty())
         return std::nullopt;
 
-    size_t size = 0;
-    float  fc = slots[0]->fc;
-    float  fs = slots[0]->fs;
+    float      fc = slots[0]->fc;
+    float      fs = slots[0]->fs;
+    IQSegments segs(fc, fs);
+
+    segs.timestamp = timestamp;
 
     for (auto it = slots.begin(); it != slots.end() && (*it)->fc == fc && (*it)->fs == fs; ++it) {
         assert((*it)->complete);
-        size += (*it)->size();
+        segs.push_back(*it);
     }
 
-    std::shared_ptr<IQBuf> buf = std::make_shared<IQBuf>(size);
-    size_t                 off = 0;
-
-    buf->timestamp = timestamp;
-    buf->fc = fc;
-    buf->fs = fs;
+    return segs;
+}
 
-    using C = std::complex<float>;
+std::optional<std::shared_ptr<IQBuf>> Snapshot::getCombinedSlots(void) const
+{
+    auto segs = getSegmentedSlots();
 
-    for (auto it = slots.begin(); it != slots.end() && (*it)->fc == fc && (*it)->fs == fs; ++it) {
-        assert(off + (*it)->size() <= buf->size());
-        memcpy(buf->data() + off, (*it)->data(), (*it)->size()*sizeof(C));
-        off += (*it)->size();
-    }
+    if (!segs)
+        return std::nullopt;
 
-    return buf;
+    return segs->combine();
 }
 
 SnapshotCollector::SnapshotCollector()
@@ -39,6 +39,12 @@ struct Snapshot {
     /** @brief Demodulated packets */
     std::vector<SelfTX> selftx;
 
+    /** @brief Return a segmented view of IQ data from all slots */
+    /** Only the leading run of slots sharing the first slot's center frequency
+     * and sample rate is included. No IQ data is copied.
+     */
+    std::optional<IQSegments> getSegmentedSlots(void) const;
+
     /** @brief Return an IQBuf containing IQ data from all slots */
     std::optional<std::shared_ptr<IQBuf>> getCombinedSlots(void) const;
 };
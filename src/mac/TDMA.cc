@@ -29,10 +29,10 @@ TDMA::TDMA(std::shared_ptr<USRP> usrp,
   , nslots_(nslots)
   , tdma_schedule_(nslots)
 {
-    rx_thread_ = std::thread(&TDMA::rxWorker, this);
-    tx_thread_ = std::thread(&TDMA::txWorker, this);
-    tx_slot_thread_ = std::thread(&TDMA::txSlotWorker, this);
-    tx_notifier_thread_ = std::thread(&TDMA::txNotifier, this);
+    rx_thread_ = spawnThread("mac_rx", &TDMA::rxWorker, this);
+    tx_thread_ = spawnThread("mac_tx", &TDMA::txWorker, this);
+    tx_slot_thread_ = spawnThread("mac_tx_slot", &TDMA::txSlotWorker, this);
+    tx_notifier_thread_ = spawnThread("mac_tx_notifier", &TDMA::txNotifier, this);
 }
 
 TDMA::~TDMA()
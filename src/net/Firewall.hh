@@ -13,6 +13,9 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <unordered_set>
 
@@ -21,18 +24,32 @@
 #include "Packet.hh"
 #include "cil/CIL.hh"
 #include "net/Processor.hh"
-#include "stats/TimeWindowEstimator.hh"
 
 /** @brief A flow processor. */
+/** The data path never takes a lock. Allowed ports are kept in a bitmap of
+ * atomic words, so a packet is checked with one relaxed load of the word
+ * holding its port and one bit test against the layout cached by
+ * Packet::classify. When the rules change, each word is rebuilt and stored in
+ * turn. A reader may see a mix of old and new words during an update, but
+ * every port is either allowed by the old rules or by the new ones.
+ */
 template <class T,
           class Set = std::unordered_set<uint16_t>>
 class Firewall : public Processor<T>
 {
 public:
+    /** @brief Number of bits in a bitmap word */
+    static constexpr unsigned kWordBits = 64;
+
+    /** @brief Number of words in the bitmap of allowed ports */
+    static constexpr unsigned kNumWords = 65536/kWordBits;
+
     Firewall()
       : enabled_(false)
       , allow_broadcasts_(false)
     {
+        for (auto &word : ports_)
+            word.store(0, std::memory_order_relaxed);
     }
 
     virtual ~Firewall() = default;
@@ -40,25 +57,25 @@ public:
     /** @brief Get enabled flagd */
     bool getEnabled(void)
     {
-        return enabled_;
+        return enabled_.load(std::memory_order_relaxed);
     }
 
     /** @brief Set enabled flag */
     void setEnabled(bool enabled)
     {
-        enabled_ = enabled;
+        enabled_.store(enabled, std::memory_order_relaxed);
     }
 
     /** @brief Get flag indicating whether or not bradcast packets are allowed */
     bool getAllowBroadcasts(void)
     {
-        return allow_broadcasts_;
+        return allow_broadcasts_.load(std::memory_order_relaxed);
     }
 
     /** @brief Set flag indicating whether or not bradcast packets are allowed */
     void setAllowBroadcasts(bool allowed)
     {
-        allow_broadcasts_ = allowed;
+        allow_broadcasts_.store(allowed, std::memory_order_relaxed);
     }
 
     /** @brief Get allowed ports */
@@ -72,28 +89,39 @@ public:
     /** @brief Set allowed ports */
     void setAllowedPorts(const Set &allowed)
     {
+        std::array<uint64_t, kNumWords> ports = {};
+
+        for (uint16_t port : allowed)
+            ports[port/kWordBits] |= uint64_t(1) << (port % kWordBits);
+
         std::lock_guard<std::mutex> lock(mutex_);
 
         allowed_ = allowed;
+
+        for (unsigned i = 0; i < kNumWords; ++i)
+            ports_[i].store(ports[i], std::memory_order_relaxed);
     }
 
 protected:
-    /** @brief Mutex for ports */
+    /** @brief Mutex serializing updates to allowed ports */
     std::mutex mutex_;
 
     /** @brief Is the fireweall enabled? */
-    bool enabled_;
+    std::atomic<bool> enabled_;
 
     /** @brief Should we allow broadcast packets? */
-    bool allow_broadcasts_;
+    std::atomic<bool> allow_broadcasts_;
 
     /** @brief allowed ports */
     Set allowed_;
 
+    /** @brief Bitmap of allowed ports */
+    std::array<std::atomic<uint64_t>, kNumWords> ports_;
+
     /** @brief Filter a packet */
     virtual bool process(T &pkt) override
     {
-        if (!enabled_)
+        if (!enabled_.load(std::memory_order_relaxed))
             return true;
 
         // Always pass SYN packets
@@ -101,51 +129,28 @@ protected:
             return true;
 
         // Then check for a broadcast
-        if (pkt->hdr.nexthop == kNodeBroadcast && allow_broadcasts_)
+        if (pkt->hdr.nexthop == kNodeBroadcast && allow_broadcasts_.load(std::memory_order_relaxed))
             return true;
 
         // Then look at the port
-        std::lock_guard<std::mutex> lock(mutex_);
-        const struct ip             *iph = pkt->getIPHdr();
+        PacketLayout layout = pkt->getLayout();
 
-        if (!iph)
+        if (layout.ip == 0)
             return true;
 
-        switch (iph->ip_p) {
-            case IPPROTO_UDP:
-            {
-                const struct udphdr *udph = pkt->getUDPHdr();
-
-                if (allowed_.find(ntohs(udph->uh_dport)) != allowed_.end())
-                    return true;
-                else {
-                    logNet(LOGDEBUG, "firewall dropping packet: curhop=%u; nexthop=%u; flow=%u",
-                        pkt->hdr.curhop,
-                        pkt->hdr.nexthop,
-                        ntohs(udph->uh_dport));
-                    return false;
-                }
-            }
-            break;
-
-            case IPPROTO_TCP:
-            {
-                const struct tcphdr *tcph = pkt->getTCPHdr();
-
-                if (allowed_.find(ntohs(tcph->th_dport)) != allowed_.end())
-                    return true;
-                else {
-                    logNet(LOGDEBUG, "firewall dropping packet: curhop=%u; nexthop=%u; flow=%u",
-                        pkt->hdr.curhop,
-                        pkt->hdr.nexthop,
-                        ntohs(tcph->th_dport));
-                    return false;
-                }
-            }
-            break;
-
-            default:
-                return false;
+        if (layout.l4 == 0)
+            return false;
+
+        uint64_t word = ports_[layout.dport/kWordBits].load(std::memory_order_relaxed);
+
+        if (word & (uint64_t(1) << (layout.dport % kWordBits)))
+            return true;
+        else {
+            logNet(LOGDEBUG, "firewall dropping packet: curhop=%u; nexthop=%u; flow=%u",
+                pkt->hdr.curhop,
+                pkt->hdr.nexthop,
+                layout.dport);
+            return false;
         }
     }
 };
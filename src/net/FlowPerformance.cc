@@ -13,6 +13,7 @@
 
 #include "Logger.hh"
 #include "net/FlowPerformance.hh"
+#include "util/sprintf.hh"
 
 #define DEBUG 0
 
@@ -28,39 +29,26 @@ FlowPerformance::FlowPerformance(double mp)
   , radio_in(*this, nullptr, nullptr, std::bind(&FlowPerformance::radioPush, this, _1))
   , radio_out(*this, nullptr, nullptr)
   , mp_(mp)
+  , source_epoch_(1)
+  , sink_epoch_(1)
 {
 }
 
 void FlowPerformance::setMandates(const MandateMap &mandates)
 {
-    // Set mandates
-    {
-        std::lock_guard<std::mutex> lock(mandates_mutex_);
-
-        mandates_ = mandates;
-    }
-
-    // Update source mandates
-    {
-        std::lock_guard<std::mutex> lock(sources_mutex_);
-
-        for (auto mandate = mandates.begin(); mandate != mandates.end(); ++mandate) {
-            auto it = sources_.find(mandate->first);
-
-            if (it != sources_.end())
-                it->second.setMandate(mandate->second);
-        }
-    }
+    std::lock_guard<std::mutex> lock(mandates_mutex_);
 
-    // Update sink mandates
-    {
-        std::lock_guard<std::mutex> lock(sinks_mutex_);
+    mandates_ = mandates;
 
-        for (auto mandate = mandates.begin(); mandate != mandates.end(); ++mandate) {
-            auto it = sinks_.find(mandate->first);
+    // Update source and sink mandates
+    for (FlowStatsTable *flows : {&sources_, &sinks_}) {
+        for (FlowStats *flow = flows->head(); flow; flow = flow->next) {
+            auto it = mandates_.find(flow->flow_uid);
 
-            if (it != sources_.end())
-                it->second.setMandate(mandate->second);
+            if (it != mandates_.end())
+                flow->setMandate(it->second);
+            else
+                flow->clearMandate();
         }
     }
 }
@@ -71,8 +59,7 @@ void FlowPerformance::netPush(std::shared_ptr<NetPacket> &&pkt)
     pkt->initMGENInfo();
 
     if (pkt->flow_uid) {
-        std::lock_guard<std::mutex> lock(sources_mutex_);
-        FlowStats                   &stats = findFlow(sources_, *pkt);
+        FlowStats &stats = findFlow(sources_, *pkt);
 
         // Record sent MGEN packet
         const struct mgenhdr *mgenhdr = pkt->getMGENHdr();
@@ -86,7 +73,7 @@ void FlowPerformance::netPush(std::shared_ptr<NetPacket> &&pkt)
 
                 pkt->mp = mp;
 
-                stats.record(*pkt, mp);
+                stats.record(*pkt, mp, source_epoch_.load(std::memory_order_relaxed));
 
                 logMgen("MGEN: send flow %d seq %d",
                     mgenhdr->getFlowId(),
@@ -103,45 +90,29 @@ void FlowPerformance::netPush(std::shared_ptr<NetPacket> &&pkt)
 
 void FlowPerformance::radioPush(std::shared_ptr<RadioPacket> &&pkt)
 {
-    const struct ip* iph = pkt->getIPHdr();
+    PacketLayout layout = pkt->getLayout();
 
-    if (iph) {
+    if (layout.ip != 0) {
         // Set packet's flow uid
-        switch (iph->ip_p) {
-            case IPPROTO_UDP:
-            {
-                const struct udphdr *udph = pkt->getUDPHdr();
-
-                if (udph)
-                    pkt->flow_uid = ntohs(udph->uh_dport);
-            }
-            break;
-
-            case IPPROTO_TCP:
-            {
-                const struct tcphdr *tcph = pkt->getTCPHdr();
-
-                if (tcph)
-                    pkt->flow_uid = ntohs(tcph->th_dport);
-            }
-            break;
-        }
+        if (layout.l4 != 0)
+            pkt->flow_uid = layout.dport;
 
         // Record flow statistics
         const struct mgenhdr *mgenhdr = pkt->getMGENHdr();
 
         if (mgenhdr) {
-            std::lock_guard<std::mutex> lock(sinks_mutex_);
-            FlowStats                   &stats = findFlow(sinks_, *pkt);
-            WallClock::time_point       ts_epoch = mgenhdr->getTimestamp();
-            double                      ts = ts_epoch.get_real_secs();
-            double                      latency = (WallClock::now() - ts_epoch).get_real_secs();
+            FlowStats             &stats = findFlow(sinks_, *pkt);
+            WallClock::time_point ts_epoch = mgenhdr->getTimestamp();
+            double                ts = ts_epoch.get_real_secs();
+            double                latency = (WallClock::now() - ts_epoch).get_real_secs();
+
+            stats.latency_metric.observe(latency);
 
             if (start_ && ts > *start_) {
                 unsigned mp = (ts - *start_) / mp_;
 
-                if (!stats.mandated_latency || latency <= *stats.mandated_latency) {
-                    stats.record(*pkt, mp);
+                if (latency <= stats.mandated_latency.load(std::memory_order_relaxed)) {
+                    stats.record(*pkt, mp, sink_epoch_.load(std::memory_order_relaxed));
 
                     logMgen("MGEN: recv flow %d seq %d latency %f",
                         mgenhdr->getFlowId(),
@@ -163,56 +134,229 @@ void FlowPerformance::radioPush(std::shared_ptr<RadioPacket> &&pkt)
     radio_out.push(std::move(pkt));
 }
 
-FlowStatsMap FlowPerformance::getFlowStatsMap(FlowStatsMap &stats,
-                                              std::mutex &mutex,
-                                              bool reset)
+FlowStatsUpdates FlowPerformance::getUpdates(FlowStatsTable &flows,
+                                             std::atomic<uint32_t> &epoch,
+                                             uint32_t cursor)
 {
-    // Get current MP
-    unsigned current_mp = (WallClock::now().get_real_secs() - *start_) / mp_;
+    FlowStatsUpdates result;
 
-    // Get a copy of the statistics
-    FlowStatsMap result;
+    // Start a new epoch. Slots modified in the epoch that was current during
+    // this export are reported again by the next export, so concurrent
+    // modifications are never lost, although a slot may be reported twice.
+    result.cursor = epoch.fetch_add(1, std::memory_order_acq_rel);
 
-    {
-        std::lock_guard<std::mutex> lock(mutex);
+    for (FlowStats *flow = flows.head(); flow; flow = flow->next) {
+        auto range = flow->modifiedSince(cursor);
 
-        // Expand stats to include current MP
-        for (auto it = stats.begin(); it != stats.end(); ++it)
-            it->second.stats.resize(current_mp + 1);
+        if (!range)
+            continue;
 
-        // Get a copy of stats
-        result = stats;
+        FlowStatsUpdate update;
 
-        // Reset statistics
-        if (reset) {
-            for (auto it = stats.begin(); it != stats.end(); ++it)
-                it->second.low_mp = it->second.stats.size();
-        }
-    }
+        update.flow_uid = flow->flow_uid;
+        update.src = flow->src;
+        update.dest = flow->dest;
+        update.first_mp = range->first;
+        update.stats.reserve(range->second - range->first + 1);
 
-    // Set lowest MP to size of stats if no MP was touched
-    for (auto it = result.begin(); it != result.end(); ++it) {
-        if (!it->second.low_mp)
-            it->second.low_mp = it->second.stats.size();
+        for (unsigned mp = range->first; mp <= range->second; ++mp)
+            update.stats.emplace_back(flow->get(mp).value_or(MPStats()));
+
+        result.flows.emplace_back(std::move(update));
     }
 
     return result;
 }
 
-FlowStats &FlowPerformance::findFlow(FlowStatsMap &stats, Packet &pkt)
+FlowStats &FlowPerformance::findFlow(FlowStatsTable &flows, Packet &pkt)
 {
     FlowUID   flow_uid = *pkt.flow_uid;
-    auto      it = stats.try_emplace(flow_uid, flow_uid, pkt.ehdr().src, pkt.ehdr().dest);
-    FlowStats &flow = it.first->second;
+    FlowStats *flow = flows.find(flow_uid);
+
+    if (flow)
+        return *flow;
+
+    // Initialize a new flow's mandated latency and metrics before it is
+    // visible to any other thread
+    auto init = [&](FlowStats &flow) {
+        std::string prefix = &flows == &sources_ ? "dragonradio_flow_sent" : "dragonradio_flow_recv";
+
+        flow.npackets_metric = Counter(metrics(),
+            prefix + sprintf("_packets_total{flow=\"%u\"}", (unsigned) flow_uid),
+            "Flow packets");
+        flow.nbytes_metric = Counter(metrics(),
+            prefix + sprintf("_bytes_total{flow=\"%u\"}", (unsigned) flow_uid),
+            "Flow bytes");
+
+        if (&flows == &sinks_)
+            flow.latency_metric = Histogram(metrics(),
+                sprintf("dragonradio_flow_latency_seconds{flow=\"%u\"}", (unsigned) flow_uid),
+                {1e-3, 2e-3, 5e-3, 10e-3, 20e-3, 50e-3, 100e-3, 200e-3, 500e-3, 1.0, 2.0, 5.0},
+                "Flow packet latency");
 
-    // If we inserted a new flow, add its mandated latency
-    if (it.second) {
         std::lock_guard<std::mutex> lock(mandates_mutex_);
         auto                        mandate = mandates_.find(flow_uid);
 
         if (mandate != mandates_.end())
             flow.setMandate(mandate->second);
+    };
+
+    flow = flows.findOrInsert(flow_uid, pkt.ehdr().src, pkt.ehdr().dest, init);
+
+    // setMandates only sees flows that are on the list of flows, and a new
+    // flow is linked into the list after init runs. Apply the mandate again
+    // now that the flow is on the list, so a concurrent setMandates cannot
+    // miss it.
+    {
+        std::lock_guard<std::mutex> lock(mandates_mutex_);
+        auto                        mandate = mandates_.find(flow_uid);
+
+        if (mandate != mandates_.end())
+            flow->setMandate(mandate->second);
+        else
+            flow->clearMandate();
+    }
+
+    return *flow;
+}
+
+FlowStats::FlowStats(FlowUID flow_uid, NodeId src, NodeId dest)
+  : flow_uid(flow_uid)
+  , src(src)
+  , dest(dest)
+  , mandated_latency(std::numeric_limits<double>::infinity())
+  , next(nullptr)
+  , epoch_(0)
+{
+}
+
+bool FlowStats::record(Packet &pkt, unsigned mp, uint32_t epoch)
+{
+    Slot     &slot = ring_[mp % kMPRingSize];
+    uint32_t tag = mp + 1;
+    uint32_t cur = slot.tag.load(std::memory_order_acquire);
+
+    // Claim the slot for this MP if it holds an older MP
+    while (cur != tag) {
+        if (cur & kBusy)
+            cur = slot.tag.load(std::memory_order_acquire);
+        else if (cur > tag)
+            return false;
+        else if (slot.tag.compare_exchange_weak(cur, tag | kBusy, std::memory_order_acquire)) {
+            slot.npackets.store(0, std::memory_order_relaxed);
+            slot.nbytes.store(0, std::memory_order_relaxed);
+            slot.tag.store(tag, std::memory_order_release);
+            cur = tag;
+        }
+    }
+
+    slot.npackets.fetch_add(1, std::memory_order_relaxed);
+    slot.nbytes.fetch_add(pkt.payload_size, std::memory_order_relaxed);
+    slot.epoch.store(epoch, std::memory_order_release);
+    epoch_.store(epoch, std::memory_order_release);
+
+    npackets_metric.inc();
+    nbytes_metric.inc(pkt.payload_size);
+
+    return true;
+}
+
+std::optional<MPStats> FlowStats::get(unsigned mp) const
+{
+    const Slot &slot = ring_[mp % kMPRingSize];
+    uint32_t   tag = mp + 1;
+    uint32_t   cur = slot.tag.load(std::memory_order_acquire);
+    MPStats    stats;
+
+    // No packet was recorded in this MP
+    if (cur < tag)
+        return stats;
+
+    // The slot has been re-used by a later MP
+    if (cur != tag)
+        return std::nullopt;
+
+    stats.npackets = slot.npackets.load(std::memory_order_relaxed);
+    stats.nbytes = slot.nbytes.load(std::memory_order_relaxed);
+
+    // Make sure the slot wasn't re-used while we were reading it
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (slot.tag.load(std::memory_order_relaxed) != tag)
+        return std::nullopt;
+
+    return stats;
+}
+
+std::optional<std::pair<unsigned, unsigned>> FlowStats::modifiedSince(uint32_t epoch) const
+{
+    std::optional<std::pair<unsigned, unsigned>> range;
+
+    if (epoch_.load(std::memory_order_acquire) < epoch)
+        return range;
+
+    for (const Slot &slot : ring_) {
+        uint32_t tag = slot.tag.load(std::memory_order_acquire);
+
+        if (tag == 0 || (tag & kBusy) || slot.epoch.load(std::memory_order_acquire) < epoch)
+            continue;
+
+        unsigned mp = tag - 1;
+
+        if (!range)
+            range = std::make_pair(mp, mp);
+        else {
+            range->first = std::min(range->first, mp);
+            range->second = std::max(range->second, mp);
+        }
+    }
+
+    return range;
+}
+
+FlowStatsTable::FlowStatsTable()
+  : flows_(new std::atomic<FlowStats*>[std::numeric_limits<FlowUID>::max() + 1])
+  , head_(nullptr)
+{
+    for (size_t i = 0; i <= std::numeric_limits<FlowUID>::max(); ++i)
+        flows_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+FlowStatsTable::~FlowStatsTable()
+{
+    FlowStats *flow = head_.load(std::memory_order_acquire);
+
+    while (flow) {
+        FlowStats *next = flow->next;
+
+        delete flow;
+        flow = next;
     }
+}
+
+FlowStats *FlowStatsTable::findOrInsert(FlowUID flow_uid,
+                                        NodeId src,
+                                        NodeId dest,
+                                        const std::function<void(FlowStats&)> &init)
+{
+    FlowStats *flow = find(flow_uid);
+
+    if (flow)
+        return flow;
+
+    std::unique_ptr<FlowStats> new_flow = std::make_unique<FlowStats>(flow_uid, src, dest);
+
+    init(*new_flow);
+
+    if (!flows_[flow_uid].compare_exchange_strong(flow, new_flow.get(), std::memory_order_acq_rel))
+        return flow;
+
+    // Add the new flow to the list of flows
+    flow = new_flow.release();
+    flow->next = head_.load(std::memory_order_relaxed);
+
+    while (!head_.compare_exchange_weak(flow->next, flow, std::memory_order_release, std::memory_order_relaxed))
+        ;
 
     return flow;
 }
@@ -4,15 +4,20 @@
 #ifndef FLOWPERFORMANCE_HH_
 #define FLOWPERFORMANCE_HH_
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <unordered_map>
+#include <vector>
 
 #include "Clock.hh"
 #include "Packet.hh"
 #include "cil/CIL.hh"
 #include "net/Processor.hh"
-#include "stats/TimeWindowEstimator.hh"
+#include "stats/Metrics.hh"
 
 /** @brief Statistics for a single measurement period */
 struct MPStats {
@@ -26,19 +31,117 @@ struct MPStats {
 };
 
 /** @brief Statistics for a single flow */
+/** Per-MP statistics are kept in a fixed-size ring indexed by MP, so memory
+ * use and export cost do not grow with the length of a run. Each ring slot is
+ * tagged with the MP it currently holds and the export epoch in which it was
+ * last modified. Recording a packet only touches atomics in its slot, so any
+ * number of threads may record packets while statistics are exported.
+ */
 struct FlowStats {
-    FlowStats(FlowUID flow_uid, NodeId src, NodeId dest)
-      : flow_uid(flow_uid)
-      , src(src)
-      , dest(dest)
+    /** @brief Number of MP's held in the ring */
+    static constexpr unsigned kMPRingSize = 256;
+
+    FlowStats(FlowUID flow_uid, NodeId src, NodeId dest);
+
+    FlowStats() = delete;
+    FlowStats(const FlowStats&) = delete;
+
+    /** @brief Flow UID */
+    const FlowUID flow_uid;
+
+    /** @brief Flow source */
+    const NodeId src;
+
+    /** @brief Flow destination */
+    const NodeId dest;
+
+    /** @brief Flow mandated latency, or infinity if there is none */
+    std::atomic<double> mandated_latency;
+
+    /** @brief Exported packet counter */
+    Counter npackets_metric;
+
+    /** @brief Exported byte counter */
+    Counter nbytes_metric;
+
+    /** @brief Exported latency histogram. Only used for sinks. */
+    Histogram latency_metric;
+
+    /** @brief Next flow in table */
+    FlowStats *next;
+
+    /** @brief Record statistics for a packet
+     * @param pkt The packet
+     * @param mp The packet's MP
+     * @param epoch The current export epoch
+     * @return true if the packet was recorded, false if its MP is too old to
+     * be held in the ring.
+     */
+    bool record(Packet &pkt, unsigned mp, uint32_t epoch);
+
+    /** @brief Get statistics for an MP
+     * @param mp The MP
+     * @return Statistics for the MP, or nothing if the MP is no longer held
+     * in the ring.
+     */
+    std::optional<MPStats> get(unsigned mp) const;
+
+    /** @brief Find range of MP's modified in or after an epoch
+     * @param epoch The epoch
+     * @return The lowest and highest MP modified, or nothing if no MP was
+     * modified.
+     */
+    std::optional<std::pair<unsigned, unsigned>> modifiedSince(uint32_t epoch) const;
+
+    /** @brief Set a flow's mandates */
+    void setMandate(const Mandate &mandate)
     {
-        // Reserve enough room for 30min worth of entries by default (assuming a
-        // measurement period of 1 sec)
-        stats.reserve(30*60);
+        mandated_latency.store(mandate.mandated_latency ? *mandate.mandated_latency : std::numeric_limits<double>::infinity(),
+                               std::memory_order_relaxed);
     }
 
-    FlowStats() = delete;
+    /** @brief Clear a flow's mandates */
+    void clearMandate(void)
+    {
+        mandated_latency.store(std::numeric_limits<double>::infinity(), std::memory_order_relaxed);
+    }
+
+protected:
+    /** @brief Tag bit indicating a slot is being reset */
+    static constexpr uint32_t kBusy = 0x80000000;
+
+    /** @brief A ring slot */
+    struct Slot {
+        Slot()
+          : tag(0)
+          , epoch(0)
+          , npackets(0)
+          , nbytes(0)
+        {
+        }
+
+        /** @brief One more than the MP held in this slot, or 0 if empty */
+        std::atomic<uint32_t> tag;
+
+        /** @brief Export epoch of last modification */
+        std::atomic<uint32_t> epoch;
+
+        /** @brief Number of packets sent/received */
+        std::atomic<uint64_t> npackets;
+
+        /** @brief Number of bytes sent/received */
+        std::atomic<uint64_t> nbytes;
+    };
 
+    /** @brief Export epoch of last modification to any slot */
+    std::atomic<uint32_t> epoch_;
+
+    /** @brief Per-MP statistics */
+    std::array<Slot, kMPRingSize> ring_;
+};
+
+/** @brief Statistics for a flow's MP's that changed since a cursor */
+struct FlowStatsUpdate {
     /** @brief Flow UID */
     FlowUID flow_uid;
 
@@ -48,36 +151,66 @@ struct FlowStats {
     /** @brief Flow destination */
     NodeId dest;
 
-    /** @brief Flow mandated latency */
-    std::optional<double> mandated_latency;
+    /** @brief First MP in stats */
+    unsigned first_mp;
 
-    /** @brief Lowest MP modified */
-    std::optional<size_t> low_mp;
-
-    /** @brief Flow statistics for each measurement period */
+    /** @brief Statistics for MP's [first_mp, first_mp + stats.size()) */
     std::vector<MPStats> stats;
+};
 
-    /** @brief Record statistics for a packet */
-    void record(Packet &pkt, size_t mp)
-    {
-        if (mp >= stats.size())
-            stats.resize(mp + 1);
+/** @brief Flow statistics that changed since a cursor */
+struct FlowStatsUpdates {
+    /** @brief Cursor to pass to the next export */
+    uint32_t cursor;
+
+    /** @brief Updated flows */
+    std::vector<FlowStatsUpdate> flows;
+};
+
+/** @brief A table of flow statistics indexed by flow UID */
+/** Flows are never removed from the table, so lookup is a single atomic load
+ * and never takes a lock.
+ */
+class FlowStatsTable {
+public:
+    FlowStatsTable();
+
+    FlowStatsTable(const FlowStatsTable&) = delete;
 
-        if (!low_mp || mp < low_mp)
-            low_mp = mp;
+    ~FlowStatsTable();
 
-        ++stats[mp].npackets;
-        stats[mp].nbytes += pkt.payload_size;
+    /** @brief Find a flow, returning nullptr if it does not exist */
+    FlowStats *find(FlowUID flow_uid) const
+    {
+        return flows_[flow_uid].load(std::memory_order_acquire);
     }
 
-    /** @brief Set a flow's mandates */
-    void setMandate(const Mandate &mandate)
+    /** @brief Find a flow, inserting it if it does not exist
+     * @param flow_uid Flow UID
+     * @param src Flow source
+     * @param dest Flow destination
+     * @param init Function used to initialize a new flow before it is
+     * inserted
+     * @return The flow
+     */
+    FlowStats *findOrInsert(FlowUID flow_uid,
+                            NodeId src,
+                            NodeId dest,
+                            const std::function<void(FlowStats&)> &init);
+
+    /** @brief Get first flow in table */
+    FlowStats *head(void) const
     {
-        mandated_latency = mandate.mandated_latency;
+        return head_.load(std::memory_order_acquire);
     }
-};
 
-using FlowStatsMap = std::unordered_map<FlowUID, FlowStats>;
+protected:
+    /** @brief Flows indexed by flow UID */
+    std::unique_ptr<std::atomic<FlowStats*>[]> flows_;
+
+    /** @brief List of all flows */
+    std::atomic<FlowStats*> head_;
+};
 
 /** @brief A flow performance measurement element. */
 class FlowPerformance : public Element
@@ -107,16 +240,22 @@ public:
         start_ = start;
     }
 
-    /** @brief Return flow source statistics */
-    FlowStatsMap getSources(bool reset)
+    /** @brief Return flow source statistics modified since a cursor
+     * @param cursor The cursor returned by the previous call, or 0 to
+     * return all statistics still held.
+     */
+    FlowStatsUpdates getSourceUpdates(uint32_t cursor)
     {
-        return getFlowStatsMap(sources_, sources_mutex_, reset);
+        return getUpdates(sources_, source_epoch_, cursor);
     }
 
-    /** @brief Return flow sink statistics */
-    FlowStatsMap getSinks(bool reset)
+    /** @brief Return flow sink statistics modified since a cursor
+     * @param cursor The cursor returned by the previous call, or 0 to
+     * return all statistics still held.
+     */
+    FlowStatsUpdates getSinkUpdates(uint32_t cursor)
     {
-        return getFlowStatsMap(sinks_, sinks_mutex_, reset);
+        return getUpdates(sinks_, sink_epoch_, cursor);
     }
 
     /** @brief Get mandates */
@@ -149,17 +288,17 @@ protected:
     /** @brief Start time */
     std::optional<double> start_;
 
-    /** @brief Mutex for sources */
-    std::mutex sources_mutex_;
+    /** @brief Current source export epoch */
+    std::atomic<uint32_t> source_epoch_;
 
-    /** @brief Flow source info */
-    FlowStatsMap sources_;
+    /** @brief Current sink export epoch */
+    std::atomic<uint32_t> sink_epoch_;
 
-    /** @brief Mutex for sinks */
-    std::mutex sinks_mutex_;
+    /** @brief Flow source info */
+    FlowStatsTable sources_;
 
     /** @brief Flow sink info */
-    FlowStatsMap sinks_;
+    FlowStatsTable sinks_;
 
     /** @brief Mandates mutex */
     std::mutex mandates_mutex_;
@@ -173,13 +312,17 @@ protected:
     /** @brief Handle a radio packet */
     void radioPush(std::shared_ptr<RadioPacket> &&pkt);
 
-    /** @brief Return a copy of a FlowStatsMap, resetting it if necessary */
-    FlowStatsMap getFlowStatsMap(FlowStatsMap &stats,
-                                 std::mutex &mutex,
-                                 bool reset);
-
-    /** @brief Find a flow's entry in statistics map */
-    FlowStats &findFlow(FlowStatsMap &stats, Packet &pkt);
+    /** @brief Return flow statistics modified since a cursor
+     * @param flows The flow table
+     * @param epoch The flow table's export epoch
+     * @param cursor The cursor returned by the previous call
+     */
+    FlowStatsUpdates getUpdates(FlowStatsTable &flows,
+                                std::atomic<uint32_t> &epoch,
+                                uint32_t cursor);
+
+    /** @brief Find a flow's entry in statistics table */
+    FlowStats &findFlow(FlowStatsTable &flows, Packet &pkt);
 };
 
 #endif /* FLOWPERFORMANCE_HH_ */
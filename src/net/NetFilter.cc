@@ -9,6 +9,7 @@
 #include <arpa/inet.h>
 
 #include <cstddef>
+#include <cstring>
 
 #include "logging.hh"
 #include "net/NetFilter.hh"
@@ -21,7 +22,17 @@ bool NetFilter::process(std::shared_ptr<NetPacket>& pkt)
         return false;
     }
 
-    struct ether_header* eth = reinterpret_cast<struct ether_header*>(pkt->data() + sizeof(ExtendedHeader));
+    const struct ether_header *eth = pkt->getEthernetHdr();
+
+    if (!eth) {
+        logNet(LOGDEBUG, "dropped runt packet");
+        return false;
+    }
+
+    // Parse headers once. Every later stage uses the cached layout.
+    pkt->classify();
+
+    const struct ip *iph = pkt->getIPHdr();
 
     // Node number is last octet of the ethernet MAC address by convention
     NodeId curhop_id = eth->ether_shost[5];
@@ -29,14 +40,13 @@ bool NetFilter::process(std::shared_ptr<NetPacket>& pkt)
 
     // Only transmit IP packets that are either broadcast packets or where we
     // are the source and we know of the destination.
-    if (ntohs(eth->ether_type) == ETHERTYPE_IP &&
+    if (iph &&
         (isEthernetBroadcast(eth->ether_dhost) || (curhop_id == radionet_->getThisNodeId() && radionet_->contains(nexthop_id)))) {
-        struct ip* iph = reinterpret_cast<struct ip*>(pkt->data() + sizeof(ExtendedHeader) + sizeof(struct ether_header));
-        in_addr    ip_src;
-        in_addr    ip_dst;
+        in_addr ip_src;
+        in_addr ip_dst;
 
-        std::memcpy(&ip_src, reinterpret_cast<char*>(iph) + offsetof(struct ip, ip_src), sizeof(ip_src));
-        std::memcpy(&ip_dst, reinterpret_cast<char*>(iph) + offsetof(struct ip, ip_dst), sizeof(ip_dst));
+        std::memcpy(&ip_src, reinterpret_cast<const char*>(iph) + offsetof(struct ip, ip_src), sizeof(ip_src));
+        std::memcpy(&ip_dst, reinterpret_cast<const char*>(iph) + offsetof(struct ip, ip_dst), sizeof(ip_dst));
 
         NodeId   src_id;
         NodeId   dest_id;
@@ -249,6 +249,9 @@ public:
         pkt.swap(*this);
         pkt.ehdr().data_len = static_cast<ssize_t>(pkt.ehdr().data_len) - saved;
         pkt.resize(outoff);
+
+        // Headers have been rewritten, so the cached layout is stale
+        pkt.invalidateLayout();
     }
 
     NetPacket &pkt;
@@ -632,6 +635,9 @@ public:
         pkt.swap(*this);
         pkt.ehdr().data_len = static_cast<ssize_t>(pkt.ehdr().data_len) + extra;
         pkt.resize(outoff);
+
+        // Headers have been restored, so parse them once
+        pkt.classify();
     }
 
     RadioPacket &pkt;
@@ -270,7 +270,7 @@ void TunTap::send(std::shared_ptr<RadioPacket>&& pkt)
 void TunTap::start(void)
 {
     done_ = false;
-    worker_thread_ = std::thread(&TunTap::worker, this);
+    worker_thread_ = spawnThread("tuntap", &TunTap::worker, this);
 }
 
 void TunTap::stop(void)
@@ -4,42 +4,30 @@
 #include "logging.hh"
 #include "phy/AutoGain.hh"
 
-void AutoGain::autoSoftGain0dBFS(float g, std::shared_ptr<IQBuf> buf)
+void AutoGain::autoSoftGain0dBFS(float g, const fc32_t *data, size_t n)
 {
-    {
-        std::unique_lock<std::shared_mutex> lock(mutex_);
-
-        if (nestimates_0dBFS_ > 0)
-            --nestimates_0dBFS_;
-        else
-            return;
-    }
-
-    size_t n = buf->size();
-
     // This should never happen, but just in case...
     if (n == 0)
         return;
 
-    std::complex<float>* f = buf->data();
-    auto                 power = std::unique_ptr<float[]>(new float[n]);
+    PowerHistogram hist;
 
-    for (size_t i = 0; i < n; ++i) {
-        std::complex<float> temp = f[i];
+    samplePower(data, n, 1.0f, getEstimateStride(), hist);
 
-        power[i] = temp.real()*temp.real() + temp.imag()*temp.imag();
-    }
-
-    std::sort(power.get(), power.get() + n);
+    autoSoftGain0dBFS(g, hist);
+}
 
-    size_t max_n = getAutoSoftTXGainClipFrac()*n;
+void AutoGain::autoSoftGain0dBFS(float g, const PowerHistogram &hist)
+{
+    // Don't bother computing a quantile if no estimate is needed
+    if (!needCalcAutoSoftGain0dBFS())
+        return;
 
-    if (max_n < 0)
-        max_n = 0;
-    else if (max_n >= n)
-        max_n = n - 1;
+    // This should never happen, but just in case...
+    if (hist.nsamples == 0)
+        return;
 
-    float max_amp2 = power[max_n];
+    float max_amp2 = hist.quantile(getAutoSoftTXGainClipFrac());
 
     // Avoid division by 0!
     if (max_amp2 == 0.0)
@@ -48,13 +36,25 @@ void AutoGain::autoSoftGain0dBFS(float g, std::shared_ptr<IQBuf> buf)
     // XXX Should I^2 + Q^2 = 1.0 or 2.0?
     float g_estimate = sqrtf(1.0/max_amp2);
 
-    // g is the gain multiplier used to produce the IQ samples
-    {
-        std::unique_lock<std::shared_mutex> lock(mutex_);
+    // g is the gain multiplier used to produce the IQ samples. Claim one of
+    // the remaining estimates and fold it into the running mean as a single
+    // step.
+    float    x = g*g_estimate;
+    uint64_t old_state = state_.load(std::memory_order_relaxed);
+    uint64_t new_state;
+
+    do {
+        unsigned nestimates_left = nestimates(old_state);
+        unsigned k = nsamples(old_state);
+        float    g_0dBFS = gain(old_state);
+
+        if (nestimates_left == 0)
+            return;
 
-        g_0dBFS_estimate_.update(g*g_estimate);
-        g_0dBFS_.store(*g_0dBFS_estimate_, std::memory_order_relaxed);
-    }
+        new_state = pack(k == 0 ? x : g_0dBFS + (x - g_0dBFS)/(k + 1),
+                         k + 1,
+                         nestimates_left - 1);
+    } while (!state_.compare_exchange_weak(old_state, new_state, std::memory_order_relaxed));
 
     logAMC(LOGDEBUG-1, "updated auto-gain %0.1f", (double) getSoftTXGain0dBFS());
 }
@@ -4,70 +4,50 @@
 #ifndef AUTOGAIN_HH_
 #define AUTOGAIN_HH_
 
+#include <algorithm>
+#include <atomic>
 #include <complex>
-#include <mutex>
-#include <shared_mutex>
+#include <cstdint>
+#include <cstring>
 
 #include <liquid/liquid.h>
 
 #include "IQBuffer.hh"
+#include "IQConvert.hh"
 #include "phy/Modem.hh"
-#include "stats/Estimator.hh"
 
 /** @brief PHY TX parameters. */
+/** The 0dBFS gain, the number of estimates averaged into it, and the number
+ * of estimates still needed are packed into a single 64-bit atomic. Reading
+ * the gain is a relaxed load, and claiming an estimate and folding it into
+ * the running mean is a single compare-and-swap, so concurrent estimates
+ * cannot interleave and no operation ever takes a lock.
+ */
 struct AutoGain {
+    /** @brief Default sampling stride used when estimating 0dBFS gain */
+    static constexpr unsigned kDefaultEstimateStride = 4;
+
+    /** @brief Maximum number of estimates that may be requested */
+    static constexpr unsigned kMaxEstimates = UINT16_MAX;
+
     AutoGain()
-      : g_0dBFS_(1.0f)
+      : state_(pack(1.0f, 0, 0))
       , auto_soft_tx_gain_clip_frac_(0.999f)
-      , nestimates_0dBFS_(0)
-      , g_0dBFS_estimate_(1.0f)
+      , estimate_stride_(kDefaultEstimateStride)
     {
     }
 
     AutoGain(const AutoGain &other)
     {
-        std::shared_lock<std::shared_mutex> lock(other.mutex_);
-
-        g_0dBFS_.store(other.g_0dBFS_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-        auto_soft_tx_gain_clip_frac_.store(other.auto_soft_tx_gain_clip_frac_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-        nestimates_0dBFS_ = other.nestimates_0dBFS_;
-        g_0dBFS_estimate_ = other.g_0dBFS_estimate_;
-    }
-
-    AutoGain(AutoGain &&other)
-    {
-        g_0dBFS_.store(other.g_0dBFS_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-        auto_soft_tx_gain_clip_frac_.store(other.auto_soft_tx_gain_clip_frac_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-        nestimates_0dBFS_ = other.nestimates_0dBFS_;
-        g_0dBFS_estimate_ = std::move(other.g_0dBFS_estimate_);
+        *this = other;
     }
 
     AutoGain& operator =(const AutoGain &other)
     {
         if (this != &other) {
-            std::unique_lock<std::shared_mutex> this_lock(mutex_, std::defer_lock);
-            std::shared_lock<std::shared_mutex> other_lock(other.mutex_, std::defer_lock);
-
-            std::lock(this_lock, other_lock);
-
-            g_0dBFS_.store(other.g_0dBFS_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            state_.store(other.state_.load(std::memory_order_relaxed), std::memory_order_relaxed);
             auto_soft_tx_gain_clip_frac_.store(other.auto_soft_tx_gain_clip_frac_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-            nestimates_0dBFS_ = other.nestimates_0dBFS_;
-            g_0dBFS_estimate_ = other.g_0dBFS_estimate_;
-        }
-
-        return *this;
-    }
-
-    AutoGain& operator =(AutoGain &&other)
-    {
-        if (this != &other) {
-            std::unique_lock<std::shared_mutex> lock(mutex_);
-
-            g_0dBFS_.store(other.g_0dBFS_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-            auto_soft_tx_gain_clip_frac_.store(other.auto_soft_tx_gain_clip_frac_.load(std::memory_order_relaxed), std::memory_order_relaxed);
-            nestimates_0dBFS_ = other.nestimates_0dBFS_;
-            g_0dBFS_estimate_ = std::move(other.g_0dBFS_estimate_);
+            estimate_stride_.store(other.estimate_stride_.load(std::memory_order_relaxed), std::memory_order_relaxed);
         }
 
         return *this;
@@ -90,10 +70,25 @@ struct AutoGain {
         auto_soft_tx_gain_clip_frac_.store(frac, std::memory_order_relaxed);
     }
 
+    /** @brief Get the sampling stride used when estimating 0dBFS gain. */
+    unsigned getEstimateStride(void) const
+    {
+        return estimate_stride_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set the sampling stride used when estimating 0dBFS gain. */
+    /** Only every stride-th sample of a modulated packet contributes to the
+     * clipping quantile. A stride of 1 uses every sample.
+     */
+    void setEstimateStride(unsigned stride)
+    {
+        estimate_stride_.store(stride == 0 ? 1 : stride, std::memory_order_relaxed);
+    }
+
     /** @brief Get soft TX gain (multiplicative factor). */
     float getSoftTXGain(void) const
     {
-        return g_0dBFS_.load(std::memory_order_relaxed);
+        return gain(state_.load(std::memory_order_relaxed));
     }
 
     /** @brief Set soft TX gain (multiplicative factor).
@@ -101,16 +96,18 @@ struct AutoGain {
      */
     void setSoftTXGain(float g)
     {
-        std::lock_guard<std::shared_mutex> lock(mutex_);
+        uint64_t old_state = state_.load(std::memory_order_relaxed);
 
-        g_0dBFS_estimate_.reset(g);
-        g_0dBFS_.store(*g_0dBFS_estimate_, std::memory_order_relaxed);
+        while (!state_.compare_exchange_weak(old_state,
+                                             pack(g, 0, nestimates(old_state)),
+                                             std::memory_order_relaxed))
+            ;
     }
 
     /** @brief Get soft TX gain (dB). */
     float getSoftTXGain0dBFS(void) const
     {
-        return 20.0*logf(g_0dBFS_.load(std::memory_order_relaxed))/logf(10.0);
+        return 20.0*logf(getSoftTXGain())/logf(10.0);
     }
 
     /** @brief Set soft TX gain (dBFS).
@@ -118,53 +115,96 @@ struct AutoGain {
      */
     void setSoftTXGain0dBFS(float dB)
     {
-        std::lock_guard<std::shared_mutex> lock(mutex_);
-
-        g_0dBFS_estimate_.reset(powf(10.0f, dB/20.0f));
-        g_0dBFS_.store(*g_0dBFS_estimate_, std::memory_order_relaxed);
+        setSoftTXGain(powf(10.0f, dB/20.0f));
     }
 
     /** @brief Recalculate the 0dBFS estimate
-     * @param nsamples The number of samples used to estimate 0dBFS
+     * @param nsamples The number of samples used to estimate 0dBFS. At most
+     * kMaxEstimates samples are used.
      */
     void recalc0dBFSEstimate(unsigned nsamples)
     {
-        std::lock_guard<std::shared_mutex> lock(mutex_);
+        uint64_t old_state = state_.load(std::memory_order_relaxed);
+
+        nsamples = std::min(nsamples, kMaxEstimates);
 
-        g_0dBFS_estimate_.reset(*g_0dBFS_estimate_);
-        g_0dBFS_.store(*g_0dBFS_estimate_, std::memory_order_relaxed);
-        nestimates_0dBFS_ = nsamples;
+        while (!state_.compare_exchange_weak(old_state,
+                                             pack(gain(old_state), 0, nsamples),
+                                             std::memory_order_relaxed))
+            ;
     }
 
     /** @brief Do we need to calculate auto-gain? */
     bool needCalcAutoSoftGain0dBFS(void) const
     {
-        std::shared_lock<std::shared_mutex> lock(mutex_);
-
-        return nestimates_0dBFS_ > 0;
+        return nestimates(state_.load(std::memory_order_relaxed)) > 0;
     }
 
     /** @brief Calculate soft TX gain necessary for 0 dBFS.
-     * @param g Gain applied to buf.
-     * @param buf The IQ buffer for which we are calculating soft gain.
+     * @param g Gain applied to the samples.
+     * @param data Samples for which we are calculating soft gain.
+     * @param n Number of samples.
+     */
+    /** Only a strided subset of the samples is examined, so this is cheap
+     * enough to run inline on the modulation path.
      */
-    void autoSoftGain0dBFS(float g, std::shared_ptr<IQBuf> buf);
+    void autoSoftGain0dBFS(float g, const fc32_t *data, size_t n);
+
+    /** @brief Calculate soft TX gain necessary for 0 dBFS from a histogram.
+     * @param g Gain applied to the samples in the histogram.
+     * @param hist Histogram of sample power, typically gathered while the
+     * soft gain was applied.
+     */
+    void autoSoftGain0dBFS(float g, const PowerHistogram &hist);
 
 private:
-    /** @brief Multiplicative TX gain necessary for 0dBFS. */
-    std::atomic<float> g_0dBFS_;
+    /** @brief 0dBFS estimate state */
+    /** The upper 32 bits hold the multiplicative TX gain necessary for 0dBFS,
+     * the next 16 bits hold the number of estimates averaged into the gain,
+     * and the lower 16 bits hold the number of estimates still needed.
+     */
+    std::atomic<uint64_t> state_;
 
     /** @brief Fraction of unclipped IQ values. Defaults to 0.999. */
     std::atomic<float> auto_soft_tx_gain_clip_frac_;
 
-    /** @brief Mutex protecting private members. */
-    mutable std::shared_mutex mutex_;
+    /** @brief Sampling stride used when estimating 0dBFS gain. */
+    std::atomic<unsigned> estimate_stride_;
+
+    /** @brief Pack estimate state */
+    static uint64_t pack(float g, unsigned nsamples, unsigned nestimates)
+    {
+        uint32_t bits;
+
+        std::memcpy(&bits, &g, sizeof(bits));
 
-    /** @brief Number of samples to take to estimate g_0dBFS. */
-    unsigned nestimates_0dBFS_;
+        return (static_cast<uint64_t>(bits) << 32) |
+               (static_cast<uint64_t>(nsamples & 0xffff) << 16) |
+               (nestimates & 0xffff);
+    }
+
+    /** @brief Extract the 0dBFS gain from estimate state */
+    static float gain(uint64_t state)
+    {
+        uint32_t bits = state >> 32;
+        float    g;
+
+        std::memcpy(&g, &bits, sizeof(g));
+
+        return g;
+    }
 
-    /** @brief Estimate of multiplicative TX gain necessary for 0dBFS. */
-    Mean<float> g_0dBFS_estimate_;
+    /** @brief Extract the number of estimates averaged into the gain */
+    static unsigned nsamples(uint64_t state)
+    {
+        return (state >> 16) & 0xffff;
+    }
+
+    /** @brief Extract the number of estimates still needed */
+    static unsigned nestimates(uint64_t state)
+    {
+        return state & 0xffff;
+    }
 };
 
 #endif /* AUTOGAIN_HH_ */
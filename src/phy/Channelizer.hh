@@ -4,15 +4,42 @@
 #ifndef CHANNELIZER_H_
 #define CHANNELIZER_H_
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "Clock.hh"
 #include "IQBuffer.hh"
 #include "RadioNet.hh"
+#include "SafeQueue.hh"
+#include "Trace.hh"
+#include "logging.hh"
 #include "phy/Channel.hh"
 #include "phy/PHY.hh"
+#include "stats/Metrics.hh"
 
 /** @brief Base class for channelizers */
 class Channelizer : public Element
 {
 public:
+    /** @brief Policy for shedding load when demodulation falls behind */
+    enum ShedPolicy {
+        /** @brief Never shed slots */
+        kShedNone = 0,
+
+        /** @brief Skip a channel's oldest slots */
+        kShedOldest,
+
+        /** @brief Skip slots on idle channels before busy channels */
+        /** An idle channel's backlog is flushed as soon as it exceeds the
+         * limit. A channel that has recently received packets sheds its oldest
+         * slots only once its backlog exceeds twice the limit.
+         */
+        kShedIdleFirst
+    };
+
     Channelizer(std::shared_ptr<PHY> phy,
                 double rx_rate,
                 const Channels &channels)
@@ -20,6 +47,20 @@ public:
       , phy_(phy)
       , rx_rate_(rx_rate)
       , channels_(channels)
+      , reconfigure_metric_(metrics(), "dragonradio_rx_reconfigurations_total", "RX channelizer reconfigurations")
+      , reconfigure_latency_metric_(metrics(), "dragonradio_rx_reconfigure_seconds", {1e-4, 1e-3, 1e-2, 1e-1, 1}, "Time to build new RX channel state")
+      , reconfigure_slots_lost_metric_(metrics(), "dragonradio_rx_reconfigure_slots_lost", {0, 1, 2, 4, 8, 16}, "RX slots lost per reconfiguration")
+      , delivery_latency_metric_(metrics(), "dragonradio_rx_delivery_seconds", {1e-4, 2e-4, 5e-4, 1e-3, 2e-3, 5e-3, 1e-2, 2e-2, 5e-2}, "Time from the last sample of a received packet to its delivery")
+      , shed_metric_(metrics(), "dragonradio_rx_slots_shed_total", "RX slots skipped because demodulation fell behind")
+      , shed_tdbufs_metric_(metrics(), "dragonradio_rx_tdbufs_shed_total", "RX time-domain buffers skipped because the FFT fell behind")
+      , backlog_metric_(metrics(), "dragonradio_rx_backlog_slots", "Largest per-channel RX demodulation backlog")
+      , chunk_size_(kDefaultChunkSize)
+      , max_backlog_(kDefaultMaxBacklog)
+      , shed_policy_(kShedOldest)
+      , shedding_(false)
+      , nshed_(0)
+      , nshed_tdbufs_(0)
+      , nretired_(0)
     {
     }
 
@@ -28,7 +69,7 @@ public:
     /** @brief Get the RX sample rate. */
     virtual double getRXRate(void)
     {
-        return rx_rate_;
+        return rx_rate_.load(std::memory_order_relaxed);
     }
 
     /** @brief Set the RX sample rate.
@@ -36,7 +77,7 @@ public:
      */
     virtual void setRXRate(double rate)
     {
-        rx_rate_ = rate;
+        rx_rate_.store(rate, std::memory_order_relaxed);
         reconfigure();
     }
 
@@ -61,6 +102,118 @@ public:
     /** @brief Reconfigure for new RX parameters */
     virtual void reconfigure(void) = 0;
 
+    /** @brief Default number of samples demodulated at a time */
+    static constexpr size_t kDefaultChunkSize = 4096;
+
+    /** @brief Get the number of samples demodulated at a time. */
+    size_t getChunkSize(void) const
+    {
+        return chunk_size_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set the number of samples demodulated at a time. */
+    /** Time-domain channelizers demodulate an IQ buffer in chunks of at most
+     * this many samples as the buffer is received, rather than waiting for
+     * the whole buffer.
+     */
+    void setChunkSize(size_t n)
+    {
+        chunk_size_.store(n == 0 ? 1 : n, std::memory_order_relaxed);
+    }
+
+    /** @brief Default maximum number of slots queued per channel */
+    static constexpr size_t kDefaultMaxBacklog = 8;
+
+    /** @brief Number of consecutive slots without a packet after which a
+     * channel is considered idle
+     */
+    static constexpr unsigned kIdleSlots = 16;
+
+    /** @brief Get the maximum number of slots queued per channel. */
+    size_t getMaxBacklog(void) const
+    {
+        return max_backlog_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set the maximum number of slots queued per channel. */
+    /** Zero means the backlog is unbounded.
+     */
+    void setMaxBacklog(size_t n)
+    {
+        max_backlog_.store(n, std::memory_order_relaxed);
+    }
+
+    /** @brief Get the load shedding policy. */
+    ShedPolicy getShedPolicy(void) const
+    {
+        return shed_policy_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set the load shedding policy. */
+    void setShedPolicy(ShedPolicy policy)
+    {
+        shed_policy_.store(policy, std::memory_order_relaxed);
+    }
+
+    /** @brief Return true if slots are currently being shed. */
+    bool isShedding(void) const
+    {
+        return shedding_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Demodulate an IQ buffer in chunks as it is received
+     * @param iqbuf The IQ buffer
+     * @param off Offset of the first sample to demodulate
+     * @param nwanted Maximum number of samples to demodulate
+     * @param f Function called with each chunk of samples and its size
+     * @param granularity Every chunk is a multiple of this many samples
+     * @return The number of samples demodulated
+     */
+    /** This is public so that per-channel stream state shared between
+     * channelizers can demodulate using the channelizer's chunk size. The
+     * chunk size is rounded down to a multiple of the granularity, but is
+     * never less than the granularity. Trailing samples that do not form a
+     * whole multiple of the granularity are not demodulated.
+     */
+    template <class F>
+    size_t demodulateChunks(IQBuf &iqbuf,
+                            size_t off,
+                            size_t nwanted,
+                            F &&f,
+                            size_t granularity = 1)
+    {
+        const size_t chunk_size = std::max(getChunkSize()/granularity, static_cast<size_t>(1))*granularity;
+        size_t       ndemodulated = 0;
+        bool         complete;
+
+        while (ndemodulated < nwanted) {
+            size_t pos = off + ndemodulated;
+            size_t avail = iqbuf.waitForSamples(pos + granularity - 1, complete);
+
+            if (avail <= pos)
+                break;
+
+            size_t n = std::min({avail - pos,
+                                 nwanted - ndemodulated,
+                                 chunk_size});
+
+            n -= n % granularity;
+
+            if (n == 0)
+                break;
+
+            {
+                TRACE_SPAN_ARG("demodulate", n);
+
+                f(iqbuf.data() + off + ndemodulated, n);
+            }
+
+            ndemodulated += n;
+        }
+
+        return ndemodulated;
+    }
+
     /** @brief Demodulated packets */
     RadioOut<Push> source;
 
@@ -69,10 +222,232 @@ protected:
     std::shared_ptr<PHY> phy_;
 
     /** @brief RX sample rate */
-    double rx_rate_;
+    /** This is atomic because packets are delivered from demodulation
+     * threads while the rate may be changed.
+     */
+    std::atomic<double> rx_rate_;
 
     /** @brief Radio channels */
     Channels channels_;
+
+    /** @brief Reconfiguration count */
+    Counter reconfigure_metric_;
+
+    /** @brief Reconfiguration latency (sec) */
+    Histogram reconfigure_latency_metric_;
+
+    /** @brief Slots lost per reconfiguration */
+    Histogram reconfigure_slots_lost_metric_;
+
+    /** @brief Latency from end of packet to delivery (sec) */
+    Histogram delivery_latency_metric_;
+
+    /** @brief Slots shed */
+    Counter shed_metric_;
+
+    /** @brief Time-domain buffers shed before channelization */
+    Counter shed_tdbufs_metric_;
+
+    /** @brief Largest per-channel backlog */
+    Gauge backlog_metric_;
+
+    /** @brief Number of samples demodulated at a time */
+    std::atomic<size_t> chunk_size_;
+
+    /** @brief Maximum number of slots queued per channel */
+    std::atomic<size_t> max_backlog_;
+
+    /** @brief Load shedding policy */
+    std::atomic<ShedPolicy> shed_policy_;
+
+    /** @brief Flag that is true while slots are being shed */
+    std::atomic<bool> shedding_;
+
+    /** @brief Number of slots shed since shedding started */
+    size_t nshed_;
+
+    /** @brief Number of time-domain buffers shed since shedding started */
+    size_t nshed_tdbufs_;
+
+    /** @brief Mutex protecting retired_ */
+    std::mutex retired_mutex_;
+
+    /** @brief IQ buffers of shed slots waiting to be freed */
+    std::vector<std::shared_ptr<IQBuf>> retired_;
+
+    /** @brief Number of IQ buffers in retired_ */
+    std::atomic<size_t> nretired_;
+
+    /** @brief Shed slots from a queue
+     * @param q The queue
+     * @param idle true if the queue belongs to an idle channel
+     * @param shed Shed slots are appended here
+     * @return The number of slots remaining in the queue
+     */
+    /** Calls to shed and updateShedding must be serialized, so each
+     * channelizer makes them from the single thread that queues slots.
+     */
+    template <class T>
+    size_t shed(SafeQueue<T> &q, bool idle, std::vector<T> &shed)
+    {
+        size_t     backlog = q.size();
+        size_t     max = getMaxBacklog();
+        ShedPolicy policy = getShedPolicy();
+
+        if (policy == kShedNone || max == 0)
+            return backlog;
+
+        // Number of slots left after shedding
+        size_t keep = max;
+
+        if (policy == kShedIdleFirst) {
+            if (idle)
+                keep = 1;
+            else
+                max *= 2;
+        }
+
+        if (backlog <= max)
+            return backlog;
+
+        T slot;
+
+        while (backlog > keep && q.try_pop(slot)) {
+            --backlog;
+            shed.emplace_back(std::move(slot));
+        }
+
+        return backlog;
+    }
+
+    /** @brief Update the shedding state after shedding from all channels
+     * @param backlog The largest per-channel backlog
+     * @param nslots The number of per-channel slots just shed
+     * @param ntdbufs The number of time-domain buffers just shed before
+     * channelization
+     */
+    /** Shedding stops once every backlog has drained to half the limit, so we
+     * don't flap between shedding and not shedding at the limit.
+     */
+    void updateShedding(size_t backlog, size_t nslots, size_t ntdbufs = 0)
+    {
+        size_t max = getMaxBacklog();
+
+        nshed_ += nslots;
+        nshed_tdbufs_ += ntdbufs;
+
+        if (nslots != 0)
+            shed_metric_.inc(nslots);
+
+        if (ntdbufs != 0)
+            shed_tdbufs_metric_.inc(ntdbufs);
+
+        backlog_metric_.set(backlog);
+
+        if (!isShedding()) {
+            if (nshed_ != 0 || nshed_tdbufs_ != 0) {
+                shedding_.store(true, std::memory_order_relaxed);
+                logPHY(LOGWARNING, "RX overload: demodulation behind, shedding slots (backlog=%lu, policy=%d)",
+                    backlog,
+                    static_cast<int>(getShedPolicy()));
+            }
+        } else if (getShedPolicy() == kShedNone || max == 0 || backlog <= max/2) {
+            shedding_.store(false, std::memory_order_relaxed);
+            logPHY(LOGINFO, "RX overload cleared: shed %lu slots and %lu time-domain buffers",
+                nshed_,
+                nshed_tdbufs_);
+            nshed_ = 0;
+            nshed_tdbufs_ = 0;
+        }
+    }
+
+    /** @brief Retire the IQ buffers of shed slots
+     * @param bufs The buffers. This is left empty.
+     */
+    /** Freeing a large IQ buffer can take a system call, so the thread that
+     * sheds slots hands their buffers to the demodulation workers, which free
+     * them in freeRetired.
+     */
+    void retire(std::vector<std::shared_ptr<IQBuf>> &bufs)
+    {
+        if (bufs.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+
+        for (auto &buf : bufs)
+            retired_.emplace_back(std::move(buf));
+
+        nretired_.store(retired_.size(), std::memory_order_release);
+        bufs.clear();
+    }
+
+    /** @brief Free the IQ buffers of shed slots */
+    /** Called by demodulation workers between slots. */
+    void freeRetired(void)
+    {
+        if (nretired_.load(std::memory_order_acquire) == 0)
+            return;
+
+        std::vector<std::shared_ptr<IQBuf>> bufs;
+
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+
+            bufs.swap(retired_);
+            nretired_.store(0, std::memory_order_release);
+        }
+    }
+
+    /** @brief Deliver a demodulated packet */
+    void deliver(std::shared_ptr<RadioPacket> &&pkt)
+    {
+        double                rx_rate = rx_rate_.load(std::memory_order_relaxed);
+        MonoClock::time_point end = pkt->slot_timestamp + pkt->end_samples/rx_rate;
+
+        delivery_latency_metric_.observe((MonoClock::now() - end).get_real_secs());
+        source.push(std::move(pkt));
+    }
+
+    /** @brief Match channels against the previous channel plan
+     * @param prev The previous channel plan
+     * @param channels The new channel plan
+     * @return For each new channel, the index of an identical channel in the
+     * previous plan, or -1 if there is no such channel.
+     */
+    /** Each previous channel is matched at most once, so the state of an
+     * unchanged channel can be carried over to the new plan even if its index
+     * changes.
+     */
+    static std::vector<int> matchChannels(const Channels &prev,
+                                          const Channels &channels)
+    {
+        std::vector<int>  match(channels.size(), -1);
+        std::vector<bool> used(prev.size(), false);
+
+        for (unsigned i = 0; i < channels.size(); ++i) {
+            for (unsigned j = 0; j < prev.size(); ++j) {
+                if (!used[j] && prev[j] == channels[i]) {
+                    match[i] = j;
+                    used[j] = true;
+                    break;
+                }
+            }
+        }
+
+        return match;
+    }
+
+    /** @brief Record a completed reconfiguration
+     * @param start Time at which reconfiguration started
+     * @param nlost Number of slots lost due to reconfiguration
+     */
+    void recordReconfiguration(const MonoClock::time_point &start, size_t nlost)
+    {
+        reconfigure_metric_.inc();
+        reconfigure_latency_metric_.observe((MonoClock::now() - start).get_real_secs());
+        reconfigure_slots_lost_metric_.observe(nlost);
+    }
 };
 
 /** @brief Demodulate packets from a channel. */
@@ -121,6 +496,14 @@ public:
     virtual void demodulate(const std::complex<float>* data,
                             size_t count) = 0;
 
+    /** @brief Finish demodulating, passing all pending packets to the
+     * callback
+     */
+    void sync(void)
+    {
+        demod_->sync();
+    }
+
 protected:
     /** @brief Channel we are demodulating */
     Channel channel_;
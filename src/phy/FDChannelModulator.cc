@@ -23,34 +23,41 @@ void FDChannelModulator::modulate(std::shared_ptr<NetPacket> pkt,
         // Perform overlap-save on modulated signal to upsample it.
         //
         // Each block of Li input samples results in a block of N output
-        // frequency domain samples. We add Li - 1 to round up.
-        //
-        // We zero the frequency-domain buffer because we only copy our signal
-        // into the frequency bins it occupies in the upsampled frequency space
-        // while leaving the other binds untouched.
-        auto   iqbuf = std::move(mpkt.samples);
-        auto   fdbuf = std::make_shared<IQBuf>(N*((iqbuf->size() + Li - 1)/Li));
-        size_t nsamples = 0;
-        size_t fdnsamples = 0;
+        // frequency domain samples, which we place directly into the wideband
+        // spectrum in the IFFT's input buffer and immediately convert back to
+        // L time-domain samples. We add Li - 1 to round up. We zero the IFFT
+        // input before each block because we only write our signal into the
+        // frequency bins it occupies while leaving the other bins untouched.
+        auto         iqbuf = std::move(mpkt.samples);
+        const size_t nout = I*iqbuf->size()/X;
+        auto         iqbuf_up = std::make_shared<IQBuf>(L*((iqbuf->size() + Li - 1)/Li));
+        auto         &spectrum = timedomain_.ifft.in;
+        size_t       nsamples = 0;
+        size_t       nblocks = 0;
+
+        auto next = [&]() {
+            if (nblocks++ != 0)
+                timedomain_.toTimeDomain(iqbuf_up->data() + L*(nblocks - 2));
+
+            std::fill(spectrum.begin(), spectrum.end(), 0);
+
+            return spectrum.data();
+        };
 
-        fdbuf->zero();
         upsampler_.reset();
         upsampler_.upsample(iqbuf->data(),
                             iqbuf->size(),
-                            fdbuf->data(),
                             g_effective,
                             true,
                             nsamples,
-                            I*iqbuf->size()/X,
-                            fdnsamples);
-        fdbuf->resize(fdnsamples);
-
-        // Now convert upsampled signal back to time domain
-        auto iqbuf_up = std::make_shared<IQBuf>(L*((fdbuf->size() + N - 1)/N));
+                            nout,
+                            next);
 
-        timedomain_.toTimeDomain(fdbuf->data(), fdbuf->size(), iqbuf_up->data());
+        // Convert the final block
+        if (nblocks != 0)
+            timedomain_.toTimeDomain(iqbuf_up->data() + L*(nblocks - 1));
 
-        iqbuf_up->resize(I*iqbuf->size()/X);
+        iqbuf_up->resize(nout);
 
         // Put samples back into ModPacket
         mpkt.offset = 0;
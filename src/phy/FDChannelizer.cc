@@ -1,19 +1,21 @@
 // Copyright 2018-2020 Drexel University
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
+#include <assert.h>
 #include <math.h>
 
+#include <algorithm>
 #include <functional>
 
-#include <xsimd/xsimd.hpp>
-#include <xsimd/stl/algorithms.hpp>
-
 #include <pybind11/pybind11.h>
 
 namespace py = pybind11;
 
+#include "Trace.hh"
+#include "dsp/FilterCache.hh"
 #include "phy/FDChannelizer.hh"
 #include "phy/PHY.hh"
+#include "util/threads.hh"
 
 using namespace std::placeholders;
 
@@ -24,18 +26,17 @@ FDChannelizer::FDChannelizer(std::shared_ptr<PHY> phy,
   : Channelizer(phy, rx_rate, channels)
   , nthreads_(nthreads)
   , done_(false)
-  , reconfigure_(true)
-  , reconfigure_sync_(nthreads+1)
   , logger_(logger)
 {
-    fft_thread_ = std::thread(&FDChannelizer::fftWorker, this);
+    reconfigure();
+
+    fft_thread_ = spawnThread("fft", &FDChannelizer::fftWorker, this);
 
     for (unsigned int tid = 0; tid < nthreads; ++tid)
-        demod_threads_.emplace_back(std::thread(&FDChannelizer::demodWorker,
+        demod_threads_.emplace_back(spawnThread("demod",
+                                                &FDChannelizer::demodWorker,
                                                 this,
                                                 tid));
-
-    reconfigure();
 }
 
 FDChannelizer::~FDChannelizer()
@@ -60,10 +61,58 @@ void FDChannelizer::push(const std::shared_ptr<IQBuf> &buf)
 
 void FDChannelizer::reconfigure(void)
 {
-    std::lock_guard<std::mutex> lock(demod_mutex_);
+    std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+    auto                        start = MonoClock::now();
+    auto                        prev = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+    auto                        config = std::make_shared<Config>();
+
+    config->rx_rate = rx_rate_;
+    config->channels = channels_;
+
+    // Build state for the new channel plan, including FFTW plans and
+    // frequency-domain filters, while the workers continue to demodulate using
+    // the old plan. A channel whose parameters have not changed keeps its
+    // demodulator, including any frame in progress, and its queue of pending
+    // slots.
+    const unsigned    nchannels = config->channels.size();
+    std::vector<int>  match(nchannels, -1);
+    std::vector<bool> reused;
+
+    if (prev && prev->rx_rate == config->rx_rate) {
+        match = matchChannels(prev->channels, config->channels);
+        reused.resize(prev->chans.size(), false);
+    }
+
+    config->chans.resize(nchannels);
+
+    for (unsigned i = 0; i < nchannels; ++i) {
+        if (match[i] >= 0) {
+            config->chans[i] = prev->chans[match[i]];
+            reused[match[i]] = true;
+        } else {
+            auto chan = std::make_shared<ChannelState>(*phy_,
+                                                       config->channels[i].first,
+                                                       config->channels[i].second,
+                                                       config->rx_rate);
+            ChannelState *chanp = chan.get();
+
+            chan->demod.setCallback([this, chanp] (std::shared_ptr<RadioPacket> &&pkt) {
+                chanp->received = true;
+                if (pkt) {
+                    pkt->channel = chanp->channel;
+                    deliver(std::move(pkt));
+                }
+            });
+
+            config->chans[i] = std::move(chan);
+        }
+    }
 
-    // Tell workers we are reconfiguring
-    reconfigure_.store(true, std::memory_order_release);
+    // Swap in the new configuration. The FFT worker hands the next slot to the
+    // new set of channels.
+    std::atomic_store_explicit(&config_,
+                               std::shared_ptr<const Config>(std::move(config)),
+                               std::memory_order_release);
 
     // Wake all workers that might be sleeping.
     {
@@ -72,30 +121,21 @@ void FDChannelizer::reconfigure(void)
         wake_cond_.notify_all();
     }
 
-    // Wait for workers to be ready for reconfiguration
-    reconfigure_sync_.wait();
-
-    // Now set the channels and reconfigure the channel state
-    unsigned nchannels = channels_.size();
-
-    demods_.resize(nchannels);
-    slots_.resize(nchannels);
+    // Retire channels that are no longer part of the plan. Any slots still
+    // queued for them will never be demodulated.
+    size_t nlost = 0;
 
-    for (unsigned i = 0; i < nchannels; i++) {
-        if (!slots_[i])
-            slots_[i] = std::make_unique<SafeQueue<Slot>>();
+    if (prev) {
+        for (unsigned j = 0; j < prev->chans.size(); ++j) {
+            if (j < reused.size() && reused[j])
+                continue;
 
-        demods_[i] = std::make_unique<FDChannelDemodulator>(*phy_,
-                                                            channels_[i].first,
-                                                            channels_[i].second,
-                                                            rx_rate_);
+            nlost += prev->chans[j]->slots.size();
+            prev->chans[j]->slots.stop();
+        }
     }
 
-    // We are done reconfiguring
-    reconfigure_.store(false, std::memory_order_release);
-
-    // Wait for workers to resume
-    reconfigure_sync_.wait();
+    recordReconfiguration(start, nlost);
 }
 
 void FDChannelizer::stop(void)
@@ -108,11 +148,17 @@ void FDChannelizer::stop(void)
     // Stop all IQ buffer queues
     tdbufs_.stop();
 
-    for (unsigned int i = 0; i < slots_.size(); ++i)
-        slots_[i]->stop();
+    auto config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+
+    for (auto &chan : config->chans)
+        chan->slots.stop();
 
     // Join on all threads
-    wake_cond_.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+
+        wake_cond_.notify_all();
+    }
 
     if (fft_thread_.joinable())
         fft_thread_.join();
@@ -125,11 +171,13 @@ void FDChannelizer::stop(void)
 
 void FDChannelizer::fftWorker(void)
 {
-    std::shared_ptr<IQBuf> iqbuf;
-    std::shared_ptr<IQBuf> fdbuf;
-    unsigned               seq = 0;
-    fftw::FFT<C>           fft(N, FFTW_FORWARD, FFTW_MEASURE);
-    size_t                 fftoff = O;
+    std::shared_ptr<IQBuf>              iqbuf;
+    std::shared_ptr<IQBuf>              fdbuf;
+    std::vector<std::shared_ptr<IQBuf>> shed_tdbufs;
+    std::vector<Slot>                   shed_slots;
+    unsigned                            seq = 0;
+    fftw::FFT<C>                        fft(N, FFTW_FORWARD, FFTW_MEASURE);
+    size_t                              fftoff = O;
 
     while (!done_) {
         // Get a time-domain IQ buffer
@@ -140,6 +188,10 @@ void FDChannelizer::fftWorker(void)
             continue;
         }
 
+        // If the FFT worker has fallen behind, skip the oldest pending
+        // time-domain buffers. The gap in sequence numbers resets FFT state.
+        size_t backlog = shed(tdbufs_, false, shed_tdbufs);
+
         // Reset FFT state on buffer discontinuity. We detect a discontinuity
         // via a gap in the time-domain IQ buffer sequence number.
         if (iqbuf->seq != seq + 1) {
@@ -162,11 +214,26 @@ void FDChannelizer::fftWorker(void)
 
         // Make the frequency-domain buffer available to the individual channels
         {
-            std::lock_guard<std::mutex> lock(demod_mutex_);
-            unsigned                    nchannels = channels_.size();
+            auto config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+
+            for (auto &chan : config->chans) {
+                chan->slots.emplace(iqbuf, fdbuf, -static_cast<ssize_t>(fftoff - O));
+
+                bool idle = chan->idle_slots.load(std::memory_order_relaxed) >= kIdleSlots;
+
+                backlog = std::max(backlog, shed(chan->slots, idle, shed_slots));
+            }
+
+            updateShedding(backlog, shed_slots.size(), shed_tdbufs.size());
+
+            // Don't free shed buffers on the FFT thread
+            for (auto &shed_slot : shed_slots) {
+                shed_tdbufs.emplace_back(std::move(shed_slot.iqbuf));
+                shed_tdbufs.emplace_back(std::move(shed_slot.fdbuf));
+            }
 
-            for (unsigned i = 0; i < nchannels; ++i)
-                slots_[i]->emplace(iqbuf, fdbuf, -static_cast<ssize_t>(fftoff - O));
+            shed_slots.clear();
+            retire(shed_tdbufs);
         }
 
         // Perform overlap-save on input buffer as data becomes available
@@ -176,28 +243,13 @@ void FDChannelizer::fftWorker(void)
         size_t inoff = 0;           // Offset into input buffer
         size_t outoff = 0;          // Offset into output buffer
 
-        for (int spin_count = 0;; ++spin_count) {
-            complete = iqbuf->complete.load(std::memory_order_acquire);
-            nsamples = iqbuf->nsamples.load(std::memory_order_acquire);
-
-            // If we don't have enough samples for a full FFT, wait for more if
-            // the buffer *is not* complete, or stop processing samples if the
-            // buffer *is* complete.
-            if (nsamples - inoff < needed) {
-                if (complete)
-                    break;
-
-                if (spin_count < 16)
-                    _mm_pause();
-                else {
-                    std::this_thread::yield();
-                    spin_count = 0;
-                }
+        for (;;) {
+            nsamples = iqbuf->waitForSamples(inoff + needed - 1, complete);
 
-                continue;
-            }
-
-            spin_count = 0;
+            // If we don't have enough samples for a full FFT, the buffer is
+            // complete, so stop processing samples.
+            if (nsamples - inoff < needed)
+                break;
 
             // Use needed samples from the input buffer
             assert(fftoff + needed == N);
@@ -206,7 +258,11 @@ void FDChannelizer::fftWorker(void)
                       fft.in.begin() + fftoff);
 
             // Perform the FFT
-            fft.execute();
+            {
+                TRACE_SPAN_ARG("fft", N);
+
+                fft.execute();
+            }
 
             // Copy FFT buffer to output
             std::copy(fft.out.begin(), fft.out.end(), fdbuf->data() + outoff);
@@ -229,14 +285,14 @@ void FDChannelizer::fftWorker(void)
                 needed += L;
             }
 
-            fdbuf->nsamples.store(outoff, std::memory_order_release);
+            fdbuf->publishSamples(outoff);
         }
 
         // Resize the buffer
         fdbuf->resize(outoff);
 
         // Now the frequency domain buffer is complete
-        fdbuf->complete.store(true, std::memory_order_release);
+        fdbuf->markComplete();
 
         // The rest of the input will be processed as part of the next full FFT
         // buffer
@@ -253,61 +309,49 @@ void FDChannelizer::fftWorker(void)
 void FDChannelizer::demodWorker(unsigned tid)
 {
     // We keep two past buffers when logging slots
-    std::shared_ptr<IQBuf> prev_prev_iqbuf;
-    std::shared_ptr<IQBuf> prev_iqbuf;
-    Slot                   slot;
-    std::optional<ssize_t> next_snapshot_off;
-    unsigned               num_extra_snapshot_slots = 0;
-    bool                   received = false; // Have we received any packets?
-    Channels               channels;         // Local copy of channels
-    Channel                channel;          // Current channel being demodulated
-
-    PHY::PacketDemodulator::callback_type callback = [&] (std::shared_ptr<RadioPacket> &&pkt) {
-        received = true;
-        if (pkt) {
-            pkt->channel = channel;
-            source.push(std::move(pkt));
-        }
-    };
+    std::shared_ptr<IQBuf>        prev_prev_iqbuf;
+    std::shared_ptr<IQBuf>        prev_iqbuf;
+    Slot                          slot;
+    std::shared_ptr<const Config> config;
 
     while (!done_) {
-        // If we are reconfiguring, wait until reconfiguration is done
-        if (reconfigure_.load(std::memory_order_acquire)) {
-            // Wait for reconfiguration to finish
-            reconfigure_sync_.wait();
-
-            // Make local copy of channels
-            channels = channels_;
-
-            // Signal that we have resumed
-            reconfigure_sync_.wait();
+        // Pick up the current configuration
+        config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
 
-            // If we are unneeded, sleep
-            if (tid >= channels.size()) {
-                std::unique_lock<std::mutex> lock(wake_mutex_);
+        // If we are unneeded, sleep until the configuration changes
+        if (tid >= config->chans.size()) {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
 
-                wake_cond_.wait(lock, [this]{ return done_ || reconfigure_.load(std::memory_order_acquire); });
+            wake_cond_.wait(lock, [&]{
+                return done_ || std::atomic_load_explicit(&config_, std::memory_order_acquire) != config;
+            });
 
-                continue;
-            }
-
-            // Set demodulator callbacks
-            for (unsigned channelidx = tid; channelidx < channels.size(); channelidx += nthreads_)
-                demods_[channelidx]->setCallback(callback);
+            continue;
         }
 
-        for (unsigned channelidx = tid; channelidx < channels.size(); channelidx += nthreads_) {
-            auto &demod = *demods_[channelidx];
-            auto &slots = *slots_[channelidx];
+        for (unsigned channelidx = tid; channelidx < config->chans.size(); channelidx += nthreads_) {
+            auto                        &chan = *config->chans[channelidx];
+            auto &demod = chan.demod;
 
-            // Get a slot
-            if (!slots.pop(slot)) {
+            // Wait for a slot without holding the channel's mutex, so a
+            // worker blocked on an idle channel never holds up the worker that
+            // demodulates the channel after a reconfiguration.
+            if (!chan.slots.wait()) {
                 if (done_)
                     return;
 
                 continue;
             }
 
+            // Free the buffers of any slots shed since we last looked
+            freeRetired();
+
+            std::lock_guard<std::mutex> lock(chan.mutex);
+
+            // Get a slot. Another worker may have taken it first.
+            if (!chan.slots.try_pop(slot))
+                continue;
+
             auto &fdbuf = slot.fdbuf;
             auto &iqbuf = slot.iqbuf;
 
@@ -322,10 +366,17 @@ void FDChannelizer::demodWorker(unsigned tid)
             // a snapshot offset.
             std::optional<ssize_t> snapshot_off;
 
+            // After a gap in sequence numbers, e.g., because slots were shed,
+            // the saved offset belongs to a buffer we never saw.
+            if (fdbuf->seq != demod.getSeq() + 1) {
+                chan.next_snapshot_off = std::nullopt;
+                chan.num_extra_snapshot_slots = 0;
+            }
+
             if (iqbuf->snapshot_off)
                 snapshot_off = iqbuf->snapshot_off;
             else
-                snapshot_off = next_snapshot_off;
+                snapshot_off = chan.next_snapshot_off;
 
             // Update IQ buffer sequence number
             demod.updateSeq(fdbuf->seq);
@@ -334,51 +385,42 @@ void FDChannelizer::demodWorker(unsigned tid)
             demod.timestamp(*fdbuf->timestamp,
                             snapshot_off,
                             slot.fd_offset,
-                            rx_rate_);
-
-            // Demodulate the IQ buffer
-            bool   complete = false; // Is the buffer complete?
-            size_t ndemodulated = 0; // How many samples we've already demodulated
-            size_t n = 0;
-
-            // Set parameters for the callback
-            received = false;
-            channel = channels[channelidx].first;
-
-            // Demodulate data as it is received
-            for (int spin_count = 0; !complete; ++spin_count) {
-                complete = fdbuf->complete.load(std::memory_order_acquire);
-                n = fdbuf->nsamples.load(std::memory_order_acquire) - ndemodulated;
-
-                if (n != 0) {
-                    demod.demodulate(fdbuf->data() + ndemodulated, n);
-                    ndemodulated += n;
-                    spin_count = 0;
-                } else if (spin_count < 16) {
-                    _mm_pause();
-                } else {
-                    std::this_thread::yield();
-                    spin_count = 0;
-                }
-            }
+                            config->rx_rate);
+
+            // Demodulate data in chunks as it is received
+            chan.received = false;
+
+            // The demodulator consumes whole FFT blocks of N samples
+            demodulateChunks(*fdbuf,
+                             0,
+                             std::numeric_limits<size_t>::max(),
+                             [&](const C *data, size_t n) { demod.demodulate(data, n); },
+                             N);
+
+            demod.sync();
+
+            if (chan.received)
+                chan.idle_slots.store(0, std::memory_order_relaxed);
+            else
+                chan.idle_slots.fetch_add(1, std::memory_order_relaxed);
 
             // Save the snapshot offset of the next IQ buffer here if we know
             // what it will be. iqbuf's size is valid now that it has been
             // marked complete.
             if (iqbuf->snapshot_off) {
-                next_snapshot_off = *iqbuf->snapshot_off + iqbuf->size();
-                num_extra_snapshot_slots = 2;
-            } else if (num_extra_snapshot_slots > 0) {
-                --num_extra_snapshot_slots;
-                next_snapshot_off = *next_snapshot_off + iqbuf->size();
+                chan.next_snapshot_off = *iqbuf->snapshot_off + iqbuf->size();
+                chan.num_extra_snapshot_slots = 2;
+            } else if (chan.num_extra_snapshot_slots > 0) {
+                --chan.num_extra_snapshot_slots;
+                chan.next_snapshot_off = *chan.next_snapshot_off + iqbuf->size();
             } else
-                next_snapshot_off = std::nullopt;
+                chan.next_snapshot_off = std::nullopt;
 
             // If we received any packets, log both the previous and the current
             // slot. We then save the current slot in case we need to log it
             // later.
             if (logger_ && logger_->getCollectSource(Logger::kSlots)) {
-                if (received) {
+                if (chan.received) {
                     if (prev_prev_iqbuf) {
                         logger_->logSlot(prev_prev_iqbuf);
                         prev_prev_iqbuf.reset();
@@ -408,31 +450,73 @@ FDChannelizer::FDChannelDemodulator::FDChannelDemodulator(PHY &phy,
   , X_(phy.getMinRXRateOversample())
   , D_(rx_rate/channel.bw)
   , ifft_(X_*N/D_, FFTW_BACKWARD, FFTW_MEASURE)
-  , temp_(N)
-  , H_(N)
 {
     // Number of FFT bins to rotate
     Nrot_ = N*channel.fc/rx_rate;
     if (Nrot_ < 0)
         Nrot_ += N;
 
-    // Compute frequency-domain filter
-    fftw::FFT<C> fft(N, FFTW_FORWARD, FFTW_MEASURE);
-
-    std::fill(fft.in.begin(), fft.in.end(), 0);
+    // Get frequency-domain filter. We apply a 1/(N*D) factor to the filter
+    // since FFTW doesn't multiply by 1/N for IFFT, and we need to compensate
+    // for summation during decimation.
     assert(taps.size() <= P);
-    std::copy(taps.begin(), taps.end(), fft.in.begin());
-    fft.execute(fft.in.data(), H_.data());
+    H_ = filterCache().frequencyResponse(taps, N, 1.0/(N*D_));
 
     // Compute filter delay
     delay_ = round((taps.size() - 1) / 2.0);
 
-    // Apply 1/(N*D) factor to filter since FFTW doesn't multiply by 1/N for
-    // IFFT, and we need to compensate for summation during decimation.
-    const C invN = 1.0/(N*D_);
+    // Find the filter's support, bins [0, half] and [N - half, N). Outside the
+    // support the response is negligible, so those bins are skipped entirely.
+    const fftw::vector<C> &H = *H_;
+    float                 peak = 0;
+    unsigned              half = 0;
 
-    xsimd::transform(H_.begin(), H_.end(), H_.begin(),
-        [&](const auto& x) { return x*invN; });
+    for (const auto &h : H)
+        peak = std::max(peak, std::abs(h));
+
+    for (unsigned k = 0; k <= N/2; ++k) {
+        if (std::abs(H[k]) > kSupportThreshold*peak || std::abs(H[(N - k) % N]) > kSupportThreshold*peak)
+            half = k;
+    }
+
+    // Decimation only folds the first D*n bins
+    const unsigned n = N/D_;
+    const unsigned end = D_*n;
+
+    if (2*half + 1 >= end) {
+        addRuns(0, end);
+    } else {
+        addRuns(0, half + 1);
+        addRuns(end - half, end);
+    }
+}
+
+void FDChannelizer::FDChannelDemodulator::addRuns(unsigned start, unsigned end)
+{
+    const unsigned n = N/D_;
+    const unsigned wrap = N - Nrot_;
+
+    while (start < end) {
+        // Split runs at alias boundaries, at the boundary between positive and
+        // negative frequencies within an alias, and where the rotated input
+        // wraps around.
+        unsigned k = start % n;
+        unsigned stop = std::min(end, start - k + (k < n/2 ? n/2 : n));
+
+        if (start < wrap)
+            stop = std::min(stop, wrap);
+
+        Run run;
+
+        run.out = k < n/2 ? k : k + (X_ - 1)*n;
+        run.h = start;
+        run.in = (start + Nrot_) % N;
+        run.len = stop - start;
+
+        runs_.push_back(run);
+
+        start = stop;
+    }
 }
 
 void FDChannelizer::FDChannelDemodulator::updateSeq(unsigned seq)
@@ -468,39 +552,29 @@ void FDChannelizer::FDChannelDemodulator::timestamp(const MonoClock::time_point
 void FDChannelizer::FDChannelDemodulator::demodulate(const std::complex<float>* data,
                                                      size_t count)
 {
-    const unsigned n = N/D_;
+    const C *H = H_->data();
+    C       *out = ifft_.in.data();
+
+    assert(count % N == 0);
 
     for (; count > 0; count -= N, data += N) {
-        // Shift FFT bins as we copy into temp buffer
-        std::rotate_copy(data, data + Nrot_, data + N, temp_.begin());
-
-        // Apply filter
-        xsimd::transform(temp_.begin(), temp_.end(), H_.begin(), temp_.begin(),
-            [](const auto& x, const auto& y) { return x*y; });
-
-        // Decimate by summing strides of temp buffer, placing result in IFFT
-        // input buffer
-        std::copy(temp_.begin(), temp_.begin() + n, ifft_.in.begin());
-
-        for (unsigned i = 1; i < D_; ++i)
-            xsimd::transform(temp_.begin() + i*n,
-                             temp_.begin() + (i+1)*n,
-                             temp_.begin(),
-                             temp_.begin(),
-                [](const auto& x, const auto& y) { return x+y; });
-
-        // Oversample if needed
-        if (X_ != 1) {
-            std::copy(temp_.begin() + n/2,
-                      temp_.begin() + n,
-                      temp_.begin() + X_*n - n/2);
-            std::fill(temp_.begin() + n/2,
-                      temp_.begin() + n,
-                      0);
+        // Rotate, filter, decimate by aliasing, and oversample in a single
+        // pass, accumulating directly into the IFFT input buffer. Bins outside
+        // the filter's support, including the zero padding between positive
+        // and negative frequencies when oversampling, stay zero.
+        std::fill(ifft_.in.begin(), ifft_.in.end(), 0);
+
+        for (const auto &run : runs_) {
+            C       *y = out + run.out;
+            const C *h = H + run.h;
+            const C *x = data + run.in;
+
+            for (unsigned i = 0; i < run.len; ++i)
+                y[i] += h[i]*x[i];
         }
 
         // Perform IFFT
-        ifft_.execute(temp_.data(), ifft_.out.data());
+        ifft_.execute();
 
         // Demodulate
         demod_->demodulate(ifft_.out.data() + X_*O/D_, X_*L/D_);
@@ -7,9 +7,9 @@
 #include <condition_variable>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 
-#include "barrier.hh"
 #include "Logger.hh"
 #include "SafeQueue.hh"
 #include "dsp/FFTW.hh"
@@ -71,6 +71,12 @@ private:
 
         virtual ~FDChannelDemodulator() = default;
 
+        /** @brief Get sequence number of the last IQ buffer demodulated */
+        unsigned getSeq(void) const
+        {
+            return seq_;
+        }
+
         /** @brief Update IQ buffer sequence number */
         void updateSeq(unsigned seq);
 
@@ -103,11 +109,40 @@ private:
         /** @brief IFFT */
         fftw::FFT<C> ifft_;
 
-        /** @brief Vector containing rotated FFT input */
-        fftw::vector<C> temp_;
+        /** @brief Frequency-domain filter, shared through the filter cache */
+        std::shared_ptr<const fftw::vector<C>> H_;
+
+        /** @brief Magnitude, relative to the peak of the filter's response,
+         * below which filter bins are treated as zero
+         */
+        static constexpr float kSupportThreshold = 1e-5f;
+
+        /** @brief A run of contiguous FFT bins that are filtered and
+         * accumulated into contiguous IFFT bins
+         */
+        struct Run {
+            /** @brief Index of first IFFT input bin */
+            unsigned out;
+
+            /** @brief Index of first filter bin */
+            unsigned h;
+
+            /** @brief Index of first FFT bin */
+            unsigned in;
 
-        /** @brief Frequency-domain filter */
-        fftw::vector<C> H_;
+            /** @brief Number of bins */
+            unsigned len;
+        };
+
+        /** @brief Runs covering the support of the filter */
+        /** Runs fold rotation, filtering, decimation by aliasing, and
+         * oversampling into a single pass over the FFT bins in the filter's
+         * support.
+         */
+        std::vector<Run> runs_;
+
+        /** @brief Add runs covering filter bins [start, end) */
+        void addRuns(unsigned start, unsigned end);
     };
 
     /** @brief A demodulation slot */
@@ -140,18 +175,73 @@ private:
         ssize_t fd_offset;
     };
 
+    /** @brief Per-channel demodulation state */
+    struct ChannelState {
+        ChannelState(PHY &phy,
+                     const Channel &channel_,
+                     const std::vector<C> &taps,
+                     double rx_rate)
+          : channel(channel_)
+          , demod(phy, channel_, taps, rx_rate)
+          , num_extra_snapshot_slots(0)
+          , received(false)
+          , idle_slots(0)
+        {
+        }
+
+        /** @brief The channel */
+        const Channel channel;
+
+        /** @brief Mutex serializing demodulation of this channel */
+        /** A channel that survives a reconfiguration may be handed to a
+         * different worker. Holding this mutex while popping and demodulating
+         * a slot guarantees that slots are still demodulated one at a time, in
+         * order. Workers wait for a slot before taking this mutex, so it is
+         * never held while blocked on an empty queue.
+         */
+        std::mutex mutex;
+
+        /** @brief Channel demodulator */
+        FDChannelDemodulator demod;
+
+        /** @brief Frequency-domain slots to demodulate */
+        SafeQueue<Slot> slots;
+
+        /** @brief Snapshot offset of the next IQ buffer */
+        std::optional<ssize_t> next_snapshot_off;
+
+        /** @brief Number of slots after the end of a snapshot for which we
+         * still record self-transmissions
+         */
+        unsigned num_extra_snapshot_slots;
+
+        /** @brief Flag that is true if we received a packet in the current
+         * slot.
+         */
+        bool received;
+
+        /** @brief Number of consecutive slots without a packet */
+        std::atomic<unsigned> idle_slots;
+    };
+
+    /** @brief An immutable demodulation configuration */
+    struct Config {
+        /** @brief RX sample rate */
+        double rx_rate;
+
+        /** @brief Radio channels */
+        Channels channels;
+
+        /** @brief Channel state, one per channel */
+        std::vector<std::shared_ptr<ChannelState>> chans;
+    };
+
     /** @brief Number of demodulation threads. */
     unsigned nthreads_;
 
     /** @brief Flag that is true when we should finish processing. */
     bool done_;
 
-    /** @brief Flag that is true when we are reconfiguring. */
-    std::atomic<bool> reconfigure_;
-
-    /** @brief Reconfiguration barrier */
-    barrier reconfigure_sync_;
-
     /** @brief Mutex for waking demodulators. */
     std::mutex wake_mutex_;
 
@@ -161,14 +251,14 @@ private:
     /** @brief Time-domain IQ buffers to demodulate */
     SafeQueue<std::shared_ptr<IQBuf>> tdbufs_;
 
-    /** @brief Mutex for demodulation state. */
-    std::mutex demod_mutex_;
+    /** @brief Mutex serializing reconfiguration. */
+    std::mutex reconfigure_mutex_;
 
-    /** @brief Channel state for demodulation. */
-    std::vector<std::unique_ptr<FDChannelDemodulator>> demods_;
-
-    /** @brief Frequency-domain packets to demodulate */
-    std::vector<std::unique_ptr<SafeQueue<Slot>>> slots_;
+    /** @brief Current demodulation configuration. */
+    /** This is only accessed atomically. The FFT worker and the demodulation
+     * workers pick up a new configuration between slots.
+     */
+    std::shared_ptr<const Config> config_;
 
     /** @brief FFT worker thread. */
     std::thread fft_thread_;
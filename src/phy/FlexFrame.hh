@@ -25,6 +25,7 @@ public:
           , liquid::PHY::PacketModulator(phy, phy.header_mcs_)
           , liquid::FlexFrameModulator(phy.header_mcs_)
         {
+            prepareMCSTable();
         }
 
         virtual ~PacketModulator() = default;
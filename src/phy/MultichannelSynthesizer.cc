@@ -11,6 +11,7 @@ namespace py = pybind11;
 #include "phy/MultichannelSynthesizer.hh"
 #include "phy/PHY.hh"
 #include "stats/Estimator.hh"
+#include "util/threads.hh"
 
 MultichannelSynthesizer::MultichannelSynthesizer(std::shared_ptr<PHY> phy,
                                                  double tx_rate,
@@ -19,15 +20,16 @@ MultichannelSynthesizer::MultichannelSynthesizer(std::shared_ptr<PHY> phy,
   : SlotSynthesizer(phy, tx_rate, channels)
   , nthreads_(nthreads)
   , done_(false)
-  , reconfigure_(true)
-  , reconfigure_sync_(nthreads+1)
+  , reconfigure_metric_(metrics(), "dragonradio_tx_reconfigurations_total", "TX synthesizer reconfigurations")
+  , reconfigure_latency_metric_(metrics(), "dragonradio_tx_reconfigure_seconds", {1e-4, 1e-3, 1e-2, 1e-1, 1}, "Time to build new TX channel state")
 {
+    reconfigure();
+
     for (size_t i = 0; i < nthreads; ++i)
-        mod_threads_.emplace_back(std::thread(&MultichannelSynthesizer::modWorker,
+        mod_threads_.emplace_back(spawnThread("mod",
+                                              &MultichannelSynthesizer::modWorker,
                                               this,
                                               i));
-
-    reconfigure();
 }
 
 MultichannelSynthesizer::~MultichannelSynthesizer()
@@ -37,6 +39,8 @@ MultichannelSynthesizer::~MultichannelSynthesizer()
 
 void MultichannelSynthesizer::modulate(const std::shared_ptr<Slot> &slot)
 {
+    slot->config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+
     std::atomic_store_explicit(&curslot_, slot, std::memory_order_release);
 }
 
@@ -50,17 +54,19 @@ void MultichannelSynthesizer::finalize(Slot &slot)
     if (!slot.iqbufs.empty())
         return;
 
-    // Flush all synthesis state
-    size_t nchannels = mods_.size();
+    // Flush all synthesis state using the configuration the slot was
+    // modulated with
+    auto   config = slotConfig(slot);
+    size_t nchannels = config->mods.size();
 
     for (unsigned channelidx = 0; channelidx < nchannels; ++channelidx) {
-        const Schedule::slot_type &slots = schedule_copy_[channelidx];
+        const Schedule::slot_type &slots = config->schedule[channelidx];
 
         // Skip this channel if we're not allowed to modulate
         if (slots[slot.slotidx]) {
-            std::lock_guard<std::mutex> lock(mods_[channelidx]->mutex);
+            std::lock_guard<std::mutex> lock(config->mods[channelidx]->mutex);
 
-            mods_[channelidx]->flush(slot);
+            config->mods[channelidx]->flush(slot);
         }
     }
 
@@ -92,7 +98,11 @@ void MultichannelSynthesizer::stop(void)
 
     done_ = true;
 
-    wake_cond_.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+
+        wake_cond_.notify_all();
+    }
 
     for (size_t i = 0; i < mod_threads_.size(); ++i) {
         if (mod_threads_[i].joinable())
@@ -102,37 +112,24 @@ void MultichannelSynthesizer::stop(void)
 
 void MultichannelSynthesizer::reconfigure(void)
 {
-    std::lock_guard<std::mutex> lock(mods_mutex_);
-
-    // Tell workers we are reconfiguring
-    reconfigure_.store(true, std::memory_order_release);
-
-    // Wake all workers that might be sleeping.
-    {
-        std::unique_lock<std::mutex> lock(wake_mutex_);
-
-        wake_cond_.notify_all();
-    }
-
-    // Kick the sink
-    sink.kick();
-
-    // Wait for workers to be ready for reconfiguration
-    reconfigure_sync_.wait();
+    std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+    auto                        start = MonoClock::now();
+    auto                        prev = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+    auto                        config = std::make_shared<Config>();
 
     // Make copies of variables for thread safety
     // NOTE: The mutex protecting the synthesizer state is held when reconfigure
     // is called.
-    tx_rate_copy_ = tx_rate_;
-    channels_copy_ = channels_;
-    schedule_copy_ = schedule_;
+    config->tx_rate = tx_rate_;
+    config->channels = channels_;
+    config->schedule = schedule_;
 
     // Compute gain necessary to compensate for maximum number of channels on
     // which we may simultaneously transmit.
     unsigned chancount = 0;
 
-    for (unsigned chanidx = 0; chanidx < schedule_.size(); ++chanidx) {
-        auto &slots = schedule_[chanidx];
+    for (unsigned chanidx = 0; chanidx < config->schedule.size(); ++chanidx) {
+        auto &slots = config->schedule[chanidx];
 
         for (unsigned slotidx = 0; slotidx < slots.size(); ++slotidx) {
             if (slots[slotidx]) {
@@ -143,70 +140,85 @@ void MultichannelSynthesizer::reconfigure(void)
     }
 
     if (chancount == 0)
-        g_multichan_ = 1.0f;
+        config->g_multichan = 1.0f;
     else
-        g_multichan_ = 1.0f/static_cast<float>(chancount);
-
-    // Now set the channels and reconfigure the channel state
-    const unsigned nchannels = channels_copy_.size();
+        config->g_multichan = 1.0f/static_cast<float>(chancount);
+
+    // Build modulators for the new configuration while the workers continue to
+    // modulate slots bound to the old configuration. A channel whose index and
+    // parameters have not changed keeps its modulator, including any packet
+    // that spills over into the next slot. We require the index to match
+    // because a channel's modulator is always driven by the same worker.
+    const unsigned nchannels = config->channels.size();
+
+    config->mods.resize(nchannels);
+
+    for (unsigned chanidx = 0; chanidx < nchannels; chanidx++) {
+        if (prev &&
+            prev->tx_rate == config->tx_rate &&
+            chanidx < prev->channels.size() &&
+            prev->channels[chanidx] == config->channels[chanidx])
+            config->mods[chanidx] = prev->mods[chanidx];
+        else
+            config->mods[chanidx] = std::make_shared<MultichannelModulator>(*phy_,
+                                                                            chanidx,
+                                                                            config->channels[chanidx].first,
+                                                                            config->channels[chanidx].second,
+                                                                            config->tx_rate);
+    }
 
-    mods_.resize(nchannels);
+    // Swap in the new configuration. It takes effect with the next slot.
+    std::atomic_store_explicit(&config_,
+                               std::shared_ptr<const Config>(std::move(config)),
+                               std::memory_order_release);
 
-    for (unsigned chanidx = 0; chanidx < nchannels; chanidx++)
-        mods_[chanidx] = std::make_unique<MultichannelModulator>(*phy_,
-                                                                 chanidx,
-                                                                 channels_copy_[chanidx].first,
-                                                                 channels_copy_[chanidx].second,
-                                                                 tx_rate_copy_);
+    // Wake all workers that might be sleeping.
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
 
-    // We are done reconfiguring
-    reconfigure_.store(false, std::memory_order_release);
+        wake_cond_.notify_all();
+    }
 
-    // Wait for workers to resume
-    reconfigure_sync_.wait();
+    reconfigure_metric_.inc();
+    reconfigure_latency_metric_.observe((MonoClock::now() - start).get_real_secs());
 }
 
 void MultichannelSynthesizer::modWorker(unsigned tid)
 {
-    std::shared_ptr<Slot>      prev_slot;
-    std::shared_ptr<Slot>      slot;
-    std::unique_ptr<ModPacket> mpkt;
-    std::shared_ptr<NetPacket> pkt;
+    std::shared_ptr<Slot>         prev_slot;
+    std::shared_ptr<Slot>         slot;
+    std::shared_ptr<const Config> config;
+    std::unique_ptr<ModPacket>    mpkt;
+    std::shared_ptr<NetPacket>    pkt;
 
     while (!done_) {
         // Wait for the next slot if we are starting at the first channel for
         // which we are responsible.
         do {
             slot = std::atomic_load_explicit(&curslot_, std::memory_order_acquire);
-        } while (!done_ && !reconfigure_.load(std::memory_order_acquire) && slot == prev_slot);
+        } while (!done_ && slot == prev_slot);
 
         // Exit now if we're done
         if (done_)
             break;
 
-        // If we are reconfiguring, wait until reconfiguration is done
-        if (reconfigure_.load(std::memory_order_acquire)) {
-            // Wait for reconfiguration to start
-            reconfigure_sync_.wait();
-
-            // Wait for reconfiguration to finish
-            reconfigure_sync_.wait();
+        // Use the configuration bound to the slot
+        config = slotConfig(*slot);
 
-            // If we are unneeded, sleep
-            if (tid >= channels_copy_.size()) {
-                std::unique_lock<std::mutex> lock(wake_mutex_);
+        // If we are unneeded, sleep until the configuration changes
+        if (tid >= config->mods.size()) {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
 
-                wake_cond_.wait(lock, [this]{ return done_ || reconfigure_.load(std::memory_order_acquire); });
-
-                continue;
-            }
+            wake_cond_.wait(lock, [&]{
+                return done_ || std::atomic_load_explicit(&config_, std::memory_order_acquire) != config;
+            });
 
-            // Otherwise, get the next slot
+            prev_slot = std::move(slot);
             continue;
         }
 
         // If we don't have a schedule yet, try again
-        if (schedule_copy_.size() == 0 || slot->slotidx > schedule_copy_[0].size()) {
+        if (config->schedule.size() == 0 || slot->slotidx > config->schedule[0].size()) {
             std::this_thread::yield();
             continue;
         }
@@ -228,10 +240,10 @@ void MultichannelSynthesizer::modWorker(unsigned tid)
             }
         }
 
-        for (unsigned channelidx = tid; channelidx < channels_copy_.size(); channelidx += nthreads_) {
+        for (unsigned channelidx = tid; channelidx < config->mods.size(); channelidx += nthreads_) {
             // Get channel state for current channel
-            MultichannelModulator     &mod = *mods_[channelidx];
-            const Schedule::slot_type &slots = schedule_copy_[channelidx];
+            MultichannelModulator     &mod = *config->mods[channelidx];
+            const Schedule::slot_type &slots = config->schedule[channelidx];
 
             // Skip this channel if we're not allowed to modulate
             if (!slots[slot->slotidx])
@@ -289,7 +301,7 @@ void MultichannelSynthesizer::modWorker(unsigned tid)
 
                 // Modulate the packet
                 if (!mpkt->pkt) {
-                    float g = phy_->mcs_table[pkt->mcsidx].autogain.getSoftTXGain()*g_multichan_;
+                    float g = phy_->mcs_table[pkt->mcsidx].autogain.getSoftTXGain()*config->g_multichan;
 
                     mod.modulate(std::move(pkt), g, *mpkt);
                 }
@@ -5,13 +5,14 @@
 #define MULTICHANNELSYNTHESIZER_H_
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 
-#include "barrier.hh"
 #include "dsp/FDResample.hh"
 #include "dsp/FFTW.hh"
 #include "phy/PHY.hh"
 #include "phy/SlotSynthesizer.hh"
+#include "stats/Metrics.hh"
 
 /** @brief A frequency-domain, per-channel synthesizer. */
 class MultichannelSynthesizer : public SlotSynthesizer
@@ -149,29 +150,32 @@ private:
         size_t fdnsamples;
     };
 
+    /** @brief An immutable modulation configuration */
+    struct Config;
+
+    /** @brief Return the configuration bound to a slot */
+    static std::shared_ptr<const Config> slotConfig(const Slot &slot);
+
     /** @brief Number of synthesizer threads. */
     unsigned nthreads_;
 
     /** @brief Flag indicating if we should stop processing packets */
     std::atomic<bool> done_;
 
-    /** @brief Flag that is true when we are reconfiguring. */
-    std::atomic<bool> reconfigure_;
-
-    /** @brief Reconfiguration barrier */
-    barrier reconfigure_sync_;
-
-    /** @brief Mutex for waking demodulators. */
+    /** @brief Mutex for waking modulators. */
     std::mutex wake_mutex_;
 
-    /** @brief Condition variable for waking demodulators. */
+    /** @brief Condition variable for waking modulators. */
     std::condition_variable wake_cond_;
 
-    /** @brief Mutex for demodulation state. */
-    std::mutex mods_mutex_;
+    /** @brief Mutex serializing reconfiguration. */
+    std::mutex reconfigure_mutex_;
 
-    /** @brief Channel state for demodulation. */
-    std::vector<std::unique_ptr<MultichannelModulator>> mods_;
+    /** @brief Current modulation configuration. */
+    /** This is only accessed atomically. It is bound to each slot handed to
+     * modulate, so a new configuration takes effect at a slot boundary.
+     */
+    std::shared_ptr<const Config> config_;
 
     /** @brief Current slot that need to be synthesized */
     std::shared_ptr<Slot> curslot_;
@@ -182,20 +186,39 @@ private:
     /** @brief OLS time domain converter */
     Upsampler::ToTimeDomain timedomain_;
 
+    /** @brief Reconfiguration count */
+    Counter reconfigure_metric_;
+
+    /** @brief Reconfiguration latency (sec) */
+    Histogram reconfigure_latency_metric_;
+
+    /** @brief Thread modulating packets */
+    void modWorker(unsigned tid);
+};
+
+/** @brief An immutable MultichannelSynthesizer modulation configuration */
+/** This is bound to each slot the synthesizer modulates. */
+struct MultichannelSynthesizer::Config : public SlotSynthesizer::SlotConfig {
     /** @brief TX sample rate */
-    double tx_rate_copy_;
+    double tx_rate;
 
     /** @brief Radio channels */
-    Channels channels_copy_;
+    Channels channels;
 
     /** @brief Radio schedule */
-    Schedule schedule_copy_;
+    Schedule schedule;
 
     /** @brief Gain necessary to compensate for simultaneous transmission */
-    float g_multichan_;
+    float g_multichan;
 
-    /** @brief Thread modulating packets */
-    void modWorker(unsigned tid);
+    /** @brief Channel modulators, one per channel */
+    std::vector<std::shared_ptr<MultichannelModulator>> mods;
 };
 
+inline std::shared_ptr<const MultichannelSynthesizer::Config>
+MultichannelSynthesizer::slotConfig(const Slot &slot)
+{
+    return std::static_pointer_cast<const Config>(slot.config);
+}
+
 #endif /* MULTICHANNELSYNTHESIZER_H_ */
@@ -26,6 +26,7 @@ public:
                                          phy.header_mcs_)
           , liquid::NewFlexFrameModulator(phy.header_mcs_)
         {
+            prepareMCSTable();
         }
 
         virtual ~PacketModulator() = default;
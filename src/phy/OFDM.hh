@@ -30,6 +30,7 @@ public:
                                   phy.taper_len_,
                                   phy.p_)
         {
+            prepareMCSTable();
         }
 
         virtual ~PacketModulator() = default;
@@ -5,6 +5,7 @@
 
 #include "phy/PHY.hh"
 #include "phy/OverlapTDChannelizer.hh"
+#include "util/threads.hh"
 
 using namespace std::placeholders;
 
@@ -18,19 +19,21 @@ OverlapTDChannelizer::OverlapTDChannelizer(std::shared_ptr<PHY> phy,
   , cur_demod_(0.0)
   , cur_demod_samps_(0)
   , enforce_ordering_(false)
+  , streaming_(false)
   , done_(false)
   , iq_size_(0)
   , iq_next_channel_(0)
   , demod_reconfigure_(nthreads)
   , logger_(logger)
 {
-    net_thread_ = std::thread(&OverlapTDChannelizer::netWorker, this);
+    net_thread_ = spawnThread("channelizer_net", &OverlapTDChannelizer::netWorker, this);
 
     for (unsigned int i = 0; i < nthreads; ++i) {
         demod_reconfigure_[i].store(false, std::memory_order_relaxed);
-        demod_threads_.emplace_back(std::thread(&OverlapTDChannelizer::demodWorker,
-                                    this,
-                                    std::ref(demod_reconfigure_[i])));
+        demod_threads_.emplace_back(spawnThread("demod",
+                                                &OverlapTDChannelizer::demodWorker,
+                                                this,
+                                                std::ref(demod_reconfigure_[i])));
     }
 }
 
@@ -70,6 +73,11 @@ void OverlapTDChannelizer::reconfigure(void)
 
     for (auto &flag : demod_reconfigure_)
         flag.store(true, std::memory_order_relaxed);
+
+    // Streams are rebuilt when they are next needed
+    std::lock_guard<std::mutex> lock(iq_mutex_);
+
+    streams_.clear();
 }
 
 void OverlapTDChannelizer::stop(void)
@@ -91,27 +99,36 @@ void OverlapTDChannelizer::stop(void)
 
 void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
 {
-    std::unique_ptr<OverlapTDChannelDemodulator> demod;
-    RadioPacketQueue::barrier                    b;
-    unsigned                                     channelidx;
-    std::shared_ptr<IQBuf>                       buf1;
-    std::shared_ptr<IQBuf>                       buf2;
-    bool                                         received;
-
-    auto callback = [&] (const std::shared_ptr<RadioPacket> &pkt) {
+    std::unique_ptr<TDChannelDemodulator> demod;
+    RadioPacketQueue::barrier             b;
+    unsigned                              channelidx;
+    std::shared_ptr<IQBuf>                buf1;
+    std::shared_ptr<IQBuf>                buf2;
+    std::shared_ptr<Stream>               stream;
+    bool                                  received;
+
+    auto callback = [&] (std::shared_ptr<RadioPacket> &&pkt) {
         received = true;
         if (pkt) {
             if (enforce_ordering_)
                 radio_q_.push(b, pkt);
             else
-                source.push(pkt);
+                deliver(std::move(pkt));
         }
     };
 
     while (!done_) {
-        if (!pop(b, channelidx, buf1, buf2))
+        if (!pop(b, channelidx, buf1, buf2, stream))
             break;
 
+        if (stream) {
+            demodStream(*stream);
+            stream.reset();
+            continue;
+        }
+
+        radio_q_.acquireBarrier(b);
+
         received = false;
 
         // Calculate how many samples we want to demodulate from the tail end of
@@ -128,10 +145,10 @@ void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
         // Either reconfigure or set current channel
         if (reconfig.load(std::memory_order_relaxed)) {
             assert(rx_rate_ != 0);
-            demod = std::make_unique<OverlapTDChannelDemodulator>(*phy_,
-                                                                  channels_[channelidx].first,
-                                                                  channels_[channelidx].second,
-                                                                  rx_rate_);
+            demod = std::make_unique<TDChannelDemodulator>(*phy_,
+                                                           channels_[channelidx].first,
+                                                           channels_[channelidx].second,
+                                                           rx_rate_);
             demod->setCallback(callback);
             reconfig.store(false, std::memory_order_relaxed);
         } else
@@ -146,8 +163,10 @@ void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
                          buf1_off,
                          rx_rate_);
 
-        demod->demodulate(buf1->data() + buf1_off,
-                          buf1_nsamples);
+        demodulateChunks(*buf1,
+                         buf1_off,
+                         buf1_nsamples,
+                         [&](const C *data, size_t n) { demod->demodulate(data, n); });
 
         // Wait for the second buffer to start to fill. If demodulation is very
         // fast, it is possible for us to finish demodulating the first buffer
@@ -157,10 +176,6 @@ void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
         if (cur_demod_samps_ > buf2->undersample) {
             // Calculate how many samples from the current slot we want to
             // demodulate. We do not demodulate the tail end of the guard interval.
-            bool   complete = false; // Is the buffer complete?
-            size_t ndemodulated = 0; // How many samples we've already demodulated
-            size_t nwanted;          // How many samples we still want to demodulate.
-            size_t n = 0;
 
             // When the snapshot is over, we need to record self-transmissions
             // for one more slot to ensure we record any transmission that
@@ -178,26 +193,18 @@ void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
                              0,
                              rx_rate_);
 
-            nwanted = cur_demod_samps_ - buf2->undersample;
-
-            for (;;) {
-                complete = buf2->complete.load(std::memory_order_acquire);
-                n = std::min(buf2->nsamples.load(std::memory_order_acquire) - ndemodulated, nwanted);
-
-                if (n != 0) {
-                    demod->demodulate(&(*buf2)[ndemodulated],
-                                      n);
-
-                    ndemodulated += n;
-                    nwanted -= n;
-
-                    if (nwanted == 0)
-                        break;
-                } else if (complete)
-                    break;
-            }
+            demodulateChunks(*buf2,
+                             0,
+                             cur_demod_samps_ - buf2->undersample,
+                             [&](const C *data, size_t n) { demod->demodulate(data, n); });
         }
 
+        // Packets must be produced before the barrier is removed. An
+        // asynchronous demodulator delivers packets still in progress later,
+        // after the barrier, so only their order relative to other channels
+        // is lost.
+        demod->sync();
+
         // Remove the barrier since we are done producing packets
         radio_q_.eraseBarrier(b);
 
@@ -209,20 +216,52 @@ void OverlapTDChannelizer::demodWorker(std::atomic<bool> &reconfig)
     }
 }
 
+void OverlapTDChannelizer::demodStream(Stream &stream)
+{
+    std::shared_ptr<IQBuf> iqbuf;
+
+    for (;;) {
+        // Take the stream's next slot, releasing the stream if there is none
+        {
+            std::lock_guard<std::mutex> lock(iq_mutex_);
+
+            if (done_ || stream.pending.empty()) {
+                stream.busy = false;
+                return;
+            }
+
+            iqbuf = std::move(stream.pending.front());
+            stream.pending.pop_front();
+        }
+
+        if (!stream.chan) {
+            assert(rx_rate_ != 0);
+            stream.chan = std::make_unique<TDChannelStream>(*phy_,
+                                                            stream.channel,
+                                                            stream.taps,
+                                                            rx_rate_,
+                                                            [this] (std::shared_ptr<RadioPacket> &&pkt) { deliver(std::move(pkt)); });
+        }
+
+        stream.chan->demodulate(*this, iqbuf, rx_rate_, logger_.get());
+    }
+}
+
 void OverlapTDChannelizer::netWorker(void)
 {
     std::shared_ptr<RadioPacket> pkt;
 
     while (!done_) {
         if (radio_q_.pop(pkt))
-            source.push(std::move(pkt));
+            deliver(std::move(pkt));
     }
 }
 
 bool OverlapTDChannelizer::pop(RadioPacketQueue::barrier& b,
                                unsigned &channel,
                                std::shared_ptr<IQBuf>& buf1,
-                               std::shared_ptr<IQBuf>& buf2)
+                               std::shared_ptr<IQBuf>& buf2,
+                               std::shared_ptr<Stream>& stream)
 {
     static MonoClock::time_point last_overflow_log(0.0);
 
@@ -230,95 +269,73 @@ bool OverlapTDChannelizer::pop(RadioPacketQueue::barrier& b,
     // slot from the queue since we no longer need it.
     std::unique_lock<std::mutex> lock(iq_mutex_);
 
-    iq_cond_.wait(lock, [this]{ return done_ || iq_size_ > 1; });
-    if (done_)
-        return false;
+    for (;;) {
+        iq_cond_.wait(lock, [this]{ return done_ || iq_size_ > (streaming_ ? 0 : 1); });
+        if (done_)
+            return false;
 
-    if (iq_size_ > 8) {
-        MonoClock::time_point now = MonoClock::now();
+        if (iq_size_ > 8) {
+            MonoClock::time_point now = MonoClock::now();
 
-        if ((now - last_overflow_log).get_full_secs() >= 1) {
-            logPHY(LOGWARNING, "Large demodulation queue: size=%lu",
-                iq_size_);
-            last_overflow_log = now;
+            if ((now - last_overflow_log).get_full_secs() >= 1) {
+                logPHY(LOGWARNING, "Large demodulation queue: size=%lu",
+                    iq_size_);
+                last_overflow_log = now;
+            }
         }
-    }
 
-    auto it = iq_.begin();
+        assert(iq_next_channel_ < channels_.size());
+        channel = iq_next_channel_++;
 
-    b = radio_q_.pushBarrier();
+        if (!streaming_) {
+            auto it = iq_.begin();
 
-    assert(iq_next_channel_ < channels_.size());
-    channel = iq_next_channel_++;
+            // Reserve the barrier here so barriers are ordered like slots,
+            // but don't wait for its entry while holding iq_mutex_.
+            b = radio_q_.reserveBarrier();
 
-    buf1 = *it++;
-    buf2 = *it;
+            stream.reset();
+            buf1 = *it++;
+            buf2 = *it;
 
-    if (iq_next_channel_ == channels_.size())
-        nextWindow();
+            if (iq_next_channel_ == channels_.size())
+                nextWindow();
 
-    return true;
-}
-
-void OverlapTDChannelizer::nextWindow(void)
-{
-    iq_.pop_front();
-    --iq_size_;
-    iq_next_channel_ = 0;
-}
+            return true;
+        }
 
-void OverlapTDChannelizer::OverlapTDChannelDemodulator::setChannel(const Channel &channel)
-{
-    double new_rate = rx_oversample_*channel.bw/rx_rate_;
-    double new_fshift = channel.fc/rx_rate_;
+        // Find the channel's stream, replacing it if the channel has changed.
+        // The stream's demodulator is built later, outside the lock.
+        if (streams_.size() != channels_.size())
+            streams_.resize(channels_.size());
 
-    channel_ = channel;
+        auto &s = streams_[channel];
 
-    if (new_rate != rate_) {
-        rate_ = new_rate;
-        resamp_.setRate(new_rate);
-    }
+        if (!s || s->channel != channels_[channel].first)
+            s = std::make_shared<Stream>(channels_[channel].first,
+                                         channels_[channel].second);
 
-    if (new_fshift != fshift_) {
-        fshift_ = new_fshift;
-        resamp_.setFreqShift(2*M_PI*channel.fc/rx_rate_);
-    }
-}
+        s->pending.push_back(iq_.front());
 
-void OverlapTDChannelizer::OverlapTDChannelDemodulator::reset(void)
-{
-    resamp_.reset();
-    demod_->reset(channel_);
-}
+        if (iq_next_channel_ == channels_.size())
+            nextWindow();
 
+        // If another worker is demodulating this stream, it will pick up the
+        // slot we just queued, so look for other work instead of waiting.
+        if (!s->busy) {
+            s->busy = true;
+            stream = s;
+            buf1.reset();
+            buf2.reset();
 
-void OverlapTDChannelizer::OverlapTDChannelDemodulator::timestamp(const MonoClock::time_point &timestamp,
-                                                                  std::optional<ssize_t> snapshot_off,
-                                                                  ssize_t offset,
-                                                                  float rx_rate)
-{
-    demod_->timestamp(timestamp,
-                      snapshot_off,
-                      offset,
-                      delay_,
-                      rate_,
-                      rx_rate);
+            return true;
+        }
+    }
 }
 
-void OverlapTDChannelizer::OverlapTDChannelDemodulator::demodulate(const std::complex<float>* data,
-                                                                   size_t count)
+void OverlapTDChannelizer::nextWindow(void)
 {
-    if (fshift_ != 0.0 || rate_ != 1.0) {
-        // Resample. Note that we can't very well mix without a frequency shift,
-        // so we are guaranteed that the resampler's rate is not 1 here.
-        unsigned nw;
-
-        resamp_buf_.resize(resamp_.neededOut(count));
-        nw = resamp_.resampleMixDown(data, count, resamp_buf_.data());
-        resamp_buf_.resize(nw);
-
-        // Demodulate resampled data.
-        demod_->demodulate(resamp_buf_.data(), resamp_buf_.size());
-    } else
-        demod_->demodulate(data, count);
+    iq_.pop_front();
+    --iq_size_;
+    iq_next_channel_ = 0;
 }
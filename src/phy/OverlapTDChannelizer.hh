@@ -7,9 +7,11 @@
 #include <math.h>
 
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <mutex>
+#include <optional>
 
 #include "Logger.hh"
 #include "RadioPacketQueue.hh"
@@ -17,12 +19,16 @@
 #include "dsp/TableNCO.hh"
 #include "phy/Channel.hh"
 #include "phy/Channelizer.hh"
+#include "phy/TDChannelizer.hh"
 
 /** @brief A time-domain channelizer that demodulates overlapping pairs of
  * slots. This duplicates work (and leads to duplicate packets), but it allows
  * us to parallelize demodulation of *a single channel*. We have to do this when
  * demodulation is slow, such as when we use liquid's resamplers.
  */
+/** In streaming mode, each channel is instead demodulated as one continuous
+ * stream, so every sample is demodulated exactly once.
+ */
 class OverlapTDChannelizer : public Channelizer
 {
 public:
@@ -84,56 +90,70 @@ public:
         enforce_ordering_ = enforce;
     }
 
+    /** @brief Return flag indicating whether or not channels are demodulated
+     * as continuous streams.
+     */
+    bool getStreaming(void)
+    {
+        std::lock_guard<std::mutex> lock(iq_mutex_);
+
+        return streaming_;
+    }
+
+    /** @brief Set whether or not channels are demodulated as continuous
+     * streams.
+     */
+    /** In streaming mode, each channel keeps its resampler and frame
+     * synchronizer state from one slot to the next, so every sample is
+     * demodulated once and a frame that spans a slot boundary is still
+     * received. Slots of a single channel are demodulated in order, one at a
+     * time, so only distinct channels are demodulated in parallel. A worker
+     * that finds a channel already being demodulated hands it the slot and
+     * moves on instead of waiting for it. The
+     * prev_demod, cur_demod, and enforce_ordering settings only apply when
+     * streaming is disabled.
+     */
+    void setStreaming(bool streaming)
+    {
+        std::lock_guard<std::mutex> lock(iq_mutex_);
+
+        streaming_ = streaming;
+        streams_.clear();
+    }
+
     /** @brief Stop demodulating. */
     void stop(void);
 
 private:
-    /** @brief Channel state for time-domain demodulation */
-    class OverlapTDChannelDemodulator : public ChannelDemodulator {
-    public:
-        OverlapTDChannelDemodulator(PHY &phy,
-                                    const Channel &channel,
-                                    const std::vector<C> &taps,
-                                    double rx_rate)
-          : ChannelDemodulator(phy, channel, taps, rx_rate)
-          , delay_(round((taps.size() - 1)/2.0))
-          , rx_rate_(rx_rate)
-          , rx_oversample_(phy.getMinRXRateOversample())
-          , resamp_buf_(0)
-          , resamp_(rate_, 2*M_PI*channel.fc/rx_rate, taps)
+    /** @brief Per-channel state for streaming demodulation */
+    struct Stream {
+        Stream(const Channel &channel_, const std::vector<C> &taps_)
+          : channel(channel_)
+          , taps(taps_)
+          , busy(false)
         {
         }
 
-        virtual ~OverlapTDChannelDemodulator() = default;
-
-        /** @brief Set channel */
-        void setChannel(const Channel &channel);
-
-        void reset(void) override;
-
-        void timestamp(const MonoClock::time_point &timestamp,
-                       std::optional<ssize_t> snapshot_off,
-                       ssize_t offset,
-                       float rx_rate) override;
-
-        void demodulate(const std::complex<float>* data,
-                        size_t count) override;
-
-    protected:
-        /** @brief Filter delay */
-        size_t delay_;
+        /** @brief The channel */
+        const Channel channel;
 
-        /** @brief RX rate */
-        const double rx_rate_;
+        /** @brief The channel filter */
+        const std::vector<C> taps;
 
-        /** @brief RX oversample factor */
-        const unsigned rx_oversample_;
+        /** @brief Demodulation state */
+        /** This is built by the first worker to demodulate the stream, so the
+         * demodulator is never constructed with iq_mutex_ held. Only the
+         * worker that has marked the stream busy may touch it.
+         */
+        std::unique_ptr<TDChannelStream> chan;
 
-        /** @brief Resampling buffer */
-        IQBuf resamp_buf_;
+        /** @brief Slots waiting to be demodulated. Protected by iq_mutex_. */
+        std::deque<std::shared_ptr<IQBuf>> pending;
 
-        /** @brief Resampler */
-        dragonradio::signal::MixingRationalResampler<C,C> resamp_;
+        /** @brief Flag that is true while a worker is demodulating this
+         * stream. Protected by iq_mutex_.
+         */
+        bool busy;
     };
 
     /** @brief What portion of the end of the previous slot should we
@@ -157,6 +177,9 @@ private:
      */
     bool enforce_ordering_;
 
+    /** @brief Should each channel be demodulated as a continuous stream? */
+    bool streaming_;
+
     /** @brief Flag that is true when we should finish processing. */
     bool done_;
 
@@ -178,6 +201,9 @@ private:
     /** @brief The queue of IQ buffers. */
     std::list<std::shared_ptr<IQBuf>> iq_;
 
+    /** @brief Streaming state, one per channel. Protected by iq_mutex_. */
+    std::vector<std::shared_ptr<Stream>> streams_;
+
     /** @brief Reconfiguration flags */
     std::vector<std::atomic<bool>> demod_reconfigure_;
 
@@ -202,6 +228,14 @@ private:
     /** @brief A demodulation worker. */
     void demodWorker(std::atomic<bool> &reconfig);
 
+    /** @brief Demodulate a stream's pending slots.
+     * @param stream The stream, which the caller has marked busy.
+     */
+    /** Slots queued while the stream is being demodulated are picked up
+     * before the stream is released.
+     */
+    void demodStream(Stream &stream);
+
     /** @brief The network send worker. */
     void netWorker(void);
 
@@ -210,16 +244,22 @@ private:
      * @param channel The channel to demodulate.
      * @param buf1 The buffer holding the previous slot's IQ data.
      * @param buf2 The buffer holding the current slot's IQ data.
+     * @param stream The stream to demodulate in streaming mode, otherwise
+     * nullptr.
      * @return Return true if pop was successful, false otherwise.
      */
     /** Return two slot's worth of IQ data---the previous slot, and the current
      * slot. The previous slot is removed from the queue, whereas the current
      * slot is kept in the queue because it becomes the new "previous" slot.
+     * In streaming mode, the current slot is instead queued on its channel's
+     * stream, and a stream is only returned if no other worker is already
+     * demodulating it.
      */
     bool pop(RadioPacketQueue::barrier& b,
              unsigned &channel,
              std::shared_ptr<IQBuf>& buf1,
-             std::shared_ptr<IQBuf>& buf2);
+             std::shared_ptr<IQBuf>& buf2,
+             std::shared_ptr<Stream>& stream);
 
      /** @brief Move to the next demodulation window. */
      void nextWindow(void);
@@ -118,6 +118,18 @@ public:
         virtual void demodulate(const std::complex<float>* data,
                                 size_t count) = 0;
 
+        /** @brief Deliver packets demodulated so far */
+        /** A demodulator that demodulates asynchronously must pass every
+         * packet it has finished demodulating to the callback, on the calling
+         * thread, before this returns. It should not wait for demodulation in
+         * progress, since that would stall the channelizer; those packets are
+         * delivered at a later call. Channelizers call this at the end of each
+         * slot.
+         */
+        virtual void sync(void)
+        {
+        }
+
     protected:
         /** @brief Our PHY */
         PHY &phy_;
@@ -215,9 +227,12 @@ public:
                     (unsigned) pkt->hdr.seq);
             }
 
-            // Cache payload size if this packet is not compressed
-            if (!pkt->hdr.flags.compressed)
+            // Classify packet and cache payload size if this packet is not
+            // compressed
+            if (!pkt->hdr.flags.compressed) {
+                pkt->classify();
                 pkt->payload_size = pkt->getPayloadSize();
+            }
 
             return pkt;
         }
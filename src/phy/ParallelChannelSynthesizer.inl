@@ -5,6 +5,8 @@
 
 #include <pybind11/pybind11.h>
 
+#include "util/threads.hh"
+
 namespace py = pybind11;
 
 template <class ChannelModulator>
@@ -19,7 +21,8 @@ ParallelChannelSynthesizer<ChannelModulator>::ParallelChannelSynthesizer(std::sh
   , reconfigure_sync_(nthreads+1)
 {
     for (size_t i = 0; i < nthreads; ++i)
-        mod_threads_.emplace_back(std::thread(&ParallelChannelSynthesizer::modWorker,
+        mod_threads_.emplace_back(spawnThread("mod",
+                                              &ParallelChannelSynthesizer::modWorker,
                                               this,
                                               i));
 
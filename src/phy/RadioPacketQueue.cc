@@ -1,11 +1,32 @@
 // Copyright 2018-2020 Drexel University
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
+#include <thread>
+
 #include "phy/RadioPacketQueue.hh"
 
-RadioPacketQueue::RadioPacketQueue() :
-    done_(false)
+/** @brief Round up to the next power of two */
+static uint64_t roundUpPow2(uint64_t n)
+{
+    uint64_t pow2 = 1;
+
+    while (pow2 < n)
+        pow2 <<= 1;
+
+    return pow2;
+}
+
+RadioPacketQueue::RadioPacketQueue(size_t nbarriers)
+  : done_(false)
+  , mask_(roundUpPow2(nbarriers) - 1)
+  , entries_(new Entry[mask_ + 1])
+  , tail_(0)
+  , head_(0)
+  , sleeping_(false)
+  , noverflow_(0)
 {
+    for (uint64_t i = 0; i <= mask_; ++i)
+        entries_[i].turn.store(i, std::memory_order_relaxed);
 }
 
 RadioPacketQueue::~RadioPacketQueue()
@@ -15,69 +36,183 @@ RadioPacketQueue::~RadioPacketQueue()
 
 void RadioPacketQueue::push(const std::shared_ptr<RadioPacket> &pkt)
 {
-    {
-        std::lock_guard<std::mutex> lock(m_);
-
-        q_.emplace_back(pkt);
-    }
+    barrier b = pushBarrier();
 
-    cond_.notify_one();
+    push(b, pkt);
+    eraseBarrier(b);
 }
 
 void RadioPacketQueue::push(barrier b,
                             const std::shared_ptr<RadioPacket> &pkt)
 {
-    {
+    if (!inRing(b)) {
         std::lock_guard<std::mutex> lock(m_);
 
-        q_.insert(b, pkt);
+        overflow_[b].pkts.push_back(pkt);
+        wakeOverflow(b);
+        return;
+    }
+
+    Entry                        &e = entries_[b & mask_];
+    std::shared_ptr<RadioPacket> p = pkt;
+
+    // The entry's queue can only be full if the consumer is still draining
+    // an older barrier, so wait for it to catch up.
+    while (!e.pkts.try_push(p)) {
+        if (done_.load(std::memory_order_acquire))
+            return;
+
+        std::this_thread::yield();
     }
 
-    cond_.notify_one();
+    wake(b);
 }
 
-RadioPacketQueue::barrier RadioPacketQueue::pushBarrier(void)
+void RadioPacketQueue::acquireBarrier(barrier b)
 {
-    RadioPacketQueue::barrier b;
-
-    {
-        std::lock_guard<std::mutex> lock(m_);
+    Entry &e = entries_[b & mask_];
 
-        b = q_.insert(q_.end(), std::monostate());
+    if (e.turn.load(std::memory_order_acquire) == b) {
+        e.turn.store(b + 1, std::memory_order_release);
+        return;
     }
 
-    cond_.notify_one();
+    // The entry is still in use because the consumer has fallen a full ring
+    // of barriers behind. Waiting for it to catch up costs far more than the
+    // lock taken by an overflow entry, so fall back immediately.
+    std::lock_guard<std::mutex> lock(m_);
 
-    return b;
+    overflow_.emplace(b, OverflowEntry());
+    noverflow_.fetch_add(1, std::memory_order_seq_cst);
 }
 
-void RadioPacketQueue::eraseBarrier(RadioPacketQueue::barrier b)
+void RadioPacketQueue::eraseBarrier(barrier b)
 {
-    {
+    if (!inRing(b)) {
         std::lock_guard<std::mutex> lock(m_);
 
-        q_.erase(b);
+        overflow_[b].complete = true;
+        wakeOverflow(b);
+        return;
     }
 
-    cond_.notify_all();
+    entries_[b & mask_].complete.store(true, std::memory_order_release);
+
+    wake(b);
 }
 
 bool RadioPacketQueue::pop(std::shared_ptr<RadioPacket>& pkt)
 {
-    std::unique_lock<std::mutex> lock(m_);
-
-    cond_.wait(lock, [this]{ return done_ || (!q_.empty() && std::holds_alternative<std::shared_ptr<RadioPacket>>(q_.front())); });
-    if (done_)
-        return false;
-    else {
-        pkt = std::move(std::get<std::shared_ptr<RadioPacket>>(q_.front()));
-        q_.pop_front();
-        return true;
+    for (;;) {
+        if (tryPop(pkt))
+            return true;
+
+        std::unique_lock<std::mutex> lock(m_);
+
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        cond_.wait(lock, [this]{ return done_.load(std::memory_order_acquire) || ready(); });
+
+        sleeping_.store(false, std::memory_order_relaxed);
+
+        if (done_.load(std::memory_order_acquire))
+            return false;
     }
 }
 
 void RadioPacketQueue::stop(void)
 {
-    done_ = true;
+    done_.store(true, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(m_);
+
     cond_.notify_all();
 }
+
+bool RadioPacketQueue::tryPop(std::shared_ptr<RadioPacket> &pkt)
+{
+    for (;;) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        Entry    &e = entries_[head & mask_];
+        uint64_t turn = e.turn.load(std::memory_order_acquire);
+
+        if (turn != head + 1) {
+            // A free entry means the barrier is either not yet acquired or
+            // was acquired as an overflow entry.
+            if (turn != head || noverflow_.load(std::memory_order_seq_cst) == 0)
+                return false;
+
+            std::unique_lock<std::mutex> lock(m_);
+            auto                         it = overflow_.find(head);
+
+            if (it == overflow_.end())
+                return false;
+
+            OverflowEntry &o = it->second;
+
+            if (o.next < o.pkts.size()) {
+                pkt = std::move(o.pkts[o.next++]);
+                return true;
+            }
+
+            if (!o.complete)
+                return false;
+
+            overflow_.erase(it);
+            noverflow_.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+
+            // Release the entry for the barrier one lap around the ring
+            e.turn.store(head + mask_ + 1, std::memory_order_release);
+            head_.store(head + 1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (e.pkts.try_pop(pkt))
+            return true;
+
+        if (!e.complete.load(std::memory_order_acquire))
+            return false;
+
+        // The barrier has been erased, so every packet pushed before it is
+        // now visible.
+        if (e.pkts.try_pop(pkt))
+            return true;
+
+        // Release the entry for the barrier one lap around the ring
+        e.complete.store(false, std::memory_order_relaxed);
+        e.turn.store(head + mask_ + 1, std::memory_order_release);
+        head_.store(head + 1, std::memory_order_relaxed);
+    }
+}
+
+bool RadioPacketQueue::ready(void)
+{
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Entry    &e = entries_[head & mask_];
+    uint64_t turn = e.turn.load(std::memory_order_acquire);
+
+    if (turn == head + 1)
+        return !e.pkts.empty() || e.complete.load(std::memory_order_acquire);
+
+    if (turn == head) {
+        auto it = overflow_.find(head);
+
+        return it != overflow_.end() &&
+               (it->second.next < it->second.pkts.size() || it->second.complete);
+    }
+
+    return false;
+}
+
+void RadioPacketQueue::wake(barrier b)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (head_.load(std::memory_order_relaxed) == b && sleeping_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_);
+
+        cond_.notify_one();
+    }
+}
@@ -4,33 +4,50 @@
 #ifndef RADIOPACKETQUEUE_H_
 #define RADIOPACKETQUEUE_H_
 
+#include <atomic>
 #include <condition_variable>
-#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <variant>
+#include <vector>
 
 #include "IQBuffer.hh"
+#include "LockFreeQueue.hh"
 #include "Packet.hh"
 
 /** @brief A thread-safe queue of network packets. Handles barriers. */
-/** This is a specialized queue for RadioPackets that handles barrier packets. A
- * barrier packet is a special packet that will not be removed from a queue---
- * seeing a barrier packet is like seeing the end of the queue. Barriers allow
- * proper ordering: a producer can insert a barrier, insert packets before the
- * barrier, then remove the barrier when it is done producing, thereby
- * guaranteeing that packets inserted *after* the barrier will not be read from
- * the queue until the barrier has been removed.
+/** This is a specialized queue for RadioPackets that handles barriers. A
+ * barrier marks a position in the queue---seeing a barrier is like seeing the
+ * end of the queue. Barriers allow proper ordering: a producer can insert a
+ * barrier, insert packets before the barrier, then remove the barrier when it
+ * is done producing, thereby guaranteeing that packets inserted *after* the
+ * barrier will not be read from the queue until the barrier has been removed.
+ *
+ * Barriers are entries in a fixed-size ring, allocated in order, e.g., one per
+ * (slot, channel) pair handed to a demodulation thread. Each entry has its own
+ * lock-free packet queue and a completion flag, so producers never take a lock
+ * or allocate to publish a packet. A single consumer drains the ring in order,
+ * delivering packets from the oldest barrier as soon as they are published and
+ * moving on to the next barrier once the oldest has been erased.
+ *
+ * If the consumer has fallen a full ring of barriers behind, a new barrier
+ * does not wait for its entry to be freed. It instead falls back to an
+ * overflow entry kept under the queue's mutex, like the original list-based
+ * queue, so a full ring never blocks producers.
  */
 class RadioPacketQueue {
 public:
-    /** @brief A queue entry */
-    using entry = std::variant<std::monostate, std::shared_ptr<RadioPacket>>;
-
     /** @brief A barrier */
-    using barrier = std::list<entry>::iterator;
+    using barrier = uint64_t;
+
+    /** @brief Maximum number of packets buffered for a single barrier */
+    static constexpr size_t kBarrierCapacity = 64;
 
-    RadioPacketQueue();
+    /** @brief Construct a queue
+     * @param nbarriers Minimum number of outstanding barriers. The actual
+     * number is the next power of two.
+     */
+    explicit RadioPacketQueue(size_t nbarriers = 64);
     ~RadioPacketQueue();
 
     RadioPacketQueue(const RadioPacketQueue&) = delete;
@@ -48,12 +65,41 @@ public:
      * @param b The barrier.
      * @param pkt The packet to push onto the queue.
      */
+    /** Only the thread that owns the barrier may push packets before it. */
     void push(barrier b, const std::shared_ptr<RadioPacket> &pkt);
 
     /** @brief Push a barrier onto the queue.
      * @return A barrier.
      */
-    barrier pushBarrier(void);
+    barrier pushBarrier(void)
+    {
+        barrier b = reserveBarrier();
+
+        acquireBarrier(b);
+
+        return b;
+    }
+
+    /** @brief Reserve a barrier's position in the queue.
+     * @return A barrier, which must be acquired before it is used.
+     */
+    /** Reserving a barrier is a single atomic increment, so a producer can
+     * reserve barriers while holding the lock that orders them and acquire
+     * them after releasing it.
+     */
+    barrier reserveBarrier(void)
+    {
+        return tail_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** @brief Acquire a reserved barrier's entry.
+     * @param b The barrier.
+     */
+    /** This never blocks. If the barrier's ring entry is still in use, the
+     * barrier uses an overflow entry instead. The consumer treats a reserved
+     * but unacquired barrier like one that has not been erased.
+     */
+    void acquireBarrier(barrier b);
 
     /** @brief Erase a barrier from the queue.
      * @param b The barrier.
@@ -64,23 +110,112 @@ public:
      * @param pkt The popped packet.
      * @return Return true if pop was successful, false otherwise.
      */
+    /** There must be only a single consumer. */
     bool pop(std::shared_ptr<RadioPacket> &pkt);
 
     /** @brief Stop processing this queue.*/
     void stop(void);
 
 private:
+    /** @brief A barrier entry */
+    struct Entry {
+        Entry()
+          : turn(0)
+          , complete(false)
+          , pkts(kBarrierCapacity)
+        {
+        }
+
+        /** @brief Entry state */
+        /** The entry is free for barrier b when turn is b, and it is owned by
+         * barrier b when turn is b + 1.
+         */
+        std::atomic<uint64_t> turn;
+
+        /** @brief Flag that is true once the barrier has been erased */
+        std::atomic<bool> complete;
+
+        /** @brief Packets inserted before the barrier */
+        LockFreeQueue<std::shared_ptr<RadioPacket>> pkts;
+    };
+
+    /** @brief A barrier entry used when the ring is full */
+    struct OverflowEntry {
+        OverflowEntry()
+          : complete(false)
+          , next(0)
+        {
+        }
+
+        /** @brief Flag that is true once the barrier has been erased */
+        bool complete;
+
+        /** @brief Index of next packet to pop */
+        size_t next;
+
+        /** @brief Packets inserted before the barrier */
+        std::vector<std::shared_ptr<RadioPacket>> pkts;
+    };
+
     /** @brief Flag that is true when we should finish processing. */
-    bool done_;
+    std::atomic<bool> done_;
 
-    /** @brief Mutex protecting the queue of packets. */
+    /** @brief Mask used to compute entry index */
+    const uint64_t mask_;
+
+    /** @brief Barrier entries */
+    std::unique_ptr<Entry[]> entries_;
+
+    /** @brief Next barrier to allocate */
+    alignas(64) std::atomic<uint64_t> tail_;
+
+    /** @brief Oldest barrier not yet drained. Only written by the consumer. */
+    alignas(64) std::atomic<uint64_t> head_;
+
+    /** @brief Flag that is true when the consumer is sleeping */
+    std::atomic<bool> sleeping_;
+
+    /** @brief Number of overflow entries */
+    std::atomic<size_t> noverflow_;
+
+    /** @brief Mutex used to sleep and wake. Also protects overflow_. */
     std::mutex m_;
 
-    /** @brief Condition variable protecting the queue of packets. */
+    /** @brief Condition variable used to wake the consumer. */
     std::condition_variable cond_;
 
-    /** @brief The queue of packets. */
-    std::list<entry> q_;
+    /** @brief Overflow entries, indexed by barrier */
+    std::map<barrier, OverflowEntry> overflow_;
+
+    /** @brief Try to pop a packet without blocking */
+    bool tryPop(std::shared_ptr<RadioPacket> &pkt);
+
+    /** @brief Return true if the consumer has work to do. Must hold m_. */
+    bool ready(void);
+
+    /** @brief Return true if a barrier is using its ring entry */
+    /** Only valid for a barrier that has been acquired and not yet erased. */
+    bool inRing(barrier b)
+    {
+        return entries_[b & mask_].turn.load(std::memory_order_acquire) == b + 1;
+    }
+
+    /** @brief Wake the consumer if it is sleeping on an overflow barrier.
+     * Must hold m_.
+     */
+    void wakeOverflow(barrier b)
+    {
+        if (sleeping_.load(std::memory_order_relaxed) && head_.load(std::memory_order_relaxed) == b)
+            cond_.notify_one();
+    }
+
+    /** @brief Wake the consumer if it is sleeping on a barrier
+     * @param b The barrier that has made progress.
+     */
+    /** The consumer can only make progress when the oldest barrier does, so
+     * producers of younger barriers never need to wake it.
+     */
+    void wake(barrier b);
 };
 
 #endif /* RADIOPACKETQUEUE_H_ */
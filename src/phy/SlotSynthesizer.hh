@@ -10,6 +10,15 @@
 class SlotSynthesizer : public Synthesizer
 {
 public:
+    /** @brief Synthesizer-specific configuration bound to a slot */
+    /** Slots are created by the MAC, which knows nothing about a particular
+     * synthesizer's configuration, so a synthesizer derives its configuration
+     * from this and downcasts the configuration bound to a slot.
+     */
+    struct SlotConfig {
+        virtual ~SlotConfig() = default;
+    };
+
     /** @brief A time slot that needs to be synthesized */
     struct Slot {
         Slot(const WallClock::time_point &deadline_,
@@ -84,6 +93,14 @@ public:
          */
         size_t npartial;
 
+        /** @brief Synthesizer configuration bound to this slot */
+        /** A synthesizer that reconfigures without stopping its workers binds
+         * its current configuration to a slot when the slot is handed to it.
+         * Every thread that modulates the slot, as well as finalize, then sees
+         * the same configuration.
+         */
+        std::shared_ptr<const SlotConfig> config;
+
         /** @brief The length of the slot, in samples. */
         /** Return the length of the slot, in samples. This does not include
          * delayed samples.
@@ -1,6 +1,7 @@
 // Copyright 2018-2020 Drexel University
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
+#include <algorithm>
 #include <functional>
 
 #include <pybind11/pybind11.h>
@@ -10,6 +11,7 @@ namespace py = pybind11;
 #include "Logger.hh"
 #include "phy/PHY.hh"
 #include "phy/TDChannelizer.hh"
+#include "util/threads.hh"
 
 using namespace std::placeholders;
 
@@ -20,16 +22,15 @@ TDChannelizer::TDChannelizer(std::shared_ptr<PHY> phy,
   : Channelizer(phy, rx_rate, channels)
   , nthreads_(nthreads)
   , done_(false)
-  , reconfigure_(true)
-  , reconfigure_sync_(nthreads+1)
   , logger_(logger)
 {
-    for (unsigned int tid = 0; tid < nthreads; ++tid)
-        demod_threads_.emplace_back(std::thread(&TDChannelizer::demodWorker,
-                                    this,
-                                    tid));
-
     reconfigure();
+
+    for (unsigned int tid = 0; tid < nthreads; ++tid)
+        demod_threads_.emplace_back(spawnThread("demod",
+                                                &TDChannelizer::demodWorker,
+                                                this,
+                                                tid));
 }
 
 TDChannelizer::~TDChannelizer()
@@ -39,19 +40,67 @@ TDChannelizer::~TDChannelizer()
 
 void TDChannelizer::push(const std::shared_ptr<IQBuf> &iqbuf)
 {
-    std::lock_guard<std::mutex> lock(demod_mutex_);
-    unsigned                    nchannels = channels_.size();
+    auto                                config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+    size_t                              backlog = 0;
+    std::vector<std::shared_ptr<IQBuf>> shed_bufs;
+
+    for (auto &chan : config->chans) {
+        chan->iqbufs.push(iqbuf);
+
+        bool idle = chan->idle_slots.load(std::memory_order_relaxed) >= kIdleSlots;
+
+        backlog = std::max(backlog, shed(chan->iqbufs, idle, shed_bufs));
+    }
 
-    for (unsigned i = 0; i < nchannels; ++i)
-        iqbufs_[i]->push(iqbuf);
+    updateShedding(backlog, shed_bufs.size());
+
+    // Don't free shed buffers on the RX thread
+    retire(shed_bufs);
 }
 
 void TDChannelizer::reconfigure(void)
 {
-    std::lock_guard<std::mutex> lock(demod_mutex_);
+    std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+    auto                        start = MonoClock::now();
+    auto                        prev = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+    auto                        config = std::make_shared<Config>();
+
+    config->rx_rate = rx_rate_;
+    config->channels = channels_;
+
+    // Build state for the new channel plan while the workers continue to
+    // demodulate using the old plan. A channel whose parameters have not
+    // changed keeps its demodulator, including any frame in progress, and its
+    // queue of pending IQ buffers.
+    const unsigned    nchannels = config->channels.size();
+    std::vector<int>  match(nchannels, -1);
+    std::vector<bool> reused;
+
+    if (prev && prev->rx_rate == config->rx_rate) {
+        match = matchChannels(prev->channels, config->channels);
+        reused.resize(prev->chans.size(), false);
+    }
 
-    // Tell workers we are reconfiguring
-    reconfigure_.store(true, std::memory_order_release);
+    config->chans.resize(nchannels);
+
+    for (unsigned i = 0; i < nchannels; ++i) {
+        if (match[i] >= 0) {
+            config->chans[i] = prev->chans[match[i]];
+            reused[match[i]] = true;
+        } else {
+            config->chans[i] = std::make_shared<ChannelState>(*phy_,
+                                                              config->channels[i].first,
+                                                              config->channels[i].second,
+                                                              config->rx_rate,
+                                                              [this] (std::shared_ptr<RadioPacket> &&pkt) { deliver(std::move(pkt)); });
+        }
+    }
+
+    // Swap in the new configuration. Workers pick it up at their next buffer
+    // boundary.
+    std::atomic_store_explicit(&config_,
+                               std::shared_ptr<const Config>(std::move(config)),
+                               std::memory_order_release);
 
     // Wake all workers that might be sleeping.
     {
@@ -60,30 +109,21 @@ void TDChannelizer::reconfigure(void)
         wake_cond_.notify_all();
     }
 
-    // Wait for workers to be ready for reconfiguration
-    reconfigure_sync_.wait();
-
-    // Now set the channels and reconfigure the channel state
-    unsigned nchannels = channels_.size();
-
-    demods_.resize(nchannels);
-    iqbufs_.resize(nchannels);
+    // Retire channels that are no longer part of the plan. Any buffers still
+    // queued for them will never be demodulated.
+    size_t nlost = 0;
 
-    for (unsigned i = 0; i < nchannels; i++) {
-        if (!iqbufs_[i])
-            iqbufs_[i] = std::make_unique<SafeQueue<std::shared_ptr<IQBuf>>>();
+    if (prev) {
+        for (unsigned j = 0; j < prev->chans.size(); ++j) {
+            if (j < reused.size() && reused[j])
+                continue;
 
-        demods_[i] = std::make_unique<TDChannelDemodulator>(*phy_,
-                                                            channels_[i].first,
-                                                            channels_[i].second,
-                                                            rx_rate_);
+            nlost += prev->chans[j]->iqbufs.size();
+            prev->chans[j]->iqbufs.stop();
+        }
     }
 
-    // We are done reconfiguring
-    reconfigure_.store(false, std::memory_order_release);
-
-    // Wait for workers to resume
-    reconfigure_sync_.wait();
+    recordReconfiguration(start, nlost);
 }
 
 void TDChannelizer::stop(void)
@@ -94,11 +134,17 @@ void TDChannelizer::stop(void)
     done_ = true;
 
     // Stop all IQ buffer queues
-    for (unsigned int i = 0; i < iqbufs_.size(); ++i)
-        iqbufs_[i]->stop();
+    auto config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
+
+    for (auto &chan : config->chans)
+        chan->iqbufs.stop();
 
     // Join on all threads
-    wake_cond_.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+
+        wake_cond_.notify_all();
+    }
 
     for (unsigned int i = 0; i < demod_threads_.size(); ++i) {
         if (demod_threads_[i].joinable())
@@ -108,126 +154,161 @@ void TDChannelizer::stop(void)
 
 void TDChannelizer::demodWorker(unsigned tid)
 {
-    std::shared_ptr<IQBuf> prev_iqbuf;
-    std::shared_ptr<IQBuf> iqbuf;
-    std::optional<ssize_t> next_snapshot_off;
-    bool                   received = false; // Have we received any packets?
-    Channel                channel;          // Current channel being demodulated
-
-    PHY::PacketDemodulator::callback_type callback = [&] (const std::shared_ptr<RadioPacket> &pkt) {
-        received = true;
-        if (pkt) {
-            pkt->channel = channel;
-            source.push(pkt);
-        }
-    };
+    std::shared_ptr<IQBuf>        iqbuf;
+    std::shared_ptr<const Config> config;
 
     while (!done_) {
-        // If we are reconfiguring, wait until reconfiguration is done
-        if (reconfigure_.load(std::memory_order_acquire)) {
-            // Wait for reconfiguration to start
-            reconfigure_sync_.wait();
-
-            // Wait for reconfiguration to finish
-            reconfigure_sync_.wait();
+        // Pick up the current configuration
+        config = std::atomic_load_explicit(&config_, std::memory_order_acquire);
 
-            // If we are unneeded, sleep
-            if (tid >= channels_.size()) {
-                std::unique_lock<std::mutex> lock(wake_mutex_);
+        // If we are unneeded, sleep until the configuration changes
+        if (tid >= config->chans.size()) {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
 
-                wake_cond_.wait(lock, [this]{ return done_ || reconfigure_.load(std::memory_order_acquire); });
+            wake_cond_.wait(lock, [&]{
+                return done_ || std::atomic_load_explicit(&config_, std::memory_order_acquire) != config;
+            });
 
-                continue;
-            }
-
-            // Set demodulator callbacks
-            for (unsigned channelidx = tid; channelidx < channels_.size(); channelidx += nthreads_)
-                demods_[channelidx]->setCallback(callback);
+            continue;
         }
 
-        for (unsigned channelidx = tid; channelidx < channels_.size(); channelidx += nthreads_) {
-            auto &demod = *demods_[channelidx];
-            auto &iqbufs = *iqbufs_[channelidx];
+        for (unsigned channelidx = tid; channelidx < config->chans.size(); channelidx += nthreads_) {
+            auto &chan = *config->chans[channelidx];
 
-            // Get an IQ buffer
-            if (!iqbufs.pop(iqbuf)) {
+            // Wait for an IQ buffer without holding the channel's mutex, so a
+            // worker blocked on an idle channel never holds up the worker that
+            // demodulates the channel after a reconfiguration.
+            if (!chan.iqbufs.wait()) {
                 if (done_)
                     return;
 
                 continue;
             }
 
-            // Wait for the buffer to start to fill.
-            iqbuf->waitToStartFilling();
+            // Free the buffers of any slots shed since we last looked
+            freeRetired();
 
-            // When the snapshot is over, we need to record self-transmissions
-            // for one more slot to ensure we record any transmission that began
-            // in the last slot of the snapshot but ended in the following slot.
-            // The offset for the next snapshot IQ buffer was saved in
-            // next_snapshot_off, so we use that if this IQ buffer does not have
-            // a snapshot offset.
-            std::optional<ssize_t> snapshot_off;
+            std::lock_guard<std::mutex> lock(chan.mutex);
 
-            if (iqbuf->snapshot_off)
-                snapshot_off = iqbuf->snapshot_off;
-            else
-                snapshot_off = next_snapshot_off;
-
-            // Update IQ buffer sequence number
-            demod.updateSeq(iqbuf->seq);
-
-            // Timestamp the demodulated data
-            demod.timestamp(*iqbuf->timestamp,
-                            snapshot_off,
-                            0,
-                            rx_rate_);
-
-            // Demodulate the IQ buffer
-            bool   complete = false; // Is the buffer complete?
-            size_t ndemodulated = 0; // How many samples we've already demodulated
-            size_t n = 0;
-
-            received = false;
-            channel = channels_[channelidx].first;
-
-            for (;;) {
-                complete = iqbuf->complete.load(std::memory_order_acquire);
-                n = iqbuf->nsamples.load(std::memory_order_acquire) - ndemodulated;
-
-                if (n != 0) {
-                    demod.demodulate(iqbuf->data() + ndemodulated, n);
-                    ndemodulated += n;
-                } else if (complete)
-                    break;
-            }
+            // Get an IQ buffer. Another worker may have taken it first.
+            if (!chan.iqbufs.try_pop(iqbuf))
+                continue;
 
-            // Save the snapshot offset of the next IQ buffer here if we know
-            // what it will be. iqbuf's size is valid now that it has been
-            // marked complete.
-            if (iqbuf->snapshot_off)
-                next_snapshot_off = *iqbuf->snapshot_off + iqbuf->size();
+            chan.demodulate(*this, iqbuf, config->rx_rate, logger_.get());
+
+            if (chan.received)
+                chan.idle_slots.store(0, std::memory_order_relaxed);
             else
-                next_snapshot_off = std::nullopt;
-
-            // If we received any packets, log both the previous and the current
-            // slot. We then save the current slot in case we need to log it
-            // later.
-            if (logger_ && logger_->getCollectSource(Logger::kSlots)) {
-                if (received) {
-                    if (prev_iqbuf) {
-                        logger_->logSlot(prev_iqbuf);
-                        prev_iqbuf.reset();
-                    }
-
-                    logger_->logSlot(iqbuf);
-                } else
-                    prev_iqbuf = std::move(iqbuf);
-            }
+                chan.idle_slots.fetch_add(1, std::memory_order_relaxed);
         }
     }
 }
 
-void TDChannelizer::TDChannelDemodulator::updateSeq(unsigned seq)
+TDChannelStream::TDChannelStream(PHY &phy,
+                                 const Channel &channel_,
+                                 const std::vector<C> &taps,
+                                 double rx_rate,
+                                 deliver_type deliver)
+  : channel(channel_)
+  , demod(phy, channel_, taps, rx_rate)
+  , received(false)
+{
+    demod.setCallback([this, deliver = std::move(deliver)] (std::shared_ptr<RadioPacket> &&pkt) {
+        received = true;
+        if (pkt) {
+            pkt->channel = channel;
+            deliver(std::move(pkt));
+        }
+    });
+}
+
+void TDChannelStream::demodulate(Channelizer &channelizer,
+                                 const std::shared_ptr<IQBuf> &iqbuf,
+                                 double rx_rate,
+                                 Logger *logger)
+{
+    // Wait for the buffer to start to fill.
+    iqbuf->waitToStartFilling();
+
+    // When the snapshot is over, we need to record self-transmissions for one
+    // more slot to ensure we record any transmission that began in the last
+    // slot of the snapshot but ended in the following slot. The offset for the
+    // next snapshot IQ buffer was saved in next_snapshot_off, so we use that if
+    // this IQ buffer does not have a snapshot offset.
+    std::optional<ssize_t> snapshot_off;
+
+    // After a gap in sequence numbers, e.g., because slots were shed, the
+    // saved offset belongs to a buffer we never saw.
+    if (iqbuf->seq != demod.getSeq() + 1)
+        next_snapshot_off = std::nullopt;
+
+    if (iqbuf->snapshot_off)
+        snapshot_off = iqbuf->snapshot_off;
+    else
+        snapshot_off = next_snapshot_off;
+
+    // Update IQ buffer sequence number
+    demod.updateSeq(iqbuf->seq);
+
+    // Timestamp the demodulated data
+    demod.timestamp(*iqbuf->timestamp,
+                    snapshot_off,
+                    0,
+                    rx_rate);
+
+    // Demodulate the IQ buffer in chunks as it is received
+    received = false;
+
+    channelizer.demodulateChunks(*iqbuf,
+                                 0,
+                                 std::numeric_limits<size_t>::max(),
+                                 [&](const C *data, size_t n) { demod.demodulate(data, n); });
+
+    // Deliver packets that are ready before we report whether any were
+    // received
+    demod.sync();
+
+    // Save the snapshot offset of the next IQ buffer here if we know what it
+    // will be. iqbuf's size is valid now that it has been marked complete.
+    if (iqbuf->snapshot_off)
+        next_snapshot_off = *iqbuf->snapshot_off + iqbuf->size();
+    else
+        next_snapshot_off = std::nullopt;
+
+    // If we received any packets, log both the previous and the current slot.
+    // We then save the current slot in case we need to log it later.
+    if (logger && logger->getCollectSource(Logger::kSlots)) {
+        if (received) {
+            if (prev_iqbuf) {
+                logger->logSlot(prev_iqbuf);
+                prev_iqbuf.reset();
+            }
+
+            logger->logSlot(iqbuf);
+        } else
+            prev_iqbuf = iqbuf;
+    }
+}
+
+void TDChannelDemodulator::setChannel(const Channel &channel)
+{
+    double new_rate = rx_oversample_*channel.bw/rx_rate_;
+    double new_fshift = channel.fc/rx_rate_;
+
+    channel_ = channel;
+
+    if (new_rate != rate_) {
+        rate_ = new_rate;
+        resamp_.setRate(new_rate);
+    }
+
+    if (new_fshift != fshift_) {
+        fshift_ = new_fshift;
+        resamp_.setFreqShift(2*M_PI*channel.fc/rx_rate_);
+    }
+}
+
+void TDChannelDemodulator::updateSeq(unsigned seq)
 {
     // Reset state if we have a discontinuity or if we're not currently
     // receiving a frame
@@ -238,14 +319,14 @@ void TDChannelizer::TDChannelDemodulator::updateSeq(unsigned seq)
     seq_ = seq;
 }
 
-void TDChannelizer::TDChannelDemodulator::reset(void)
+void TDChannelDemodulator::reset(void)
 {
     resamp_.reset();
     demod_->reset(channel_);
     seq_ = 0;
 }
 
-void TDChannelizer::TDChannelDemodulator::timestamp(const MonoClock::time_point &timestamp,
+void TDChannelDemodulator::timestamp(const MonoClock::time_point &timestamp,
                                                     std::optional<ssize_t> snapshot_off,
                                                     ssize_t offset,
                                                     float rx_rate)
@@ -258,7 +339,7 @@ void TDChannelizer::TDChannelDemodulator::timestamp(const MonoClock::time_point
                       rx_rate);
 }
 
-void TDChannelizer::TDChannelDemodulator::demodulate(const std::complex<float>* data,
+void TDChannelDemodulator::demodulate(const std::complex<float>* data,
                                                      size_t count)
 {
     if (fshift_ != 0.0 || rate_ != 1.0) {
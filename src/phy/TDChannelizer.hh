@@ -9,15 +9,139 @@
 #include <condition_variable>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 
-#include "barrier.hh"
+#include "Logger.hh"
 #include "SafeQueue.hh"
 #include "dsp/Polyphase.hh"
 #include "dsp/TableNCO.hh"
 #include "phy/Channel.hh"
 #include "phy/Channelizer.hh"
 
+/** @brief Time-domain demodulator for a single channel */
+class TDChannelDemodulator : public ChannelDemodulator {
+public:
+    TDChannelDemodulator(PHY &phy,
+                         const Channel &channel,
+                         const std::vector<C> &taps,
+                         double rx_rate)
+      : ChannelDemodulator(phy, channel, taps, rx_rate)
+      , seq_(0)
+      , delay_(round((taps.size() - 1)/2.0))
+      , rx_rate_(rx_rate)
+      , rx_oversample_(phy.getMinRXRateOversample())
+      , resamp_buf_(0)
+      , resamp_(rate_, 2*M_PI*channel.fc/rx_rate, taps)
+    {
+    }
+
+    virtual ~TDChannelDemodulator() = default;
+
+    /** @brief Set channel */
+    /** The channel's filter is left unchanged. */
+    void setChannel(const Channel &channel);
+
+    /** @brief Get sequence number of the last IQ buffer demodulated */
+    unsigned getSeq(void) const
+    {
+        return seq_;
+    }
+
+    /** @brief Update IQ buffer sequence number */
+    /** Demodulator state is reset if the sequence number does not follow the
+     * previous one or no frame is in progress.
+     */
+    void updateSeq(unsigned seq);
+
+    void reset(void) override;
+
+    void timestamp(const MonoClock::time_point &timestamp,
+                   std::optional<ssize_t> snapshot_off,
+                   ssize_t offset,
+                   float rx_rate) override;
+
+    void demodulate(const std::complex<float>* data,
+                    size_t count) override;
+
+protected:
+    /** @brief Channel IQ buffer sequence number */
+    unsigned seq_;
+
+    /** @brief Filter delay */
+    size_t delay_;
+
+    /** @brief RX rate */
+    const double rx_rate_;
+
+    /** @brief RX oversample factor */
+    const unsigned rx_oversample_;
+
+    /** @brief Resampling buffer */
+    IQBuf resamp_buf_;
+
+    /** @brief Resampler */
+    dragonradio::signal::MixingRationalResampler<C,C> resamp_;
+};
+
+/** @brief A channel demodulated as one continuous stream of IQ buffers */
+/** Demodulator state carries over from one IQ buffer to the next, so a frame
+ * that spans a slot boundary is still received. The buffers of a stream must
+ * be demodulated one at a time, in order.
+ */
+struct TDChannelStream {
+    using deliver_type = std::function<void(std::shared_ptr<RadioPacket>&&)>;
+
+    /** @brief Construct a stream
+     * @param phy The PHY
+     * @param channel_ The channel
+     * @param taps The channel filter
+     * @param rx_rate RX rate (Hz)
+     * @param deliver Function called with each packet received on the
+     * channel. The packet's channel has already been set.
+     */
+    TDChannelStream(PHY &phy,
+                    const Channel &channel_,
+                    const std::vector<C> &taps,
+                    double rx_rate,
+                    deliver_type deliver);
+
+    TDChannelStream(const TDChannelStream&) = delete;
+    TDChannelStream(TDChannelStream&&) = delete;
+
+    TDChannelStream& operator=(const TDChannelStream&) = delete;
+    TDChannelStream& operator=(TDChannelStream&&) = delete;
+
+    /** @brief The channel */
+    const Channel channel;
+
+    /** @brief Channel demodulator */
+    TDChannelDemodulator demod;
+
+    /** @brief Snapshot offset of the next IQ buffer */
+    std::optional<ssize_t> next_snapshot_off;
+
+    /** @brief Previous IQ buffer, kept in case we need to log it */
+    std::shared_ptr<IQBuf> prev_iqbuf;
+
+    /** @brief Flag that is true if we received a packet in the current
+     * buffer.
+     */
+    bool received;
+
+    /** @brief Demodulate the next IQ buffer of the stream
+     * @param channelizer The channelizer demodulating the stream
+     * @param iqbuf The IQ buffer
+     * @param rx_rate RX rate (Hz)
+     * @param logger If non-null, slots in which a packet was received are
+     * logged here.
+     */
+    void demodulate(Channelizer &channelizer,
+                    const std::shared_ptr<IQBuf> &iqbuf,
+                    double rx_rate,
+                    Logger *logger);
+};
+
 /** @brief A time-domain channelizer. */
 class TDChannelizer : public Channelizer
 {
@@ -36,48 +160,36 @@ public:
     void stop(void);
 
 private:
-    /** @brief Channel state for time-domain demodulation */
-    class TDChannelDemodulator : public ChannelDemodulator {
-    public:
-        TDChannelDemodulator(PHY &phy,
-                     const Channel &channel,
-                     const std::vector<C> &taps,
-                     double rx_rate)
-          : ChannelDemodulator(phy, channel, taps, rx_rate)
-          , seq_(0)
-          , delay_(round((taps.size() - 1)/2.0))
-          , resamp_buf_(0)
-          , resamp_(rate_, 2*M_PI*channel.fc/rx_rate, taps)
-        {
-        }
-
-        virtual ~TDChannelDemodulator() = default;
-
-        /** @brief Update IQ buffer sequence number */
-        void updateSeq(unsigned seq);
-
-        void reset(void) override;
-
-        void timestamp(const MonoClock::time_point &timestamp,
-                       std::optional<ssize_t> snapshot_off,
-                       ssize_t offset,
-                       float rx_rate) override;
-
-        void demodulate(const std::complex<float>* data,
-                        size_t count) override;
-
-    protected:
-        /** @brief Channel IQ buffer sequence number */
-        unsigned seq_;
-
-        /** @brief Filter delay */
-        size_t delay_;
-
-        /** @brief Resampling buffer */
-        IQBuf resamp_buf_;
-
-        /** @brief Resampler */
-        dragonradio::signal::MixingRationalResampler<C,C> resamp_;
+    /** @brief Per-channel demodulation state */
+    struct ChannelState : public TDChannelStream {
+        using TDChannelStream::TDChannelStream;
+
+        /** @brief Mutex serializing demodulation of this channel */
+        /** A channel that survives a reconfiguration may be handed to a
+         * different worker. Holding this mutex while popping and demodulating
+         * a buffer guarantees that buffers are still demodulated one at a
+         * time, in order. Workers wait for a buffer before taking this mutex,
+         * so it is never held while blocked on an empty queue.
+         */
+        std::mutex mutex;
+
+        /** @brief IQ buffers to demodulate */
+        SafeQueue<std::shared_ptr<IQBuf>> iqbufs;
+
+        /** @brief Number of consecutive buffers without a packet */
+        std::atomic<unsigned> idle_slots{0};
+    };
+
+    /** @brief An immutable demodulation configuration */
+    struct Config {
+        /** @brief RX sample rate */
+        double rx_rate;
+
+        /** @brief Radio channels */
+        Channels channels;
+
+        /** @brief Channel state, one per channel */
+        std::vector<std::shared_ptr<ChannelState>> chans;
     };
 
     static const unsigned LOGN = 4;
@@ -88,26 +200,20 @@ private:
     /** @brief Flag that is true when we should finish processing. */
     bool done_;
 
-    /** @brief Flag that is true when we are reconfiguring. */
-    std::atomic<bool> reconfigure_;
-
-    /** @brief Reconfiguration barrier */
-    barrier reconfigure_sync_;
-
     /** @brief Mutex for waking demodulators. */
     std::mutex wake_mutex_;
 
     /** @brief Condition variable for waking demodulators. */
     std::condition_variable wake_cond_;
 
-    /** @brief Mutex for demodulation state. */
-    std::mutex demod_mutex_;
-
-    /** @brief Channel state for demodulation. */
-    std::vector<std::unique_ptr<TDChannelDemodulator>> demods_;
+    /** @brief Mutex serializing reconfiguration. */
+    std::mutex reconfigure_mutex_;
 
-    /** @brief Packets to demodulate */
-    std::vector<std::unique_ptr<SafeQueue<std::shared_ptr<IQBuf>>>> iqbufs_;
+    /** @brief Current demodulation configuration. */
+    /** This is only accessed atomically. Workers pick up a new configuration
+     * between IQ buffers.
+     */
+    std::shared_ptr<const Config> config_;
 
     /** @brief Demodulation worker threads. */
     std::vector<std::thread> demod_threads_;
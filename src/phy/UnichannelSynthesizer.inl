@@ -5,6 +5,8 @@
 
 #include <pybind11/pybind11.h>
 
+#include "util/threads.hh"
+
 namespace py = pybind11;
 
 template <class ChannelModulator>
@@ -18,7 +20,8 @@ UnichannelSynthesizer<ChannelModulator>::UnichannelSynthesizer(std::shared_ptr<P
 {
     for (size_t i = 0; i < nthreads; ++i) {
         mod_reconfigure_[i].store(true, std::memory_order_release);
-        mod_threads_.emplace_back(std::thread(&UnichannelSynthesizer::modWorker,
+        mod_threads_.emplace_back(spawnThread("mod",
+                                              &UnichannelSynthesizer::modWorker,
                                               this,
                                               std::ref(mod_reconfigure_[i]),
                                               i));
@@ -0,0 +1,72 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pybind11/pybind11.h>
+
+#include <optional>
+#include <string>
+
+#include "logging.hh"
+#include "WorkQueue.hh"
+#include "python/async.hh"
+
+/** @brief Return the queue on which asynchronous commands run */
+/** A single thread runs commands so that reconfigurations are applied in the
+ * order they were submitted. The queue is never destroyed, because commands
+ * may still be running while static objects are destroyed.
+ */
+static WorkQueue &commandQueue(void)
+{
+    static WorkQueue *queue = new WorkQueue(1);
+
+    return *queue;
+}
+
+/** @brief Future completed by an asynchronous command */
+/** Python objects may only be copied or destroyed with the GIL held, so a
+ * completion is only touched by the command thread once it holds the GIL.
+ */
+struct Completion {
+    py::object loop;
+    py::object future;
+};
+
+py::object runAsync(std::function<void(void)> &&cmd)
+{
+    py::object loop = py::module::import("asyncio").attr("get_running_loop")();
+    py::object future = loop.attr("create_future")();
+    Completion *completion = new Completion{loop, future};
+
+    commandQueue().submit([cmd = std::move(cmd), completion]() {
+        std::optional<std::string> err;
+
+        try {
+            cmd();
+        } catch (std::exception &e) {
+            err = e.what();
+        }
+
+        py::gil_scoped_acquire gil;
+
+        try {
+            py::object future = completion->future;
+
+            completion->loop.attr("call_soon_threadsafe")(py::cpp_function([future, err]() {
+                if (future.attr("done")().cast<bool>())
+                    return;
+
+                if (err)
+                    future.attr("set_exception")(py::reinterpret_borrow<py::object>(PyExc_RuntimeError)(*err));
+                else
+                    future.attr("set_result")(py::none());
+            }));
+        } catch (py::error_already_set &e) {
+            // The event loop may already be closed
+            logEvent(kEventSystem, LOGWARNING, "Could not complete asynchronous command: %s", e.what());
+        }
+
+        delete completion;
+    });
+
+    return future;
+}
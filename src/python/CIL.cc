@@ -2,16 +2,34 @@
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
 #include "cil/CIL.hh"
 #include "cil/Scorer.hh"
+#include "net/FlowPerformance.hh"
 #include "python/PyModules.hh"
 
 #if !defined(DOXYGEN)
 PYBIND11_MAKE_OPAQUE(MandateMap)
 #endif /* !defined(DOXYGEN) */
 
+/** @brief View the packet counts of a vector of MPStats as MPCounts */
+static MPCounts mpPackets(const std::vector<MPStats> &stats)
+{
+    return MPCounts(stats.data(), stats.size(), [](const void *data, size_t i) {
+        return static_cast<const MPStats*>(data)[i].npackets;
+    });
+}
+
+/** @brief View the byte counts of a vector of MPStats as MPCounts */
+static MPCounts mpBytes(const std::vector<MPStats> &stats)
+{
+    return MPCounts(stats.data(), stats.size(), [](const void *data, size_t i) {
+        return static_cast<const MPStats*>(data)[i].nbytes;
+    });
+}
+
 void exportCIL(py::module &m)
 {
     // Export Mandate class to Python
@@ -91,9 +109,21 @@ void exportCIL(py::module &m)
     ;
 
     py::bind_vector<Scores>(m, "Scores")
+    .def_readonly("base_mp",
+        &Scores::base_mp,
+        "MP of first entry")
     .def_readonly("invalid_mp",
         &Scores::invalid_mp,
         "First invalid MP")
+    .def_readonly("scored_mp",
+        &Scores::scored_mp,
+        "One past the last scored MP")
+    .def_readonly("finalized_score",
+        &Scores::finalized_score,
+        "Total score of finalized MP's")
+    .def_property_readonly("total_score",
+        &Scores::totalScore,
+        "Total score of all MP's")
     ;
 
     py::bind_map<ScoreMap>(m, "ScoreMap");
@@ -107,12 +137,63 @@ void exportCIL(py::module &m)
     .def_property_readonly("scores",
         &Scorer::getScores,
         "Scores")
+    .def_property("history",
+        &Scorer::getHistory,
+        &Scorer::setHistory,
+        "Number of MP's before the latest scored MP that may still be updated")
+    .def_property_readonly("nstale_updates",
+        &Scorer::getNumStaleUpdates,
+        "Number of per-MP updates dropped because the MP was older than the history")
     .def("updateSentStatistics",
-        &Scorer::updateSentStatistics,
+        [](Scorer &self,
+           FlowUID flow,
+           double timestamp,
+           unsigned first_mp,
+           py::array_t<size_t, py::array::c_style | py::array::forcecast> npackets,
+           py::array_t<size_t, py::array::c_style | py::array::forcecast> nbytes)
+        {
+            self.updateSentStatistics(flow,
+                                      timestamp,
+                                      first_mp,
+                                      MPCounts(npackets.data(), npackets.size()),
+                                      MPCounts(nbytes.data(), nbytes.size()));
+        },
         "Update statistics for sent data")
+    .def("updateSentStatistics",
+        [](Scorer &self, double timestamp, const FlowStatsUpdate &update)
+        {
+            self.updateSentStatistics(update.flow_uid,
+                                      timestamp,
+                                      update.first_mp,
+                                      mpPackets(update.stats),
+                                      mpBytes(update.stats));
+        },
+        "Update statistics for sent data from a flow update")
     .def("updateReceivedStatistics",
-        &Scorer::updateReceivedStatistics,
+        [](Scorer &self,
+           FlowUID flow,
+           double timestamp,
+           unsigned first_mp,
+           py::array_t<size_t, py::array::c_style | py::array::forcecast> npackets,
+           py::array_t<size_t, py::array::c_style | py::array::forcecast> nbytes)
+        {
+            self.updateReceivedStatistics(flow,
+                                          timestamp,
+                                          first_mp,
+                                          MPCounts(npackets.data(), npackets.size()),
+                                          MPCounts(nbytes.data(), nbytes.size()));
+        },
         "Update statistics for received data")
+    .def("updateReceivedStatistics",
+        [](Scorer &self, double timestamp, const FlowStatsUpdate &update)
+        {
+            self.updateReceivedStatistics(update.flow_uid,
+                                          timestamp,
+                                          update.first_mp,
+                                          mpPackets(update.stats),
+                                          mpBytes(update.stats));
+        },
+        "Update statistics for received data from a flow update")
     .def("updateScore",
         &Scorer::updateScore,
         "Update scores up to given MP")
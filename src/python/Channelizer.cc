@@ -12,17 +12,39 @@
 #include "phy/OverlapTDChannelizer.hh"
 #include "phy/TDChannelizer.hh"
 #include "python/PyModules.hh"
+#include "python/async.hh"
 
 void exportChannelizers(py::module &m)
 {
     // Export class Channelizer to Python
-    py::class_<Channelizer, std::shared_ptr<Channelizer>>(m, "Channelizer")
+    auto channelizer_class = py::class_<Channelizer, std::shared_ptr<Channelizer>>(m, "Channelizer")
         .def_property("rx_rate",
             &Channelizer::getRXRate,
             &Channelizer::setRXRate)
         .def_property("channels",
             &Channelizer::getChannels,
             &Channelizer::setChannels)
+        .def_property("chunk_size",
+            &Channelizer::getChunkSize,
+            &Channelizer::setChunkSize,
+            "Number of samples demodulated at a time as a slot is received")
+        .def_property("max_backlog",
+            &Channelizer::getMaxBacklog,
+            &Channelizer::setMaxBacklog,
+            "Maximum number of slots queued per channel before shedding (0 for unbounded)")
+        .def_property("shed_policy",
+            &Channelizer::getShedPolicy,
+            &Channelizer::setShedPolicy,
+            "Policy for shedding slots when demodulation falls behind")
+        .def_property_readonly("shedding",
+            &Channelizer::isShedding,
+            "Are slots currently being shed?")
+        .def("setChannelsAsync",
+            [](std::shared_ptr<Channelizer> self, const Channels &channels)
+            {
+                return runAsync([self, channels]() { self->setChannels(channels); });
+            },
+            "Set channels without blocking, returning an awaitable future")
         .def_property_readonly("source",
             [](std::shared_ptr<Channelizer> e)
             {
@@ -30,6 +52,12 @@ void exportChannelizers(py::module &m)
             })
         ;
 
+    py::enum_<Channelizer::ShedPolicy>(channelizer_class, "ShedPolicy")
+        .value("NONE", Channelizer::kShedNone)
+        .value("OLDEST", Channelizer::kShedOldest)
+        .value("IDLE_FIRST", Channelizer::kShedIdleFirst)
+        .export_values();
+
     // Export class FDChannelizer to Python
     py::class_<FDChannelizer, Channelizer, std::shared_ptr<FDChannelizer>>(m, "FDChannelizer")
         .def(py::init<std::shared_ptr<PHY>,
@@ -73,5 +101,8 @@ void exportChannelizers(py::module &m)
         .def_property("enforce_ordering",
             &OverlapTDChannelizer::getEnforceOrdering,
             &OverlapTDChannelizer::setEnforceOrdering)
+        .def_property("streaming",
+            &OverlapTDChannelizer::getStreaming,
+            &OverlapTDChannelizer::setStreaming)
         ;
 }
@@ -74,4 +74,34 @@ void exportClock(py::module &m)
       ;
 
     m.attr("clock") = std::make_shared<WallClock>();
+
+    py::class_<VirtualTime>(m, "VirtualTime")
+      .def_property_readonly_static("enabled",
+          [](py::object) {
+              return VirtualTime::enabled();
+          },
+          "Is virtual time enabled?")
+      .def_static("enable",
+          &Clock::enableVirtualTime,
+          "Use paused virtual time instead of the USRP's time. Fails if a USRP is attached.")
+      .def_static("disable",
+          &Clock::disableVirtualTime,
+          "Go back to using the USRP's time")
+      .def_static("run",
+          [](double secs) {
+              py::gil_scoped_release gil;
+
+              VirtualTime::runUntil(VirtualTime::now() + secs);
+          },
+          "Advance virtual time by the given number of seconds",
+          py::arg("secs"))
+      .def_static("run_until",
+          [](const MonoClock::time_point &t) {
+              py::gil_scoped_release gil;
+
+              VirtualTime::runUntil(t.t);
+          },
+          "Advance virtual time to the given time",
+          py::arg("t"))
+      ;
 }
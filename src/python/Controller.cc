@@ -169,6 +169,18 @@ void exportControllers(py::module &m)
             &SmartController::getDecreaseRetransMCSIdx,
             &SmartController::setDecreaseRetransMCSIdx,
             "Should we decrease the MCS index of retransmitted packets with a deadline?")
+        .def_property("sync_clock",
+            &SmartController::getSyncClock,
+            &SmartController::setSyncClock,
+            "Should we synchronize our clock to the time master?")
+        .def_property("min_sync_pairs",
+            &SmartController::getMinSyncPairs,
+            &SmartController::setMinSyncPairs,
+            "Minimum number of timestamp pairs needed to synchronize our clock")
+        .def_property("min_sync_change",
+            &SmartController::getMinSyncChange,
+            &SmartController::setMinSyncChange,
+            "Minimum clock change (sec) applied when synchronizing our clock")
         .def_property_readonly("send",
             [](std::shared_ptr<SmartController> controller) -> std::unique_ptr<SendWindowsProxy>
             {
@@ -4,6 +4,7 @@
 #include "Clock.hh"
 #include "python/PyModules.hh"
 #include "stats/Estimator.hh"
+#include "stats/SlidingWindowEstimator.hh"
 #include "stats/TimeWindowEstimator.hh"
 
 template <class T>
@@ -115,6 +116,84 @@ void exportTimeWindowMaxEstimator(py::module &m, const char *name)
         ;
 }
 
+template <class T>
+void exportWindowSnapshot(py::module &m, const char *name)
+{
+    py::class_<WindowSnapshot<T>>(m, name)
+        .def_readonly("value",
+            &WindowSnapshot<T>::value,
+            "The value of the estimator")
+        .def_readonly("size",
+            &WindowSnapshot<T>::size,
+            "The number of samples used in the estimate")
+        .def_readonly("t_last",
+            &WindowSnapshot<T>::t_last,
+            "Time of the newest sample (sec)")
+        ;
+}
+
+template <class Clock, class T, size_t N>
+void exportSlidingWindowEstimator(py::module &m, const char *name)
+{
+    using E = SlidingWindowEstimator<Clock, T, N>;
+
+    py::class_<E, Estimator<T>, std::shared_ptr<E>>(m, name)
+        .def_property("time_window",
+            &E::getTimeWindow,
+            &E::setTimeWindow,
+            "The time window (sec)")
+        .def_property_readonly("granularity",
+            &E::getGranularity,
+            "The time granularity of the window (sec)")
+        .def_property_readonly("snapshot",
+            &E::snapshot,
+            "The most recently published snapshot (lock-free)")
+        .def_property_readonly("last_published_value",
+            &E::lastPublishedValue,
+            "The estimate as of the last update, which may include expired samples (lock-free)")
+        .def("reset",
+            &E::reset,
+            "Reset the estimate")
+        ;
+}
+
+template <class E, class Base>
+void exportSlidingWindowSubclass(py::module &m, const char *name)
+{
+    py::class_<E, Base, std::shared_ptr<E>>(m, name)
+        .def(py::init<double>(),
+            py::arg("twindow")=1.0)
+        ;
+}
+
+template <class Clock, class T>
+void exportTimeEWMAEstimator(py::module &m, const char *name)
+{
+    py::class_<TimeEWMA<Clock, T>, Estimator<T>, std::shared_ptr<TimeEWMA<Clock, T>>>(m, name)
+        .def(py::init<double>(),
+            py::arg("tau")=1.0)
+        .def_property("time_constant",
+            &TimeEWMA<Clock, T>::getTimeConstant,
+            &TimeEWMA<Clock, T>::setTimeConstant,
+            "The time constant (sec)")
+        .def_property_readonly("snapshot",
+            &TimeEWMA<Clock, T>::snapshot,
+            "The most recently published snapshot (lock-free)")
+        .def("reset",
+            &TimeEWMA<Clock, T>::reset,
+            "Reset the estimate")
+        ;
+}
+
+template <class Clock, class T>
+void exportTimeEWMARateEstimator(py::module &m, const char *name)
+{
+    py::class_<TimeEWMARate<Clock, T>, TimeEWMA<Clock, T>, std::shared_ptr<TimeEWMARate<Clock, T>>>(m, name)
+        .def(py::init<double>(),
+            py::arg("tau")=1.0)
+        ;
+}
+
 void exportEstimators(py::module &m)
 {
     exportEstimator<float>(m, "FloatEstimator");
@@ -137,4 +216,15 @@ void exportEstimators(py::module &m)
     exportTimeWindowMeanRateEstimator<MonoClock, double>(m, "MonoTimeWindowMeanRate");
     exportTimeWindowMinEstimator<MonoClock, double>(m, "MonoTimeWindowMin");
     exportTimeWindowMaxEstimator<MonoClock, double>(m, "MonoTimeWindowMax");
+
+    exportWindowSnapshot<double>(m, "WindowSnapshot");
+
+    exportSlidingWindowEstimator<MonoClock, double, 64>(m, "MonoSlidingWindowEstimator");
+    exportSlidingWindowSubclass<BucketedTimeWindowMean<MonoClock, double>, SlidingWindowEstimator<MonoClock, double, 64>>(m, "MonoBucketedTimeWindowMean");
+    exportSlidingWindowSubclass<BucketedTimeWindowMeanRate<MonoClock, double>, BucketedTimeWindowMean<MonoClock, double>>(m, "MonoBucketedTimeWindowMeanRate");
+    exportSlidingWindowSubclass<BucketedTimeWindowMin<MonoClock, double>, SlidingWindowEstimator<MonoClock, double, 64>>(m, "MonoBucketedTimeWindowMin");
+    exportSlidingWindowSubclass<BucketedTimeWindowMax<MonoClock, double>, SlidingWindowEstimator<MonoClock, double, 64>>(m, "MonoBucketedTimeWindowMax");
+
+    exportTimeEWMAEstimator<MonoClock, double>(m, "MonoTimeEWMA");
+    exportTimeEWMARateEstimator<MonoClock, double>(m, "MonoTimeEWMARate");
 }
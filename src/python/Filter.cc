@@ -10,6 +10,7 @@
 #include "dsp/FIR.hh"
 #include "dsp/FIRDesign.hh"
 #include "dsp/Filter.hh"
+#include "dsp/FilterCache.hh"
 #include "dsp/Window.hh"
 #include "liquid/Filter.hh"
 #include "python/PyModules.hh"
@@ -138,9 +139,16 @@ void exportFilters(py::module &m)
     exportLiquidFIR<C,C,C>(m, "LiquidFIRCCC");
     exportLiquidIIR<C,C,C>(m, "LiquidIIRCCC");
 
-    m.def("parks_mcclellan", &liquid::parks_mcclellan);
+    // Filter designs are memoized in the global filter cache
+    m.def("parks_mcclellan",
+        [](unsigned n, float fc, float As) {
+            return *filterCache().parks_mcclellan(n, fc, As);
+        });
 
-    m.def("kaiser", &liquid::kaiser);
+    m.def("kaiser",
+        [](unsigned n, float fc, float As) {
+            return *filterCache().kaiser(n, fc, As);
+        });
 
     m.def("butter_lowpass", &liquid::butter_lowpass);
 
@@ -166,7 +174,15 @@ void exportFilters(py::module &m)
         ;
 
     m.def("firpm",
-        &dragonradio::signal::firpm,
+        [](std::size_t N,
+           const std::vector<double> &f,
+           const std::vector<double> &a,
+           const std::vector<double> &w,
+           double fs,
+           double epsT,
+           int Nmax) {
+            return *filterCache().firpm(FilterCache::kFIRPM, N, f, a, w, fs, epsT, Nmax);
+        },
         "Use the Remez exchange algorithm to design an equiripple filter",
         py::arg("numtaps"),
         py::arg("bands"),
@@ -177,7 +193,15 @@ void exportFilters(py::module &m)
         py::arg("Nmax") = 4);
 
     m.def("firpm1f",
-        &dragonradio::signal::firpm1f,
+        [](std::size_t N,
+           const std::vector<double> &f,
+           const std::vector<double> &a,
+           const std::vector<double> &w,
+           double fs,
+           double epsT,
+           int Nmax) {
+            return *filterCache().firpm(FilterCache::kFIRPM1f, N, f, a, w, fs, epsT, Nmax);
+        },
         "Use the Remez exchange algorithm to design a filter with 1/f rolloff",
         py::arg("numtaps"),
         py::arg("bands"),
@@ -188,7 +212,15 @@ void exportFilters(py::module &m)
         py::arg("Nmax") = 4);
 
     m.def("firpm1f2",
-        &dragonradio::signal::firpm1f2,
+        [](std::size_t N,
+           const std::vector<double> &f,
+           const std::vector<double> &a,
+           const std::vector<double> &w,
+           double fs,
+           double epsT,
+           int Nmax) {
+            return *filterCache().firpm(FilterCache::kFIRPM1f2, N, f, a, w, fs, epsT, Nmax);
+        },
         "Use the Remez exchange algorithm to design a filter with 1/f^2 rolloff",
         py::arg("numtaps"),
         py::arg("bands"),
@@ -199,4 +231,24 @@ void exportFilters(py::module &m)
         py::arg("Nmax") = 4);
 
     exportWindow<C>(m, "WindowC");
+
+    // Export class FilterCache to Python
+    py::class_<FilterCache, std::unique_ptr<FilterCache, py::nodelete>>(m, "FilterCache")
+        .def("__len__",
+            &FilterCache::size)
+        .def("clear",
+            &FilterCache::clear,
+            "Remove all cached filters")
+        .def("save",
+            &FilterCache::save,
+            "Save cached filters to a file",
+            py::call_guard<py::gil_scoped_release>())
+        .def("load",
+            &FilterCache::load,
+            "Load cached filters from a file",
+            py::call_guard<py::gil_scoped_release>())
+        ;
+
+    // Export our global filter cache
+    m.attr("filter_cache") = py::cast(&filterCache(), py::return_value_policy::reference);
 }
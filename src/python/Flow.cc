@@ -30,29 +30,39 @@ void exportFlow(py::module &m)
 
     py::bind_vector<std::vector<MPStats>>(m, "MPStatsVector");
 
-    // Export FlowStats class to Python
-    py::class_<FlowStats, std::unique_ptr<FlowStats>>(m, "FlowStats")
+    // Export FlowStatsUpdate class to Python
+    py::class_<FlowStatsUpdate, std::unique_ptr<FlowStatsUpdate>>(m, "FlowStatsUpdate")
     .def_readonly("flow_uid",
-        &FlowStats::flow_uid,
+        &FlowStatsUpdate::flow_uid,
         "Flow UID")
     .def_readonly("src",
-        &FlowStats::src,
+        &FlowStatsUpdate::src,
         "Flow source")
     .def_readonly("dest",
-        &FlowStats::dest,
+        &FlowStatsUpdate::dest,
         "Flow destinations")
-    .def_readonly("low_mp",
-        &FlowStats::low_mp,
-        "Lowest MP modified")
+    .def_readonly("first_mp",
+        &FlowStatsUpdate::first_mp,
+        "First MP in statistics")
     .def_readonly("stats",
-        &FlowStats::stats,
-        "Flow statistics per-measuremnt period")
-    .def("__repr__", [](const FlowStats& self) {
-        return py::str("FlowStats(src={}, dest={})").\
-        format(self.src, self.dest);
+        &FlowStatsUpdate::stats,
+        "Flow statistics per-measuremnt period, starting at first_mp")
+    .def("__repr__", [](const FlowStatsUpdate& self) {
+        return py::str("FlowStatsUpdate(flow_uid={}, src={}, dest={}, first_mp={})").\
+        format(self.flow_uid, self.src, self.dest, self.first_mp);
      })
     ;
 
+    // Export FlowStatsUpdates class to Python
+    py::class_<FlowStatsUpdates, std::unique_ptr<FlowStatsUpdates>>(m, "FlowStatsUpdates")
+    .def_readonly("cursor",
+        &FlowStatsUpdates::cursor,
+        "Cursor to pass to next update")
+    .def_readonly("flows",
+        &FlowStatsUpdates::flows,
+        "Updated flows")
+    ;
+
     // Export class FlowPerformance to Python
     py::class_<FlowPerformance, std::shared_ptr<FlowPerformance>>(m, "FlowPerformance")
         .def(py::init<double>())
@@ -67,12 +77,16 @@ void exportFlow(py::module &m)
             &FlowPerformance::getMandates,
             &FlowPerformance::setMandates,
             "Mandates")
-        .def("getSources",
-            &FlowPerformance::getSources,
-            "Get flow source statistics")
-        .def("getSinks",
-            &FlowPerformance::getSinks,
-            "Get flow sink statistics")
+        .def("getSourceUpdates",
+            &FlowPerformance::getSourceUpdates,
+            "Get flow source statistics modified since cursor",
+            py::arg("cursor") = 0,
+            py::call_guard<py::gil_scoped_release>())
+        .def("getSinkUpdates",
+            &FlowPerformance::getSinkUpdates,
+            "Get flow sink statistics modified since cursor",
+            py::arg("cursor") = 0,
+            py::call_guard<py::gil_scoped_release>())
         .def_property_readonly("net_in",
             [](std::shared_ptr<FlowPerformance> element) { return exposePort(element, &element->net_in); },
             "Network packet input port")
@@ -3,6 +3,7 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <pybind11/stl.h>
 
 #include "IQBuffer.hh"
 #include "python/PyModules.hh"
@@ -75,4 +76,57 @@ void exportIQBuffer(py::module &m)
 #endif /* !defined(NOUHD) */
              })
         ;
+
+    // Export class IQSpan to Python
+    py::class_<IQSpan>(m, "IQSpan")
+        .def_readonly("buf",
+            &IQSpan::buf,
+            "IQ buffer holding the samples")
+        .def_readonly("off",
+            &IQSpan::off,
+            "Offset of first sample in span")
+#if !defined(NOUHD)
+        .def_property_readonly("timestamp",
+            &IQSpan::timestamp,
+            "Timestamp of first sample in span")
+#endif /* !defined(NOUHD) */
+        .def_property_readonly("data",
+            [](const IQSpan &self) {
+                return py::array_t<fc32>(self.size(), self.data(), sharedptr_capsule(self.buf));
+            },
+            "IQ data (not copied)")
+        .def("__len__",
+            &IQSpan::size)
+        .def("__repr__",
+            [](const IQSpan& self) {
+                return py::str("IQSpan(off={}, len={})").format(self.off, self.len);
+             })
+        ;
+
+    // Export class IQSegments to Python
+    py::class_<IQSegments>(m, "IQSegments")
+#if !defined(NOUHD)
+        .def_readonly("timestamp",
+            &IQSegments::timestamp,
+            "Timestamp of first sample")
+#endif /* !defined(NOUHD) */
+        .def_readonly("fc",
+            &IQSegments::fc,
+            "Sample center frequency")
+        .def_readonly("fs",
+            &IQSegments::fs,
+            "Sample rate")
+        .def_readonly("spans",
+            &IQSegments::spans,
+            "Spans making up the segmented IQ data")
+        .def_property_readonly("combined",
+            &IQSegments::combine,
+            "Copy of all IQ data as a single IQ buffer")
+        .def("__len__",
+            &IQSegments::size)
+        .def("__repr__",
+            [](const IQSegments& self) {
+                return py::str("IQSegments(fc={:g}, fs={:g}, nspans={}, nsamples={})").format(self.fc, self.fs, self.spans.size(), self.size());
+             })
+        ;
 }
@@ -74,7 +74,7 @@ protected:
 
 void exportIQCompression(py::module &m)
 {
-    m.def("convert2sc16", [](py::array_t<fc32_t> in) -> py::array_t<int16_t> {
+    m.def("convert2sc16", [](py::array_t<fc32_t, py::array::c_style | py::array::forcecast> in, float g) -> py::array_t<int16_t> {
         auto inbuf = in.request();
 
         py::array_t<int16_t> outarr(2*inbuf.size);
@@ -82,24 +82,98 @@ void exportIQCompression(py::module &m)
 
         convert2sc16(static_cast<fc32_t*>(inbuf.ptr),
                      static_cast<sc16_t*>(outbuf.ptr),
-                     inbuf.size);
+                     inbuf.size,
+                     g);
 
         return outarr;
-    }, "convert fc32 buffer to a sc16 buffer")
+    }, "convert fc32 buffer to a sc16 buffer, saturating at full scale",
+       py::arg("in"),
+       py::arg("g") = 1.0f)
     ;
 
-    m.def("convert2fc32", [](py::array_t<int16_t> in) -> py::array_t<fc32_t> {
+    m.def("convert2sc8", [](py::array_t<fc32_t, py::array::c_style | py::array::forcecast> in, float g) -> py::array_t<int8_t> {
         auto inbuf = in.request();
 
-        py::array_t<fc32_t> outarr(inbuf.size/2);
+        py::array_t<int8_t> outarr(2*inbuf.size);
         auto                outbuf = outarr.request();
 
-        convert2fc32(static_cast<sc16_t*>(inbuf.ptr),
-                     static_cast<fc32_t*>(outbuf.ptr),
-                     inbuf.size/2);
+        convert2sc8(static_cast<fc32_t*>(inbuf.ptr),
+                    static_cast<sc8_t*>(outbuf.ptr),
+                    inbuf.size,
+                    g);
 
         return outarr;
-    }, "convert sc16 buffer to a fc32 buffer")
+    }, "convert fc32 buffer to a sc8 buffer, saturating at full scale",
+       py::arg("in"),
+       py::arg("g") = 1.0f)
+    ;
+
+    m.def("convert2fc32", [](py::array in, float g) -> py::array_t<fc32_t> {
+        if (py::isinstance<py::array_t<int8_t>>(in)) {
+            auto inarr = py::array_t<int8_t, py::array::c_style | py::array::forcecast>::ensure(in);
+            auto inbuf = inarr.request();
+
+            py::array_t<fc32_t> outarr(inbuf.size/2);
+            auto                outbuf = outarr.request();
+
+            convert2fc32(static_cast<sc8_t*>(inbuf.ptr),
+                         static_cast<fc32_t*>(outbuf.ptr),
+                         inbuf.size/2,
+                         g);
+
+            return outarr;
+        } else {
+            auto inarr = py::array_t<int16_t, py::array::c_style | py::array::forcecast>::ensure(in);
+            auto inbuf = inarr.request();
+
+            py::array_t<fc32_t> outarr(inbuf.size/2);
+            auto                outbuf = outarr.request();
+
+            convert2fc32(static_cast<sc16_t*>(inbuf.ptr),
+                         static_cast<fc32_t*>(outbuf.ptr),
+                         inbuf.size/2,
+                         g);
+
+            return outarr;
+        }
+    }, "convert sc16 or sc8 buffer to a fc32 buffer",
+       py::arg("in"),
+       py::arg("g") = 1.0f)
+    ;
+
+    // Export class IQStats to Python
+    py::class_<IQStats>(m, "IQStats")
+        .def(py::init())
+        .def_readonly("peak_power",
+            &IQStats::peak_power,
+            "Peak sample power")
+        .def_property_readonly("avg_power",
+            &IQStats::avgPower,
+            "Average sample power")
+        .def_readonly("nclipped",
+            &IQStats::nclipped,
+            "Number of I or Q components that exceeded full scale")
+        .def_readonly("nsamples",
+            &IQStats::nsamples,
+            "Number of samples")
+        .def("__repr__", [](const IQStats& self) {
+            return py::str("IQStats(peak_power={:g}, avg_power={:g}, nclipped={}, nsamples={})").format(self.peak_power, self.avgPower(), self.nclipped, self.nsamples);
+         })
+        ;
+
+    m.def("iqStats", [](py::array_t<fc32_t, py::array::c_style | py::array::forcecast> in, float g) -> IQStats {
+        auto    inbuf = in.request();
+        IQStats stats;
+
+        computeIQStats(static_cast<fc32_t*>(inbuf.ptr),
+                       inbuf.size,
+                       g,
+                       &stats);
+
+        return stats;
+    }, "compute statistics of fc32 samples scaled by g",
+       py::arg("in"),
+       py::arg("g") = 1.0f)
     ;
 
     m.def("compressIQData", [](py::array_t<fc32_t> sig) -> py::bytes {
@@ -111,6 +185,14 @@ void exportIQCompression(py::module &m)
     }, "compress fc32 samples")
     ;
 
+    m.def("compressIQData", [](const IQSegments &segs) -> py::bytes {
+        PyArrayEncoder encoder;
+
+        encoder.encode(segs);
+        return std::move(encoder.encoded);
+    }, "compress segmented fc32 samples")
+    ;
+
     m.def("decompressIQData", [](py::array_t<char> data) -> py::array_t<fc32_t> {
         PyArrayDecoder decoder;
         auto           buf = data.request();
@@ -119,4 +201,23 @@ void exportIQCompression(py::module &m)
         return std::move(decoder.decoded);
     }, "decompress fc32 samples")
     ;
+
+    // Export class IQCompressor to Python
+    py::class_<IQCompressor>(m, "IQCompressor")
+        .def(py::init<size_t>())
+        .def("compress",
+            [](IQCompressor &self, py::array_t<fc32_t, py::array::c_style | py::array::forcecast> sig) {
+                auto sigbuf = sig.request();
+
+                self.compress(reinterpret_cast<fc32_t*>(sigbuf.ptr), sigbuf.size);
+            },
+            "compress the next block of fc32 samples")
+        .def("finish",
+            [](IQCompressor &self) -> py::bytes {
+                buffer<char> compressed = self.finish();
+
+                return py::bytes(compressed.data(), compressed.size());
+            },
+            "finish compression, returning compressed data")
+        ;
 }
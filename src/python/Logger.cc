@@ -89,6 +89,25 @@ void exportLogger(py::module &m)
         .def("logSnapshot",
             &Logger::logSnapshot,
             "Log a snapshot")
+        .def_property("symbol_buffers",
+            &Logger::getSymbolBuffers,
+            &Logger::setSymbolBuffers,
+            "int: Number of buffers used to capture received symbols")
+        .def_property("symbol_stride",
+            &Logger::getSymbolStride,
+            &Logger::setSymbolStride,
+            "int: Capture symbols of every Nth sampled frame")
+        .def_property("symbol_invalid_only",
+            &Logger::getSymbolInvalidOnly,
+            &Logger::setSymbolInvalidOnly,
+            "bool: Only capture symbols of frames with invalid payloads")
+        .def_property("symbol_node",
+            &Logger::getSymbolNode,
+            &Logger::setSymbolNode,
+            "Optional[int]: Only capture symbols of frames from this node")
+        .def_property_readonly("symbol_drops",
+            &Logger::getSymbolDrops,
+            "int: Number of symbol captures dropped because no buffer was free")
         ;
 
     addLoggerSource(loggerCls, "log_slots", Logger::kSlots);
@@ -12,6 +12,7 @@
 #include "mac/SlottedMAC.hh"
 #include "mac/TDMA.hh"
 #include "python/PyModules.hh"
+#include "python/async.hh"
 
 void exportMACs(py::module &m)
 {
@@ -27,6 +28,18 @@ void exportMACs(py::module &m)
             &SlottedMAC::getSchedule,
             py::overload_cast<const Schedule::sched_type &>(&SlottedMAC::setSchedule),
             "MAC schedule specifying on which channels this node may transmit in each schedule slot.")
+        .def("setScheduleAsync",
+            [](std::shared_ptr<MAC> self, const Schedule::sched_type &schedule)
+            {
+                return runAsync([self, schedule]() { self->setSchedule(schedule); });
+            },
+            "Set MAC schedule without blocking, returning an awaitable future")
+        .def("reconfigureAsync",
+            [](std::shared_ptr<MAC> self)
+            {
+                return runAsync([self]() { self->reconfigure(); });
+            },
+            "Reconfigure the MAC without blocking, returning an awaitable future")
         .def_property("min_channel_bandwidth",
             nullptr,
             &MAC::setMinChannelBandwidth,
@@ -0,0 +1,75 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "stats/Metrics.hh"
+#include "python/PyModules.hh"
+
+void exportMetrics(py::module &m)
+{
+    // Export class MetricsRegistry to Python
+    py::class_<MetricsRegistry, std::unique_ptr<MetricsRegistry, py::nodelete>>(m, "MetricsRegistry")
+        .def_property_readonly("shm_name",
+            &MetricsRegistry::getSharedMemoryName,
+            "str: Name of shared memory segment holding metrics")
+        .def_property_readonly("shm_size",
+            &MetricsRegistry::getSharedMemorySize,
+            "int: Size of shared memory segment holding metrics")
+        .def("__len__",
+            &MetricsRegistry::size)
+        .def("renderPrometheus",
+            &MetricsRegistry::renderPrometheus,
+            "Render metrics in Prometheus text format")
+        ;
+
+    // Export class Counter to Python
+    py::class_<Counter, std::shared_ptr<Counter>>(m, "Counter")
+        .def(py::init([](const std::string &name, const std::string &help) {
+                return std::make_shared<Counter>(metrics(), name, help);
+            }),
+            py::arg("name"),
+            py::arg("help") = "")
+        .def_property_readonly("value",
+            &Counter::value,
+            "int: Counter value")
+        .def("inc",
+            &Counter::inc,
+            "Increment counter",
+            py::arg("n") = 1)
+        ;
+
+    // Export class Gauge to Python
+    py::class_<Gauge, std::shared_ptr<Gauge>>(m, "Gauge")
+        .def(py::init([](const std::string &name, const std::string &help) {
+                return std::make_shared<Gauge>(metrics(), name, help);
+            }),
+            py::arg("name"),
+            py::arg("help") = "")
+        .def_property("value",
+            &Gauge::value,
+            &Gauge::set,
+            "float: Gauge value")
+        .def("add",
+            &Gauge::add,
+            "Add to gauge")
+        ;
+
+    // Export class MetricsExporter to Python
+    py::class_<MetricsExporter, std::shared_ptr<MetricsExporter>>(m, "MetricsExporter")
+        .def(py::init([](const std::string &path) {
+                return std::make_shared<MetricsExporter>(metrics(), path);
+            }))
+        .def_property_readonly("path",
+            &MetricsExporter::getPath,
+            "str: Path of Unix domain socket")
+        .def("stop",
+            &MetricsExporter::stop,
+            "Stop exporting metrics",
+            py::call_guard<py::gil_scoped_release>())
+        ;
+
+    // Export our global metrics registry
+    m.attr("metrics") = py::cast(&metrics(), py::return_value_policy::reference);
+}
@@ -5,13 +5,21 @@
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
-#include "WorkQueue.hh"
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.hh"
+#include "LockFreeQueue.hh"
 #include "phy/FlexFrame.hh"
 #include "phy/Gain.hh"
 #include "phy/NewFlexFrame.hh"
 #include "phy/OFDM.hh"
 #include "phy/PHY.hh"
 #include "python/PyModules.hh"
+#include "util/threads.hh"
 
 using fc32 = std::complex<float>;
 
@@ -88,7 +96,7 @@ public:
         AutoGain &autogain = mcs_table[pkt->mcsidx].autogain;
 
         if (autogain.needCalcAutoSoftGain0dBFS())
-            work_queue.submit(&AutoGain::autoSoftGain0dBFS, &autogain, g, iqbuf);
+            autogain.autoSoftGain0dBFS(g, iqbuf->data(), iqbuf->size());
     }
 
     std::vector<PHY::MCSEntry> &getMCSTable()
@@ -114,16 +122,322 @@ public:
     std::vector<std::shared_ptr<MCS>> mcs_table_;
 };
 
+/** @brief Run Python overrides on a dedicated thread */
+/** Radio threads never acquire the GIL to call a Python override. Instead,
+ * they push work onto a lock-free queue that is drained by a single bridge
+ * thread, which acquires the GIL once per batch of work items. IQ samples are
+ * copied into pooled buffers that are handed to Python as zero-copy numpy
+ * views and returned to the pool when Python drops the view.
+ */
+class PyBridge {
+public:
+    using work_type = std::function<void(void)>;
+
+    /** @brief Pooled sample buffer */
+    struct Samples {
+        std::vector<fc32> data;
+    };
+
+    /** @brief Capacity of work queue */
+    static constexpr size_t kQueueSize = 1024;
+
+    /** @brief Maximum number of work items run per GIL acquisition */
+    static constexpr size_t kMaxBatch = 64;
+
+    /** @brief Maximum number of pooled sample buffers */
+    static constexpr size_t kPoolSize = 256;
+
+    PyBridge()
+      : work_q_(kQueueSize)
+      , pool_(kPoolSize)
+      , done_(false)
+      , sleeping_(false)
+    {
+        worker_thread_ = spawnThread("python_bridge", &PyBridge::worker, this);
+    }
+
+    PyBridge(const PyBridge&) = delete;
+    PyBridge(PyBridge&&) = delete;
+
+    PyBridge& operator=(const PyBridge&) = delete;
+    PyBridge& operator=(PyBridge&&) = delete;
+
+    /** @brief Submit work to be run with the GIL held */
+    void submit(work_type &&work)
+    {
+        // Once the bridge is stopped, run work in the caller
+        if (done_.load(std::memory_order_acquire)) {
+            py::gil_scoped_acquire gil;
+
+            run(work);
+            return;
+        }
+
+        while (!work_q_.try_push(work))
+            std::this_thread::yield();
+
+        if (sleeping_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+
+            wake_cond_.notify_one();
+        }
+    }
+
+    /** @brief Stop the bridge thread */
+    /** Work that has already been submitted is run before this returns. If
+     * the caller holds the GIL, it is released while joining the bridge
+     * thread, which needs the GIL to drain its queue.
+     */
+    void stop(void)
+    {
+        done_.store(true, std::memory_order_seq_cst);
+
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+
+            wake_cond_.notify_one();
+        }
+
+        if (worker_thread_.joinable()) {
+            if (PyGILState_Check()) {
+                py::gil_scoped_release nogil;
+
+                worker_thread_.join();
+            } else
+                worker_thread_.join();
+        }
+
+        // Run any work that raced with shutdown
+        work_type work;
+
+        while (work_q_.try_pop(work)) {
+            py::gil_scoped_acquire gil;
+
+            run(work);
+        }
+    }
+
+    /** @brief Copy samples into a pooled buffer */
+    Samples *getSamples(const fc32 *data, size_t count)
+    {
+        Samples *samples;
+
+        if (!pool_.try_pop(samples))
+            samples = new Samples;
+
+        samples->data.assign(data, data + count);
+
+        return samples;
+    }
+
+    /** @brief Return a buffer to the pool */
+    void releaseSamples(Samples *samples)
+    {
+        if (!pool_.try_push(samples))
+            delete samples;
+    }
+
+    /** @brief Create a numpy view of a pooled buffer */
+    /** The view takes ownership of the buffer, which is returned to the pool
+     * when the view is destroyed. Must be called with the GIL held.
+     */
+    py::array_t<fc32> view(Samples *samples)
+    {
+        py::capsule owner(samples, [](void *p) {
+            pyBridge().releaseSamples(static_cast<Samples*>(p));
+        });
+
+        return py::array_t<fc32>(samples->data.size(), samples->data.data(), owner);
+    }
+
+    /** @brief Return the global bridge */
+    /** The bridge is never destroyed, since work may still reference it while
+     * static objects are destroyed. It is stopped when the interpreter exits.
+     */
+    static PyBridge &pyBridge(void)
+    {
+        static PyBridge *bridge = new PyBridge();
+
+        return *bridge;
+    }
+
+protected:
+    /** @brief Work queue */
+    LockFreeQueue<work_type> work_q_;
+
+    /** @brief Pool of sample buffers */
+    LockFreeQueue<Samples*> pool_;
+
+    /** @brief Flag indicating we should terminate */
+    std::atomic<bool> done_;
+
+    /** @brief Flag indicating the bridge thread may be sleeping */
+    std::atomic<bool> sleeping_;
+
+    /** @brief Mutex protecting wake condition */
+    std::mutex wake_mutex_;
+
+    /** @brief Condition variable used to wake the bridge thread */
+    std::condition_variable wake_cond_;
+
+    /** @brief Bridge thread */
+    std::thread worker_thread_;
+
+    /** @brief Run a work item, logging Python errors */
+    static void run(work_type &work)
+    {
+        try {
+            work();
+        } catch (py::error_already_set &err) {
+            logPHY(LOGERROR, "Python override raised exception: %s", err.what());
+        }
+
+        // Destroy any Python objects captured by the work item while we still
+        // hold the GIL.
+        work = nullptr;
+    }
+
+    /** @brief Bridge worker */
+    void worker(void)
+    {
+        std::vector<work_type> batch;
+        work_type              work;
+
+        batch.reserve(kMaxBatch);
+
+        for (;;) {
+            while (batch.size() < kMaxBatch && work_q_.try_pop(work))
+                batch.emplace_back(std::move(work));
+
+            if (batch.empty()) {
+                if (done_.load(std::memory_order_seq_cst))
+                    return;
+
+                std::unique_lock<std::mutex> lock(wake_mutex_);
+
+                // Re-check the queue after announcing that we are about to
+                // sleep so that a concurrent submit cannot be missed.
+                sleeping_.store(true, std::memory_order_seq_cst);
+
+                if (work_q_.empty() && !done_.load(std::memory_order_seq_cst))
+                    wake_cond_.wait_for(lock, std::chrono::milliseconds(10));
+
+                sleeping_.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            py::gil_scoped_acquire gil;
+
+            for (auto &item : batch)
+                run(item);
+
+            batch.clear();
+        }
+    }
+};
+
+/** @brief Return the global Python bridge */
+static PyBridge &pyBridge(void)
+{
+    return PyBridge::pyBridge();
+}
+
+/** @brief Cached test for a Python override of a virtual method */
+/** A Python subclass's methods are fixed once the object is created, so the
+ * override lookup only needs to take the GIL once per object.
+ */
+class PyOverride {
+public:
+    PyOverride()
+      : state_(kUnknown)
+    {
+    }
+
+    /** @brief Does the Python object implement the named method? */
+    template <class T>
+    bool has(const char *name, const T *self)
+    {
+        int state = state_.load(std::memory_order_acquire);
+
+        if (state == kUnknown) {
+            py::gil_scoped_acquire gil;
+
+            state = py::get_overload(self, name) ? kPresent : kAbsent;
+            state_.store(state, std::memory_order_release);
+        }
+
+        return state == kPresent;
+    }
+
+private:
+    enum { kUnknown = 0, kAbsent, kPresent };
+
+    /** @brief Lookup state */
+    std::atomic<int> state_;
+};
+
+/** @brief Run a function that may block without holding the GIL */
+template <class F>
+static void withoutGIL(F &&f)
+{
+    if (PyGILState_Check()) {
+        py::gil_scoped_release nogil;
+
+        f();
+    } else
+        f();
+}
+
 class PyPacketModulator : public PacketModulator {
 public:
     using PacketModulator::PacketModulator;
 
+    /** Modulation is handed to the Python bridge thread, so the calling radio
+     * thread waits for the result without ever contending for the GIL.
+     * Concurrent calls from several synthesizer threads are run under a
+     * single GIL acquisition.
+     */
     void modulate(std::shared_ptr<NetPacket> pkt,
                   const float gain,
                   ModPacket &mpkt) override
     {
-        py::gil_scoped_acquire gil;
-        py::function           overload = py::get_overload(this, "modulate");
+        // Python calling into us already holds the GIL, so run inline
+        if (PyGILState_Check()) {
+            modulatePy(pkt, gain, mpkt);
+            return;
+        }
+
+        // Without a Python override there is nothing to hand to the bridge
+        if (!overrides_.has("modulate", static_cast<const PacketModulator*>(this)))
+            return;
+
+        std::promise<void> done;
+        std::future<void>  result = done.get_future();
+
+        pyBridge().submit([&]() {
+            try {
+                modulatePy(pkt, gain, mpkt);
+                done.set_value();
+            } catch (py::error_already_set &err) {
+                done.set_exception(std::make_exception_ptr(std::runtime_error(err.what())));
+            } catch (...) {
+                done.set_exception(std::current_exception());
+            }
+        });
+
+        result.get();
+    }
+
+protected:
+    /** @brief Cached Python override lookup */
+    PyOverride overrides_;
+
+    /** @brief Call Python modulate override. Must hold the GIL. */
+    void modulatePy(std::shared_ptr<NetPacket> pkt,
+                    const float gain,
+                    ModPacket &mpkt)
+    {
+        py::function overload = py::get_overload(static_cast<const PacketModulator*>(this), "modulate");
 
         if (overload) {
             py::object                 obj = overload(pkt, gain);
@@ -136,25 +450,53 @@ public:
 
 class PyPacketDemodulator : public PacketDemodulator {
 public:
-    using PacketDemodulator::PacketDemodulator;
+    /** @brief Capacity of queue of demodulated packets */
+    static constexpr size_t kResultQueueSize = 1024;
+
+    PyPacketDemodulator(PHY &phy)
+      : PacketDemodulator(phy)
+      , results_(kResultQueueSize)
+      , pending_(0)
+      , frame_open_(false)
+    {
+    }
+
+    virtual ~PyPacketDemodulator()
+    {
+        // Outstanding work refers to this object. Discard results while we
+        // wait so that the bridge thread cannot block on a full result queue.
+        withoutGIL([this]() {
+            std::unique_lock<std::mutex> lock(done_mutex_);
+            std::shared_ptr<RadioPacket> pkt;
+
+            while (pending_.load(std::memory_order_acquire) != 0) {
+                while (results_.try_pop(pkt))
+                    pkt.reset();
+
+                done_cond_.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        });
+    }
 
+    /** Demodulation is asynchronous, so a frame is considered open while any
+     * submitted samples have not yet been demodulated.
+     */
     bool isFrameOpen(void) override
     {
-        PYBIND11_OVERLOAD_PURE(
-            bool,
-            PacketDemodulator,
-            isFrameOpen,
-        );
+        return pending_.load(std::memory_order_acquire) != 0 ||
+               frame_open_.load(std::memory_order_acquire);
     }
 
     void reset(const Channel &channel) override
     {
-        PYBIND11_OVERLOAD_PURE(
-            void,
-            PacketDemodulator,
-            reset,
-            channel
-        );
+        // Work is run in submission order, so demodulation of samples from
+        // the old channel finishes before the reset takes effect. Packets it
+        // produces are delivered at a later call.
+        deliver();
+
+        submit([this, channel]() {
+            call("reset", channel);
+        });
     }
 
     void timestamp(const MonoClock::time_point &timestamp,
@@ -164,36 +506,132 @@ public:
                    float rate,
                    float rx_rate) override
     {
-        PYBIND11_OVERLOAD_PURE(
-            void,
-            PacketDemodulator,
-            timestamp,
-            timestamp,
-            snapshot_off,
-            offset,
-            delay,
-            rate,
-            rx_rate
-        );
+        deliver();
+
+        submit([=]() {
+            call("timestamp", timestamp, snapshot_off, offset, delay, rate, rx_rate);
+        });
     }
 
+    /** Samples are copied into a pooled buffer and demodulated on the Python
+     * bridge thread, so the channelizer keeps receiving samples while Python
+     * demodulates. Demodulated packets are passed to the callback by the
+     * calling thread at its next call into the demodulator, so the callback
+     * always runs on the channelizer's own thread.
+     */
     void demodulate(const std::complex<float>* data,
                     size_t count) override
     {
-        py::gil_scoped_acquire gil;
-        py::function           overload = py::get_overload(this, "demodulate");
+        deliver();
 
-        if (overload) {
-            py::array_t<fc32> buf(count, data);
-            py::list          pkts = overload(buf);
+        // Without a Python override, there is nothing to copy or submit
+        if (!demodulate_override_.has("demodulate", static_cast<const PacketDemodulator*>(this)))
+            return;
+
+        PyBridge::Samples *samples = pyBridge().getSamples(data, count);
+
+        submit([this, samples]() {
+            py::array_t<fc32> buf = pyBridge().view(samples);
+            py::function      overload = py::get_overload(static_cast<const PacketDemodulator*>(this), "demodulate");
 
-            for (py::handle pkt : pkts) {
-                std::shared_ptr<RadioPacket> rpkt = pkt.cast<std::shared_ptr<RadioPacket>>();
+            if (overload) {
+                py::list pkts = overload(buf);
 
-                if (rpkt)
-                    callback_(std::move(rpkt));
+                for (py::handle pkt : pkts) {
+                    std::shared_ptr<RadioPacket> rpkt = pkt.cast<std::shared_ptr<RadioPacket>>();
+
+                    if (rpkt)
+                        pushResult(rpkt);
+                }
             }
-        }
+
+            frame_open_.store(call("isFrameOpen").cast<bool>(), std::memory_order_release);
+        });
+    }
+
+    /** Deliver every packet that has been demodulated so far without waiting
+     * for the bridge thread. Waiting here would make every channelizer slot
+     * wait for Python, so packets still being demodulated are instead
+     * delivered at a later call, typically within the next slot.
+     */
+    void sync(void) override
+    {
+        deliver();
+    }
+
+protected:
+    /** @brief Demodulated packets not yet passed to the callback */
+    LockFreeQueue<std::shared_ptr<RadioPacket>> results_;
+
+    /** @brief Number of submitted work items that have not completed */
+    std::atomic<unsigned> pending_;
+
+    /** @brief Was a frame open after the last demodulated buffer? */
+    std::atomic<bool> frame_open_;
+
+    /** @brief Cached Python demodulate override lookup */
+    PyOverride demodulate_override_;
+
+    /** @brief Mutex protecting completion condition */
+    std::mutex done_mutex_;
+
+    /** @brief Condition variable signaled when work completes */
+    std::condition_variable done_cond_;
+
+    /** @brief Call a Python override. Must hold the GIL. */
+    template <class... Args>
+    py::object call(const char *name, Args&&... args)
+    {
+        py::function overload = py::get_overload(static_cast<const PacketDemodulator*>(this), name);
+
+        if (!overload)
+            py::pybind11_fail(std::string("Tried to call pure virtual function \"PacketDemodulator::") + name + "\"");
+
+        return overload(std::forward<Args>(args)...);
+    }
+
+    /** @brief Submit work to the Python bridge */
+    template <class F>
+    void submit(F &&f)
+    {
+        pending_.fetch_add(1, std::memory_order_acq_rel);
+
+        pyBridge().submit([this, f = std::forward<F>(f)]() {
+            struct Done {
+                PyPacketDemodulator &demod;
+
+                ~Done()
+                {
+                    // Notify while holding the lock, because the demodulator
+                    // may be destroyed as soon as pending_ reaches zero.
+                    std::lock_guard<std::mutex> lock(demod.done_mutex_);
+
+                    demod.pending_.fetch_sub(1, std::memory_order_acq_rel);
+                    demod.done_cond_.notify_all();
+                }
+            } done{*this};
+
+            f();
+        });
+    }
+
+    /** @brief Queue a demodulated packet */
+    void pushResult(std::shared_ptr<RadioPacket> &pkt)
+    {
+        // The channelizer drains the queue at every call, so this only spins
+        // if the channelizer is busy elsewhere and more than kResultQueueSize
+        // packets are pending.
+        while (!results_.try_push(pkt))
+            std::this_thread::yield();
+    }
+
+    /** @brief Pass demodulated packets to the callback */
+    void deliver(void)
+    {
+        std::shared_ptr<RadioPacket> pkt;
+
+        while (results_.try_pop(pkt))
+            callback_(std::move(pkt));
     }
 };
 
@@ -223,6 +661,10 @@ void exportPHYs(py::module &m)
             &AutoGain::getAutoSoftTXGainClipFrac,
             &AutoGain::setAutoSoftTXGainClipFrac,
             "Clipping threshold for automatic TX soft gain")
+        .def_property("estimate_stride",
+            &AutoGain::getEstimateStride,
+            &AutoGain::setEstimateStride,
+            "Sampling stride used when estimating 0dBFS gain")
         .def("recalc0dBFSEstimate",
             &AutoGain::recalc0dBFSEstimate,
             "Reset the 0dBFS estimate")
@@ -352,6 +794,13 @@ void exportPHYs(py::module &m)
         .def("demodulate",
             &PacketDemodulator::demodulate)
         ;
+
+    // Stop the Python bridge thread before the interpreter is finalized
+    py::module::import("atexit").attr("register")(py::cpp_function([]() {
+        py::gil_scoped_release nogil;
+
+        pyBridge().stop();
+    }));
 }
 
 void exportLiquidPHYs(py::module &m)
@@ -364,6 +813,10 @@ void exportLiquidPHYs(py::module &m)
             &liquid::PHY::getSoftHeader)
         .def_property_readonly("soft_payload",
             &liquid::PHY::getSoftPayload)
+        .def("verifyModulatedSizes",
+            &liquid::PHY::verifyModulatedSizes,
+            "Verify cached modulated sizes and return the number of mismatches",
+            py::call_guard<py::gil_scoped_release>())
         ;
 
     // Export class FlexFrame to Python
@@ -91,5 +91,9 @@ void exportFilters(py::module &m);
 void exportIQBuffer(py::module &m);
 void exportIQCompression(py::module &m);
 void exportSnapshot(py::module &m);
+void exportMetrics(py::module &m);
+void exportStats(py::module &m);
+void exportThreads(py::module &m);
+void exportTrace(py::module &m);
 
 #endif /* PYMODULES_H_ */
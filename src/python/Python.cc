@@ -53,6 +53,10 @@ PYBIND11_EMBEDDED_MODULE(_dragonradio, m) {
     exportIQBuffer(mradio);
     exportIQCompression(mradio);
     exportSnapshot(mradio);
+    exportMetrics(mradio);
+    exportStats(mradio);
+    exportThreads(mradio);
+    exportTrace(mlogging);
     exportNetUtil(mnet);
 #endif /* !defined(PYMODULE) */
 }
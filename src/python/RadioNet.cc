@@ -29,6 +29,25 @@ void exportRadioNet(py::module &m)
          })
         ;
 
+    // Export class TimeSync::Estimate to Python
+    py::class_<TimeSync::Estimate, std::shared_ptr<TimeSync::Estimate>>(m, "TimeEstimate")
+        .def_readonly("n",
+            &TimeSync::Estimate::n,
+            "Number of timestamp pairs used in the fit")
+        .def_readonly("offset",
+            &TimeSync::Estimate::offset,
+            "Clock offset (sec)")
+        .def_readonly("skew",
+            &TimeSync::Estimate::skew,
+            "Clock skew")
+        .def_readonly("residual",
+            &TimeSync::Estimate::residual,
+            "RMS residual of the fit (sec)")
+        .def("__repr__", [](const TimeSync::Estimate& self) {
+            return py::str("TimeEstimate(n={},offset={},skew={},residual={})").format(self.n, self.offset, self.skew, self.residual);
+         })
+        ;
+
     // Export class Node to Python
     py::class_<Node, std::shared_ptr<Node>>(m, "Node")
         .def_readonly("id",
@@ -73,9 +92,14 @@ void exportRadioNet(py::module &m)
             [](Node &node) {
                 std::lock_guard<std::mutex> lock(node.timestamps_mutex);
 
-                return node.timestamps;
+                return node.timesync.getPairs();
+            },
+            "Most recent (sent, received) timestamp pairs, by timestamp sequence number")
+        .def_property_readonly("time_estimate",
+            [](Node &node) {
+                return std::const_pointer_cast<TimeSync::Estimate>(node.timesync.getEstimate());
             },
-            "Timestamps received from this node")
+            "Clock estimate from timestamp pairs, or None if there are none")
         ;
 
     // Export class RadioNet to Python
@@ -24,6 +24,9 @@ void exportSnapshot(py::module &m)
         .def_readonly("selftx",
             &Snapshot::selftx,
             "Self-transmission events")
+        .def_property_readonly("segmented_slots",
+            &Snapshot::getSegmentedSlots,
+            "Segmented IQ data for all slots in snapshot (not copied)")
         .def_property_readonly("combined_slots",
             &Snapshot::getCombinedSlots,
             "Combined IQ data for all slots in snapshot")
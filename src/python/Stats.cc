@@ -0,0 +1,120 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "stats/StatsPublisher.hh"
+#include "python/PyModules.hh"
+
+void exportStats(py::module &m)
+{
+    // Export class SendWindowStats to Python
+    using SendWindowStats = SmartController::SendWindowStats;
+
+    py::class_<SendWindowStats, std::shared_ptr<SendWindowStats>>(m, "SendWindowStats")
+        .def_readonly("node_id",
+            &SendWindowStats::node_id,
+            "Destination node")
+        .def_readonly("mcsidx",
+            &SendWindowStats::mcsidx,
+            "Modulation index")
+        .def_readonly("short_per",
+            &SendWindowStats::short_per,
+            "Short-term PER")
+        .def_readonly("long_per",
+            &SendWindowStats::long_per,
+            "Long-term PER")
+        .def_readonly("short_evm",
+            &SendWindowStats::short_evm,
+            "Short-term EVM, as reported by receiver")
+        .def_readonly("long_evm",
+            &SendWindowStats::long_evm,
+            "Long-term EVM, as reported by receiver")
+        .def_readonly("short_rssi",
+            &SendWindowStats::short_rssi,
+            "Short-term RSSI, as reported by receiver")
+        .def_readonly("long_rssi",
+            &SendWindowStats::long_rssi,
+            "Long-term RSSI, as reported by receiver")
+        ;
+
+    // Export class ReceiveWindowStats to Python
+    using ReceiveWindowStats = SmartController::ReceiveWindowStats;
+
+    py::class_<ReceiveWindowStats, std::shared_ptr<ReceiveWindowStats>>(m, "ReceiveWindowStats")
+        .def_readonly("node_id",
+            &ReceiveWindowStats::node_id,
+            "Source node")
+        .def_readonly("short_evm",
+            &ReceiveWindowStats::short_evm,
+            "Short-term EVM")
+        .def_readonly("long_evm",
+            &ReceiveWindowStats::long_evm,
+            "Long-term EVM")
+        .def_readonly("short_rssi",
+            &ReceiveWindowStats::short_rssi,
+            "Short-term RSSI")
+        .def_readonly("long_rssi",
+            &ReceiveWindowStats::long_rssi,
+            "Long-term RSSI")
+        ;
+
+    // Export class RadioStats to Python
+    py::class_<RadioStats, std::shared_ptr<RadioStats>>(m, "RadioStats")
+        .def_property_readonly("timestamp",
+            [](RadioStats &self) -> double
+            {
+                return self.timestamp.get_real_secs();
+            },
+            "Time at which statistics were published (sec)")
+        .def_readonly("seq",
+            &RadioStats::seq,
+            "Publication sequence number")
+        .def_readonly("load",
+            &RadioStats::load,
+            "MAC load")
+        .def_readonly("send",
+            &RadioStats::send,
+            "Send window statistics")
+        .def_readonly("recv",
+            &RadioStats::recv,
+            "Receive window statistics")
+        .def_readonly("tx_underflows",
+            &RadioStats::tx_underflows,
+            "Total number of TX underflow errors")
+        .def_readonly("tx_late",
+            &RadioStats::tx_late,
+            "Total number of late TX packet errors")
+        ;
+
+    // Export class StatsPublisher to Python
+    py::class_<StatsPublisher, std::shared_ptr<StatsPublisher>>(m, "StatsPublisher")
+        .def(py::init<std::shared_ptr<USRP>,
+                      std::shared_ptr<MAC>,
+                      std::shared_ptr<Controller>,
+                      double>(),
+            py::arg("usrp"),
+            py::arg("mac"),
+            py::arg("controller"),
+            py::arg("period") = 0.1)
+        .def_property_readonly("stats",
+            [](StatsPublisher &self)
+            {
+                return std::const_pointer_cast<RadioStats>(self.getStats());
+            },
+            "Most recently published statistics")
+        .def_property("period",
+            &StatsPublisher::getPeriod,
+            &StatsPublisher::setPeriod,
+            "Publication period (sec)")
+        .def("publish",
+            &StatsPublisher::publish,
+            "Gather and publish statistics now",
+            py::call_guard<py::gil_scoped_release>())
+        .def("stop",
+            &StatsPublisher::stop,
+            "Stop publishing",
+            py::call_guard<py::gil_scoped_release>())
+        ;
+}
@@ -15,6 +15,7 @@
 #include "phy/TDChannelModulator.hh"
 #include "phy/UnichannelSynthesizer.inl"
 #include "python/PyModules.hh"
+#include "python/async.hh"
 
 void exportSynthesizers(py::module &m)
 {
@@ -31,6 +32,18 @@ void exportSynthesizers(py::module &m)
             &SlotSynthesizer::getSchedule,
             py::overload_cast<const Schedule::sched_type &>(&SlotSynthesizer::setSchedule),
             "MAC schedule")
+        .def("setChannelsAsync",
+            [](std::shared_ptr<Synthesizer> self, const Channels &channels)
+            {
+                return runAsync([self, channels]() { self->setChannels(channels); });
+            },
+            "Set TX channels without blocking, returning an awaitable future")
+        .def("setScheduleAsync",
+            [](std::shared_ptr<Synthesizer> self, const Schedule::sched_type &schedule)
+            {
+                return runAsync([self, schedule]() { self->setSchedule(schedule); });
+            },
+            "Set MAC schedule without blocking, returning an awaitable future")
         .def_property_readonly("sink",
             [](std::shared_ptr<Synthesizer> element)
             {
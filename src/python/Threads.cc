@@ -0,0 +1,92 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "python/PyModules.hh"
+#include "util/threads.hh"
+
+void exportThreads(py::module &m)
+{
+    m.attr("SCHED_OTHER") = SCHED_OTHER;
+    m.attr("SCHED_FIFO") = SCHED_FIFO;
+    m.attr("SCHED_RR") = SCHED_RR;
+
+    // Export class ThreadRole to Python
+    py::class_<ThreadRole>(m, "ThreadRole")
+        .def(py::init<>())
+        .def(py::init([](const std::vector<int> &cpus,
+                         int policy,
+                         int priority,
+                         std::optional<int> numa_node) {
+            return ThreadRole{cpus, policy, priority, numa_node};
+        }),
+            py::arg("cpus") = std::vector<int>{},
+            py::arg("policy") = SCHED_OTHER,
+            py::arg("priority") = 0,
+            py::arg("numa_node") = std::nullopt)
+        .def_readwrite("cpus",
+            &ThreadRole::cpus,
+            "CPUs the thread may run on, or empty for any CPU")
+        .def_readwrite("policy",
+            &ThreadRole::policy,
+            "Scheduling policy")
+        .def_readwrite("priority",
+            &ThreadRole::priority,
+            "Scheduling priority, or nice value for SCHED_OTHER")
+        .def_readwrite("numa_node",
+            &ThreadRole::numa_node,
+            "NUMA node to preferentially allocate memory from")
+        .def("__repr__", [](const ThreadRole& self) {
+            return py::str("ThreadRole(cpus={},policy={},priority={},numa_node={})").format(self.cpus, self.policy, self.priority, self.numa_node);
+         })
+        ;
+
+    // Export class ThreadPlacement to Python
+    py::class_<ThreadPlacement>(m, "ThreadPlacement")
+        .def_readonly("role",
+            &ThreadPlacement::role,
+            "Thread role")
+        .def_readonly("tid",
+            &ThreadPlacement::tid,
+            "Kernel thread ID")
+        .def_readonly("cpu",
+            &ThreadPlacement::cpu,
+            "CPU the thread last ran on")
+        .def_readonly("affinity",
+            &ThreadPlacement::affinity,
+            "CPUs the thread may run on")
+        .def_readonly("policy",
+            &ThreadPlacement::policy,
+            "Scheduling policy")
+        .def_readonly("priority",
+            &ThreadPlacement::priority,
+            "Scheduling priority, or nice value for SCHED_OTHER")
+        .def_readonly("user_time",
+            &ThreadPlacement::user_time,
+            "CPU time spent in user mode (sec)")
+        .def_readonly("system_time",
+            &ThreadPlacement::system_time,
+            "CPU time spent in kernel mode (sec)")
+        .def("__repr__", [](const ThreadPlacement& self) {
+            return py::str("ThreadPlacement(role={},tid={},cpu={},user_time={},system_time={})").format(self.role, self.tid, self.cpu, self.user_time, self.system_time);
+         })
+        ;
+
+    m.def("setThreadRole",
+        &setThreadRole,
+        "Set placement for threads that play a role");
+
+    m.def("clearThreadRole",
+        &clearThreadRole,
+        "Remove placement for threads that play a role");
+
+    m.def("getThreadRoles",
+        &getThreadRoles,
+        "Get configured thread roles");
+
+    m.def("getThreadPlacements",
+        &getThreadPlacements,
+        "Report actual placement and CPU usage of all running role threads");
+}
@@ -0,0 +1,33 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "Trace.hh"
+#include "python/PyModules.hh"
+
+void exportTrace(py::module &m)
+{
+    // Starting a trace sleeps to calibrate the tick counter, and dumping a
+    // trace writes a file, so neither holds the GIL.
+    m.def("startTrace",
+        &Tracer::start,
+        "Record trace spans for the given number of seconds",
+        py::arg("duration"),
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("stopTrace",
+        &Tracer::stop,
+        "Stop recording trace spans");
+
+    m.def("isTracing",
+        &Tracer::isTracing,
+        "Return True if trace spans are being recorded");
+
+    m.def("dumpTrace",
+        &Tracer::dump,
+        "Write trace spans recorded since tracing started to a Chrome trace JSON file",
+        py::arg("path"),
+        py::call_guard<py::gil_scoped_release>());
+}
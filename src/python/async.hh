@@ -0,0 +1,23 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include <functional>
+
+#include <pybind11/pybind11.h>
+
+namespace py = pybind11;
+
+/** @brief Run a command asynchronously and return an awaitable future */
+/** The command runs without the GIL on a dedicated command thread, in the
+ * order in which commands were submitted. The returned asyncio future belongs
+ * to the running event loop and completes when the command finishes. If the
+ * command throws, the future raises RuntimeError. This must be called from a
+ * coroutine or callback running in an event loop; otherwise it raises
+ * RuntimeError.
+ */
+py::object runAsync(std::function<void(void)> &&cmd);
+
+#endif /* ASYNC_H_ */
@@ -0,0 +1,399 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "logging.hh"
+#include "stats/Metrics.hh"
+#include "util/sprintf.hh"
+#include "util/threads.hh"
+
+/** @brief Slot used by default-constructed handles */
+static MetricsRegistry::Slot dummy_slot;
+
+/** @brief Allocate a private slot for a metric that could not be registered */
+/** Each failed registration gets its own slot so that unrelated metrics never
+ * share a value. Handles hold raw slot pointers and may be copied freely, so
+ * the slot is never freed; registration failures are bounded by the number of
+ * metrics a process creates.
+ */
+static MetricsRegistry::Slot *privateSlot(MetricsRegistry::Type type,
+                                          std::initializer_list<double> bounds)
+{
+    auto slot = new MetricsRegistry::Slot();
+
+    slot->type = type;
+    slot->nbounds = std::min(bounds.size(), MetricsRegistry::kMaxBuckets);
+    std::copy_n(bounds.begin(), slot->nbounds, slot->bounds);
+
+    return slot;
+}
+
+MetricsRegistry::MetricsRegistry(const std::string &shm_name)
+  : shm_name_(shm_name)
+  , size_(sizeof(Header) + kMaxMetrics*sizeof(Slot))
+{
+    void *p = MAP_FAILED;
+
+    if (!shm_name_.empty()) {
+        int fd = shm_open(shm_name_.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+
+        if (fd >= 0) {
+            if (ftruncate(fd, size_) == 0)
+                p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            close(fd);
+        }
+
+        if (p == MAP_FAILED) {
+            logEvent(kEventSystem, LOGWARNING, "Could not create metrics shared memory %s: %s",
+                shm_name_.c_str(),
+                strerror(errno));
+            shm_unlink(shm_name_.c_str());
+            shm_name_.clear();
+        }
+    }
+
+    // Fall back to anonymous memory
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::runtime_error(strerror(errno));
+    }
+
+    // The mapping is zero-filled, which is a valid initial state for every
+    // slot.
+    hdr_ = static_cast<Header*>(p);
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(p) + sizeof(Header));
+
+    hdr_->magic = kMagic;
+    hdr_->version = kVersion;
+    hdr_->nslots = kMaxMetrics;
+    hdr_->nused.store(0, std::memory_order_release);
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    unlinkSharedMemory();
+    munmap(hdr_, size_);
+}
+
+void MetricsRegistry::unlinkSharedMemory(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!shm_name_.empty()) {
+        shm_unlink(shm_name_.c_str());
+        shm_name_.clear();
+    }
+}
+
+MetricsRegistry::Slot *MetricsRegistry::lookup(const std::string &name,
+                                               const std::string &help,
+                                               Type type,
+                                               std::initializer_list<double> bounds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t                    nused = hdr_->nused.load(std::memory_order_relaxed);
+
+    if (name.size() >= kMaxNameLen) {
+        logEvent(kEventSystem, LOGWARNING, "Metric name too long: %s", name.c_str());
+        return privateSlot(type, bounds);
+    }
+
+    // Length of the family name if this is a labeled series, otherwise 0
+    size_t brace = name.find('{');
+    size_t family_len = brace == std::string::npos ? 0 : brace;
+    size_t nseries = 0;
+
+    for (uint32_t i = 0; i < nused; ++i) {
+        Slot &slot = slots_[i];
+
+        if (name == slot.name) {
+            if (slot.type != type) {
+                logEvent(kEventSystem, LOGWARNING, "Metric %s registered with different type", name.c_str());
+                return privateSlot(type, bounds);
+            }
+
+            return &slot;
+        }
+
+        if (family_len != 0 &&
+            slot.name[family_len] == '{' &&
+            name.compare(0, family_len, slot.name, family_len) == 0)
+            ++nseries;
+    }
+
+    if (nused == kMaxMetrics) {
+        logEvent(kEventSystem, LOGWARNING, "Too many metrics: %s", name.c_str());
+        return privateSlot(type, bounds);
+    }
+
+    if (nseries >= kMaxSeriesPerFamily) {
+        logEvent(kEventSystem, LOGWARNING, "Too many series in metric family: %s", name.c_str());
+        return privateSlot(type, bounds);
+    }
+
+    Slot &slot = slots_[nused];
+
+    slot.type = type;
+    strncpy(slot.name, name.c_str(), kMaxNameLen - 1);
+    strncpy(slot.help, help.c_str(), kMaxHelpLen - 1);
+    slot.nbounds = std::min(bounds.size(), kMaxBuckets);
+    std::copy_n(bounds.begin(), slot.nbounds, slot.bounds);
+
+    slot.state.store(kReady, std::memory_order_release);
+    hdr_->nused.store(nused + 1, std::memory_order_release);
+
+    return &slot;
+}
+
+/** @brief Format a double for Prometheus */
+static std::string fmtDouble(double x)
+{
+    if (std::isinf(x))
+        return x > 0 ? "+Inf" : "-Inf";
+    else if (std::isnan(x))
+        return "NaN";
+    else
+        return sprintf("%.15g", x);
+}
+
+std::string MetricsRegistry::renderPrometheus(void) const
+{
+    uint32_t           nused = hdr_->nused.load(std::memory_order_acquire);
+    std::vector<Slot*> slots;
+
+    slots.reserve(nused);
+
+    for (uint32_t i = 0; i < nused; ++i) {
+        if (slots_[i].state.load(std::memory_order_acquire) == kReady)
+            slots.push_back(&slots_[i]);
+    }
+
+    // All series in a family must be grouped together, so sort by family
+    // name first. Sorting by full name alone would split a family whenever
+    // another family's name extends it, e.g., "foo{...}" and "foo_bar".
+    std::sort(slots.begin(), slots.end(), [](const Slot *x, const Slot *y) {
+        size_t xlen = strcspn(x->name, "{");
+        size_t ylen = strcspn(y->name, "{");
+        int    cmp = strncmp(x->name, y->name, std::min(xlen, ylen));
+
+        if (cmp != 0)
+            return cmp < 0;
+        else if (xlen != ylen)
+            return xlen < ylen;
+        else
+            return strcmp(x->name + xlen, y->name + ylen) < 0;
+    });
+
+    std::string out;
+    std::string last_family;
+
+    out.reserve(256*slots.size());
+
+    for (Slot *slot : slots) {
+        std::string name(slot->name);
+        size_t      brace = name.find('{');
+        std::string family = name.substr(0, brace);
+        std::string labels;
+
+        // Labels, without braces
+        if (brace != std::string::npos)
+            labels = name.substr(brace + 1, name.size() - brace - 2);
+
+        if (family != last_family) {
+            static const char *types[] = { "counter", "gauge", "histogram" };
+
+            if (slot->help[0] != '\0')
+                out += "# HELP " + family + " " + slot->help + "\n";
+
+            out += "# TYPE " + family + " " + types[slot->type] + "\n";
+
+            last_family = family;
+        }
+
+        switch (slot->type) {
+            case kCounter:
+                out += name + " " + std::to_string(slot->value.load(std::memory_order_relaxed)) + "\n";
+                break;
+
+            case kGauge:
+            {
+                uint64_t bits = slot->value.load(std::memory_order_relaxed);
+                double   x;
+
+                std::memcpy(&x, &bits, sizeof(x));
+                out += name + " " + fmtDouble(x) + "\n";
+            }
+            break;
+
+            case kHistogram:
+            {
+                std::string sep = labels.empty() ? "" : ",";
+                std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+                uint64_t    count = 0;
+                uint64_t    bits = slot->sum.load(std::memory_order_relaxed);
+                double      sum;
+
+                std::memcpy(&sum, &bits, sizeof(sum));
+
+                for (unsigned i = 0; i <= slot->nbounds; ++i) {
+                    std::string le = i < slot->nbounds ? fmtDouble(slot->bounds[i]) : "+Inf";
+
+                    count += slot->buckets[i].load(std::memory_order_relaxed);
+                    out += family + "_bucket{" + labels + sep + "le=\"" + le + "\"} " + std::to_string(count) + "\n";
+                }
+
+                // Use the sum of the buckets as the count so that the count is
+                // consistent with the +Inf bucket.
+                out += family + "_sum" + suffix + " " + fmtDouble(sum) + "\n";
+                out += family + "_count" + suffix + " " + std::to_string(count) + "\n";
+            }
+            break;
+        }
+    }
+
+    return out;
+}
+
+MetricsRegistry &metrics(void)
+{
+    // The global registry is never destroyed, because threads may still be
+    // updating metrics while static objects are destroyed. We only remove the
+    // shared memory segment's name at exit.
+    static MetricsRegistry *registry = []() {
+        auto r = new MetricsRegistry(sprintf("/dragonradio-metrics-%d", getpid()));
+
+        std::atexit([]() { metrics().unlinkSharedMemory(); });
+
+        return r;
+    }();
+
+    return *registry;
+}
+
+MetricHandle::MetricHandle()
+  : slot_(&dummy_slot)
+{
+}
+
+MetricsExporter::MetricsExporter(MetricsRegistry &registry,
+                                 const std::string &path)
+  : registry_(registry)
+  , path_(path)
+  , done_(false)
+{
+    struct sockaddr_un addr = {};
+
+    if (path_.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path too long: " + path_);
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+
+    if ((fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        throw std::runtime_error(strerror(errno));
+
+    // Remove stale socket
+    unlink(path_.c_str());
+
+    if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(fd_, 8) < 0) {
+        int err = errno;
+
+        close(fd_);
+        throw std::runtime_error(strerror(err));
+    }
+
+    worker_thread_ = spawnThread("metrics", &MetricsExporter::worker, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+}
+
+void MetricsExporter::stop(void)
+{
+    done_ = true;
+
+    if (worker_thread_.joinable()) {
+        worker_thread_.join();
+        close(fd_);
+        unlink(path_.c_str());
+    }
+}
+
+void MetricsExporter::worker(void)
+{
+    struct pollfd pfd = { fd_, POLLIN, 0 };
+
+    while (!done_) {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        int client = accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+
+        if (client < 0)
+            continue;
+
+        serve(client);
+        close(client);
+    }
+}
+
+void MetricsExporter::serve(int fd)
+{
+    // Don't let a stalled client block the exporter
+    struct timeval tv = { 1, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Give the client a brief chance to send an HTTP request
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char          req[1024];
+    bool          http = false;
+
+    if (poll(&pfd, 1, 10) > 0) {
+        ssize_t n = recv(fd, req, sizeof(req), MSG_DONTWAIT);
+
+        http = n >= 4 && memcmp(req, "GET ", 4) == 0;
+    }
+
+    std::string body = registry_.renderPrometheus();
+    std::string resp;
+
+    if (http)
+        resp = sprintf("HTTP/1.0 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: %zu\r\n"
+                       "\r\n", body.size()) + body;
+    else
+        resp = std::move(body);
+
+    const char *p = resp.data();
+    size_t     left = resp.size();
+
+    while (left > 0) {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+
+        if (n <= 0)
+            break;
+
+        p += n;
+        left -= n;
+    }
+}
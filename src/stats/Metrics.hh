@@ -0,0 +1,406 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef METRICS_HH_
+#define METRICS_HH_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/** @brief Shared-memory metrics registry */
+/** Metrics live in a POSIX shared memory segment with a fixed layout, so an
+ * external process can map the segment read-only and read every metric
+ * without any cooperation from the radio. Updating a metric is a single
+ * relaxed atomic operation on the shared segment and never takes a lock.
+ *
+ * The segment consists of a MetricsRegistry::Header followed by
+ * Header::nslots MetricsRegistry::Slot entries. A slot is valid once its
+ * state is kReady, and slots are only ever appended, so readers can scan slots
+ * [0, Header::nused).
+ */
+class MetricsRegistry {
+public:
+    /** @brief Magic number identifying a metrics segment */
+    static constexpr uint32_t kMagic = 0x4d455452; // "METR"
+
+    /** @brief Version of the shared memory layout */
+    static constexpr uint32_t kVersion = 1;
+
+    /** @brief Maximum number of metrics */
+    static constexpr size_t kMaxMetrics = 4096;
+
+    /** @brief Maximum number of labeled series in a metric family */
+    /** Per-flow and per-node series are registered as flows and nodes appear,
+     * so this bounds how much of the registry any one family can take.
+     */
+    static constexpr size_t kMaxSeriesPerFamily = 256;
+
+    /** @brief Maximum length of a metric name, including labels */
+    static constexpr size_t kMaxNameLen = 128;
+
+    /** @brief Maximum length of a metric's help string */
+    static constexpr size_t kMaxHelpLen = 96;
+
+    /** @brief Maximum number of histogram bucket upper bounds */
+    static constexpr size_t kMaxBuckets = 16;
+
+    /** @brief Metric type */
+    enum Type : uint32_t {
+        kCounter = 0,
+        kGauge,
+        kHistogram
+    };
+
+    /** @brief Slot state */
+    enum State : uint32_t {
+        kFree = 0,
+        kReady
+    };
+
+    /** @brief Segment header */
+    struct Header {
+        /** @brief Magic number */
+        uint32_t magic;
+
+        /** @brief Layout version */
+        uint32_t version;
+
+        /** @brief Total number of slots in segment */
+        uint32_t nslots;
+
+        /** @brief Number of slots in use */
+        std::atomic<uint32_t> nused;
+    };
+
+    /** @brief A single metric */
+    struct Slot {
+        /** @brief Slot state */
+        std::atomic<uint32_t> state;
+
+        /** @brief Metric type */
+        uint32_t type;
+
+        /** @brief Metric name, possibly followed by Prometheus labels */
+        char name[kMaxNameLen];
+
+        /** @brief Help string */
+        char help[kMaxHelpLen];
+
+        /** @brief Counter value, gauge value as double bits, or histogram
+         * observation count.
+         */
+        std::atomic<uint64_t> value;
+
+        /** @brief Histogram sum of observations as double bits */
+        std::atomic<uint64_t> sum;
+
+        /** @brief Number of histogram bucket upper bounds */
+        uint32_t nbounds;
+
+        /** @brief Histogram bucket upper bounds */
+        double bounds[kMaxBuckets];
+
+        /** @brief Histogram bucket counts. The last bucket is +Inf. These
+         * counts are not cumulative.
+         */
+        std::atomic<uint64_t> buckets[kMaxBuckets+1];
+    };
+
+    /** @brief Create a registry in a named shared memory segment
+     * @param shm_name Name of POSIX shared memory segment. If empty, the
+     * registry is backed by anonymous memory.
+     */
+    explicit MetricsRegistry(const std::string &shm_name);
+
+    MetricsRegistry() = delete;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry(MetricsRegistry&&) = delete;
+
+    ~MetricsRegistry();
+
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(MetricsRegistry&&) = delete;
+
+    /** @brief Get name of shared memory segment */
+    const std::string &getSharedMemoryName(void) const
+    {
+        return shm_name_;
+    }
+
+    /** @brief Get size of shared memory segment */
+    size_t getSharedMemorySize(void) const
+    {
+        return size_;
+    }
+
+    /** @brief Remove the shared memory segment's name */
+    /** The segment stays mapped, so metrics can still be updated, but no new
+     * reader can attach to it.
+     */
+    void unlinkSharedMemory(void);
+
+    /** @brief Get number of registered metrics */
+    size_t size(void) const
+    {
+        return hdr_->nused.load(std::memory_order_acquire);
+    }
+
+    /** @brief Get slot for a metric, registering it if necessary */
+    /** If a metric of the same name and type has already been registered, its
+     * slot is returned. If the registry is full, the metric's family already
+     * has kMaxSeriesPerFamily labeled series, or the name is registered with a
+     * different type, a new private slot that is not exported is returned so
+     * that callers never need to check for failure.
+     */
+    Slot *lookup(const std::string &name,
+                 const std::string &help,
+                 Type type,
+                 std::initializer_list<double> bounds = {});
+
+    /** @brief Render all metrics in Prometheus text exposition format */
+    std::string renderPrometheus(void) const;
+
+protected:
+    /** @brief Name of shared memory segment */
+    std::string shm_name_;
+
+    /** @brief Size of shared memory segment */
+    size_t size_;
+
+    /** @brief Shared memory segment header */
+    Header *hdr_;
+
+    /** @brief Shared memory segment slots */
+    Slot *slots_;
+
+    /** @brief Mutex serializing registration */
+    std::mutex mutex_;
+};
+
+/** @brief Return the global metrics registry */
+/** The global registry is created on first use in the shared memory segment
+ * named /dragonradio-metrics-<pid>.
+ */
+MetricsRegistry &metrics(void);
+
+/** @brief A handle to a metric slot */
+class MetricHandle {
+public:
+    /** @brief Construct a handle to a private, unregistered slot */
+    MetricHandle();
+
+    explicit MetricHandle(MetricsRegistry::Slot *slot)
+      : slot_(slot)
+    {
+    }
+
+protected:
+    /** @brief Load a double stored as bits */
+    static double load(const std::atomic<uint64_t> &x)
+    {
+        uint64_t bits = x.load(std::memory_order_relaxed);
+        double   d;
+
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+
+    /** @brief Store a double as bits */
+    static void store(std::atomic<uint64_t> &x, double d)
+    {
+        uint64_t bits;
+
+        std::memcpy(&bits, &d, sizeof(bits));
+        x.store(bits, std::memory_order_relaxed);
+    }
+
+    /** @brief Atomically add to a double stored as bits */
+    static void add(std::atomic<uint64_t> &x, double d)
+    {
+        uint64_t old_bits = x.load(std::memory_order_relaxed);
+        uint64_t new_bits;
+        double   old_d;
+        double   new_d;
+
+        do {
+            std::memcpy(&old_d, &old_bits, sizeof(old_d));
+            new_d = old_d + d;
+            std::memcpy(&new_bits, &new_d, sizeof(new_bits));
+        } while (!x.compare_exchange_weak(old_bits, new_bits, std::memory_order_relaxed));
+    }
+
+    /** @brief Metric slot */
+    MetricsRegistry::Slot *slot_;
+};
+
+/** @brief A monotonically increasing counter */
+class Counter : public MetricHandle {
+public:
+    using MetricHandle::MetricHandle;
+
+    Counter() = default;
+
+    Counter(MetricsRegistry &registry,
+            const std::string &name,
+            const std::string &help = "")
+      : MetricHandle(registry.lookup(name, help, MetricsRegistry::kCounter))
+    {
+    }
+
+    /** @brief Increment the counter */
+    void inc(uint64_t n = 1)
+    {
+        slot_->value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /** @brief Get counter value */
+    uint64_t value(void) const
+    {
+        return slot_->value.load(std::memory_order_relaxed);
+    }
+};
+
+/** @brief A gauge */
+class Gauge : public MetricHandle {
+public:
+    using MetricHandle::MetricHandle;
+
+    Gauge() = default;
+
+    Gauge(MetricsRegistry &registry,
+          const std::string &name,
+          const std::string &help = "")
+      : MetricHandle(registry.lookup(name, help, MetricsRegistry::kGauge))
+    {
+    }
+
+    /** @brief Set the gauge */
+    void set(double x)
+    {
+        store(slot_->value, x);
+    }
+
+    /** @brief Add to the gauge */
+    void add(double x)
+    {
+        MetricHandle::add(slot_->value, x);
+    }
+
+    /** @brief Get gauge value */
+    double value(void) const
+    {
+        return load(slot_->value);
+    }
+};
+
+/** @brief A histogram with fixed bucket bounds */
+class Histogram : public MetricHandle {
+public:
+    using MetricHandle::MetricHandle;
+
+    Histogram() = default;
+
+    /** @brief Construct a histogram
+     * @param registry The registry
+     * @param name Metric name
+     * @param bounds Increasing bucket upper bounds; at most
+     * MetricsRegistry::kMaxBuckets are used.
+     * @param help Help string
+     */
+    Histogram(MetricsRegistry &registry,
+              const std::string &name,
+              std::initializer_list<double> bounds,
+              const std::string &help = "")
+      : MetricHandle(registry.lookup(name, help, MetricsRegistry::kHistogram, bounds))
+    {
+    }
+
+    /** @brief Record an observation */
+    void observe(double x)
+    {
+        unsigned i = 0;
+
+        while (i < slot_->nbounds && x > slot_->bounds[i])
+            ++i;
+
+        slot_->buckets[i].fetch_add(1, std::memory_order_relaxed);
+        slot_->value.fetch_add(1, std::memory_order_relaxed);
+        add(slot_->sum, x);
+    }
+
+    /** @brief Get number of observations */
+    uint64_t count(void) const
+    {
+        return slot_->value.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Get sum of observations */
+    double sum(void) const
+    {
+        return load(slot_->sum);
+    }
+};
+
+/** @brief Export metrics over a Unix domain socket */
+/** A background thread listens on a Unix domain stream socket. Each
+ * connection receives a snapshot of the registry in Prometheus text format
+ * and is then closed. If the client sends an HTTP request first, the snapshot
+ * is wrapped in an HTTP response, so both plain socket readers and HTTP
+ * scrapers work. Rendering only reads atomics in the registry, so a scrape
+ * never takes the GIL or any lock on the radio's data path.
+ */
+class MetricsExporter {
+public:
+    /** @brief Create an exporter
+     * @param registry The registry to export
+     * @param path Path of the Unix domain socket
+     */
+    MetricsExporter(MetricsRegistry &registry, const std::string &path);
+
+    MetricsExporter() = delete;
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter(MetricsExporter&&) = delete;
+
+    ~MetricsExporter();
+
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(MetricsExporter&&) = delete;
+
+    /** @brief Get socket path */
+    const std::string &getPath(void) const
+    {
+        return path_;
+    }
+
+    /** @brief Stop the exporter */
+    void stop(void);
+
+protected:
+    /** @brief The registry */
+    MetricsRegistry &registry_;
+
+    /** @brief Socket path */
+    std::string path_;
+
+    /** @brief Listening socket */
+    int fd_;
+
+    /** @brief Flag indicating we should terminate */
+    std::atomic<bool> done_;
+
+    /** @brief Exporter thread */
+    std::thread worker_thread_;
+
+    /** @brief Exporter worker */
+    void worker(void);
+
+    /** @brief Serve a single client */
+    void serve(int fd);
+};
+
+#endif /* METRICS_HH_ */
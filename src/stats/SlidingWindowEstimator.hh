@@ -0,0 +1,682 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef SLIDINGWINDOWESTIMATOR_HH_
+#define SLIDINGWINDOWESTIMATOR_HH_
+
+#include <math.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <type_traits>
+
+#include "Estimator.hh"
+#include "SeqLock.hh"
+
+/** @brief A published snapshot of a windowed estimator */
+template <class T>
+struct WindowSnapshot {
+    /** @brief Estimator value */
+    T value;
+
+    /** @brief Number of samples in the window */
+    size_t size;
+
+    /** @brief Time (in seconds) of the newest sample */
+    double t_last;
+};
+
+/** @brief A bounded-memory estimator over a time window */
+/** Time is divided into N buckets, each covering twindow/N seconds, so the
+ * window boundary has a granularity of one bucket. No memory is allocated
+ * after construction, updates and queries are amortized O(1) and never worse
+ * than O(N), and the most recent value is published on every update so it can
+ * be read from other threads without taking a lock.
+ */
+template <class Clock, class T, size_t N>
+class SlidingWindowEstimator : public Estimator<T> {
+public:
+    explicit SlidingWindowEstimator(double twindow)
+      : twindow_(twindow)
+      , granularity_(twindow/N)
+      , head_epoch_(0)
+      , tail_epoch_(0)
+      , nsamples_(0)
+      , snapshot_(WindowSnapshot<T>{T(), 0, 0.0})
+    {
+    }
+
+    virtual ~SlidingWindowEstimator() = default;
+
+    /** @brief Get the current time window */
+    double getTimeWindow(void) const
+    {
+        return twindow_;
+    }
+
+    /** @brief Set the current time window */
+    /** Changing the time window resets the estimator. */
+    void setTimeWindow(double twindow)
+    {
+        twindow_ = twindow;
+        granularity_ = twindow/N;
+        reset();
+    }
+
+    /** @brief Get the time granularity of the window */
+    double getGranularity(void) const
+    {
+        return granularity_;
+    }
+
+    operator bool() const override
+    {
+        expire(Clock::now());
+
+        return nsamples_ != 0;
+    }
+
+    std::optional<T> value(void) const override
+    {
+        expire(Clock::now());
+
+        if (nsamples_ == 0)
+            return std::nullopt;
+        else
+            return **this;
+    }
+
+    T value_or(T&& default_value) const override
+    {
+        expire(Clock::now());
+
+        if (nsamples_ == 0)
+            return default_value;
+        else
+            return **this;
+    }
+
+    size_t size(void) const override
+    {
+        return nsamples_;
+    }
+
+    void update(T x) override
+    {
+        update(Clock::now(), x);
+    }
+
+    /** @brief Update the estimator with a new value */
+    virtual void update(typename Clock::time_point t, T x) = 0;
+
+    /** @brief Reset the estimator */
+    virtual void reset(void)
+    {
+        head_epoch_ = 0;
+        tail_epoch_ = 0;
+        nsamples_ = 0;
+        snapshot_.store(WindowSnapshot<T>{T(), 0, 0.0});
+    }
+
+    /** @brief Return the most recently published snapshot */
+    /** This may be called from any thread without holding a lock. */
+    WindowSnapshot<T> snapshot(void) const
+    {
+        return snapshot_.load();
+    }
+
+    /** @brief Return the estimate as of the last update */
+    /** This may be called from any thread without holding a lock. The value
+     * is the estimate over the window ending at the newest sample, not the
+     * window ending now: samples that have expired since the last update are
+     * still included, so the oldest contributing sample may be up to two
+     * windows old. Returns nothing if no samples have been published or if
+     * the newest published sample has itself fallen outside the window. Use
+     * value() under the owner's lock when the current window is required.
+     */
+    std::optional<T> lastPublishedValue(void) const
+    {
+        WindowSnapshot<T> snap = snapshot_.load();
+
+        if (snap.size == 0 || snap.t_last + twindow_ < Clock::now().get_real_secs())
+            return std::nullopt;
+        else
+            return snap.value;
+    }
+
+protected:
+    /** @brief Time window (sec) */
+    double twindow_;
+
+    /** @brief Duration of a bucket (sec) */
+    double granularity_;
+
+    /** @brief Newest epoch seen */
+    mutable int64_t head_epoch_;
+
+    /** @brief Oldest epoch that may still hold live data */
+    mutable int64_t tail_epoch_;
+
+    /** @brief Number of samples in the window */
+    mutable size_t nsamples_;
+
+    /** @brief Published snapshot */
+    SeqLock<WindowSnapshot<T>> snapshot_;
+
+    /** @brief Return the epoch of a time point */
+    int64_t epoch(typename Clock::time_point t) const
+    {
+        return static_cast<int64_t>(floor(t.get_real_secs()/granularity_));
+    }
+
+    /** @brief Return true if an epoch is outside the window */
+    bool expired(int64_t e) const
+    {
+        return e <= head_epoch_ - static_cast<int64_t>(N);
+    }
+
+    /** @brief Advance the window so that it ends at time t */
+    void expire(typename Clock::time_point t) const
+    {
+        int64_t e = epoch(t);
+
+        if (e > head_epoch_)
+            head_epoch_ = e;
+
+        int64_t oldest = head_epoch_ - static_cast<int64_t>(N) + 1;
+
+        if (tail_epoch_ >= oldest)
+            return;
+
+        // If every bucket has expired, clear them all at once so the cost of
+        // a long idle period is bounded by N.
+        if (oldest - tail_epoch_ >= static_cast<int64_t>(N))
+            clear();
+        else {
+            for (; tail_epoch_ < oldest; ++tail_epoch_)
+                expireEpoch(tail_epoch_);
+        }
+
+        tail_epoch_ = oldest;
+    }
+
+    /** @brief Publish the current estimate */
+    void publish(typename Clock::time_point t)
+    {
+        snapshot_.store(WindowSnapshot<T>{nsamples_ == 0 ? T() : **this,
+                                          nsamples_,
+                                          t.get_real_secs()});
+    }
+
+    /** @brief Bucket index of an epoch */
+    static size_t bucket(int64_t e)
+    {
+        return static_cast<uint64_t>(e) % N;
+    }
+
+    /** @brief Drop the data for an expired epoch */
+    virtual void expireEpoch(int64_t e) const = 0;
+
+    /** @brief Drop all data */
+    virtual void clear(void) const = 0;
+};
+
+/** @brief Compute mean over a time window using fixed-granularity buckets */
+template <class Clock, class T, size_t N = 64>
+class BucketedTimeWindowMean : public SlidingWindowEstimator<Clock, T, N> {
+public:
+    using base = SlidingWindowEstimator<Clock, T, N>;
+
+    using base::nsamples_;
+    using base::epoch;
+    using base::expired;
+    using base::expire;
+    using base::bucket;
+    using base::publish;
+
+    explicit BucketedTimeWindowMean(double twindow=1.0)
+      : base(twindow)
+      , sum_(0)
+      , nexpired_(0)
+    {
+        clear();
+    }
+
+    virtual ~BucketedTimeWindowMean() = default;
+
+    T operator *() const override
+    {
+        return sum_/static_cast<T>(nsamples_);
+    }
+
+    void reset(void) override
+    {
+        base::reset();
+        clear();
+    }
+
+    void update(typename Clock::time_point t, T x) override
+    {
+        expire(t);
+
+        int64_t e = epoch(t);
+
+        // Ignore samples that are already outside the window
+        if (expired(e))
+            return;
+
+        Bucket &b = buckets_[bucket(e)];
+
+        if (b.epoch != e) {
+            b.epoch = e;
+            b.sum = 0;
+            b.count = 0;
+        }
+
+        b.sum += x;
+        ++b.count;
+
+        sum_ += x;
+        ++nsamples_;
+
+        publish(t);
+    }
+
+protected:
+    struct Bucket {
+        /** @brief Epoch of the data in this bucket */
+        int64_t epoch;
+
+        /** @brief Sum of values in this bucket */
+        T sum;
+
+        /** @brief Number of values in this bucket */
+        size_t count;
+    };
+
+    /** @brief Buckets */
+    mutable std::array<Bucket, N> buckets_;
+
+    /** @brief Sum of values in our window */
+    mutable T sum_;
+
+    /** @brief Number of buckets expired since sum_ was last recomputed */
+    mutable size_t nexpired_;
+
+    void expireEpoch(int64_t e) const override
+    {
+        Bucket &b = buckets_[bucket(e)];
+
+        if (b.epoch == e && b.count != 0) {
+            sum_ -= b.sum;
+            nsamples_ -= b.count;
+            b.sum = 0;
+            b.count = 0;
+
+            // Subtracting expired buckets from the running sum accumulates
+            // rounding error, so recompute the sum from the buckets once every
+            // N expirations. This keeps the amortized cost O(1).
+            if (++nexpired_ >= N)
+                resum();
+        }
+    }
+
+    void clear(void) const override
+    {
+        for (auto &b : buckets_)
+            b = Bucket{std::numeric_limits<int64_t>::min(), 0, 0};
+
+        sum_ = 0;
+        nsamples_ = 0;
+        nexpired_ = 0;
+    }
+
+    /** @brief Recompute the running sum from the buckets */
+    /** Expired buckets have a zero sum, so this is just the sum over all
+     * buckets.
+     */
+    void resum(void) const
+    {
+        T sum = 0;
+
+        for (const auto &b : buckets_)
+            sum += b.sum;
+
+        sum_ = sum;
+        nexpired_ = 0;
+    }
+};
+
+/** @brief Compute mean value *per second* over a time window using
+ * fixed-granularity buckets
+ */
+template <class Clock, class T, size_t N = 64>
+class BucketedTimeWindowMeanRate : public BucketedTimeWindowMean<Clock, T, N> {
+public:
+    using BucketedTimeWindowMean<Clock, T, N>::sum_;
+    using BucketedTimeWindowMean<Clock, T, N>::twindow_;
+
+    explicit BucketedTimeWindowMeanRate(double twindow=1.0)
+      : BucketedTimeWindowMean<Clock, T, N>(twindow)
+    {
+    }
+
+    virtual ~BucketedTimeWindowMeanRate() = default;
+
+    T operator *() const override
+    {
+        return sum_/twindow_;
+    }
+};
+
+/** @brief Compute an extremum over a time window using a monotonic deque of
+ * fixed-granularity buckets
+ */
+/** Each bucket holds the extremum of its values, and a monotonic deque of
+ * bucket epochs tracks the candidates for the window's extremum, so both
+ * update and query are amortized O(1) and the deque never holds more than N
+ * entries. Samples older than the newest sample are attributed to the newest
+ * bucket.
+ */
+template <class Clock, class T, class Compare, size_t N>
+class BucketedTimeWindowExtremum : public SlidingWindowEstimator<Clock, T, N> {
+public:
+    using base = SlidingWindowEstimator<Clock, T, N>;
+
+    using base::nsamples_;
+    using base::head_epoch_;
+    using base::epoch;
+    using base::expire;
+    using base::bucket;
+    using base::publish;
+
+    explicit BucketedTimeWindowExtremum(double twindow=1.0)
+      : base(twindow)
+    {
+        clear();
+    }
+
+    virtual ~BucketedTimeWindowExtremum() = default;
+
+    T operator *() const override
+    {
+        return values_[bucket(deque_[bucket(front_)])];
+    }
+
+    void reset(void) override
+    {
+        base::reset();
+        clear();
+    }
+
+    void update(typename Clock::time_point t, T x) override
+    {
+        expire(t);
+
+        int64_t e = std::max(epoch(t), head_epoch_);
+        T       &v = values_[bucket(e)];
+
+        // Start a new bucket or fold x into the current one
+        if (back_ == front_ || deque_[bucket(back_ - 1)] != e)
+            v = x;
+        else if (cmp_(x, v))
+            v = x;
+        else {
+            ++counts_[bucket(e)];
+            ++nsamples_;
+            publish(t);
+            return;
+        }
+
+        // Remove buckets dominated by the new value. This may include the
+        // current bucket, which is re-added below.
+        while (back_ != front_ && !cmp_(values_[bucket(deque_[bucket(back_ - 1)])], v))
+            --back_;
+
+        deque_[bucket(back_++)] = e;
+
+        ++counts_[bucket(e)];
+        ++nsamples_;
+
+        publish(t);
+    }
+
+protected:
+    /** @brief Comparison; cmp_(a, b) is true when a strictly dominates b */
+    Compare cmp_;
+
+    /** @brief Extremum of each bucket, indexed by epoch */
+    mutable std::array<T, N> values_;
+
+    /** @brief Ring buffer of bucket epochs forming a monotonic deque */
+    mutable std::array<int64_t, N> deque_;
+
+    /** @brief Index of front of deque */
+    mutable uint64_t front_;
+
+    /** @brief Index one past back of deque */
+    mutable uint64_t back_;
+
+    /** @brief Number of samples in each bucket, indexed by epoch */
+    mutable std::array<size_t, N> counts_;
+
+    void expireEpoch(int64_t e) const override
+    {
+        if (back_ != front_ && deque_[bucket(front_)] == e)
+            ++front_;
+
+        size_t &count = counts_[bucket(e)];
+
+        nsamples_ -= count;
+        count = 0;
+    }
+
+    void clear(void) const override
+    {
+        values_.fill(T());
+        deque_.fill(0);
+        counts_.fill(0);
+        front_ = 0;
+        back_ = 0;
+        nsamples_ = 0;
+    }
+};
+
+/** @brief Compute maximum over a time window in amortized constant time */
+template <class Clock, class T, size_t N = 64>
+using BucketedTimeWindowMax = BucketedTimeWindowExtremum<Clock, T, std::greater<T>, N>;
+
+/** @brief Compute minimum over a time window in amortized constant time */
+template <class Clock, class T, size_t N = 64>
+using BucketedTimeWindowMin = BucketedTimeWindowExtremum<Clock, T, std::less<T>, N>;
+
+/** @brief Exponentially-weighted moving average with a time constant */
+/** Unlike EMA, the weight of each sample depends on the time elapsed since
+ * the previous sample, so irregularly-spaced samples are weighted correctly.
+ */
+template <class Clock, class T>
+class TimeEWMA : public Estimator<T> {
+public:
+    /** @brief Create a time-based EWMA estimator
+     * @param tau Time constant (sec)
+     */
+    explicit TimeEWMA(double tau=1.0)
+      : tau_(tau)
+      , value_(0)
+      , t_last_(0.0)
+      , nsamples_(0)
+      , snapshot_(WindowSnapshot<T>{T(), 0, 0.0})
+    {
+    }
+
+    virtual ~TimeEWMA() = default;
+
+    /** @brief Get time constant */
+    double getTimeConstant(void) const
+    {
+        return tau_;
+    }
+
+    /** @brief Set time constant */
+    void setTimeConstant(double tau)
+    {
+        tau_ = tau;
+    }
+
+    operator bool() const override
+    {
+        return nsamples_ != 0;
+    }
+
+    T operator *() const override
+    {
+        return value_;
+    }
+
+    std::optional<T> value(void) const override
+    {
+        if (nsamples_ == 0)
+            return std::nullopt;
+        else
+            return value_;
+    }
+
+    T value_or(T&& default_value) const override
+    {
+        if (nsamples_ == 0)
+            return default_value;
+        else
+            return value_;
+    }
+
+    size_t size(void) const override
+    {
+        return nsamples_;
+    }
+
+    void reset(void)
+    {
+        value_ = 0;
+        nsamples_ = 0;
+        snapshot_.store(WindowSnapshot<T>{T(), 0, 0.0});
+    }
+
+    void update(T x) override
+    {
+        update(Clock::now(), x);
+    }
+
+    void update(typename Clock::time_point t, T x)
+    {
+        if (nsamples_ == 0)
+            value_ = x;
+        else {
+            double dt = (t - t_last_).get_real_secs();
+
+            if (dt > 0)
+                value_ += (1.0 - exp(-dt/tau_))*(x - value_);
+        }
+
+        t_last_ = t;
+        ++nsamples_;
+
+        snapshot_.store(WindowSnapshot<T>{value_, nsamples_, t.get_real_secs()});
+    }
+
+    /** @brief Return the most recently published snapshot */
+    /** This may be called from any thread without holding a lock. */
+    WindowSnapshot<T> snapshot(void) const
+    {
+        return snapshot_.load();
+    }
+
+protected:
+    /** @brief Time constant (sec) */
+    double tau_;
+
+    /** @brief Current estimate */
+    T value_;
+
+    /** @brief Time of last update */
+    typename Clock::time_point t_last_;
+
+    /** @brief Number of samples */
+    size_t nsamples_;
+
+    /** @brief Published snapshot */
+    SeqLock<WindowSnapshot<T>> snapshot_;
+};
+
+/** @brief Exponentially-weighted moving estimate of a rate (per second) */
+/** Each update adds x to an exponentially-decaying accumulator; the estimate
+ * decays towards zero when there are no updates.
+ */
+template <class Clock, class T>
+class TimeEWMARate : public TimeEWMA<Clock, T> {
+public:
+    using TimeEWMA<Clock, T>::tau_;
+    using TimeEWMA<Clock, T>::value_;
+    using TimeEWMA<Clock, T>::t_last_;
+    using TimeEWMA<Clock, T>::nsamples_;
+    using TimeEWMA<Clock, T>::snapshot_;
+
+    explicit TimeEWMARate(double tau=1.0)
+      : TimeEWMA<Clock, T>(tau)
+    {
+    }
+
+    virtual ~TimeEWMARate() = default;
+
+    T operator *() const override
+    {
+        return decayed(Clock::now());
+    }
+
+    std::optional<T> value(void) const override
+    {
+        if (nsamples_ == 0)
+            return std::nullopt;
+        else
+            return decayed(Clock::now());
+    }
+
+    T value_or(T&& default_value) const override
+    {
+        if (nsamples_ == 0)
+            return default_value;
+        else
+            return decayed(Clock::now());
+    }
+
+    void update(T x) override
+    {
+        update(Clock::now(), x);
+    }
+
+    void update(typename Clock::time_point t, T x)
+    {
+        value_ = decayed(t) + x/tau_;
+        t_last_ = t;
+        ++nsamples_;
+
+        snapshot_.store(WindowSnapshot<T>{value_, nsamples_, t.get_real_secs()});
+    }
+
+protected:
+    /** @brief Return the estimate decayed to time t */
+    T decayed(typename Clock::time_point t) const
+    {
+        if (nsamples_ == 0)
+            return 0;
+
+        double dt = (t - t_last_).get_real_secs();
+
+        return dt > 0 ? value_*exp(-dt/tau_) : value_;
+    }
+};
+
+#endif /* SLIDINGWINDOWESTIMATOR_HH_ */
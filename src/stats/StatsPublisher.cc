@@ -0,0 +1,84 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#include "stats/StatsPublisher.hh"
+#include "util/threads.hh"
+
+StatsPublisher::StatsPublisher(std::shared_ptr<USRP> usrp,
+                               std::shared_ptr<MAC> mac,
+                               std::shared_ptr<Controller> controller,
+                               double period)
+  : usrp_(usrp)
+  , mac_(mac)
+  , controller_(std::dynamic_pointer_cast<SmartController>(controller))
+  , period_(period)
+  , seq_(0)
+  , done_(false)
+{
+    publish();
+
+    worker_thread_ = spawnThread("stats", &StatsPublisher::worker, this);
+}
+
+StatsPublisher::~StatsPublisher()
+{
+    stop();
+}
+
+void StatsPublisher::publish(void)
+{
+    auto stats = std::make_shared<RadioStats>();
+
+    stats->timestamp = WallClock::now();
+    stats->seq = seq_.fetch_add(1, std::memory_order_relaxed);
+
+    if (mac_)
+        stats->load = mac_->getLoad();
+
+    if (controller_) {
+        stats->send = controller_->getSendWindowStats();
+        stats->recv = controller_->getReceiveWindowStats();
+    }
+
+    if (usrp_) {
+        stats->tx_underflows = usrp_->getTXUnderflowTotal();
+        stats->tx_late = usrp_->getTXLateTotal();
+    } else {
+        stats->tx_underflows = 0;
+        stats->tx_late = 0;
+    }
+
+    std::atomic_store_explicit(&stats_,
+                               std::shared_ptr<const RadioStats>(std::move(stats)),
+                               std::memory_order_release);
+}
+
+void StatsPublisher::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+
+        done_ = true;
+    }
+
+    wake_cond_.notify_one();
+
+    if (worker_thread_.joinable())
+        worker_thread_.join();
+}
+
+void StatsPublisher::worker(void)
+{
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+
+    while (!done_) {
+        auto period = std::chrono::duration<double>(period_.load(std::memory_order_relaxed));
+
+        if (wake_cond_.wait_for(lock, period, [this]{ return done_; }))
+            break;
+
+        lock.unlock();
+        publish();
+        lock.lock();
+    }
+}
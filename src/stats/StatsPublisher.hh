@@ -0,0 +1,135 @@
+// Copyright 2018-2020 Drexel University
+// Author: Geoffrey Mainland <mainland@drexel.edu>
+
+#ifndef STATSPUBLISHER_HH_
+#define STATSPUBLISHER_HH_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "Clock.hh"
+#include "USRP.hh"
+#include "llc/Controller.hh"
+#include "llc/SmartController.hh"
+#include "mac/MAC.hh"
+
+/** @brief An immutable snapshot of radio statistics */
+struct RadioStats {
+    /** @brief Time at which statistics were published */
+    WallClock::time_point timestamp;
+
+    /** @brief Publication sequence number */
+    uint64_t seq;
+
+    /** @brief MAC load */
+    std::optional<MAC::Load> load;
+
+    /** @brief Send window statistics */
+    std::vector<SmartController::SendWindowStats> send;
+
+    /** @brief Receive window statistics */
+    std::vector<SmartController::ReceiveWindowStats> recv;
+
+    /** @brief Total number of TX underflow errors */
+    uint64_t tx_underflows;
+
+    /** @brief Total number of late TX packet errors */
+    uint64_t tx_late;
+};
+
+/** @brief Periodically publish radio statistics */
+/** A background thread gathers statistics from the USRP, MAC, and controller
+ * at a fixed period and publishes them as an immutable RadioStats snapshot
+ * with a single atomic shared_ptr store. Readers, e.g., a Python controller,
+ * only load the current snapshot, so they never take a data-path lock or hold
+ * the GIL while the radio is waiting on one.
+ */
+class StatsPublisher {
+public:
+    /** @brief Create a publisher
+     * @param usrp The USRP, or nullptr
+     * @param mac The MAC, or nullptr
+     * @param controller The controller, or nullptr. Window statistics are only
+     * published for a SmartController.
+     * @param period Publication period (sec)
+     */
+    StatsPublisher(std::shared_ptr<USRP> usrp,
+                   std::shared_ptr<MAC> mac,
+                   std::shared_ptr<Controller> controller,
+                   double period);
+
+    StatsPublisher() = delete;
+    StatsPublisher(const StatsPublisher&) = delete;
+    StatsPublisher(StatsPublisher&&) = delete;
+
+    ~StatsPublisher();
+
+    StatsPublisher& operator=(const StatsPublisher&) = delete;
+    StatsPublisher& operator=(StatsPublisher&&) = delete;
+
+    /** @brief Get the most recently published statistics */
+    std::shared_ptr<const RadioStats> getStats(void) const
+    {
+        return std::atomic_load_explicit(&stats_, std::memory_order_acquire);
+    }
+
+    /** @brief Get publication period (sec) */
+    double getPeriod(void) const
+    {
+        return period_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Set publication period (sec) */
+    /** The new period takes effect after the next publication. */
+    void setPeriod(double period)
+    {
+        period_.store(period, std::memory_order_relaxed);
+    }
+
+    /** @brief Gather and publish statistics now */
+    void publish(void);
+
+    /** @brief Stop publishing */
+    void stop(void);
+
+protected:
+    /** @brief The USRP */
+    std::shared_ptr<USRP> usrp_;
+
+    /** @brief The MAC */
+    std::shared_ptr<MAC> mac_;
+
+    /** @brief The controller, if it is a SmartController */
+    std::shared_ptr<SmartController> controller_;
+
+    /** @brief Publication period (sec) */
+    std::atomic<double> period_;
+
+    /** @brief Publication sequence number */
+    std::atomic<uint64_t> seq_;
+
+    /** @brief Most recently published statistics */
+    std::shared_ptr<const RadioStats> stats_;
+
+    /** @brief Flag indicating we should terminate */
+    bool done_;
+
+    /** @brief Mutex protecting done_ */
+    std::mutex wake_mutex_;
+
+    /** @brief Condition variable used to wake the publisher thread */
+    std::condition_variable wake_cond_;
+
+    /** @brief Publisher thread */
+    std::thread worker_thread_;
+
+    /** @brief Publisher worker */
+    void worker(void);
+};
+
+#endif /* STATSPUBLISHER_HH_ */
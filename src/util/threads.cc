@@ -2,11 +2,20 @@
 // Author: Geoffrey Mainland <mainland@drexel.edu>
 
 #include <math.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #include <atomic>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
 
 #include <uhd/utils/thread_priority.hpp>
 
+#include "VirtualTime.hh"
 #include "logging.hh"
 #include "util/capabilities.hh"
 #include "util/threads.hh"
@@ -66,8 +75,233 @@ void pinThisThread(void)
     pinThreadToCPU(pthread_self(), npinned++ % num_cpus);
 }
 
+/** @brief Thread roles and the threads that have taken them on */
+struct ThreadRegistry {
+    /** @brief Mutex protecting the registry */
+    std::mutex mutex;
+
+    /** @brief Configured roles */
+    std::map<std::string, ThreadRole> roles;
+
+    /** @brief Role threads, by kernel thread ID */
+    std::map<pid_t, std::string> threads;
+};
+
+static ThreadRegistry &threadRegistry(void)
+{
+    // The registry is never destroyed, because threads may still be starting
+    // while static objects are destroyed.
+    static ThreadRegistry *registry = new ThreadRegistry();
+
+    return *registry;
+}
+
+void setThreadRole(const std::string &role, const ThreadRole &placement)
+{
+    ThreadRegistry              &registry = threadRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.roles.insert_or_assign(role, placement);
+}
+
+void clearThreadRole(const std::string &role)
+{
+    ThreadRegistry              &registry = threadRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.roles.erase(role);
+}
+
+std::map<std::string, ThreadRole> getThreadRoles(void)
+{
+    ThreadRegistry              &registry = threadRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    return registry.roles;
+}
+
+void applyThreadRole(const std::string &role)
+{
+    ThreadRegistry            &registry = threadRegistry();
+    pid_t                     tid = syscall(SYS_gettid);
+    std::optional<ThreadRole> placement;
+    int                       ret;
+
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto                        it = registry.roles.find(role);
+
+        if (it != registry.roles.end())
+            placement = it->second;
+
+        registry.threads.insert_or_assign(tid, role);
+    }
+
+    // Thread names are limited to 15 characters
+    pthread_setname_np(pthread_self(), role.substr(0, 15).c_str());
+
+    if (!placement)
+        return;
+
+    RaiseCaps caps({CAP_SYS_NICE});
+
+    if (!placement->cpus.empty()) {
+        cpu_set_t cpuset;
+        int       ncpus = 0;
+
+        CPU_ZERO(&cpuset);
+
+        for (auto cpu : placement->cpus) {
+            // CPU_SET does not check its argument
+            if (cpu < 0 || cpu >= CPU_SETSIZE) {
+                logScheduler(LOGERROR, "Invalid CPU: cpu=%d; role=%s",
+                    cpu,
+                    role.c_str());
+                continue;
+            }
+
+            CPU_SET(cpu, &cpuset);
+            ++ncpus;
+        }
+
+        if (ncpus != 0) {
+            ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+            if (ret != 0)
+                logScheduler(LOGERROR, "pthread_setaffinity_np: %s; error=%d; role=%s",
+                    strerror(ret),
+                    ret,
+                    role.c_str());
+        }
+    }
+
+    if (placement->policy == SCHED_OTHER) {
+        if (setpriority(PRIO_PROCESS, tid, placement->priority) != 0)
+            logScheduler(LOGERROR, "setpriority: %s; error=%d; role=%s",
+                strerror(errno),
+                errno,
+                role.c_str());
+    } else {
+        struct sched_param params;
+
+        params.sched_priority = placement->priority;
+
+        ret = pthread_setschedparam(pthread_self(), placement->policy, &params);
+        if (ret != 0)
+            logScheduler(LOGERROR, "pthread_setschedparam: %s; error=%d; role=%s",
+                strerror(ret),
+                ret,
+                role.c_str());
+    }
+
+    // Prefer memory on the given NUMA node. This is a per-thread policy, so
+    // buffers allocated by this thread, e.g., IQ buffers allocated by the RX
+    // worker and packets allocated by demodulators, land on the node that
+    // processes them.
+    if (placement->numa_node) {
+        // Linux supports at most 1024 NUMA nodes
+        constexpr int kMaxNUMANodes = 1024;
+        constexpr int kBitsPerWord = 8*sizeof(unsigned long);
+        int           node = *placement->numa_node;
+
+        if (node < 0 || node >= kMaxNUMANodes) {
+            logScheduler(LOGERROR, "Invalid NUMA node: node=%d; role=%s",
+                node,
+                role.c_str());
+        } else {
+            std::vector<unsigned long> nodemask(node/kBitsPerWord + 1);
+
+            nodemask[node/kBitsPerWord] = 1ul << (node % kBitsPerWord);
+
+            // The kernel only reads maxnode - 1 bits of the mask
+            if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask.data(), nodemask.size()*kBitsPerWord + 1) != 0)
+                logScheduler(LOGERROR, "set_mempolicy: %s; error=%d; role=%s",
+                    strerror(errno),
+                    errno,
+                    role.c_str());
+        }
+    }
+}
+
+/** @brief Read the fields of /proc/self/task/<tid>/stat following the command
+ * name, i.e., starting with field 3.
+ */
+static std::optional<std::vector<std::string>> readTaskStat(pid_t tid)
+{
+    std::ifstream f("/proc/self/task/" + std::to_string(tid) + "/stat");
+    std::string   line;
+
+    if (!std::getline(f, line))
+        return std::nullopt;
+
+    // The command name may contain spaces, so skip past its closing paren
+    auto pos = line.rfind(')');
+
+    if (pos == std::string::npos)
+        return std::nullopt;
+
+    std::istringstream is(line.substr(pos + 1));
+
+    return std::vector<std::string>(std::istream_iterator<std::string>(is),
+                                    std::istream_iterator<std::string>());
+}
+
+std::vector<ThreadPlacement> getThreadPlacements(void)
+{
+    ThreadRegistry               &registry = threadRegistry();
+    std::lock_guard<std::mutex>  lock(registry.mutex);
+    std::vector<ThreadPlacement> placements;
+    const double                 ticks = sysconf(_SC_CLK_TCK);
+
+    for (auto it = registry.threads.begin(); it != registry.threads.end();) {
+        auto [tid, role] = *it;
+        auto stat = readTaskStat(tid);
+
+        // Forget threads that have exited. Fields are numbered from 3: utime
+        // is field 14, stime is field 15, and processor is field 39.
+        if (!stat || stat->size() < 37) {
+            it = registry.threads.erase(it);
+            continue;
+        }
+
+        ThreadPlacement    p;
+        cpu_set_t          cpuset;
+        struct sched_param params;
+
+        p.role = role;
+        p.tid = tid;
+        p.cpu = std::stoi((*stat)[36]);
+        p.user_time = std::stod((*stat)[11])/ticks;
+        p.system_time = std::stod((*stat)[12])/ticks;
+
+        CPU_ZERO(&cpuset);
+
+        if (sched_getaffinity(tid, sizeof(cpu_set_t), &cpuset) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &cpuset))
+                    p.affinity.push_back(cpu);
+        }
+
+        p.policy = sched_getscheduler(tid);
+
+        if (p.policy == SCHED_OTHER)
+            p.priority = getpriority(PRIO_PROCESS, tid);
+        else if (sched_getparam(tid, &params) == 0)
+            p.priority = params.sched_priority;
+        else
+            p.priority = 0;
+
+        placements.push_back(std::move(p));
+        ++it;
+    }
+
+    return placements;
+}
+
 int doze(double sec)
 {
+    if (VirtualTime::enabled())
+        return VirtualTime::sleepFor(sec) ? 0 : -1;
+
     struct timespec ts;
     double whole, frac;
 
@@ -128,5 +362,8 @@ void makeThreadWakeable(void)
 
 void wakeThread(std::thread& t)
 {
-    pthread_kill(t.native_handle(), SIGWAKE);
+    if (VirtualTime::enabled())
+        VirtualTime::wake(t.get_id());
+    else
+        pthread_kill(t.native_handle(), SIGWAKE);
 }
@@ -4,10 +4,17 @@
 #ifndef UTIL_THREADS_HH_
 #define UTIL_THREADS_HH_
 
+#include <sched.h>
 #include <signal.h>
 #include <unistd.h>
 
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 /** @brief Make thread have real-time priority. */
 void setRealtimePriority(void);
@@ -21,11 +28,100 @@ void pinThreadToCPU(pthread_t t, int cpu_num);
 /** @brief Pin this thread to a CPU */
 void pinThisThread(void);
 
+/** @brief Placement and scheduling for threads that play a role */
+struct ThreadRole {
+    /** @brief CPUs the thread may run on. If empty, the thread may run on
+     * any CPU.
+     */
+    std::vector<int> cpus;
+
+    /** @brief Scheduling policy: SCHED_OTHER, SCHED_FIFO, or SCHED_RR */
+    int policy = SCHED_OTHER;
+
+    /** @brief Scheduling priority */
+    /** For SCHED_OTHER, this is the thread's nice value. */
+    int priority = 0;
+
+    /** @brief NUMA node the thread should preferentially allocate memory
+     * from
+     */
+    std::optional<int> numa_node;
+};
+
+/** @brief Actual placement of a running thread */
+struct ThreadPlacement {
+    /** @brief Thread role */
+    std::string role;
+
+    /** @brief Kernel thread ID */
+    pid_t tid;
+
+    /** @brief CPU the thread last ran on */
+    int cpu;
+
+    /** @brief CPUs the thread may run on */
+    std::vector<int> affinity;
+
+    /** @brief Scheduling policy */
+    int policy;
+
+    /** @brief Scheduling priority, or nice value for SCHED_OTHER */
+    int priority;
+
+    /** @brief CPU time spent in user mode (sec) */
+    double user_time;
+
+    /** @brief CPU time spent in kernel mode (sec) */
+    double system_time;
+};
+
+/** @brief Set placement for threads that play a role */
+/** Placement is applied when a thread with the role starts, so roles should
+ * be configured before the subsystems that spawn threads are created.
+ */
+void setThreadRole(const std::string &role, const ThreadRole &placement);
+
+/** @brief Remove placement for threads that play a role */
+void clearThreadRole(const std::string &role);
+
+/** @brief Get configured thread roles */
+std::map<std::string, ThreadRole> getThreadRoles(void);
+
+/** @brief Apply the placement for a role to the current thread */
+/** The thread is named after its role and recorded so that its placement is
+ * reported by getThreadPlacements. If no placement is configured for the role,
+ * the thread keeps the placement it inherited.
+ */
+void applyThreadRole(const std::string &role);
+
+/** @brief Report actual placement and CPU usage of all running role threads */
+std::vector<ThreadPlacement> getThreadPlacements(void);
+
+/** @brief Start a thread that plays a role
+ * @param role The thread's role
+ * @param f Function the thread runs
+ * @param args Arguments to f
+ */
+template <class F, class... Args>
+std::thread spawnThread(const std::string &role, F&& f, Args&&... args)
+{
+    return std::thread([role](auto&& f, auto&&... args)
+        {
+            applyThreadRole(role);
+            std::invoke(std::forward<decltype(f)>(f), std::forward<decltype(args)>(args)...);
+        },
+        std::forward<F>(f),
+        std::forward<Args>(args)...);
+}
+
 /** @brief Sleep for the specified number of seconds. sleep, usleep, and
  * nanosleep were already taken, so this function is named "doze."
  * @param sec The number of seconds to sleep.
  * @returns -1 if interrupted.
  */
+/** When virtual time is enabled, this sleeps in virtual time, and wakeThread
+ * interrupts the sleep.
+ */
 int doze(double sec);
 
 /** @brief The signal we use to wake a thread */